@@ -0,0 +1,82 @@
+#pragma once
+
+#ifndef ACCUMULATOR_H
+#define ACCUMULATOR_H
+
+#include <optix.h>
+#include <optixu/optixu_math_namespace.h>
+
+#include <memory>
+#include <vector>
+
+#include "inc/TileScheduler.h"
+
+namespace POptix
+{
+	// Radiance a sample adds to a pixel outside of its tile, see BidirectionalIntegrator. Doesn't count as a sample of it.
+	struct Splat
+	{
+		int           pixel; // y * width + x.
+		optix::float3 radiance;
+	};
+
+	// Progressive accumulation of the host renderers without locks or atomics.
+	// Every tile of a pass, or every sample slice of a tile, writes its samples into a buffer of its own which no other
+	// thread touches during the pass. At the end of the pass these buffers are added to running sums per pixel, the slices
+	// of a tile in ascending order. Neither the thread which rendered a tile nor the order in which the tiles finished enter
+	// the result, so the image is bitwise identical for any thread count, tile size, tile order and stealing pattern.
+	// The sums are doubles and the samples are added one by one, so n passes with one slice give the same image as one
+	// pass with n slices.
+	// Splats take the same route: each tile collects its own, resolve() adds them in the order of the tile indices.
+	// With a NUMA topology every node keeps its own sums, first touched by a thread on that node. A tile is merged into the
+	// sums of its home node, the node whose workers are seeded with it, so which slices a node sums up doesn't depend on
+	// stealing either. The node sums are added in node order when the output is written. One node gives the image of
+	// the single socket path, more nodes a different but equally deterministic one.
+	class Accumulator
+	{
+	public:
+		Accumulator();
+		~Accumulator();
+
+		// The tiles as dispatched by scheduler, indexed by Tile::index. Tiles with the same rectangle are the slices of one
+		// region. The scheduler gives the NUMA nodes and the home node per tile. Keeps the sums as long as the image size
+		// and the number of nodes don't change.
+		void setLayout(int width, int height, std::vector<Tile> const& tiles, TileScheduler const& scheduler);
+
+		// The next resolve() starts a new accumulation.
+		void clear();
+
+		// Samples of the tile for the current pass, tile.width * tile.height entries in rows from the lower left corner.
+		// rgb is the radiance sum and w the number of samples. Must be written completely every pass.
+		// The memory is untouched until then, so its pages land on the NUMA node of the thread rendering the tile.
+		optix::float4* getTileBuffer(int tileIndex) { return m_tileBuffers[tileIndex].get(); }
+
+		// Splats of the tile for the current pass, resolve() empties them. They are divided by the samples of their pixel, so
+		// each pixel needs the same number of samples.
+		std::vector<Splat>& getTileSplats(int tileIndex) { return m_tileSplats[tileIndex]; }
+
+		// Adds the tile buffers to the node sums and writes the averages of all nodes with w = 1 to output.
+		// Runs over the regions on scheduler.
+		// meanSquares, if given, receives the average squared luminance of the samples per pixel, see AdaptiveSampling.
+		void resolve(TileScheduler& scheduler, std::vector<optix::float4>& output, std::vector<float>* meanSquares = nullptr);
+
+		int getNumPasses() const { return m_numPasses; } // resolve() calls since the last clear().
+
+	private:
+		int m_width;
+		int m_height;
+		int m_numNodes;
+		int m_numPasses;
+
+		std::vector<Tile>                             m_tiles;
+		std::vector<std::vector<int>>                 m_regions;     // Tile indices per rectangle, in slice order.
+		std::vector<int>                              m_tileNodes;   // Home node per tile index.
+		std::vector<std::unique_ptr<optix::float4[]>> m_tileBuffers;
+		std::vector<std::vector<Splat>>               m_tileSplats;
+		std::vector<double>                           m_splatSums;   // rgb of the splats of the pass per pixel.
+		std::vector<std::vector<double>>              m_nodeSums;    // rgb sum and sample count per pixel, per node.
+		std::vector<std::vector<double>>              m_nodeSquares; // Sum of the squared sample luminances per pixel, per node.
+	};
+}
+
+#endif // ACCUMULATOR_H
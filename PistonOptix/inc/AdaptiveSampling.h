@@ -0,0 +1,76 @@
+#pragma once
+
+#ifndef ADAPTIVE_SAMPLING_H
+#define ADAPTIVE_SAMPLING_H
+
+#include <optix.h>
+#include <optixu/optixu_math_namespace.h>
+
+#include <vector>
+
+#include "shaders/app_config.h"
+
+namespace POptix
+{
+	// Convergence decisions of the adaptive sampling, shared by the HostRenderer and the OptiX path of the Application.
+	// The image is split into blocks of ADAPTIVE_BLOCK_SIZE^2 pixels. After the warm-up every update() estimates the relative
+	// RMS error of each block, the standard errors of the pixel means over their luminances, from the running means of the
+	// luminance and of its square. A block whose error and the errors of its neighbours are below the target stops sampling
+	// for good. Its pixels keep the samples 0 to n - 1 of their sequences, which keeps the stratification of the Sobol and
+	// Halton samplers intact. The estimate assumes independent samples, so it is conservative for these samplers.
+	// The images enter only through the per block sums of shaders/adaptive_reduce.h, which the OptiX path computes on the
+	// device. The WavefrontRenderer has no adaptive sampling.
+	class AdaptiveSampling
+	{
+	public:
+		AdaptiveSampling();
+		~AdaptiveSampling();
+
+		void setImageSize(int width, int height);
+		void setWarmup(int samples);      // Samples every pixel gets before the first decision, 16 by default.
+		void setTargetError(float error); // Relative RMS error at which a block converges, 0.1 by default.
+
+		// All blocks active again.
+		void restart();
+
+		// mean is the accumulated image, meanSquare the running mean of the squared luminance per pixel, both after samples
+		// samples in the active pixels. Converged blocks keep the images of the sample count at which they stopped.
+		void update(const optix::float4* mean, const float* meanSquare, int samples);
+
+		// Same with the images already reduced per block by adaptiveBlockVariance(), see shaders/adaptive_reduce.h.
+		// One entry per block in the layout of getMask().
+		void updateBlocks(const float* blockVariances, int samples);
+
+		bool isActive(int x, int y) const { return m_mask[(y / ADAPTIVE_BLOCK_SIZE) * m_blocksX + x / ADAPTIVE_BLOCK_SIZE] != 0; }
+		bool isConverged() const          { return m_numActive == 0; } // Every block reached the target, the image is done.
+
+		// One entry per block, rows from the bottom of the image, 0 for converged blocks. Layout of sysAdaptiveMask.
+		std::vector<unsigned char> const& getMask() const { return m_mask; }
+
+		int       getBlocksX() const         { return m_blocksX; }
+		int       getBlocksY() const         { return m_blocksY; }
+		int       getWarmup() const          { return m_warmup; }
+		float     getTargetError() const     { return m_targetError; }
+		int       getNumActiveBlocks() const { return m_numActive; }
+		float     getError() const           { return m_error; }      // Estimated relative RMS error of the image at the last update().
+		long long getNumSamples() const      { return m_numSamples; } // Camera paths traced until the last update().
+
+	private:
+		int   m_width;
+		int   m_height;
+		int   m_blocksX;
+		int   m_blocksY;
+		int   m_warmup;
+		float m_targetError;
+
+		int       m_numActive;
+		float     m_error;
+		long long m_numSamples;
+
+		std::vector<unsigned char> m_mask;
+		std::vector<int>           m_blockSamples; // Sample count at which the block converged.
+		std::vector<float>         m_blockErrors;
+	};
+}
+
+#endif // ADAPTIVE_SAMPLING_H
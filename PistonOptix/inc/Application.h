@@ -31,6 +31,14 @@
 #include "shaders/material_parameter.h"
 #include "inc\LightParameters.h"
 #include "inc\Scene.h"
+#include "inc/TopLevelAccel.h"
+#include "inc/LightTree.h"
+#include "inc/LightAliasTable.h"
+#include "shaders/low_discrepancy.h"
+#include "inc/EnvironmentMap.h"
+#include "inc/BlueNoiseTile.h"
+#include "inc/AdaptiveSampling.h"
+#include "shaders/reservoir.h"
 
 #include <string>
 #include <map>
@@ -75,7 +83,8 @@ public:
 		const int height,
 		const unsigned int devices,
 		const unsigned int stackSize,
-		const bool interop);
+		const bool interop,
+		const std::string& builder);
 	~Application();
 
 	bool isValid() const;
@@ -87,6 +96,9 @@ public:
 
 	void screenshot(std::string const& filename);
 
+	// Moves a scene node instance. The root acceleration is refit or rebuilt once before the next launch.
+	void setInstanceTransform(unsigned int instanceIndex, const float* transform);
+
 	void guiNewFrame();
 	void guiWindow();
 	void guiEventHandler();
@@ -109,21 +121,28 @@ private:
 	void initLightProgrames();
 	void initMaterials();
 	void initLights();
+	void initEnvironment();
+	void initBlueNoise();
+	void initAdaptiveSampling();
+	void initRestir();
 	void initScene();
 
 	void createScene();
 
 	//optix::Geometry LoadOBJ(std::string objPath);
 
-	void createGeometry(optix::Geometry& geometry, optix::Material& material, uint materialID, float* transform);
+	optix::Transform createGeometry(optix::Geometry& geometry, optix::Material& material, uint materialID, float* transform, std::string const& builder = std::string());
 	optix::Geometry createGeometry(std::vector<VertexAttributes> const& attributes, std::vector<unsigned int> const& indices);
 
-	void setAccelerationProperties(optix::Acceleration acceleration);
+	void setAccelerationProperties(optix::Acceleration acceleration, std::string const& builder);
+	void updateRootAcceleration();
 
 	void updateMaterialParameters();
 	void updateLightParameters();
 
 	void restartAccumulation();
+	void updateAdaptiveSampling();
+	void updateReservoirBuffer();
 
 private:
 	GLFWwindow* m_window;
@@ -142,6 +161,11 @@ private:
 	int   m_minPathLength;       // Minimum path length after which Russian Roulette path termination starts.
 	int   m_maxPathLength;       // Maximum path length.
 	float m_sceneEpsilonFactor;  // Factor on 1e-7 used to offset ray origins along the path to reduce self intersections. 
+	int   m_lightSelection;      // POptix::ELightSelection of the next event estimation.
+	int   m_sampler;             // POptix::ESampler of the paths.
+	bool  m_adaptive;            // Stop sampling pixel blocks which reached the target error.
+	float m_targetError;         // Relative RMS error at which a block converges.
+	int   m_restir;              // POptix::ERestir of the direct light at the primary hits.
 
 	int   m_frameCount;
 	int   m_iterationIndex;
@@ -177,6 +201,28 @@ private:
 	
 	optix::Buffer						m_bufferMaterialParameters; // Array of MaterialParameters.
 	optix::Buffer						m_bufferLightParameters; // Array of LightsParameters.
+	optix::Buffer						m_bufferLightTree;       // Array of LightTreeNode.
+	optix::Buffer						m_bufferLightTreeMap;    // POptix::LightTree::getLightMap().
+	optix::Buffer						m_bufferLightAliasTable; // Array of LightAliasEntry.
+
+	POptix::LightTree					m_lightTree;
+	POptix::LightAliasTable				m_lightAliasTable;
+	float								m_sceneRadius;           // Bounding sphere of the meshes, for the power of directional lights.
+
+	POptix::EnvironmentMap				m_environment;           // Image of the first environment light, black without one.
+	int									m_environmentLight;      // Its index in sysLightParameters, -1 without one.
+	optix::Buffer						m_bufferEnvironmentMarginal;    // EnvironmentMap::getMarginalCdf().
+	optix::Buffer						m_bufferEnvironmentConditional; // EnvironmentMap::getConditionalCdf().
+
+	optix::Buffer						m_bufferBlueNoise;       // BlueNoiseTile::getRanks().
+
+	POptix::AdaptiveSampling			m_adaptiveSampling;
+	optix::Buffer						m_bufferLuminanceSquared; // Running mean of the squared luminance per pixel.
+	optix::Buffer						m_bufferAdaptiveMask;     // AdaptiveSampling::getMask().
+	optix::Buffer						m_bufferAdaptiveVariance; // Per block sums of adaptive_reduce() for AdaptiveSampling::updateBlocks().
+	bool								m_adaptiveMaskDirty;      // Upload the mask before the next launch.
+
+	optix::Buffer						m_bufferReservoirs;       // POptix::ReservoirPixel, RESTIR_SLOTS per pixel with ReSTIR, for one pixel without.
 
 	bool   m_present; // This controls if the texture image is updated per launch or only once a second.
 	bool   m_presentNext;
@@ -216,6 +262,11 @@ private:
 	optix::Group        m_rootGroup;
 	optix::Acceleration m_rootAcceleration;
 
+	// Host side mirror of the root acceleration over the node instances. Decides between refit and rebuild when nodes move.
+	POptix::TopLevelAccel         m_topLevelAccel;
+	std::vector<optix::Transform> m_instanceTransforms; // Indexed like the m_topLevelAccel instances.
+	bool                          m_instancesDirty;
+
 	// Scene Test
 	POptix::Scene* scene;
 };
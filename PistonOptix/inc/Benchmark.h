@@ -0,0 +1,17 @@
+#pragma once
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <string>
+
+namespace POptix
+{
+	// Headless host side measurements, selected with "--benchmark <name>" on the command line.
+	// Results are printed to std::cout. Returns the process exit code.
+	int runBenchmark(std::string const& name);
+
+	void printBenchmarks();
+}
+
+#endif // BENCHMARK_H
@@ -0,0 +1,182 @@
+#pragma once
+
+#ifndef BENCHMARK_COMMON_H
+#define BENCHMARK_COMMON_H
+
+#include "inc/HostScene.h"
+#include "inc/HostShading.h"
+#include "inc/Scene.h"
+#include "inc/Timer.h"
+
+#include <optixu/optixu_math_namespace.h>
+
+#include <memory>
+#include <vector>
+
+// Helpers shared by the benchmarks of runBenchmark(), which live in one file per subsystem.
+
+namespace POptix
+{
+	class HostRenderer;
+
+	// Scenes.
+
+	// Scene::build() plus the quad light of the TestScene, no files needed. The reflections of the sun in the glossy red metal are
+	// fireflies of thousands when seen from the diffuse surfaces, the metal is made rougher for the few samples of the benchmarks.
+	void createBenchmarkScene(Scene& scene);
+
+	// The TestScene lit by a sun from above only, the directional light of Scene::build() points up through the floor. Caustics
+	// of the small quad light through the smooth sphere are rare fireflies that hide the stratification of the samplers in the error.
+	void createSunScene(Scene& scene);
+
+	// Adds a grid of finely tessellated spheres to the benchmark scene, so the BVH no longer fits into the caches.
+	void addDenseGeometry(Scene& scene, const int gridSize, const int tessellation);
+
+	// Adds count small one sided quad lights at random positions in a layer above the objects of Scene::build(), with powers
+	// spread over two orders of magnitude. They face down, tilted by up to 30 degrees, so the benchmark camera only sees their backs
+	// and the image noise is the one of the lighting.
+	void addManyLights(Scene& scene, const int count, const unsigned int seed);
+
+	// The GuidingScene of the resources, two rooms lit through a door by a lamp facing away from it. nullptr when the file is
+	// missing, after printing that the measurement is skipped.
+	std::unique_ptr<Scene> loadGuidingScene();
+
+	// Cameras.
+
+	// Frustum of a pinhole camera like PinholeCamera::getFrustum() returns it, for an image of width x height pixels.
+	struct BenchmarkCamera
+	{
+		int           width;
+		int           height;
+		optix::float3 position;
+		optix::float3 U;
+		optix::float3 V;
+		optix::float3 W;
+
+		// Normalized direction of the ray through the image point (x, y) in pixels, (x + 0.5, y + 0.5) is the center of pixel (x, y).
+		optix::float3 getDirection(const float x, const float y) const
+		{
+			const optix::float2 ndc = optix::make_float2(x / float(width), y / float(height)) * 2.0f - 1.0f;
+			return optix::normalize(ndc.x * U + ndc.y * V + W);
+		}
+	};
+
+	// Default view of the Application. Smaller distances fill more of the image with the scene.
+	BenchmarkCamera getBenchmarkCamera(const int width, const int height, const float distance = 38.0f);
+
+	// View into the room of the GuidingScene whose door the lamp light comes through.
+	BenchmarkCamera getGuidingSceneCamera(const int width, const int height);
+
+	// Sets the resolution and the camera of a HostRenderer or WavefrontRenderer.
+	template<typename Renderer>
+	void setCamera(Renderer& renderer, BenchmarkCamera const& camera)
+	{
+		renderer.setResolution(camera.width, camera.height);
+		renderer.setCamera(camera.position, camera.U, camera.V, camera.W);
+	}
+
+	// Rendering and images.
+
+	// Renders count passes, returns the time they took in seconds.
+	template<typename Renderer>
+	double renderSamples(Renderer& renderer, const int count)
+	{
+		Timer timer;
+		timer.start();
+		for (int sample = 0; sample < count; ++sample)
+		{
+			renderer.render();
+		}
+		return timer.getTime();
+	}
+
+	// Bitwise equality, for renderers which must produce the same image.
+	bool identicalImages(std::vector<optix::float4> const& a, std::vector<optix::float4> const& b);
+
+	// Mean luminance of image.
+	double meanLuminance(std::vector<optix::float4> const& image);
+
+	// Luminance of image minus luminance of reference.
+	std::vector<double> errorImage(std::vector<optix::float4> const& image, std::vector<optix::float4> const& reference);
+
+	// RMS error of the luminance of image against reference. With a mask only in its pixels.
+	double imageError(std::vector<optix::float4> const& image, std::vector<optix::float4> const& reference);
+	double imageError(std::vector<optix::float4> const& image, std::vector<optix::float4> const& reference, std::vector<char> const& mask);
+
+	// Relative RMS error of the luminance of image against reference, the squared errors divided by reference^2 + 0.01 like the
+	// error estimate of AdaptiveSampling.
+	double relativeError(std::vector<optix::float4> const& image, std::vector<optix::float4> const& reference);
+
+	// Renders until each of the numBudgets render times in seconds is used up, appending the RMSE against reference and the
+	// samples per pixel at each. Returns the mean luminance of the last image.
+	double renderEqualTime(HostRenderer& renderer, std::vector<optix::float4> const& reference, double const* budgets, const int numBudgets,
+	                       std::vector<double>& rmse, std::vector<int>& samples);
+
+	// Statistics.
+
+	// Pearson's chi-square test of histogram counts against the expected counts. Cells expecting fewer than 5 samples are pooled
+	// as the test requires. Returns the p-value with the Wilson-Hilferty approximation of the chi-square distribution, 0 when a
+	// sample landed where none are expected.
+	double chiSquareTest(std::vector<double> const& observed, std::vector<double> const& expected, double& statistic, int& dof);
+
+	// Direct lighting.
+
+	// Shading points at the pixel centers of the benchmark camera at distance 20, normals flipped to the camera like beginSurface()
+	// does. Pixels showing a light or nothing are skipped. directions are the camera rays.
+	void getShadingPoints(HostScene const& scene, const int width, const int height, const float sceneEpsilon, std::vector<State>& points, std::vector<optix::float3>& directions);
+
+	// Pixels whose four corners see the same material and no light. The jittered camera rays of the pixels at the silhouettes
+	// alternate between the objects, that noise is the same for all direct light estimators and would hide their differences.
+	std::vector<char> getInteriorPixels(HostScene const& scene, const int width, const int height, const float distance);
+
+	// One sample of the direct lighting at a diffuse shading point: the next event estimation with its shadow ray plus the
+	// BRDF sample with the MIS weighted emission of the light or the environment it hits, the first two segments of the path tracer.
+	// Without a selector there is no next event estimation, the BRDF sample picks up the emission unweighted like miss.cu did
+	// before the environment was importance sampled.
+	float sampleDirectLightingEstimate(HostScene const& scene, LightSelector const* selector, Material const& mat, State const& state, const optix::float3& wo, const float sceneEpsilon, unsigned int& seed);
+
+	// sampleDirectLightingEstimate() for a scene with the single quad light 0, sampled with the given minSolidAngle instead of
+	// QUAD_LIGHT_MIN_SOLID_ANGLE. FLT_MAX samples by area only.
+	float sampleQuadLightEstimate(HostScene const& scene, Material const& mat, State const& state, const optix::float3& wo, const float minSolidAngle, const float sceneEpsilon, unsigned int& seed);
+
+	// The benchmarks, see g_benchmarks in Benchmark.cpp.
+
+	// BenchmarkBvh.cpp
+	int benchmarkRefit();
+	int benchmarkWatertight();
+	int benchmarkTriangles();
+	int benchmarkSbvh();
+	int benchmarkLbvh();
+	int benchmarkCompressed();
+	int benchmarkShadow();
+	int benchmarkBvhCache();
+
+	// BenchmarkRenderer.cpp
+	int benchmarkTiles();
+	int benchmarkWavefront();
+	int benchmarkRaySort();
+	int benchmarkNuma();
+	int benchmarkAccumulation();
+	int benchmarkRoulette();
+	int benchmarkAdaptive();
+
+	// BenchmarkSimd.cpp
+	int benchmarkSimd();
+
+	// BenchmarkLights.cpp
+	int benchmarkLightTree();
+	int benchmarkLightPower();
+	int benchmarkEnvironment();
+	int benchmarkSphereLight();
+	int benchmarkQuadLight();
+	int benchmarkRestir();
+
+	// BenchmarkSampling.cpp
+	int benchmarkSampler();
+	int benchmarkBlueNoise();
+	int benchmarkMicrofacet();
+	int benchmarkGuiding();
+	int benchmarkBidirectional();
+}
+
+#endif // BENCHMARK_COMMON_H
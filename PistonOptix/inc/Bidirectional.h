@@ -0,0 +1,155 @@
+#pragma once
+
+#ifndef BIDIRECTIONAL_H
+#define BIDIRECTIONAL_H
+
+#include <optix.h>
+#include <optixu/optixu_math_namespace.h>
+
+#include <vector>
+
+#include "inc/Accumulator.h"
+#include "inc/HostScene.h"
+#include "inc/HostShading.h"
+#include "inc/LightParameters.h"
+#include "shaders/material_parameter.h"
+#include "shaders/per_ray_data.h"
+
+namespace POptix
+{
+	// Integrators of the HostRenderer.
+	enum EIntegrator
+	{
+		INTEGRATOR_PATH,          // Unidirectional path tracing with next event estimation, the one of the OptiX programs.
+		INTEGRATOR_BIDIRECTIONAL, // Bidirectional path tracing, see BidirectionalIntegrator.
+
+		NUM_OF_INTEGRATORS
+	};
+
+	// The quad and sphere lights by emitted power, luminance(emission) * area. They start the light subpaths.
+	// Directional and environment lights have no position to start from, their light is found by the camera subpaths.
+	class EmitterDistribution
+	{
+	public:
+		EmitterDistribution();
+
+		void build(std::vector<Light> const& lights);
+
+		bool  empty() const { return m_lights.empty(); }
+		int   sample(const float u, float& pmf) const;                       // Index of the light in the scene.
+		float pmf(const int lightIndex) const { return m_pmf[lightIndex]; }  // 0 for the lights without light subpaths.
+
+	private:
+		std::vector<int>   m_lights; // Indices of the emitters.
+		std::vector<float> m_cdf;    // Over m_lights, the last entry is 1.
+		std::vector<float> m_pmf;    // Per light of the scene.
+	};
+
+	// The pinhole camera of the HostRenderer, the camera rays go through ndc.x * U + ndc.y * V + W with ndc in [-1, 1]^2.
+	struct BidirectionalCamera
+	{
+		// Solid angle pdf of the camera rays of all pixels in direction, which is the importance of the pinhole.
+		float directionPdf(const optix::float3& direction) const;
+
+		// Pixel whose camera rays see point, false outside the image.
+		bool project(const optix::float3& point, int& pixel) const;
+
+		optix::float3 position;
+		optix::float3 U;
+		optix::float3 V;
+		optix::float3 W;
+		int           width;
+		int           height;
+	};
+
+	enum EPathVertex
+	{
+		PATH_VERTEX_CAMERA,
+		PATH_VERTEX_LIGHT,   // Start of a light subpath, or a light hit by a camera subpath.
+		PATH_VERTEX_SURFACE
+	};
+
+	// Vertex of a camera or light subpath. The densities are per area, the ones of vertices sampled from a specular lobe are 0.
+	struct PathVertex
+	{
+		optix::float3 position;
+		optix::float3 geometryNormal; // Surfaces flip both normals to the side of toPrevious, lights keep their emitting side.
+		optix::float3 shadingNormal;
+		optix::float3 toPrevious;     // Unit direction to the previous vertex of the subpath.
+		optix::float3 beta;           // Throughput of the subpath up to the vertex over its pdf, light subpaths include Le.
+		float         pdfFwd;         // Density of the vertex, sampled by its subpath.
+		float         pdfRev;         // Density of the vertex, sampled from the next vertex of its subpath in reverse.
+		EPathVertex   type;
+		int           index;          // Material of surfaces, light of lights.
+		EBrdfTypes    brdf;           // Lobe selected by beginSurface().
+		bool          delta;          // Specular lobe, connections can't reach it.
+
+		int           neeLight;       // Light sampled for the connection to a new light vertex at camera vertices, -1 without.
+		float         neeSelectionPmf;
+		LightSample   neeSample;
+	};
+
+	// Bidirectional path tracing on the HostScene, see "Robust Monte Carlo Methods for Light Transport Simulation" by Veach.
+	// Every pixel sample traces a camera subpath like the path tracer and a light subpath from an emitter, then connects all
+	// their prefixes. The strategies are weighted by the power heuristic, evaluated from the densities of the vertices as
+	// in PBRT. The connections to a new light vertex are the next event estimation of the path tracer, with its light
+	// selection and solid angle sampling, and the connections to the camera splat into the pixel they project to.
+	// The materials keep the one sample model of closesthit.cu: every vertex selects its lobe, which the connections through
+	// it evaluate with evalSurface() like the path tracer.
+	// Paths have up to maxPathLength + 1 segments, the longest the path tracer reaches with its next event estimation.
+	class BidirectionalIntegrator
+	{
+	public:
+		BidirectionalIntegrator(HostScene const& scene, EmitterDistribution const& emitters, BidirectionalCamera const& camera, const ELightSelection lightSelection,
+		                        const int minPathLength, const int maxPathLength, const float sceneEpsilon);
+
+		// prd is started by beginSample() with the camera ray in hit_pos and wi. Returns the radiance of the strategies with at
+		// least two camera vertices and appends those of the light subpath reaching the camera to splats.
+		optix::float3 sample(PerRayData& prd, ShadowCache& shadowCache, std::vector<Splat>& splats);
+
+	private:
+		// Extends path from origin along direction, pdf is the solid angle pdf of direction. Returns the radiance of the
+		// environment light if a camera subpath escapes.
+		optix::float3 randomWalk(PerRayData& prd, optix::float3 origin, optix::float3 direction, optix::float3 beta, float pdf, const bool importance,
+		                         std::vector<PathVertex>& path);
+
+		void traceLightPath(PerRayData& prd);
+
+		// Radiance of the strategy with s light and t camera vertices and its weight.
+		optix::float3 connect(const int s, const int t, ShadowCache& shadowCache, int& pixel);
+
+		float misWeight(const int s, const int t, PathVertex const& sampled);
+
+		// The BRDF of the lobe of vertex between the directions to the camera and to the light, importance on light subpaths.
+		optix::float3 evalBrdf(PathVertex const& vertex, const optix::float3& toCamera, const optix::float3& toLight, const bool importance) const;
+
+		// Solid angle density of sampling direction at vertex with its lobe, coming from from.
+		float brdfPdf(PathVertex const& vertex, const optix::float3& from, const optix::float3& direction) const;
+
+		// Density of the vertex to, sampled from the vertex from by the pdf per solid angle.
+		float toArea(const float pdf, PathVertex const& from, PathVertex const& to) const;
+
+		float emissionPdf(PathVertex const& light, const optix::float3& direction) const; // Per solid angle.
+		float originPdf(PathVertex const& light) const;                                   // Per area.
+		float connectionPdf(PathVertex const& light, PathVertex const& vertex) const;     // The next event estimation at vertex, per area.
+
+		bool visible(const optix::float3& from, const optix::float3& to, ShadowCache& shadowCache) const;
+
+	private:
+		HostScene const&           m_scene;
+		EmitterDistribution const& m_emitters;
+		BidirectionalCamera        m_camera;
+		LightSelector              m_selector;
+		int                        m_minPathLength;
+		int                        m_maxPathLength;
+		float                      m_sceneEpsilon;
+
+		std::vector<PathVertex> m_cameraPath;
+		std::vector<PathVertex> m_lightPath;
+		std::vector<float>      m_pdfLight;  // Densities of the vertices of a full path sampled towards the camera,
+		std::vector<float>      m_pdfCamera; // towards the light and their delta flags, see misWeight().
+		std::vector<char>       m_delta;
+	};
+}
+
+#endif // BIDIRECTIONAL_H
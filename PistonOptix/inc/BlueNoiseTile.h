@@ -0,0 +1,38 @@
+#pragma once
+
+#ifndef BLUE_NOISE_TILE_H
+#define BLUE_NOISE_TILE_H
+
+#include <string>
+#include <vector>
+
+#include "shaders/low_discrepancy.h"
+
+namespace POptix
+{
+	// The blue noise tile of SAMPLER_BLUE_NOISE, a BLUE_NOISE_TILE_SIZE^2 void-and-cluster rank mask repeated over the image,
+	// see blueNoiseSample1D(). The host renderers read it through getRank(), the Application uploads getRanks() to sysBlueNoise.
+	// There is one tile per process, loaded at startup from data/BlueNoise64.pgm.
+	class BlueNoiseTile
+	{
+	public:
+		// 16 bit binary PGM (P5) of BLUE_NOISE_TILE_SIZE^2 ranks. Returns false when it can't be read, the ranks are then a
+		// random permutation, white noise, which keeps the sampler unbiased.
+		static bool load(std::string const& filename);
+
+		static bool isBlueNoise() { return s_loaded; }
+
+		static unsigned int getRank(const unsigned int x, const unsigned int y) { return s_ranks[y * BLUE_NOISE_TILE_SIZE + x]; }
+
+		// Rows from y = 0, the layout of the 2D sysBlueNoise buffer.
+		static std::vector<unsigned short> const& getRanks() { return s_ranks; }
+
+	private:
+		static std::vector<unsigned short> whiteNoise();
+
+		static std::vector<unsigned short> s_ranks;
+		static bool                        s_loaded;
+	};
+}
+
+#endif // BLUE_NOISE_TILE_H
@@ -0,0 +1,320 @@
+#pragma once
+
+#ifndef BVH_H
+#define BVH_H
+
+#include <optix.h>
+#include <optixu/optixu_math_namespace.h>
+#include <optixu/optixu_aabb_namespace.h>
+
+#include <memory>
+#include <vector>
+
+#include "inc/SharedArray.h"
+
+using namespace optix;
+
+namespace POptix
+{
+	// Binary BVH node. Nodes are stored in depth-first order and the two children of an interior node are
+	// allocated as a pair after their parent, so a reverse sweep over the node array visits children before parents.
+	struct BvhNode
+	{
+		optix::Aabb bounds;
+		int         offset;	// Interior: index of the first child (the second is offset + 1). Leaf: first entry in the primitive index list.
+		int         count;	// Number of primitives in a leaf, 0 for interior nodes.
+
+		bool isLeaf() const { return 0 < count; }
+	};
+
+	class TileScheduler;
+
+	enum EBvhBuilder
+	{
+		BVH_BUILDER_BINNED_SAH,  // Object splits only, every primitive is referenced once.
+		BVH_BUILDER_SBVH,        // Object and spatial splits, triangles straddling a split plane are clipped and referenced on both sides.
+		BVH_BUILDER_LBVH         // Hierarchy emitted from Morton sorted centroids, optionally improved by treelet restructuring. Fast to build, slower to trace.
+	};
+
+	struct BvhBuildOptions
+	{
+		BvhBuildOptions()
+			: builder(BVH_BUILDER_BINNED_SAH)
+			, binCount(16)
+			, maxLeafSize(4)
+			, traversalCost(1.0f)
+			, intersectionCost(1.0f)
+			, spatialSplitAlpha(1.0e-5f)
+			, maxDuplication(0.5f)
+			, treeletPasses(0)
+			, scheduler(nullptr)
+		{
+		}
+
+		EBvhBuilder builder;
+		int   binCount;          // Number of SAH bins per axis, also used for the spatial split bins.
+		int   maxLeafSize;       // Nodes with more primitives are always split.
+		float traversalCost;     // SAH cost of visiting an interior node.
+		float intersectionCost;  // SAH cost of testing one primitive.
+		float spatialSplitAlpha; // SBVH: spatial splits are only tried when the children of the best object split overlap by more than this fraction of the root area.
+		float maxDuplication;    // SBVH: the build stops splitting references when their count exceeds (1 + maxDuplication) * primitives.
+		int   treeletPasses;     // LBVH: bottom-up passes of treelet restructuring after the linear build, 0 keeps the plain LBVH.
+
+		TileScheduler* scheduler; // LBVH: threads for the sort and the hierarchy emission. Runs serially when null.
+	};
+
+	struct BvhRay
+	{
+		BvhRay(const optix::float3& o, const optix::float3& d, const float t0, const float t1)
+			: origin(o)
+			, direction(d)
+			, invDirection(optix::make_float3(1.0f / d.x, 1.0f / d.y, 1.0f / d.z))
+			, tmin(t0)
+			, tmax(t1)
+		{
+		}
+
+		optix::float3 origin;
+		optix::float3 direction;
+		optix::float3 invDirection;
+		float         tmin;
+		float         tmax;	// Shrinks to the closest hit found so far.
+	};
+
+	struct BvhTraversalStats
+	{
+		BvhTraversalStats()
+			: nodesVisited(0)
+			, primitivesTested(0)
+		{
+		}
+
+		unsigned long long nodesVisited;
+		unsigned long long primitivesTested;
+	};
+
+	// Slab test. Returns the entry distance in tnear.
+	inline bool intersectAabb(const optix::Aabb& box, const BvhRay& ray, float& tnear)
+	{
+		const optix::float3 t0 = (box.m_min - ray.origin) * ray.invDirection;
+		const optix::float3 t1 = (box.m_max - ray.origin) * ray.invDirection;
+		const optix::float3 tsmaller = optix::fminf(t0, t1);
+		const optix::float3 tbigger  = optix::fmaxf(t0, t1);
+
+		tnear = optix::fmaxf(ray.tmin, optix::fmaxf(tsmaller));
+		const float tfar = optix::fminf(ray.tmax, optix::fminf(tbigger));
+		return tnear <= tfar;
+	}
+
+	// Bounding volume hierarchy over a set of primitive bounds.
+	// The builder only sees axis aligned boxes, so the same class is used for instances (top level) and triangles (bottom level).
+	class Bvh
+	{
+	public:
+		Bvh();
+		~Bvh();
+
+		// Build from scratch with the builder selected in the options. BVH_BUILDER_SBVH needs the triangles and falls back to binned SAH here.
+		void build(std::vector<optix::Aabb> const& primitiveBounds, BvhBuildOptions const& options = BvhBuildOptions());
+
+		// Build over triangles, three vertices per triangle. Uses the builder selected in the options.
+		// With BVH_BUILDER_SBVH splittable (one flag per triangle, optional) limits the spatial splits to the flagged triangles.
+		void build(std::vector<optix::float3> const& triangleVertices, BvhBuildOptions const& options, std::vector<unsigned char> const* splittable = nullptr);
+
+		// Recomputes all node bounds bottom-up for changed primitive bounds in O(n). The topology stays untouched.
+		// After a spatial split build the refitted leaves use the full primitive bounds, not the clipped ones.
+		void refit(std::vector<optix::Aabb> const& primitiveBounds);
+
+		// Replaces the hierarchy with previously built nodes and primitive indices inside storage, e.g. a mapped BvhCache file.
+		// The traversal reads them in place, nothing is copied.
+		void reference(BvhBuildOptions const& options, std::shared_ptr<const void> const& storage,
+		               const BvhNode* nodes, const size_t numNodes, const unsigned int* primitiveIndices, const size_t numPrimitiveIndices);
+
+		// Expected cost of a random ray query, normalized by the root surface area.
+		float sahCost() const;
+
+		bool empty() const { return m_nodes.empty(); }
+
+		SharedArray<BvhNode> const&      getNodes() const            { return m_nodes; }
+		SharedArray<unsigned int> const& getPrimitiveIndices() const { return m_primitiveIndices; } // Primitives can be referenced by more than one leaf after a spatial split build.
+		BvhBuildOptions const&           getOptions() const          { return m_options; }
+
+		// Front-to-back traversal. intersectPrimitive(primitiveIndex, ray) is called for every primitive in a visited leaf
+		// and is expected to shrink ray.tmax when it reports a closer hit.
+		template<typename IntersectPrimitive>
+		void intersect(BvhRay& ray, IntersectPrimitive& intersectPrimitive, BvhTraversalStats* stats = nullptr) const;
+
+		// Any hit traversal for occlusion queries. Children are visited in memory order without sorting them by distance.
+		// Returns true as soon as occludedPrimitive(primitiveIndex, ray) returns true.
+		template<typename OccludedPrimitive>
+		bool occluded(BvhRay const& ray, OccludedPrimitive& occludedPrimitive, BvhTraversalStats* stats = nullptr) const;
+
+	private:
+		int  createNode();
+		void subdivide(int nodeIndex, int begin, int end, std::vector<optix::Aabb> const& primitiveBounds, std::vector<optix::float3> const& centroids);
+		void buildSpatialSplits(std::vector<optix::float3> const& triangleVertices, std::vector<unsigned char> const* splittable);
+		void buildLinear(std::vector<optix::Aabb> const& primitiveBounds);
+		void restructureTreelet(const int root, const int numInternal, std::vector<int>& children, std::vector<int>& parents,
+		                        std::vector<optix::Aabb>& nodeBounds, std::vector<int>& nodeCounts, std::vector<float>& nodeCosts) const;
+
+	private:
+		static const int kTreeletSize = 7; // Leaves per restructured treelet.
+
+		BvhBuildOptions           m_options;
+		SharedArray<BvhNode>      m_nodes;            // Built here or referenced, see reference().
+		SharedArray<unsigned int> m_primitiveIndices;
+	};
+
+
+	template<typename IntersectPrimitive>
+	void Bvh::intersect(BvhRay& ray, IntersectPrimitive& intersectPrimitive, BvhTraversalStats* stats) const
+	{
+		if (m_nodes.empty())
+		{
+			return;
+		}
+
+		const BvhNode*      nodes            = m_nodes.data();
+		const unsigned int* primitiveIndices = m_primitiveIndices.data();
+
+		int stack[64];
+		int stackSize = 0;
+		int nodeIndex = 0;
+
+		float tnear;
+		if (!intersectAabb(nodes[0].bounds, ray, tnear))
+		{
+			return;
+		}
+
+		while (true)
+		{
+			const BvhNode& node = nodes[nodeIndex];
+			if (stats)
+			{
+				++stats->nodesVisited;
+			}
+
+			if (node.isLeaf())
+			{
+				for (int i = node.offset; i < node.offset + node.count; ++i)
+				{
+					intersectPrimitive(primitiveIndices[i], ray);
+				}
+				if (stats)
+				{
+					stats->primitivesTested += node.count;
+				}
+			}
+			else
+			{
+				float tnear0;
+				float tnear1;
+				const bool hit0 = intersectAabb(nodes[node.offset    ].bounds, ray, tnear0);
+				const bool hit1 = intersectAabb(nodes[node.offset + 1].bounds, ray, tnear1);
+
+				if (hit0 && hit1)
+				{
+					// Visit the nearer child first, defer the other one.
+					const bool swap = tnear1 < tnear0;
+					stack[stackSize++] = node.offset + (swap ? 0 : 1);
+					nodeIndex = node.offset + (swap ? 1 : 0);
+					continue;
+				}
+				if (hit0 || hit1)
+				{
+					nodeIndex = node.offset + (hit0 ? 0 : 1);
+					continue;
+				}
+			}
+
+			// Pop the next node which is still in front of the closest hit.
+			bool found = false;
+			while (0 < stackSize && !found)
+			{
+				nodeIndex = stack[--stackSize];
+				found = intersectAabb(nodes[nodeIndex].bounds, ray, tnear);
+			}
+			if (!found)
+			{
+				break;
+			}
+		}
+	}
+
+	template<typename OccludedPrimitive>
+	bool Bvh::occluded(BvhRay const& ray, OccludedPrimitive& occludedPrimitive, BvhTraversalStats* stats) const
+	{
+		if (m_nodes.empty())
+		{
+			return false;
+		}
+
+		const BvhNode*      nodes            = m_nodes.data();
+		const unsigned int* primitiveIndices = m_primitiveIndices.data();
+
+		int stack[64];
+		int stackSize = 0;
+		int nodeIndex = 0;
+
+		float tnear;
+		if (!intersectAabb(nodes[0].bounds, ray, tnear))
+		{
+			return false;
+		}
+
+		// The ray interval never shrinks, so deferred nodes don't need to be tested again when they are popped.
+		while (true)
+		{
+			const BvhNode& node = nodes[nodeIndex];
+			if (stats)
+			{
+				++stats->nodesVisited;
+			}
+
+			if (node.isLeaf())
+			{
+				for (int i = node.offset; i < node.offset + node.count; ++i)
+				{
+					if (stats)
+					{
+						++stats->primitivesTested;
+					}
+					if (occludedPrimitive(primitiveIndices[i], ray))
+					{
+						return true;
+					}
+				}
+			}
+			else
+			{
+				const bool hit0 = intersectAabb(nodes[node.offset    ].bounds, ray, tnear);
+				const bool hit1 = intersectAabb(nodes[node.offset + 1].bounds, ray, tnear);
+
+				if (hit0)
+				{
+					if (hit1)
+					{
+						stack[stackSize++] = node.offset + 1;
+					}
+					nodeIndex = node.offset;
+					continue;
+				}
+				if (hit1)
+				{
+					nodeIndex = node.offset + 1;
+					continue;
+				}
+			}
+
+			if (stackSize == 0)
+			{
+				break;
+			}
+			nodeIndex = stack[--stackSize];
+		}
+		return false;
+	}
+}
+
+#endif // BVH_H
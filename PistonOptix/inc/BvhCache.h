@@ -0,0 +1,97 @@
+#pragma once
+
+#ifndef BVH_CACHE_H
+#define BVH_CACHE_H
+
+#include <optix.h>
+#include <optixu/optixu_math_namespace.h>
+
+#include <string>
+#include <vector>
+
+#include "inc/Bvh.h"
+#include "inc/SharedArray.h"
+
+namespace POptix
+{
+	class Scene;
+
+	// Arrays of a cache file, in file order.
+	enum EBvhCacheArray
+	{
+		BVH_CACHE_NODES,
+		BVH_CACHE_PRIMITIVE_INDICES,
+		BVH_CACHE_VERTICES,
+		BVH_CACHE_NORMALS,
+		BVH_CACHE_MATERIAL_INDICES,
+		BVH_CACHE_LIGHT_INDICES,
+		BVH_CACHE_ARRAYS
+	};
+
+	// Header of a cache file. The arrays follow at byte offsets relative to the start of the file, so a mapped file can be
+	// used at any address without fixing up pointers.
+	struct BvhCacheHeader
+	{
+		char               magic[8];       // "POBVHCHE"
+		unsigned int       version;        // BvhCache::kVersion
+		unsigned int       nodeSize;       // sizeof(BvhNode) of the writer, rejects files from builds with another layout.
+		unsigned long long key;
+		unsigned long long fileSize;
+		float              boundsMin[3];   // Of the vertices.
+		float              boundsMax[3];
+		unsigned long long offsets[BVH_CACHE_ARRAYS];
+		unsigned long long counts[BVH_CACHE_ARRAYS];
+	};
+
+	// World space triangles of a HostScene, stored next to their BVH.
+	struct BvhCacheTriangles
+	{
+		SharedArray<optix::float3>* vertices;        // Three per triangle.
+		SharedArray<optix::float3>* normals;         // Three per triangle.
+		SharedArray<int>*           materialIndices; // Per triangle.
+		SharedArray<int>*           lightIndices;    // Per triangle.
+		optix::Aabb*                bounds;
+	};
+
+	// Directory of flattened host scenes with their bottom level BVH, one versioned binary file per key.
+	// The key is a hash of everything HostScene::build() reads to flatten the scene and of every build setting which changes
+	// the hierarchy. An unchanged scene finds its file again before any triangle is transformed, and any edit of the
+	// geometry, the lights or the builder settings misses and rebuilds.
+	// A hit maps the file and the host scene reads the triangles and traverses the BVH right out of the mapping.
+	class BvhCache
+	{
+	public:
+		static const unsigned int kVersion = 2; // Bump whenever the file layout, BvhNode, the flattening or a builder changes.
+
+		explicit BvhCache(std::string const& directory);
+		~BvhCache();
+
+		// Hash of the meshes, node transforms and materials, the light geometry and the build options, as seen by
+		// HostScene::build(). The scheduler only changes the build speed and is not part of the key.
+		static unsigned long long computeKey(Scene const& scene, BvhBuildOptions const& options);
+
+		// Maps the file of the key. On success bvh and the triangle arrays reference the mapping, which stays alive as long
+		// as any of them does. Returns false when there is no valid file.
+		bool load(const unsigned long long key, BvhBuildOptions const& options, Bvh& bvh, BvhCacheTriangles const& triangles);
+
+		// Writes the file of the key. The file is written under a temporary name first, so readers never see a partial file.
+		bool store(const unsigned long long key, Bvh const& bvh, BvhCacheTriangles const& triangles);
+
+		// Deletes the file of the key.
+		void remove(const unsigned long long key);
+
+		std::string const& getDirectory() const { return m_directory; }
+		int                getHits() const      { return m_hits; }
+		int                getMisses() const    { return m_misses; }
+
+	private:
+		std::string getFilename(const unsigned long long key) const;
+
+	private:
+		std::string m_directory;
+		int         m_hits;
+		int         m_misses;
+	};
+}
+
+#endif // BVH_CACHE_H
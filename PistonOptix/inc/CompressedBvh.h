@@ -0,0 +1,76 @@
+#pragma once
+
+#ifndef COMPRESSED_BVH_H
+#define COMPRESSED_BVH_H
+
+#include <optix.h>
+#include <optixu/optixu_math_namespace.h>
+#include <optixu/optixu_aabb_namespace.h>
+
+#include <vector>
+
+#include "inc/Bvh.h"
+#include "inc/TrianglePacket.h"
+
+namespace POptix
+{
+	// Four wide BVH node in one 64 byte cache line.
+	// The child bounds are stored as 8 bit coordinates on a grid spanning the node bounds. The grid cell size is a power of two
+	// per axis, so decoding is exact, and the coordinates are rounded outwards, so the decoded boxes always contain the children.
+	struct CompressedBvhNode
+	{
+		optix::float3 origin;       // Minimum of the node bounds, the grid origin.
+		unsigned char exponent[3];  // Biased float exponent of the grid cell size per axis.
+		unsigned char count;        // Number of children.
+		unsigned char lo[3][4];     // Quantized child bounds per axis and child.
+		unsigned char hi[3][4];
+		unsigned int  child[4];     // Interior child: node index. Leaf child: kLeafFlag | triangle count << kLeafCountShift | first triangle.
+		unsigned int  pad[2];
+	};
+
+	// Leaf triangles are copied in traversal order, so each leaf is one contiguous block.
+	struct CompressedBvhTriangle
+	{
+		optix::float3 v0;
+		optix::float3 v1;
+		optix::float3 v2;
+		unsigned int  primitive;
+	};
+
+	// Compact copy of a binary Bvh over triangles for host side ray queries.
+	// Every node collapses up to two levels of the binary hierarchy. Compared to the BvhNode array plus the primitive index
+	// and vertex arrays it needs about half the memory, which matters when the acceleration structure doesn't fit into the caches.
+	class CompressedBvh
+	{
+	public:
+		static const unsigned int kLeafFlag       = 0x80000000u;
+		static const unsigned int kLeafCountShift = 27;
+		static const unsigned int kMaxLeafSize    = 15;  // Triangles per leaf child, larger binary leaves are not supported.
+
+		CompressedBvh();
+		~CompressedBvh();
+
+		// triangleVertices are the vertices the binary bvh was built over, three per primitive.
+		void build(Bvh const& bvh, SharedArray<optix::float3> const& triangleVertices);
+
+		// Closest hit in (tmin, tmax], like HostScene::intersect().
+		bool intersect(const optix::float3& origin, const optix::float3& direction, const float tmin, const float tmax, TriangleHit& hit, BvhTraversalStats* stats = nullptr) const;
+
+		// Bytes of nodes and leaf triangles.
+		size_t getMemorySize() const;
+
+		std::vector<CompressedBvhNode> const&     getNodes() const     { return m_nodes; }
+		std::vector<CompressedBvhTriangle> const& getTriangles() const { return m_triangles; }
+		optix::Aabb const&                        getBounds() const    { return m_bounds; }
+
+	private:
+		void quantizeChildren(CompressedBvhNode& node, optix::Aabb const& bounds, const optix::Aabb* childBounds, const int count) const;
+
+	private:
+		std::vector<CompressedBvhNode>     m_nodes;
+		std::vector<CompressedBvhTriangle> m_triangles;
+		optix::Aabb                        m_bounds;
+	};
+}
+
+#endif // COMPRESSED_BVH_H
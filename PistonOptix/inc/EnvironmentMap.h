@@ -0,0 +1,58 @@
+#pragma once
+
+#ifndef ENVIRONMENT_MAP_H
+#define ENVIRONMENT_MAP_H
+
+#include <optix.h>
+#include <optixu/optixu_math_namespace.h>
+
+#include <string>
+#include <vector>
+
+namespace POptix
+{
+	// HDR environment map with the cumulative distributions for its importance sampling, see shaders/environment_sample.h.
+	// The texel weight is the luminance. The projection of miss.cu preserves area, so no sin(theta) factor is needed.
+	class EnvironmentMap
+	{
+	public:
+		EnvironmentMap();
+		~EnvironmentMap();
+
+		// RGBA texels, rows from v = 0 (straight down) to v = 1 (straight up), the layout of the envmap texture.
+		void build(const int width, const int height, const float* texels);
+
+		// Radiance .hdr file read with HDRLoader, flipped like loadHDRTexture() does. Returns false when it can't be read,
+		// the map is then a single black texel.
+		bool load(std::string const& filename);
+
+		bool isValid() const { return 0 < m_width; }
+
+		// Bilinear lookup with repeat wrapping, like tex2D() with the linear filtering of the envmap sampler.
+		optix::float3 eval(const optix::float2& uv) const;
+		optix::float3 operator()(const optix::float2& uv) const { return eval(uv); }
+
+		// Host side of sampleEnvironment() and environmentPdf(), with directions instead of texture coordinates.
+		optix::float3 sample(const float u1, const float u2, float& pdf) const;
+		float         pdf(const optix::float3& direction) const;
+
+		// Radiance averaged over the sphere.
+		float getAverageLuminance() const { return m_averageLuminance; }
+
+		int                       getWidth() const          { return m_width; }
+		int                       getHeight() const         { return m_height; }
+		std::vector<float> const& getTexels() const         { return m_texels; }
+		std::vector<float> const& getMarginalCdf() const    { return m_marginal; }
+		std::vector<float> const& getConditionalCdf() const { return m_conditional; }
+
+	private:
+		int                m_width;
+		int                m_height;
+		std::vector<float> m_texels;       // RGBA.
+		std::vector<float> m_marginal;     // height + 1 entries.
+		std::vector<float> m_conditional;  // height * (width + 1) entries.
+		float              m_averageLuminance;
+	};
+}
+
+#endif // ENVIRONMENT_MAP_H
@@ -0,0 +1,169 @@
+#pragma once
+
+#ifndef HOST_RENDERER_H
+#define HOST_RENDERER_H
+
+#include <optix.h>
+#include <optixu/optixu_math_namespace.h>
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "inc/Accumulator.h"
+#include "inc/AdaptiveSampling.h"
+#include "inc/Bidirectional.h"
+#include "inc/HostScene.h"
+#include "inc/PathGuiding.h"
+#include "inc/TileScheduler.h"
+#include "shaders/per_ray_data.h"
+#include "shaders/reservoir.h"
+
+namespace POptix
+{
+	// Progressive unidirectional path tracer on the CPU.
+	// Same integrator as raygeneration.cu, closesthit.cu, closesthit_light.cu and miss.cu, so the images of both paths converge to
+	// the same result. The image is split into tiles which are distributed over the threads of a TileScheduler.
+	// The tiles write their samples into private buffers of an Accumulator which are merged in a fixed order after each pass,
+	// so the image doesn't depend on the number of threads or on which thread rendered which tile.
+	// With a NUMA topology of more than one node the workers are pinned per node and every node traces against its own copy
+	// of the scene, first touched by a thread on that node like the tile buffers. The Accumulator keeps a sample sum buffer per
+	// node, the nodes are merged when the output is written. This mode is off unless a topology is passed,
+	// and its gain is unproven: it has only run on a single node machine with a simulated topology, see benchmarkNuma().
+	// With path guiding the continuation rays sample a mixture of the BRDF and an SD-tree learned from the paths of the earlier
+	// passes. Training iteration k lasts 2^k passes, the paths of a pass sample the distribution of the previous iteration and
+	// record into the next one without locks. The SD-tree of the next iteration is built on a thread of its own during the pass
+	// after the last one of an iteration, whose paths only sample, and replaces the current one at the end of that pass.
+	// Without adaptive sampling each iteration accumulates an image of its own, which enters the output weighted by the inverse
+	// of its variance, so the noisy samples of the first iterations don't dominate the image as the guiding gets better.
+	// With ReSTIR the direct light of the primary hits is resampled from reservoirs, see reservoir.h. The tile pass of the paths
+	// fills the reservoirs, a second tile pass reuses those of the neighbours and writes the samples.
+	// INTEGRATOR_BIDIRECTIONAL replaces the path tracer by a BidirectionalIntegrator, whose samples reaching the camera from
+	// the light subpaths are splatted through the Accumulator. It runs without adaptive sampling, path guiding and ReSTIR.
+	class HostRenderer
+	{
+	public:
+		explicit HostRenderer(HostScene const& scene, int numThreads = 0, NumaTopology const* topology = nullptr);
+		~HostRenderer();
+
+		void setResolution(int width, int height);
+		void setCamera(const optix::float3& position, const optix::float3& U, const optix::float3& V, const optix::float3& W);
+		void setPathLengths(int minPathLength, int maxPathLength);
+		void setSceneEpsilon(float epsilon);
+		void setLightSelection(ELightSelection selection); // How the next event estimation picks its light, uniform by default.
+		void setSampler(ESampler sampler);                 // Random numbers of the paths, Sobol by default.
+
+		// Samples per pixel and render() call. Each sample is a slice of its tile, which is scheduled separately.
+		void setSamplesPerPass(int samples);
+
+		// Stop sampling the pixels of converged blocks, off by default. Warm-up and target error are set on getAdaptiveSampling().
+		void setAdaptive(bool enabled);
+
+		// Path guiding, off by default. Switching it on starts learning from scratch on the bounds of the scene.
+		void setGuiding(bool enabled);
+
+		// Reservoir resampling of the direct light of the primary hits, RESTIR_OFF by default. Needs one sample per pass.
+		void setRestir(ERestir mode);
+
+		// The light transport algorithm, INTEGRATOR_PATH by default.
+		void setIntegrator(EIntegrator integrator);
+
+		// Next render() starts a new accumulation.
+		void restartAccumulation();
+
+		// Samples per pass per pixel, accumulated into the output buffer. Returns without tracing once isConverged().
+		void render();
+
+		TileScheduler&    getScheduler()            { return m_scheduler; }
+		AdaptiveSampling& getAdaptiveSampling()     { return m_adaptive; }
+		int               getIterationIndex() const { return m_iterationIndex; } // Number of accumulated samples, in the active pixels.
+		bool              isNumaEnabled() const     { return !m_nodeScenes.empty(); }
+		bool              isConverged() const       { return m_adaptiveEnabled && m_adaptive.isConverged(); }
+		double            getResolveTime() const    { return m_resolveTime; } // Seconds the Accumulator took in the last render().
+
+		bool              getGuiding() const           { return m_guidingEnabled; }
+		SDTree&           getGuidingTree()             { return m_guiding; } // Thresholds of the training.
+		int               getGuidingIteration() const  { return m_guidingIteration; } // Training iterations finished.
+		double            getGuidingUpdateTime() const { return m_guidingUpdateTime; } // Seconds of the last SD-tree update, in the background.
+
+		ERestir           getRestir() const { return m_restir; }
+		EIntegrator       getIntegrator() const { return m_integrator; }
+
+		// Tile pass of the paths of the last render(). The ReSTIR pass and the resolve run on the scheduler afterwards and
+		// replace its last pass stats.
+		TilePassStats const& getPassStats() const { return m_passStats; }
+
+		std::vector<optix::float4> const& getOutputBuffer() const { return m_outputBuffer; } // RGBA32F, row 0 is the bottom of the image.
+
+	private:
+		void renderTile(Tile const& tile, int threadIndex);
+		void restirTile(Tile const& tile, int threadIndex); // Spatial reuse, after renderTile() of all tiles.
+
+		void updateGuiding(int iteration); // Runs on m_guidingThread, m_guidingUpdate becomes m_guiding after update(iteration).
+		void combineGuidingIterations(bool iterationEnd); // Mixes the image of the current iteration into m_outputBuffer.
+		void joinGuiding();
+
+		// restirPixel receives the primary hit when its direct light is left to the reservoirs, nullptr without ReSTIR.
+		void integrator(HostScene const& scene, PerRayData& prd, optix::float3& radiance, ShadowCache& shadowCache, std::vector<GuidingVertex>* guidingPath,
+		                ReservoirPixel* restirPixel) const;
+
+		// guidingVertex is filled with the continuation ray when it can be guided, nullptr without guiding.
+		void closestHit(HostScene const& scene, PerRayData& prd, const optix::float3& direction, TriangleHit const& hit, ShadowCache& shadowCache, GuidingVertex* guidingVertex,
+		                ReservoirPixel* restirPixel) const;
+		void closestHitLight(HostScene const& scene, PerRayData& prd, const optix::float3& direction, TriangleHit const& hit) const;
+
+	private:
+		HostScene const& m_scene;
+		TileScheduler    m_scheduler;
+		Accumulator      m_accumulator;
+
+		std::vector<std::unique_ptr<HostScene>> m_nodeScenes; // NUMA mode, per node.
+
+		int    m_width;
+		int    m_height;
+		int    m_iterationIndex;
+		int    m_samplesPerPass;
+		double m_resolveTime;
+
+		TilePassStats m_passStats;
+
+		optix::float3 m_cameraPosition;
+		optix::float3 m_cameraU;
+		optix::float3 m_cameraV;
+		optix::float3 m_cameraW;
+
+		int   m_minPathLength;
+		int   m_maxPathLength;
+		float m_sceneEpsilon;
+
+		ELightSelection m_lightSelection;
+		ESampler        m_sampler;
+
+		bool             m_adaptiveEnabled;
+		AdaptiveSampling m_adaptive;
+
+		bool        m_guidingEnabled;
+		SDTree      m_guiding;           // Sampled by the paths, which record into its training D-trees.
+		SDTree      m_guidingUpdate;
+		std::thread m_guidingThread;
+		bool        m_guidingRecording;  // False during the pass of a background update, which copies m_guiding.
+		int         m_guidingIteration;
+		int         m_guidingPasses;     // Passes of the current training iteration.
+		double      m_guidingUpdateTime;
+		double      m_guidingThreadTime; // Of the update on m_guidingThread, read after the join.
+
+		std::vector<optix::float4> m_guidingImage;         // Of the finished iterations, empty before the first one ends.
+		double                     m_guidingImageVariance; // Mean variance of its pixels.
+
+		ERestir                     m_restir;
+		std::vector<ReservoirPixel> m_reservoirs; // RESTIR_SLOTS per pixel.
+
+		EIntegrator         m_integrator;
+		EmitterDistribution m_emitters; // Starts the light subpaths.
+
+		std::vector<optix::float4> m_outputBuffer;
+		std::vector<float>         m_meanSquares; // Average squared luminance per pixel, the input of the adaptive sampling.
+	};
+}
+
+#endif // HOST_RENDERER_H
@@ -0,0 +1,103 @@
+#pragma once
+
+#ifndef HOST_SCENE_H
+#define HOST_SCENE_H
+
+#include <optix.h>
+#include <optixu/optixu_math_namespace.h>
+
+#include <vector>
+
+#include "inc/Bvh.h"
+#include "inc/BvhCache.h"
+#include "inc/TrianglePacket.h"
+#include "inc/LightParameters.h"
+#include "inc/LightTree.h"
+#include "inc/LightAliasTable.h"
+#include "inc/EnvironmentMap.h"
+#include "inc/CudaUtils/State.h"
+#include "shaders/material_parameter.h"
+#include "shaders/vertex_attributes.h"
+
+namespace POptix
+{
+	class Scene;
+
+	// Last occluding triangle of a thread, tested first by HostScene::occluded().
+	// Shadow rays of neighbouring pixels towards the same light are often blocked by the same triangle.
+	struct ShadowCache
+	{
+		ShadowCache()
+			: primitive(~0u)
+			, lookups(0)
+			, hits(0)
+		{
+		}
+
+		unsigned int       primitive;
+		unsigned long long lookups;
+		unsigned long long hits;
+	};
+
+	// World space triangle soup of a Scene for rendering on the host.
+	// Mirrors Application::createScene(): every node mesh is transformed into world space and quad and sphere lights
+	// get the same emitting geometry the OptiX scene uses.
+	class HostScene
+	{
+	public:
+		HostScene();
+		~HostScene();
+
+		// options.builder is the default for meshes without a builder entry. Meshes with builder "Sbvh" get spatial splits.
+		// With a cache the BVH is loaded from it when the triangles and build settings are unchanged, otherwise built and stored.
+		void build(Scene const& scene, BvhBuildOptions const& options = BvhBuildOptions(), BvhCache* cache = nullptr);
+
+		// Closest hit in (tmin, tmax]. stats, when given, accumulates the traversal work.
+		bool intersect(const optix::float3& origin, const optix::float3& direction, const float tmin, const float tmax, TriangleHit& hit, BvhTraversalStats* stats = nullptr) const;
+
+		// Any hit in (tmin, tmax], same result as intersect() without computing the closest one. Tests the cached occluder first and updates it.
+		bool occluded(const optix::float3& origin, const optix::float3& direction, const float tmin, const float tmax, ShadowCache* cache = nullptr, BvhTraversalStats* stats = nullptr) const;
+
+		// Fills hit_position, geometry_normal and shading_normal in world space. The normals are not flipped to the ray side.
+		void getState(const optix::float3& origin, const optix::float3& direction, TriangleHit const& hit, State& state) const;
+
+		int getMaterialIndex(const unsigned int primitive) const { return m_materialIndices[primitive]; }
+		int getLightIndex(const unsigned int primitive) const    { return m_lightIndices[primitive]; }   // -1 when the triangle doesn't emit.
+
+		unsigned int getNumTriangles() const { return static_cast<unsigned int>(m_materialIndices.size()); }
+
+		std::vector<Material> const&      getMaterials() const { return m_materials; }
+		std::vector<Light> const&         getLights() const    { return m_lights; }
+		LightTree const&                  getLightTree() const { return m_lightTree; }
+		LightAliasTable const&            getLightAliasTable() const { return m_lightAliasTable; }
+		EnvironmentMap const&             getEnvironment() const { return m_environment; }
+		int                               getEnvironmentLight() const { return m_environmentLight; } // -1 without an environment light.
+		SharedArray<optix::float3> const& getVertices() const  { return m_vertices; }
+		Bvh const&                        getBvh() const       { return m_bvh; }
+		optix::Aabb const&                getBounds() const    { return m_bounds; }
+
+	private:
+		void buildLightAliasTable();
+		void addMesh(std::vector<VertexAttributes> const& attributes, std::vector<unsigned int> const& indices, const float* transform, const int materialIndex, const int lightIndex, const bool splittable);
+
+	private:
+		// Built from the scene or referenced in a mapped BvhCache file.
+		SharedArray<optix::float3> m_vertices;         // Three per triangle, world space.
+		SharedArray<optix::float3> m_normals;          // Three per triangle, world space shading normals.
+		SharedArray<int>           m_materialIndices;  // Per triangle.
+		SharedArray<int>           m_lightIndices;     // Per triangle.
+		std::vector<unsigned char> m_splittable;       // Per triangle, allows spatial splits. Empty after a cache hit.
+
+		std::vector<Material> m_materials;
+		std::vector<Light>    m_lights;
+		LightTree             m_lightTree;
+		LightAliasTable       m_lightAliasTable;
+		EnvironmentMap        m_environment;       // Image of the environment light, invalid without one.
+		int                   m_environmentLight;
+
+		Bvh         m_bvh;
+		optix::Aabb m_bounds;
+	};
+}
+
+#endif // HOST_SCENE_H
@@ -0,0 +1,438 @@
+#pragma once
+
+#ifndef HOST_SHADING_H
+#define HOST_SHADING_H
+
+#include <optix.h>
+#include <optixu/optixu_math_namespace.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "inc/LightParameters.h"
+#include "inc/LightTree.h"
+#include "inc/LightAliasTable.h"
+#include "inc/EnvironmentMap.h"
+#include "inc/PathGuiding.h"
+#include "inc/CudaUtils/State.h"
+#include "shaders/material_parameter.h"
+#include "shaders/per_ray_data.h"
+#include "shaders/brdf_functions.h"
+#include "shaders/light_sample.h"
+#include "shaders/environment_sample.h"
+
+// The closesthit.cu and closesthit_light.cu programs split into the steps the host renderers need.
+// HostRenderer runs them back to back per path, WavefrontRenderer runs each step over a whole queue of paths.
+// Both consume the random numbers in the same order as the OptiX programs.
+
+namespace POptix
+{
+	// Host counterparts of the sysBRDFPdf, sysBRDFSample and sysBRDFEval callable program buffers, indexed by EBrdfTypes.
+	typedef void          (*BrdfPdfFunction)(Material const& mat, State const& state, const optix::float3& woWorld, PerRayData& prd);
+	typedef void          (*BrdfSampleFunction)(Material const& mat, State const& state, const optix::float3& woWorld, PerRayData& prd);
+	typedef optix::float3 (*BrdfEvalFunction)(Material const& mat, State const& state, const optix::float3& woWorld, PerRayData& prd);
+
+	static const BrdfPdfFunction    g_brdfPdf[NUM_OF_BRDF]    = { lambertPdf,    phongPdf,    microfacetReflectionPdf };
+	static const BrdfSampleFunction g_brdfSample[NUM_OF_BRDF] = { lambertSample, phongSample, microfacetReflectionSample };
+	static const BrdfEvalFunction   g_brdfEval[NUM_OF_BRDF]   = { lambertEval,   phongEval,   microfacetReflectionEval };
+
+	// The BRDF samples for a given unit square sample, see sampleGuidedSurface().
+	typedef optix::float3 (*BrdfSampleDirectionFunction)(Material const& mat, State const& state, const optix::float3& woWorld, const optix::float2& u);
+
+	static const BrdfSampleDirectionFunction g_brdfSampleDirection[NUM_OF_BRDF] = { lambertSampleDirection, phongSampleDirection, microfacetReflectionSampleDirection };
+
+	// Host counterpart of sysLightSample, indexed by ELightType. The environment needs its map, see sampleDirectLighting().
+	typedef void (*LightSampleFunction)(Light const& light, PerRayData& prd, LightSample& sample, State const& state);
+
+	static const LightSampleFunction g_lightSample[NUM_OF_LIGHT_TYPE] = { sphereLightSample, quadLightSample, directionalLightSample, nullptr };
+
+	// Shadow ray of the next event estimation. radiance is added to the path when nothing blocks (tmin, tmax).
+	struct ShadowRay
+	{
+		optix::float3 origin;
+		optix::float3 direction;
+		float         tmin;
+		float         tmax;
+		optix::float3 radiance;
+	};
+
+	// Probability with which beginSurface() selects the LAMBERT lobe of mat, MICROFACET_REFLECTION otherwise.
+	inline float diffuseLobeProbability(Material const& mat)
+	{
+		return 0.5f * (1.0f - mat.metallic);
+	}
+
+	// One sample model of the path guiding: the continuation ray follows the BRDF with the probability bsdfFraction and the
+	// D-tree of the cell otherwise. Inactive without a learned distribution, then only the BRDF is sampled.
+	// Guides the diffuse and glossy lobes, specular ones only continue along their mirror direction. Rough materials are
+	// guided with both lobes weighted by their selection probabilities, the BRDF the selected lobes average to, since the
+	// D-tree can't know which lobe a vertex selected and a path through the weak one would carry almost nothing.
+	struct GuidingMixture
+	{
+		GuidingMixture()
+			: dTree(nullptr)
+			, bsdfFraction(1.0f)
+		{
+		}
+
+		GuidingMixture(DTree const* tree, const float fraction)
+			: dTree(tree)
+			, bsdfFraction(fraction)
+		{
+		}
+
+		bool isActive() const
+		{
+			return dTree != nullptr && 0.0f < dTree->getTotal() && bsdfFraction < 1.0f;
+		}
+
+		float pdf(const optix::float3& direction, const float bsdfPdf) const
+		{
+			return isActive() ? mixture(bsdfPdf, dTree->pdf(direction)) : bsdfPdf;
+		}
+
+		float mixture(const float bsdfPdf, const float guidingPdf) const
+		{
+			return bsdfFraction * bsdfPdf + (1.0f - bsdfFraction) * guidingPdf;
+		}
+
+		bool averagesLobes(Material const& mat) const
+		{
+			return isActive() && 0.0f < mat.roughness;
+		}
+
+		DTree const* dTree;
+		float        bsdfFraction;
+	};
+
+	// closesthit.cu up to the roulette. Expects prd.hit_pos and the unflipped normals in state, flips them to the side of prd.wo.
+	// Returns the BRDF which samples the next direction.
+	inline EBrdfTypes beginSurface(Material const& mat, State& state, PerRayData& prd)
+	{
+		prd.flags |= (0.0f <= optix::dot(prd.wo, state.geometry_normal)) ? FLAG_FRONTFACE : 0;
+
+		if ((prd.flags & FLAG_FRONTFACE) == 0)
+		{
+			state.geometry_normal = -state.geometry_normal;
+			state.shading_normal  = -state.shading_normal;
+		}
+
+		prd.radiance   = optix::make_float3(0.0f);
+		prd.f_over_pdf = optix::make_float3(0.0f);
+		prd.pdf        = 0.0f;
+		prd.brdf_flags = 0;
+
+		// Roulette-select the ray's path.
+		const float roulette   = sample1D(prd, SAMPLE_DIMENSION_LOBE);
+		const float diffChance = diffuseLobeProbability(mat);
+		if (roulette < diffChance)
+		{
+			prd.brdf_flags |= BSDF_REFLECTION;
+			prd.brdf_flags |= BSDF_DIFFUSE;
+			return LAMBERT;
+		}
+
+		prd.brdf_flags |= BSDF_REFLECTION;
+		prd.brdf_flags |= (mat.roughness > 0.0f) ? BSDF_GLOSSY : BSDF_SPECULAR;
+		return MICROFACET_REFLECTION;
+	}
+
+	// The BRDF of the selected lobe in the direction prd.wi, its pdf in prd.pdf.
+	inline optix::float3 evalSurface(const EBrdfTypes brdf, Material const& mat, State const& state, const optix::float3& woWorld, PerRayData& prd)
+	{
+		g_brdfPdf[brdf](mat, state, woWorld, prd);
+		const optix::float3 value = g_brdfEval[brdf](mat, state, woWorld, prd);
+
+		return (brdf == LAMBERT) ? diffuseFresnelWeight(mat, woWorld, prd.wi) * value : value;
+	}
+
+	// evalSurface() of both lobes weighted by the probabilities beginSurface() selects them with, the pdf of sampling the
+	// selected lobe in prd.pdf. Not for the specular lobe of a smooth material.
+	inline optix::float3 evalSurfaceLobes(Material const& mat, State const& state, const optix::float3& woWorld, PerRayData& prd)
+	{
+		const float diffuse = diffuseLobeProbability(mat);
+
+		optix::float3 f   = optix::make_float3(0.0f);
+		float         pdf = 0.0f;
+		if (0.0f < diffuse)
+		{
+			f   += diffuse * evalSurface(LAMBERT, mat, state, woWorld, prd);
+			pdf += diffuse * prd.pdf;
+		}
+		if (diffuse < 1.0f)
+		{
+			f   += (1.0f - diffuse) * evalSurface(MICROFACET_REFLECTION, mat, state, woWorld, prd);
+			pdf += (1.0f - diffuse) * prd.pdf;
+		}
+		prd.pdf = pdf;
+		return f;
+	}
+
+	// Samples the continuation ray with the selected BRDF and fills prd.wi, prd.pdf and prd.f_over_pdf.
+	// Returns false when the path terminates at this surface.
+	inline bool sampleSurface(const EBrdfTypes brdf, Material const& mat, State const& state, PerRayData& prd)
+	{
+		const optix::float3 woWorld = prd.wo;
+
+		g_brdfSample[brdf](mat, state, woWorld, prd);
+		const optix::float3 f = evalSurface(brdf, mat, state, woWorld, prd);
+
+		// Do not sample opaque surfaces below the geometry!
+		if (prd.pdf <= 0.0f || optix::dot(prd.wi, state.geometry_normal) <= 0.0f)
+		{
+			prd.flags |= FLAG_TERMINATE;
+			return false;
+		}
+
+		prd.f_over_pdf = f * fabsf(optix::dot(prd.wi, state.shading_normal)) / prd.pdf;
+		return true;
+	}
+
+	// sampleSurface() with the direction drawn from the mixture of the BRDF and the guiding distribution. prd.pdf is the pdf of
+	// the mixture, which weights the continuation against the next event estimation. The x of the BRDF sample picks the
+	// distribution and is stretched back to [0, 1), so the samples of both stay stratified in their own two dimensions.
+	// The BRDF part samples the selected lobe, see GuidingMixture for the BRDF it is evaluated with.
+	inline bool sampleGuidedSurface(const EBrdfTypes brdf, Material const& mat, State const& state, GuidingMixture const& guiding, PerRayData& prd)
+	{
+		if (!guiding.isActive() || !(prd.brdf_flags & (BSDF_DIFFUSE | BSDF_GLOSSY)))
+		{
+			return sampleSurface(brdf, mat, state, prd);
+		}
+
+		const optix::float3 woWorld = prd.wo;
+
+		float guidingPdf;
+
+		optix::float2 u = sample2D(prd, SAMPLE_DIMENSION_BRDF);
+		if (u.x < guiding.bsdfFraction)
+		{
+			u.x = std::min(u.x / guiding.bsdfFraction, 0.99999994f);
+			prd.wi = g_brdfSampleDirection[brdf](mat, state, woWorld, u);
+			guidingPdf = guiding.dTree->pdf(prd.wi);
+		}
+		else
+		{
+			u.x = std::min((u.x - guiding.bsdfFraction) / (1.0f - guiding.bsdfFraction), 0.99999994f);
+			prd.wi = guiding.dTree->sample(u, guidingPdf);
+		}
+		const optix::float3 f = guiding.averagesLobes(mat) ? evalSurfaceLobes(mat, state, woWorld, prd) : evalSurface(brdf, mat, state, woWorld, prd);
+
+		prd.pdf = guiding.mixture(prd.pdf, guidingPdf);
+
+		if (prd.pdf <= 0.0f || optix::dot(prd.wi, state.geometry_normal) <= 0.0f)
+		{
+			prd.flags |= FLAG_TERMINATE;
+			return false;
+		}
+
+		prd.f_over_pdf = f * fabsf(optix::dot(prd.wi, state.shading_normal)) / prd.pdf;
+		return true;
+	}
+
+	// The sysLightSelection of DirectLighting() with the structures of the scene it reads. Only the one of mode is used.
+	// environment is sampled when the selection picks an ENVIRONMENT light.
+	struct LightSelector
+	{
+		LightSelector(const ELightSelection selectionMode, LightTree const& lightTree, LightAliasTable const& lightAliasTable, EnvironmentMap const& environmentMap)
+			: mode(selectionMode)
+			, tree(&lightTree)
+			, aliasTable(&lightAliasTable)
+			, environment(&environmentMap)
+		{
+		}
+
+		ELightSelection        mode;
+		LightTree const*       tree;
+		LightAliasTable const* aliasTable;
+		EnvironmentMap const*  environment;
+	};
+
+	// Probability with which sampleDirectLighting() at position picks lightIndex.
+	inline float lightSelectionPmf(std::vector<Light> const& lights, LightSelector const& selector, const int lightIndex, const optix::float3& position)
+	{
+		switch (selector.mode)
+		{
+		case LIGHT_SELECTION_TREE:
+			return selector.tree->pmf(lightIndex, position);
+		case LIGHT_SELECTION_POWER:
+			return selector.aliasTable->pmf(lightIndex);
+		default:
+			return 1.0f / float(lights.size());
+		}
+	}
+
+	// The light sysLightSelection picks at position for the uniform sample u, its probability in pmf.
+	inline int selectLight(std::vector<Light> const& lights, LightSelector const& selector, const optix::float3& position, const float u, float& pmf)
+	{
+		const int numberOfLights = int(lights.size());
+
+		if (selector.mode == LIGHT_SELECTION_TREE)
+		{
+			return selector.tree->sample(position, u, pmf);
+		}
+		if (selector.mode == LIGHT_SELECTION_POWER)
+		{
+			return selector.aliasTable->sample(u, pmf);
+		}
+		pmf = 1.0f / numberOfLights;
+		return std::min((int)(u * numberOfLights), numberOfLights - 1);
+	}
+
+	// sysLightSample of light at state.hit_position.
+	inline void sampleLight(Light const& light, LightSelector const& selector, PerRayData& prd, State const& state, LightSample& lightSample)
+	{
+		if (light.lightType == ENVIRONMENT)
+		{
+			EnvironmentMap const& environment = *selector.environment;
+			environmentLightSample(light, prd, lightSample, environment.getMarginalCdf().data(), environment.getConditionalCdf().data(),
+			                       environment.getWidth(), environment.getHeight(), environment);
+		}
+		else
+		{
+			g_lightSample[light.lightType](light, prd, lightSample, state);
+		}
+	}
+
+	// DirectLighting() of closesthit.cu without the visibility test. Returns false when there is nothing to connect.
+	// With guiding the BRDF samples follow its mixture, whose pdf weights the light sample.
+	inline bool sampleDirectLighting(std::vector<Light> const& lights, LightSelector const& selector, Material const& mat, State const& state, PerRayData& prd, const float sceneEpsilon, ShadowRay& shadowRay,
+	                                 GuidingMixture const* guiding = nullptr)
+	{
+		const int numberOfLights = int(lights.size());
+		if (!(prd.brdf_flags & (BSDF_DIFFUSE | BSDF_GLOSSY)) || numberOfLights <= 0)
+		{
+			return false;
+		}
+
+		const optix::float3 woWorld = prd.wo;
+
+		LightSample lightSample;
+
+		float lightPdf;
+		const int lightNum = selectLight(lights, selector, prd.hit_pos, sample1D(prd, SAMPLE_DIMENSION_LIGHT_SELECTION), lightPdf);
+		const Light& sampledLight = lights[lightNum];
+
+		sampleLight(sampledLight, selector, prd, state, lightSample);
+
+		optix::float3 Li = optix::make_float3(0.0f);
+		float directLightPdf = 0.0f;
+		float scatteringPdf  = 0.0f;
+
+		if (lightSample.pdf == 0 || lightSample.distance == 0)
+		{
+			return false;
+		}
+
+		// Quads emit on the front side only. The environment surrounds everything, spheres are sampled on the cap facing the point.
+		if (sampledLight.lightType == ENVIRONMENT || sampledLight.lightType == SPHERE || optix::dot(sampledLight.normal, -lightSample.direction) > 0.0f)
+		{
+			Li = lightSample.emission;
+			directLightPdf = lightSample.pdf;
+		}
+
+		if (!(lightSample.pdf > 0.0f && isNotNull(Li)))
+		{
+			return false;
+		}
+
+		// Like the BRDF samples, nothing arrives from below the surface.
+		const optix::float3 wiWorld = optix::normalize(lightSample.direction);
+		if (optix::dot(wiWorld, state.geometry_normal) <= 0.0f)
+		{
+			return false;
+		}
+
+		// The BRDF and its pdf in the light direction, the BRDF the continuation is weighted with. prd keeps the continuation ray
+		// of sampleSurface().
+		PerRayData lightPrd = prd;
+		lightPrd.wi = wiWorld;
+
+		const EBrdfTypes brdf = (prd.brdf_flags & BSDF_DIFFUSE) ? LAMBERT : MICROFACET_REFLECTION;
+
+		optix::float3 f = (guiding != nullptr && guiding->averagesLobes(mat)) ? evalSurfaceLobes(mat, state, woWorld, lightPrd) : evalSurface(brdf, mat, state, woWorld, lightPrd);
+		scatteringPdf = lightPrd.pdf;
+		f *= fabsf(optix::dot(wiWorld, state.shading_normal));
+
+		if (!isNotNull(f))
+		{
+			return false;
+		}
+
+		if (guiding != nullptr)
+		{
+			scatteringPdf = guiding->pdf(wiWorld, scatteringPdf);
+		}
+
+		optix::float3 Ld;
+		if (sampledLight.isDelta || (prd.flags & FLAG_LAST_SEGMENT))
+		{
+			Ld = f * Li / directLightPdf;
+		}
+		else
+		{
+			// The selection probability is part of the light sampling pdf, shadeLight() uses the same product.
+			const float weight = PowerHeuristic(1, lightPdf * directLightPdf, 1, scatteringPdf);
+			Ld = f * Li * weight / directLightPdf;
+		}
+
+		// The sysSceneEpsilon is applied on both sides of the shadow ray to not hit the light geometry itself.
+		shadowRay.origin    = prd.hit_pos;
+		shadowRay.direction = wiWorld;
+		shadowRay.tmin      = sceneEpsilon;
+		shadowRay.tmax      = lightSample.distance - sceneEpsilon;
+		shadowRay.radiance  = Ld / lightPdf;
+		return true;
+	}
+
+	// miss.cu. The environment light, if there is one, is weighted against its sampling in sampleDirectLighting() at origin.
+	inline void shadeMiss(std::vector<Light> const& lights, LightSelector const& selector, const int environmentLight, const optix::float3& origin, const optix::float3& direction, PerRayData& prd)
+	{
+		prd.radiance = optix::make_float3(0.0f);
+
+		// The reservoirs of the primary hit sampled it.
+		if (0 <= environmentLight && !(prd.flags & FLAG_DIRECT_RESAMPLED))
+		{
+			EnvironmentMap const& environment = *selector.environment;
+			prd.radiance = lights[environmentLight].emission * environment.eval(environmentUV(direction));
+
+#if USE_NEXT_EVENT_ESTIMATION
+			const float pdfLight = lightSelectionPmf(lights, selector, environmentLight, origin) * environment.pdf(direction);
+			if ((prd.brdf_flags & (BSDF_DIFFUSE | BSDF_GLOSSY)) && DENOMINATOR_EPSILON < pdfLight)
+			{
+				prd.radiance *= powerHeuristic(prd.pdf, pdfLight);
+			}
+#endif // USE_NEXT_EVENT_ESTIMATION
+		}
+
+		prd.flags |= FLAG_TERMINATE; // End of path.
+	}
+
+	// closesthit_light.cu. selectionPmf is the lightSelectionPmf() of the light at the ray origin.
+	// hitDistance is the distance along the ray, geometryNormal the unflipped normal of the light geometry.
+	inline void shadeLight(Light const& light, const float selectionPmf, const optix::float3& origin, const float hitDistance, const optix::float3& geometryNormal, PerRayData& prd)
+	{
+		const float cosTheta = optix::dot(prd.wo, geometryNormal);
+		prd.flags |= (0.0f <= cosTheta) ? FLAG_FRONTFACE : 0;
+
+		prd.radiance = optix::make_float3(0.0f); // Backside is black.
+
+		if ((prd.flags & FLAG_FRONTFACE) && !(prd.flags & FLAG_DIRECT_RESAMPLED))
+		{
+			prd.radiance = light.emission;
+
+#if USE_NEXT_EVENT_ESTIMATION
+			const float pdfLight = selectionPmf * lightSamplePdf(light, origin, hitDistance, cosTheta);
+			// If it's an implicit light hit from a diffuse scattering event and the light emission was not returning a zero pdf.
+			if ((prd.brdf_flags & (BSDF_DIFFUSE | BSDF_GLOSSY)) && DENOMINATOR_EPSILON < pdfLight)
+			{
+				prd.radiance *= powerHeuristic(prd.pdf, pdfLight);
+			}
+#endif // USE_NEXT_EVENT_ESTIMATION
+		}
+
+		// Lights have no other material properties than emission. Terminate the path.
+		prd.flags |= FLAG_TERMINATE;
+	}
+}
+
+#endif // HOST_SHADING_H
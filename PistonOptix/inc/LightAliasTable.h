@@ -0,0 +1,43 @@
+#pragma once
+
+#ifndef LIGHT_ALIAS_TABLE_H
+#define LIGHT_ALIAS_TABLE_H
+
+#include <optix.h>
+#include <optixu/optixu_math_namespace.h>
+
+#include <vector>
+
+#include "inc/LightParameters.h"
+
+namespace POptix
+{
+	// Alias table selecting each light with a probability proportional to its emitted power, sampled by sampleLightAlias()
+	// in shaders/light_alias.h. Quad and sphere lights emit luminance(emission) * area * pi. Directional and environment lights
+	// have no area, they are counted with the power falling onto the disk of the scene bounding sphere.
+	class LightAliasTable
+	{
+	public:
+		LightAliasTable();
+		~LightAliasTable();
+
+		// Rebuild whenever the emission or the size of a light changes. sceneRadius is the radius of the scene bounding sphere,
+		// environmentLuminance the EnvironmentMap::getAverageLuminance() of the environment light, if there is one.
+		// Without any power, e.g. all lights switched off, the selection is uniform.
+		void build(std::vector<Light> const& lights, const float sceneRadius, const float environmentLuminance);
+
+		// Host side of sampleLightAlias() and lightAliasPmf().
+		int   sample(const float u, float& pmf) const;
+		float pmf(const int lightIndex) const;
+
+		std::vector<LightAliasEntry> const& getEntries() const { return m_entries; }
+
+		// Emitted power the table is built from.
+		static float getLightPower(Light const& light, const float sceneRadius, const float environmentLuminance);
+
+	private:
+		std::vector<LightAliasEntry> m_entries;
+	};
+}
+
+#endif // LIGHT_ALIAS_TABLE_H
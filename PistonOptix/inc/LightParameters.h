@@ -13,10 +13,21 @@ namespace POptix
 		SPHERE,
 		QUAD,
 		DIRECTIONAL,
+		ENVIRONMENT,  // HDR image at infinity, see shaders/environment_sample.h. emission scales the image.
 
 		NUM_OF_LIGHT_TYPE
 	};
 
+	// How DirectLighting() picks the light of a next event estimation.
+	enum ELightSelection
+	{
+		LIGHT_SELECTION_UNIFORM,  // Every light with the same probability.
+		LIGHT_SELECTION_TREE,     // Stochastic traversal of the light BVH, see shaders/light_tree.h.
+		LIGHT_SELECTION_POWER,    // Proportional to the emitted power with an alias table, see shaders/light_alias.h.
+
+		NUM_OF_LIGHT_SELECTION
+	};
+
 	struct Light
 	{
 		optix::float3 position;
@@ -39,5 +50,26 @@ namespace POptix
 		optix::float3 emission;
 		float         pdf;
 	};
+
+	// Node of the light BVH over the lights with a position. Bounds, power and emission directions of all lights below it.
+	struct LightTreeNode
+	{
+		optix::float3 boundsMin;
+		float         power;     // Sum of luminance(emission) * area.
+		optix::float3 boundsMax;
+		float         cosThetaO; // Cosine of the half angle of the cone around axis which contains the normals of all lights.
+		optix::float3 axis;
+		float         cosThetaE; // Cosine of the angle to the normal up to which the lights emit.
+		int           child;     // Inner node: index of the second child, the first one follows the node. Leaf: -1 - light index.
+		int           parent;    // -1 at the root.
+	};
+
+	// Entry of the alias table over all lights, indexed by the light index.
+	struct LightAliasEntry
+	{
+		float threshold; // Stay at this entry when the fraction of the scaled random number is below, else take alias.
+		int   alias;
+		float pmf;       // Selection probability of this light, power / total power.
+	};
 }
 #endif // LIGHT_PARAMETERS_H
@@ -0,0 +1,62 @@
+#pragma once
+
+#ifndef LIGHT_TREE_BUILDER_H
+#define LIGHT_TREE_BUILDER_H
+
+#include <optix.h>
+#include <optixu/optixu_math_namespace.h>
+#include <optixu/optixu_aabb_namespace.h>
+
+#include <vector>
+
+#include "inc/LightParameters.h"
+
+namespace POptix
+{
+	// Light BVH for many-light sampling, traversed by sampleLightTree() in shaders/light_tree.h.
+	// One leaf per quad or sphere light. The splits minimize the surface area orientation heuristic of Conty Estevez and Kulla,
+	// power * bounds area * orientation cone measure per child, so lights with similar position and direction share subtrees.
+	// Directional and environment lights have no position, they are not in the tree, see the light map.
+	class LightTree
+	{
+	public:
+		LightTree();
+		~LightTree();
+
+		// Rebuild whenever a light moves or its emission changes, the importance uses the power.
+		void build(std::vector<Light> const& lights);
+
+		// Host side of sampleLightTree() and lightTreePmf().
+		int   sample(const optix::float3& position, const float u, float& pmf) const;
+		float pmf(const int lightIndex, const optix::float3& position) const;
+
+		std::vector<LightTreeNode> const& getNodes() const    { return m_nodes; }
+		std::vector<int> const&           getLightMap() const { return m_lightMap; }  // numberOfLights + directional entries.
+		int getNumLights() const            { return m_numLights; }
+		int getNumDirectionalLights() const { return m_numDirectionalLights; }
+		int getDepth() const                { return m_depth; }
+
+	private:
+		struct BuildLight
+		{
+			optix::Aabb   bounds;
+			optix::float3 centroid;
+			optix::float3 axis;
+			float         thetaO;
+			float         thetaE;
+			float         power;
+			int           index;
+		};
+
+		int buildNode(std::vector<BuildLight>& lights, const int begin, const int end, const int parent, const int depth);
+
+	private:
+		std::vector<LightTreeNode> m_nodes;
+		std::vector<int>           m_lightMap;
+		int                        m_numLights;
+		int                        m_numDirectionalLights;
+		int                        m_depth;
+	};
+}
+
+#endif // LIGHT_TREE_BUILDER_H
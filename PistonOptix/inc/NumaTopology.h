@@ -0,0 +1,49 @@
+#pragma once
+
+#ifndef NUMA_TOPOLOGY_H
+#define NUMA_TOPOLOGY_H
+
+#include <functional>
+#include <vector>
+
+namespace POptix
+{
+	// NUMA nodes of the machine and the logical CPUs belonging to each.
+	// Memory is placed by first touch: a page is allocated on the node of the thread writing it first, so data created inside
+	// runOnNode() is local to that node. No NUMA library is needed for that.
+	class NumaTopology
+	{
+	public:
+		// One node with all CPUs of the process.
+		NumaTopology();
+		~NumaTopology();
+
+		// Nodes of the system restricted to the CPUs this process may run on (e.g. under numactl --cpunodebind).
+		// Falls back to a single node when the topology can't be queried.
+		static NumaTopology detect();
+
+		// Splits the CPUs of the process round robin into numNodes nodes, to exercise the NUMA code paths on a single socket.
+		// The memory of a simulated node is not any closer to its CPUs.
+		static NumaTopology simulate(int numNodes);
+
+		int                     getNumNodes() const        { return int(m_nodes.size()); }
+		int                     getNumCpus() const;
+		std::vector<int> const& getCpus(int node) const    { return m_nodes[node]; }
+		bool                    isSimulated() const        { return m_simulated; }
+
+		// Restricts the calling thread to the CPUs of node. Returns false when the system refused.
+		bool pinCurrentThread(int node) const;
+
+		// Runs function on a temporary thread pinned to node and waits for it.
+		void runOnNode(int node, std::function<void()> const& function) const;
+
+	private:
+		static std::vector<int> getProcessCpus();
+
+	private:
+		std::vector<std::vector<int>> m_nodes;  // Logical CPU numbers per node. On Windows group * 64 + processor.
+		bool                          m_simulated;
+	};
+}
+
+#endif // NUMA_TOPOLOGY_H
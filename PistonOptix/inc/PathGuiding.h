@@ -0,0 +1,132 @@
+#pragma once
+
+#ifndef PATH_GUIDING_H
+#define PATH_GUIDING_H
+
+#include <optix.h>
+#include <optixu/optixu_math_namespace.h>
+#include <optixu/optixu_aabb_namespace.h>
+
+#include <atomic>
+#include <vector>
+
+namespace POptix
+{
+	// Directional quadtree of the practical path guiding, see "Practical Path Guiding for Efficient Light-Transport Simulation"
+	// by Mueller, Gross and Novak. Directions map to the unit square by ((cos(theta) + 1) / 2, phi / (2 pi)), which preserves
+	// areas, so the density of a leaf is its share of the recorded radiance over its share of the square.
+	class DTree
+	{
+	public:
+		DTree();
+		DTree(DTree const& other);
+		DTree& operator=(DTree const& other);
+
+		// Adds the incident radiance estimate radiance / pdf of direction to its leaf. Lock free, the render threads record
+		// into the training trees while they sample the others.
+		void record(const optix::float3& direction, const float value) const;
+
+		// Sums the recorded values of the leaves up to the root, after all records of an iteration.
+		void build();
+
+		// Structure for the next iteration from the built tree previous: leaves with more than subdivisionThreshold of its total
+		// are split, nodes with less are merged, down to maxDepth. All sums are zero.
+		void reset(DTree const& previous, const int maxDepth, const float subdivisionThreshold);
+
+		optix::float3 sample(optix::float2 u, float& pdf) const;   // pdf() of the direction, from the nodes on the way down.
+		float         pdf(const optix::float3& direction) const; // Per solid angle, uniform while nothing is recorded.
+
+		float getTotal() const      { return m_total; }       // Sum of the recorded values at the last build().
+		int   getNumRecords() const { return m_numRecords; }  // Records since the last reset().
+		int   getNumNodes() const   { return int(m_nodes.size()); }
+		int   getDepth() const      { return m_depth; }
+
+		void setNumRecords(const int records) { m_numRecords = records; }
+
+	private:
+		struct Node
+		{
+			Node();
+			Node(Node const& other);
+			Node& operator=(Node const& other);
+
+			float getSum(const int i) const { return sum[i].load(std::memory_order_relaxed); }
+			float getTotal() const          { return getSum(0) + getSum(1) + getSum(2) + getSum(3); }
+			bool  isLeaf(const int i) const { return child[i] == 0; }
+
+			mutable std::atomic<float> sum[4]; // Children in the order (0, 0), (1, 0), (0, 1), (1, 1) of the square.
+			int                        child[4];
+		};
+
+		float buildNode(const int index);
+
+		std::vector<Node>        m_nodes;
+		float                    m_total;
+		int                      m_depth;
+		mutable std::atomic<int> m_numRecords;
+	};
+
+	// The two D-trees of a spatial cell. Paths sample the one learned in the previous iteration and record into the other.
+	struct DTreeWrapper
+	{
+		DTree sampling;
+		DTree building;
+	};
+
+	// Binary tree over the cube around the scene bounds, split in the middle along x, y and z in turn. Its leaves hold the
+	// D-trees. After each training iteration update() splits the cells with more records than the threshold, which grows with
+	// the square root of the samples of an iteration, and swaps the D-trees of all cells.
+	class SDTree
+	{
+	public:
+		SDTree();
+		~SDTree();
+
+		// Starts over with a single cell and nothing learned.
+		void init(optix::Aabb const& bounds);
+
+		void setSpatialThreshold(const int records);      // Records of a cell before it is split in the first iteration, 4000 by default.
+		void setDirectionalThreshold(const float share);  // Share of the radiance of a D-tree leaf before it is split, 0.01 by default.
+
+		// The D-trees of the cell containing position.
+		DTreeWrapper const& getDTrees(const optix::float3& position) const;
+
+		// End of the training iteration iteration, which took 2^iteration samples per pixel.
+		void update(const int iteration);
+
+		// Exchanges the cells, the D-trees and the thresholds with other.
+		void swap(SDTree& other);
+
+		int getNumCells() const { return int(m_dTrees.size()); }
+		int getNumDTreeNodes() const; // Both D-trees of all cells.
+
+	private:
+		struct Node
+		{
+			int axis;
+			int children; // First of the two children, -1 for a leaf.
+			int dTrees;   // Index into m_dTrees of a leaf.
+		};
+
+		optix::float3 m_origin;
+		float         m_size;
+		int           m_spatialThreshold;
+		float         m_directionalThreshold;
+
+		std::vector<Node>         m_nodes;
+		std::vector<DTreeWrapper> m_dTrees;
+	};
+
+	// Vertex of a guided path. The incident radiance of the sampled direction is the rest of the path divided by the
+	// throughput after the vertex, it is recorded into the training D-tree of the cell when the path ends.
+	struct GuidingVertex
+	{
+		DTreeWrapper const* dTrees;
+		optix::float3       direction;
+		optix::float3       throughput;
+		optix::float3       radiance;
+		float               pdf;       // Of the mixture which sampled direction.
+	};
+}
+
+#endif // PATH_GUIDING_H
@@ -0,0 +1,36 @@
+#pragma once
+
+#ifndef RADIX_SORT_H
+#define RADIX_SORT_H
+
+#include <vector>
+
+namespace POptix
+{
+	class TileScheduler;
+
+	// Spreads the lower 10 bits of v so that there are two zero bits between each of them.
+	inline unsigned int expandBits(unsigned int v)
+	{
+		v &= 0x000003FF;
+		v = (v | (v << 16)) & 0x030000FF;
+		v = (v | (v <<  8)) & 0x0300F00F;
+		v = (v | (v <<  4)) & 0x030C30C3;
+		v = (v | (v <<  2)) & 0x09249249;
+		return v;
+	}
+
+	// 30 bit Morton code of three 10 bit coordinates.
+	inline unsigned int morton3D(unsigned int x, unsigned int y, unsigned int z)
+	{
+		return (expandBits(x) << 2) | (expandBits(y) << 1) | expandBits(z);
+	}
+
+	// Stable least significant digit radix sort of keys with their values, 8 bits per pass.
+	// Only the lower numBits of the keys are sorted. Each pass histograms and scatters fixed size chunks in parallel.
+	// The scratch vectors are resized as needed and can be kept around to avoid allocations.
+	void radixSort(TileScheduler& scheduler, std::vector<unsigned int>& keys, std::vector<int>& values, const int numBits,
+	               std::vector<unsigned int>& scratchKeys, std::vector<int>& scratchValues);
+}
+
+#endif // RADIX_SORT_H
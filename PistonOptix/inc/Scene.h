@@ -5,6 +5,7 @@
 
 #include <vector>
 #include <map>
+#include <string>
 
 #include "shaders\vertex_attributes.h"
 #include "shaders\material_parameter.h"
@@ -28,6 +29,7 @@ namespace POptix
 		int ID;
 		string filePath;
 		string name;
+		string builder; // Optional "builder" entry of the scene file: "Sbvh", "Bvh", "Trbvh", ... Empty uses the default.
 		vector<VertexAttributes> attributes;
 		vector<unsigned int> indices;
 	};
@@ -65,6 +67,7 @@ namespace POptix
 		map<unsigned int, Mesh*> mMeshList;
 		vector<Material*> mMaterialList;
 		vector<Light*> mLightList;
+		string mEnvironmentFile; // HDR image of the ENVIRONMENT light, at most one per scene.
 		PinholeCamera* mCamera;
 	};
 }
@@ -0,0 +1,93 @@
+#pragma once
+
+#ifndef SHARED_ARRAY_H
+#define SHARED_ARRAY_H
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "inc/MyAssert.h"
+
+namespace POptix
+{
+	// Array which either owns its elements or references elements inside a storage it keeps alive, e.g. a mapped
+	// BvhCache file. Readers don't see the difference. The vector style changes go through edit(), which copies
+	// referenced elements first. Copies always own their elements, so a copy made on a NUMA node is local to it.
+	template<typename T>
+	class SharedArray
+	{
+	public:
+		SharedArray()
+			: m_data(nullptr)
+			, m_size(0)
+		{
+		}
+
+		SharedArray(SharedArray const& other)
+			: m_owned(other.begin(), other.end())
+			, m_data(nullptr)
+			, m_size(0)
+		{
+		}
+
+		SharedArray& operator=(SharedArray const& other)
+		{
+			if (this != &other)
+			{
+				m_owned.assign(other.begin(), other.end());
+				m_storage.reset();
+			}
+			return *this;
+		}
+
+		// Points to size elements at data inside storage.
+		void reference(std::shared_ptr<const void> const& storage, const T* data, const size_t size)
+		{
+			MY_ASSERT(storage != nullptr);
+			std::vector<T>().swap(m_owned);
+			m_storage = storage;
+			m_data    = data;
+			m_size    = size;
+		}
+
+		// The owned elements for changes.
+		std::vector<T>& edit()
+		{
+			if (m_storage != nullptr)
+			{
+				m_owned.assign(m_data, m_data + m_size);
+				m_storage.reset();
+			}
+			return m_owned;
+		}
+
+		bool isReferenced() const { return m_storage != nullptr; }
+
+		const T* data() const  { return (m_storage != nullptr) ? m_data : m_owned.data(); }
+		size_t   size() const  { return (m_storage != nullptr) ? m_size : m_owned.size(); }
+		bool     empty() const { return size() == 0; }
+		const T* begin() const { return data(); }
+		const T* end() const   { return data() + size(); }
+
+		const T& operator[](const size_t i) const { return data()[i]; }
+		T&       operator[](const size_t i)       { return edit()[i]; }
+
+		void clear()                                   { m_storage.reset(); m_owned.clear(); }
+		void reserve(const size_t size)                { edit().reserve(size); }
+		void resize(const size_t size)                 { edit().resize(size); }
+		void resize(const size_t size, T const& value) { edit().resize(size, value); }
+		void push_back(T const& value)                 { edit().push_back(value); }
+
+		template<typename Iterator>
+		void assign(Iterator first, Iterator last) { edit().assign(first, last); }
+
+	private:
+		std::vector<T>              m_owned;
+		std::shared_ptr<const void> m_storage; // Keeps the referenced elements alive, null when owning.
+		const T*                    m_data;
+		size_t                      m_size;
+	};
+}
+
+#endif // SHARED_ARRAY_H
@@ -0,0 +1,730 @@
+#pragma once
+
+#ifndef SIMD_MATH_H
+#define SIMD_MATH_H
+
+#include <optix.h>
+#include <optixu/optixu_math_namespace.h>
+
+#include <cmath>
+#include <cstring>
+
+// Host side SIMD math for batches of shading points.
+// simd::Float<W>, simd::Int<W> and simd::Mask<W> hold W lanes, W being 4, 8 or 16. Each width is built from the widest
+// native registers which fit: AVX-512F gives 16 lanes, AVX2 8 lanes, SSE2 4 lanes, without any of them the lanes are plain
+// floats the compiler may vectorize on its own. A width wider than the native registers runs several of them side by side.
+// SIMD_WIDTH selects the width of the SimdFloat, SimdFloat3, SimdInt and SimdMask typedefs. It defaults to the widest
+// native width and can be overridden on the compiler command line.
+#if defined(__AVX512F__)
+#include <immintrin.h>
+#define SIMD_AVX512 1
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SIMD_AVX2 1
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && 2 <= _M_IX86_FP)
+#include <emmintrin.h>
+#define SIMD_SSE2 1
+#endif
+
+#if !defined(SIMD_WIDTH)
+#if defined(SIMD_AVX512)
+#define SIMD_WIDTH 16
+#elif defined(SIMD_AVX2)
+#define SIMD_WIDTH 8
+#else
+#define SIMD_WIDTH 4
+#endif
+#endif
+
+#if defined(_MSC_VER)
+#define SIMD_INLINE __forceinline
+#else
+#define SIMD_INLINE inline __attribute__((always_inline))
+#endif
+
+namespace POptix
+{
+	namespace simd
+	{
+		// Native register operations. Every backend offers the same set, Mask is the result of a comparison.
+		// min(a, b) and max(a, b) return b when a lane is unordered, like minps/maxps.
+		struct ScalarOps
+		{
+			static const int kWidth = 1;
+
+			typedef float Float;
+			typedef int   Int;
+			typedef bool  Mask;
+
+			static SIMD_INLINE Float set1(const float f)                 { return f; }
+			static SIMD_INLINE Float load(const float* p)                { return *p; }
+			static SIMD_INLINE void  store(float* p, const Float a)      { *p = a; }
+			static SIMD_INLINE Float add(const Float a, const Float b)   { return a + b; }
+			static SIMD_INLINE Float sub(const Float a, const Float b)   { return a - b; }
+			static SIMD_INLINE Float mul(const Float a, const Float b)   { return a * b; }
+			static SIMD_INLINE Float div(const Float a, const Float b)   { return a / b; }
+			static SIMD_INLINE Float min(const Float a, const Float b)   { return (a < b) ? a : b; }
+			static SIMD_INLINE Float max(const Float a, const Float b)   { return (a > b) ? a : b; }
+			static SIMD_INLINE Float sqrt(const Float a)                 { return sqrtf(a); }
+			static SIMD_INLINE Float select(const Mask m, const Float a, const Float b) { return m ? a : b; }
+
+			static SIMD_INLINE Mask cmpeq(const Float a, const Float b)  { return a == b; }
+			static SIMD_INLINE Mask cmpneq(const Float a, const Float b) { return !(a == b); }
+			static SIMD_INLINE Mask cmplt(const Float a, const Float b)  { return a < b; }
+			static SIMD_INLINE Mask cmple(const Float a, const Float b)  { return a <= b; }
+			static SIMD_INLINE Mask andm(const Mask a, const Mask b)     { return a && b; }
+			static SIMD_INLINE Mask orm(const Mask a, const Mask b)      { return a || b; }
+			static SIMD_INLINE Mask xorm(const Mask a, const Mask b)     { return a != b; }
+			static SIMD_INLINE Mask notm(const Mask a)                   { return !a; }
+			static SIMD_INLINE int  bits(const Mask a)                   { return a ? 1 : 0; }
+
+			static SIMD_INLINE Int   set1i(const int i)                  { return i; }
+			static SIMD_INLINE Int   addi(const Int a, const Int b)      { return int(unsigned(a) + unsigned(b)); }
+			static SIMD_INLINE Int   subi(const Int a, const Int b)      { return int(unsigned(a) - unsigned(b)); }
+			static SIMD_INLINE Int   andi(const Int a, const Int b)      { return a & b; }
+			static SIMD_INLINE Int   ori(const Int a, const Int b)       { return a | b; }
+			static SIMD_INLINE Int   xori(const Int a, const Int b)      { return a ^ b; }
+			static SIMD_INLINE Mask  cmpeqi(const Int a, const Int b)    { return a == b; }
+			template<int N> static SIMD_INLINE Int shl(const Int a)      { return int(unsigned(a) << N); }
+			template<int N> static SIMD_INLINE Int sra(const Int a)      { return a >> N; }
+
+			static SIMD_INLINE Int   roundToInt(const Float a)           { return int(lrintf(a)); }
+			static SIMD_INLINE Int   truncateToInt(const Float a)        { return int(a); }
+			static SIMD_INLINE Float toFloat(const Int a)                { return float(a); }
+			static SIMD_INLINE Int   castToInt(const Float a)            { Int i; memcpy(&i, &a, sizeof(Int)); return i; }
+			static SIMD_INLINE Float castToFloat(const Int a)            { Float f; memcpy(&f, &a, sizeof(Float)); return f; }
+		};
+
+#if defined(SIMD_SSE2)
+		struct SseOps
+		{
+			static const int kWidth = 4;
+
+			typedef __m128  Float;
+			typedef __m128i Int;
+			typedef __m128  Mask;
+
+			static SIMD_INLINE Float set1(const float f)                 { return _mm_set1_ps(f); }
+			static SIMD_INLINE Float load(const float* p)                { return _mm_loadu_ps(p); }
+			static SIMD_INLINE void  store(float* p, const Float a)      { _mm_storeu_ps(p, a); }
+			static SIMD_INLINE Float add(const Float a, const Float b)   { return _mm_add_ps(a, b); }
+			static SIMD_INLINE Float sub(const Float a, const Float b)   { return _mm_sub_ps(a, b); }
+			static SIMD_INLINE Float mul(const Float a, const Float b)   { return _mm_mul_ps(a, b); }
+			static SIMD_INLINE Float div(const Float a, const Float b)   { return _mm_div_ps(a, b); }
+			static SIMD_INLINE Float min(const Float a, const Float b)   { return _mm_min_ps(a, b); }
+			static SIMD_INLINE Float max(const Float a, const Float b)   { return _mm_max_ps(a, b); }
+			static SIMD_INLINE Float sqrt(const Float a)                 { return _mm_sqrt_ps(a); }
+			static SIMD_INLINE Float select(const Mask m, const Float a, const Float b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+
+			static SIMD_INLINE Mask cmpeq(const Float a, const Float b)  { return _mm_cmpeq_ps(a, b); }
+			static SIMD_INLINE Mask cmpneq(const Float a, const Float b) { return _mm_cmpneq_ps(a, b); }
+			static SIMD_INLINE Mask cmplt(const Float a, const Float b)  { return _mm_cmplt_ps(a, b); }
+			static SIMD_INLINE Mask cmple(const Float a, const Float b)  { return _mm_cmple_ps(a, b); }
+			static SIMD_INLINE Mask andm(const Mask a, const Mask b)     { return _mm_and_ps(a, b); }
+			static SIMD_INLINE Mask orm(const Mask a, const Mask b)      { return _mm_or_ps(a, b); }
+			static SIMD_INLINE Mask xorm(const Mask a, const Mask b)     { return _mm_xor_ps(a, b); }
+			static SIMD_INLINE Mask notm(const Mask a)                   { return _mm_xor_ps(a, _mm_castsi128_ps(_mm_set1_epi32(-1))); }
+			static SIMD_INLINE int  bits(const Mask a)                   { return _mm_movemask_ps(a); }
+
+			static SIMD_INLINE Int   set1i(const int i)                  { return _mm_set1_epi32(i); }
+			static SIMD_INLINE Int   addi(const Int a, const Int b)      { return _mm_add_epi32(a, b); }
+			static SIMD_INLINE Int   subi(const Int a, const Int b)      { return _mm_sub_epi32(a, b); }
+			static SIMD_INLINE Int   andi(const Int a, const Int b)      { return _mm_and_si128(a, b); }
+			static SIMD_INLINE Int   ori(const Int a, const Int b)       { return _mm_or_si128(a, b); }
+			static SIMD_INLINE Int   xori(const Int a, const Int b)      { return _mm_xor_si128(a, b); }
+			static SIMD_INLINE Mask  cmpeqi(const Int a, const Int b)    { return _mm_castsi128_ps(_mm_cmpeq_epi32(a, b)); }
+			template<int N> static SIMD_INLINE Int shl(const Int a)      { return _mm_slli_epi32(a, N); }
+			template<int N> static SIMD_INLINE Int sra(const Int a)      { return _mm_srai_epi32(a, N); }
+
+			static SIMD_INLINE Int   roundToInt(const Float a)           { return _mm_cvtps_epi32(a); }
+			static SIMD_INLINE Int   truncateToInt(const Float a)        { return _mm_cvttps_epi32(a); }
+			static SIMD_INLINE Float toFloat(const Int a)                { return _mm_cvtepi32_ps(a); }
+			static SIMD_INLINE Int   castToInt(const Float a)            { return _mm_castps_si128(a); }
+			static SIMD_INLINE Float castToFloat(const Int a)            { return _mm_castsi128_ps(a); }
+		};
+#endif
+
+#if defined(SIMD_AVX2)
+		struct Avx2Ops
+		{
+			static const int kWidth = 8;
+
+			typedef __m256  Float;
+			typedef __m256i Int;
+			typedef __m256  Mask;
+
+			static SIMD_INLINE Float set1(const float f)                 { return _mm256_set1_ps(f); }
+			static SIMD_INLINE Float load(const float* p)                { return _mm256_loadu_ps(p); }
+			static SIMD_INLINE void  store(float* p, const Float a)      { _mm256_storeu_ps(p, a); }
+			static SIMD_INLINE Float add(const Float a, const Float b)   { return _mm256_add_ps(a, b); }
+			static SIMD_INLINE Float sub(const Float a, const Float b)   { return _mm256_sub_ps(a, b); }
+			static SIMD_INLINE Float mul(const Float a, const Float b)   { return _mm256_mul_ps(a, b); }
+			static SIMD_INLINE Float div(const Float a, const Float b)   { return _mm256_div_ps(a, b); }
+			static SIMD_INLINE Float min(const Float a, const Float b)   { return _mm256_min_ps(a, b); }
+			static SIMD_INLINE Float max(const Float a, const Float b)   { return _mm256_max_ps(a, b); }
+			static SIMD_INLINE Float sqrt(const Float a)                 { return _mm256_sqrt_ps(a); }
+			static SIMD_INLINE Float select(const Mask m, const Float a, const Float b) { return _mm256_blendv_ps(b, a, m); }
+
+			static SIMD_INLINE Mask cmpeq(const Float a, const Float b)  { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+			static SIMD_INLINE Mask cmpneq(const Float a, const Float b) { return _mm256_cmp_ps(a, b, _CMP_NEQ_UQ); }
+			static SIMD_INLINE Mask cmplt(const Float a, const Float b)  { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+			static SIMD_INLINE Mask cmple(const Float a, const Float b)  { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+			static SIMD_INLINE Mask andm(const Mask a, const Mask b)     { return _mm256_and_ps(a, b); }
+			static SIMD_INLINE Mask orm(const Mask a, const Mask b)      { return _mm256_or_ps(a, b); }
+			static SIMD_INLINE Mask xorm(const Mask a, const Mask b)     { return _mm256_xor_ps(a, b); }
+			static SIMD_INLINE Mask notm(const Mask a)                   { return _mm256_xor_ps(a, _mm256_castsi256_ps(_mm256_set1_epi32(-1))); }
+			static SIMD_INLINE int  bits(const Mask a)                   { return _mm256_movemask_ps(a); }
+
+			static SIMD_INLINE Int   set1i(const int i)                  { return _mm256_set1_epi32(i); }
+			static SIMD_INLINE Int   addi(const Int a, const Int b)      { return _mm256_add_epi32(a, b); }
+			static SIMD_INLINE Int   subi(const Int a, const Int b)      { return _mm256_sub_epi32(a, b); }
+			static SIMD_INLINE Int   andi(const Int a, const Int b)      { return _mm256_and_si256(a, b); }
+			static SIMD_INLINE Int   ori(const Int a, const Int b)       { return _mm256_or_si256(a, b); }
+			static SIMD_INLINE Int   xori(const Int a, const Int b)      { return _mm256_xor_si256(a, b); }
+			static SIMD_INLINE Mask  cmpeqi(const Int a, const Int b)    { return _mm256_castsi256_ps(_mm256_cmpeq_epi32(a, b)); }
+			template<int N> static SIMD_INLINE Int shl(const Int a)      { return _mm256_slli_epi32(a, N); }
+			template<int N> static SIMD_INLINE Int sra(const Int a)      { return _mm256_srai_epi32(a, N); }
+
+			static SIMD_INLINE Int   roundToInt(const Float a)           { return _mm256_cvtps_epi32(a); }
+			static SIMD_INLINE Int   truncateToInt(const Float a)        { return _mm256_cvttps_epi32(a); }
+			static SIMD_INLINE Float toFloat(const Int a)                { return _mm256_cvtepi32_ps(a); }
+			static SIMD_INLINE Int   castToInt(const Float a)            { return _mm256_castps_si256(a); }
+			static SIMD_INLINE Float castToFloat(const Int a)            { return _mm256_castsi256_ps(a); }
+		};
+#endif
+
+#if defined(SIMD_AVX512)
+		// AVX-512F only, the float bit operations of AVX-512DQ are done on the integer registers.
+		struct Avx512Ops
+		{
+			static const int kWidth = 16;
+
+			typedef __m512    Float;
+			typedef __m512i   Int;
+			typedef __mmask16 Mask;
+
+			static SIMD_INLINE Float set1(const float f)                 { return _mm512_set1_ps(f); }
+			static SIMD_INLINE Float load(const float* p)                { return _mm512_loadu_ps(p); }
+			static SIMD_INLINE void  store(float* p, const Float a)      { _mm512_storeu_ps(p, a); }
+			static SIMD_INLINE Float add(const Float a, const Float b)   { return _mm512_add_ps(a, b); }
+			static SIMD_INLINE Float sub(const Float a, const Float b)   { return _mm512_sub_ps(a, b); }
+			static SIMD_INLINE Float mul(const Float a, const Float b)   { return _mm512_mul_ps(a, b); }
+			static SIMD_INLINE Float div(const Float a, const Float b)   { return _mm512_div_ps(a, b); }
+			static SIMD_INLINE Float min(const Float a, const Float b)   { return _mm512_min_ps(a, b); }
+			static SIMD_INLINE Float max(const Float a, const Float b)   { return _mm512_max_ps(a, b); }
+			static SIMD_INLINE Float sqrt(const Float a)                 { return _mm512_sqrt_ps(a); }
+			static SIMD_INLINE Float select(const Mask m, const Float a, const Float b) { return _mm512_mask_blend_ps(m, b, a); }
+
+			static SIMD_INLINE Mask cmpeq(const Float a, const Float b)  { return _mm512_cmp_ps_mask(a, b, _CMP_EQ_OQ); }
+			static SIMD_INLINE Mask cmpneq(const Float a, const Float b) { return _mm512_cmp_ps_mask(a, b, _CMP_NEQ_UQ); }
+			static SIMD_INLINE Mask cmplt(const Float a, const Float b)  { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+			static SIMD_INLINE Mask cmple(const Float a, const Float b)  { return _mm512_cmp_ps_mask(a, b, _CMP_LE_OQ); }
+			static SIMD_INLINE Mask andm(const Mask a, const Mask b)     { return Mask(a & b); }
+			static SIMD_INLINE Mask orm(const Mask a, const Mask b)      { return Mask(a | b); }
+			static SIMD_INLINE Mask xorm(const Mask a, const Mask b)     { return Mask(a ^ b); }
+			static SIMD_INLINE Mask notm(const Mask a)                   { return Mask(~a); }
+			static SIMD_INLINE int  bits(const Mask a)                   { return int(a); }
+
+			static SIMD_INLINE Int   set1i(const int i)                  { return _mm512_set1_epi32(i); }
+			static SIMD_INLINE Int   addi(const Int a, const Int b)      { return _mm512_add_epi32(a, b); }
+			static SIMD_INLINE Int   subi(const Int a, const Int b)      { return _mm512_sub_epi32(a, b); }
+			static SIMD_INLINE Int   andi(const Int a, const Int b)      { return _mm512_and_si512(a, b); }
+			static SIMD_INLINE Int   ori(const Int a, const Int b)       { return _mm512_or_si512(a, b); }
+			static SIMD_INLINE Int   xori(const Int a, const Int b)      { return _mm512_xor_si512(a, b); }
+			static SIMD_INLINE Mask  cmpeqi(const Int a, const Int b)    { return _mm512_cmpeq_epi32_mask(a, b); }
+			template<int N> static SIMD_INLINE Int shl(const Int a)      { return _mm512_slli_epi32(a, N); }
+			template<int N> static SIMD_INLINE Int sra(const Int a)      { return _mm512_srai_epi32(a, N); }
+
+			static SIMD_INLINE Int   roundToInt(const Float a)           { return _mm512_cvtps_epi32(a); }
+			static SIMD_INLINE Int   truncateToInt(const Float a)        { return _mm512_cvttps_epi32(a); }
+			static SIMD_INLINE Float toFloat(const Int a)                { return _mm512_cvtepi32_ps(a); }
+			static SIMD_INLINE Int   castToInt(const Float a)            { return _mm512_castps_si512(a); }
+			static SIMD_INLINE Float castToFloat(const Int a)            { return _mm512_castsi512_ps(a); }
+		};
+#endif
+
+		// Widest native registers for W lanes.
+		template<int W> struct NativeOps;
+
+#if defined(SIMD_SSE2)
+		template<> struct NativeOps<4>  { typedef SseOps Ops; };
+#else
+		template<> struct NativeOps<4>  { typedef ScalarOps Ops; };
+#endif
+
+#if defined(SIMD_AVX2)
+		template<> struct NativeOps<8>  { typedef Avx2Ops Ops; };
+#else
+		template<> struct NativeOps<8>  { typedef NativeOps<4>::Ops Ops; };
+#endif
+
+#if defined(SIMD_AVX512)
+		template<> struct NativeOps<16> { typedef Avx512Ops Ops; };
+#else
+		template<> struct NativeOps<16> { typedef NativeOps<8>::Ops Ops; };
+#endif
+
+// The parts have to be unrolled, otherwise the native registers of widths wider than the hardware live in memory.
+#if defined(__clang__)
+#define SIMD_PARTS _Pragma("unroll") for (int i = 0; i < kParts; ++i)
+#elif defined(__GNUC__)
+#define SIMD_PARTS _Pragma("GCC unroll 16") for (int i = 0; i < kParts; ++i)
+#else
+#define SIMD_PARTS for (int i = 0; i < kParts; ++i)
+#endif
+
+		template<int W> class Float;
+		template<int W> class Int;
+
+		// Result of a lane wise comparison. Selects lanes in select() and the masked operations.
+		template<int W>
+		class Mask
+		{
+		public:
+			typedef typename NativeOps<W>::Ops Ops;
+			static const int kWidth = W;
+			static const int kParts = W / Ops::kWidth;
+
+			SIMD_INLINE Mask()
+			{
+			}
+
+			SIMD_INLINE explicit Mask(const bool value)
+			{
+				const typename Ops::Float zero = Ops::set1(0.0f);
+				SIMD_PARTS v[i] = value ? Ops::cmpeq(zero, zero) : Ops::cmplt(zero, zero);
+			}
+
+			// Bit i is lane i.
+			SIMD_INLINE int bits() const
+			{
+				int result = 0;
+				SIMD_PARTS result |= Ops::bits(v[i]) << (i * Ops::kWidth);
+				return result;
+			}
+
+			SIMD_INLINE bool any() const  { return bits() != 0; }
+			SIMD_INLINE bool all() const  { return bits() == int((1ull << W) - 1); }
+			SIMD_INLINE bool none() const { return bits() == 0; }
+
+			SIMD_INLINE bool operator[](const int lane) const { return (bits() >> lane) & 1; }
+
+			friend SIMD_INLINE Mask operator&(Mask const& a, Mask const& b) { Mask r; SIMD_PARTS r.v[i] = Ops::andm(a.v[i], b.v[i]); return r; }
+			friend SIMD_INLINE Mask operator|(Mask const& a, Mask const& b) { Mask r; SIMD_PARTS r.v[i] = Ops::orm(a.v[i], b.v[i]);  return r; }
+			friend SIMD_INLINE Mask operator^(Mask const& a, Mask const& b) { Mask r; SIMD_PARTS r.v[i] = Ops::xorm(a.v[i], b.v[i]); return r; }
+			friend SIMD_INLINE Mask operator~(Mask const& a)                { Mask r; SIMD_PARTS r.v[i] = Ops::notm(a.v[i]);          return r; }
+
+			typename Ops::Mask v[kParts];
+		};
+
+		template<int W>
+		class Int
+		{
+		public:
+			typedef typename NativeOps<W>::Ops Ops;
+			static const int kWidth = W;
+			static const int kParts = W / Ops::kWidth;
+
+			SIMD_INLINE Int()
+			{
+			}
+
+			SIMD_INLINE Int(const int value)
+			{
+				SIMD_PARTS v[i] = Ops::set1i(value);
+			}
+
+			SIMD_INLINE Float<W> toFloat() const;
+			SIMD_INLINE Float<W> castToFloat() const;
+
+			template<int N> SIMD_INLINE Int shl() const { Int r; SIMD_PARTS r.v[i] = Ops::template shl<N>(v[i]); return r; }
+			template<int N> SIMD_INLINE Int sra() const { Int r; SIMD_PARTS r.v[i] = Ops::template sra<N>(v[i]); return r; }
+
+			friend SIMD_INLINE Int operator+(Int const& a, Int const& b) { Int r; SIMD_PARTS r.v[i] = Ops::addi(a.v[i], b.v[i]); return r; }
+			friend SIMD_INLINE Int operator-(Int const& a, Int const& b) { Int r; SIMD_PARTS r.v[i] = Ops::subi(a.v[i], b.v[i]); return r; }
+			friend SIMD_INLINE Int operator&(Int const& a, Int const& b) { Int r; SIMD_PARTS r.v[i] = Ops::andi(a.v[i], b.v[i]); return r; }
+			friend SIMD_INLINE Int operator|(Int const& a, Int const& b) { Int r; SIMD_PARTS r.v[i] = Ops::ori(a.v[i], b.v[i]);  return r; }
+			friend SIMD_INLINE Int operator^(Int const& a, Int const& b) { Int r; SIMD_PARTS r.v[i] = Ops::xori(a.v[i], b.v[i]); return r; }
+
+			friend SIMD_INLINE Mask<W> operator==(Int const& a, Int const& b) { Mask<W> r; SIMD_PARTS r.v[i] = Ops::cmpeqi(a.v[i], b.v[i]); return r; }
+
+			typename Ops::Int v[kParts];
+		};
+
+		template<int W>
+		class Float
+		{
+		public:
+			typedef typename NativeOps<W>::Ops Ops;
+			static const int kWidth = W;
+			static const int kParts = W / Ops::kWidth;
+
+			SIMD_INLINE Float()
+			{
+			}
+
+			// Broadcast.
+			SIMD_INLINE Float(const float value)
+			{
+				SIMD_PARTS v[i] = Ops::set1(value);
+			}
+
+			// W consecutive floats, no alignment needed.
+			static SIMD_INLINE Float load(const float* p)
+			{
+				Float r;
+				SIMD_PARTS r.v[i] = Ops::load(p + i * Ops::kWidth);
+				return r;
+			}
+
+			SIMD_INLINE void store(float* p) const
+			{
+				SIMD_PARTS Ops::store(p + i * Ops::kWidth, v[i]);
+			}
+
+			// The first count lanes, the others are zero. For the tail of an array.
+			static SIMD_INLINE Float loadPartial(const float* p, const int count)
+			{
+				float lanes[W] = {};
+				for (int lane = 0; lane < count && lane < W; ++lane)
+				{
+					lanes[lane] = p[lane];
+				}
+				return load(lanes);
+			}
+
+			SIMD_INLINE void storePartial(float* p, const int count) const
+			{
+				float lanes[W];
+				store(lanes);
+				for (int lane = 0; lane < count && lane < W; ++lane)
+				{
+					p[lane] = lanes[lane];
+				}
+			}
+
+			// 0, 1, 2, ... W - 1.
+			static SIMD_INLINE Float laneIndices()
+			{
+				float lanes[W];
+				for (int lane = 0; lane < W; ++lane)
+				{
+					lanes[lane] = float(lane);
+				}
+				return load(lanes);
+			}
+
+			SIMD_INLINE float operator[](const int lane) const
+			{
+				float lanes[W];
+				store(lanes);
+				return lanes[lane];
+			}
+
+			SIMD_INLINE Int<W> castToInt() const     { Int<W> r; SIMD_PARTS r.v[i] = Ops::castToInt(v[i]);     return r; }
+			SIMD_INLINE Int<W> roundToInt() const    { Int<W> r; SIMD_PARTS r.v[i] = Ops::roundToInt(v[i]);    return r; } // Round to nearest even.
+			SIMD_INLINE Int<W> truncateToInt() const { Int<W> r; SIMD_PARTS r.v[i] = Ops::truncateToInt(v[i]); return r; }
+
+			// Masked assignment, lanes outside the mask keep their value.
+			SIMD_INLINE Float& assign(Mask<W> const& m, Float const& a)
+			{
+				SIMD_PARTS v[i] = Ops::select(m.v[i], a.v[i], v[i]);
+				return *this;
+			}
+
+			SIMD_INLINE Float& operator+=(Float const& a) { SIMD_PARTS v[i] = Ops::add(v[i], a.v[i]); return *this; }
+			SIMD_INLINE Float& operator-=(Float const& a) { SIMD_PARTS v[i] = Ops::sub(v[i], a.v[i]); return *this; }
+			SIMD_INLINE Float& operator*=(Float const& a) { SIMD_PARTS v[i] = Ops::mul(v[i], a.v[i]); return *this; }
+			SIMD_INLINE Float& operator/=(Float const& a) { SIMD_PARTS v[i] = Ops::div(v[i], a.v[i]); return *this; }
+
+			friend SIMD_INLINE Float operator+(Float const& a, Float const& b) { Float r; SIMD_PARTS r.v[i] = Ops::add(a.v[i], b.v[i]); return r; }
+			friend SIMD_INLINE Float operator-(Float const& a, Float const& b) { Float r; SIMD_PARTS r.v[i] = Ops::sub(a.v[i], b.v[i]); return r; }
+			friend SIMD_INLINE Float operator*(Float const& a, Float const& b) { Float r; SIMD_PARTS r.v[i] = Ops::mul(a.v[i], b.v[i]); return r; }
+			friend SIMD_INLINE Float operator/(Float const& a, Float const& b) { Float r; SIMD_PARTS r.v[i] = Ops::div(a.v[i], b.v[i]); return r; }
+			friend SIMD_INLINE Float operator-(Float const& a)                 { return (a.castToInt() ^ Int<W>(int(0x80000000u))).castToFloat(); }
+
+			friend SIMD_INLINE Mask<W> operator==(Float const& a, Float const& b) { Mask<W> r; SIMD_PARTS r.v[i] = Ops::cmpeq(a.v[i], b.v[i]);  return r; }
+			friend SIMD_INLINE Mask<W> operator!=(Float const& a, Float const& b) { Mask<W> r; SIMD_PARTS r.v[i] = Ops::cmpneq(a.v[i], b.v[i]); return r; }
+			friend SIMD_INLINE Mask<W> operator<(Float const& a, Float const& b)  { Mask<W> r; SIMD_PARTS r.v[i] = Ops::cmplt(a.v[i], b.v[i]);  return r; }
+			friend SIMD_INLINE Mask<W> operator<=(Float const& a, Float const& b) { Mask<W> r; SIMD_PARTS r.v[i] = Ops::cmple(a.v[i], b.v[i]);  return r; }
+			friend SIMD_INLINE Mask<W> operator>(Float const& a, Float const& b)  { return b < a; }
+			friend SIMD_INLINE Mask<W> operator>=(Float const& a, Float const& b) { return b <= a; }
+
+			friend SIMD_INLINE Float select(Mask<W> const& m, Float const& a, Float const& b) { Float r; SIMD_PARTS r.v[i] = Ops::select(m.v[i], a.v[i], b.v[i]); return r; }
+
+			// a where the mask is set, 0 elsewhere.
+			friend SIMD_INLINE Float masked(Mask<W> const& m, Float const& a) { return select(m, a, Float(0.0f)); }
+
+			friend SIMD_INLINE Float min(Float const& a, Float const& b) { Float r; SIMD_PARTS r.v[i] = Ops::min(a.v[i], b.v[i]); return r; }
+			friend SIMD_INLINE Float max(Float const& a, Float const& b) { Float r; SIMD_PARTS r.v[i] = Ops::max(a.v[i], b.v[i]); return r; }
+			friend SIMD_INLINE Float sqrt(Float const& a)                { Float r; SIMD_PARTS r.v[i] = Ops::sqrt(a.v[i]);         return r; }
+			friend SIMD_INLINE Float abs(Float const& a)                 { return (a.castToInt() & Int<W>(0x7fffffff)).castToFloat(); }
+			friend SIMD_INLINE Float clamp(Float const& a, Float const& lo, Float const& hi) { return min(max(a, lo), hi); }
+
+			// Magnitude of a with the sign of b.
+			friend SIMD_INLINE Float copysign(Float const& a, Float const& b)
+			{
+				return ((a.castToInt() & Int<W>(0x7fffffff)) | (b.castToInt() & Int<W>(int(0x80000000u)))).castToFloat();
+			}
+
+			typename Ops::Float v[kParts];
+		};
+
+		template<int W>
+		SIMD_INLINE Float<W> Int<W>::toFloat() const
+		{
+			Float<W> r;
+			SIMD_PARTS r.v[i] = Ops::toFloat(v[i]);
+			return r;
+		}
+
+		template<int W>
+		SIMD_INLINE Float<W> Int<W>::castToFloat() const
+		{
+			Float<W> r;
+			SIMD_PARTS r.v[i] = Ops::castToFloat(v[i]);
+			return r;
+		}
+
+#undef SIMD_PARTS
+
+		// Structure of arrays float3, lane i is one optix::float3.
+		template<int W>
+		class Float3
+		{
+		public:
+			SIMD_INLINE Float3()
+			{
+			}
+
+			SIMD_INLINE Float3(Float<W> const& a, Float<W> const& b, Float<W> const& c)
+				: x(a)
+				, y(b)
+				, z(c)
+			{
+			}
+
+			// Broadcast.
+			SIMD_INLINE Float3(const optix::float3& f)
+				: x(f.x)
+				, y(f.y)
+				, z(f.z)
+			{
+			}
+
+			// W consecutive optix::float3.
+			static SIMD_INLINE Float3 loadAos(const optix::float3* p)
+			{
+				float lanes[3][W];
+				for (int lane = 0; lane < W; ++lane)
+				{
+					lanes[0][lane] = p[lane].x;
+					lanes[1][lane] = p[lane].y;
+					lanes[2][lane] = p[lane].z;
+				}
+				return Float3(Float<W>::load(lanes[0]), Float<W>::load(lanes[1]), Float<W>::load(lanes[2]));
+			}
+
+			SIMD_INLINE void storeAos(optix::float3* p) const
+			{
+				float lanes[3][W];
+				x.store(lanes[0]);
+				y.store(lanes[1]);
+				z.store(lanes[2]);
+				for (int lane = 0; lane < W; ++lane)
+				{
+					p[lane] = optix::make_float3(lanes[0][lane], lanes[1][lane], lanes[2][lane]);
+				}
+			}
+
+			SIMD_INLINE optix::float3 operator[](const int lane) const
+			{
+				return optix::make_float3(x[lane], y[lane], z[lane]);
+			}
+
+			SIMD_INLINE Float3& assign(Mask<W> const& m, Float3 const& a)
+			{
+				x.assign(m, a.x);
+				y.assign(m, a.y);
+				z.assign(m, a.z);
+				return *this;
+			}
+
+			SIMD_INLINE Float3& operator+=(Float3 const& a) { x += a.x; y += a.y; z += a.z; return *this; }
+			SIMD_INLINE Float3& operator-=(Float3 const& a) { x -= a.x; y -= a.y; z -= a.z; return *this; }
+			SIMD_INLINE Float3& operator*=(Float<W> const& s) { x *= s; y *= s; z *= s; return *this; }
+
+			friend SIMD_INLINE Float3 operator+(Float3 const& a, Float3 const& b)   { return Float3(a.x + b.x, a.y + b.y, a.z + b.z); }
+			friend SIMD_INLINE Float3 operator-(Float3 const& a, Float3 const& b)   { return Float3(a.x - b.x, a.y - b.y, a.z - b.z); }
+			friend SIMD_INLINE Float3 operator*(Float3 const& a, Float3 const& b)   { return Float3(a.x * b.x, a.y * b.y, a.z * b.z); }
+			friend SIMD_INLINE Float3 operator*(Float3 const& a, Float<W> const& s) { return Float3(a.x * s, a.y * s, a.z * s); }
+			friend SIMD_INLINE Float3 operator*(Float<W> const& s, Float3 const& a) { return Float3(s * a.x, s * a.y, s * a.z); }
+			friend SIMD_INLINE Float3 operator/(Float3 const& a, Float<W> const& s) { return Float3(a.x / s, a.y / s, a.z / s); }
+			friend SIMD_INLINE Float3 operator-(Float3 const& a)                    { return Float3(-a.x, -a.y, -a.z); }
+
+			friend SIMD_INLINE Float<W> dot(Float3 const& a, Float3 const& b)  { return a.x * b.x + a.y * b.y + a.z * b.z; }
+			friend SIMD_INLINE Float3   cross(Float3 const& a, Float3 const& b) { return Float3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x); }
+			friend SIMD_INLINE Float<W> length(Float3 const& a)                { return sqrt(dot(a, a)); }
+
+			// Same expression as optix::normalize().
+			friend SIMD_INLINE Float3 normalize(Float3 const& a)
+			{
+				const Float<W> invLength = Float<W>(1.0f) / sqrt(dot(a, a));
+				return a * invLength;
+			}
+
+			friend SIMD_INLINE Float3 select(Mask<W> const& m, Float3 const& a, Float3 const& b)
+			{
+				return Float3(select(m, a.x, b.x), select(m, a.y, b.y), select(m, a.z, b.z));
+			}
+
+			Float<W> x;
+			Float<W> y;
+			Float<W> z;
+		};
+
+		// Vectorized transcendentals after the single precision Cephes library.
+		// They stay within a few ulp of the C library in the ranges shading needs: exp, log and pow over the full float range
+		// (denormal inputs of log are flushed to the smallest normal number), sin and cos for |x| < 8192.
+
+		template<int W>
+		SIMD_INLINE Float<W> exp(Float<W> const& x)
+		{
+			// Clamped so the exponent of the result scale stays in range, the results underflow into the denormals like expf().
+			const Float<W> xc = clamp(x, Float<W>(-104.0f), Float<W>(88.8f));
+
+			const Int<W>   n  = (xc * Float<W>(1.44269504088896341f)).roundToInt();
+			const Float<W> fn = n.toFloat();
+			Float<W> r = xc - fn * Float<W>(0.693359375f);
+			r = r - fn * Float<W>(-2.12194440e-4f);
+
+			const Float<W> z = r * r;
+			Float<W> p = Float<W>(1.9875691500e-4f);
+			p = p * r + Float<W>(1.3981999507e-3f);
+			p = p * r + Float<W>(8.3334519073e-3f);
+			p = p * r + Float<W>(4.1665795894e-2f);
+			p = p * r + Float<W>(1.6666665459e-1f);
+			p = p * r + Float<W>(5.0000001201e-1f);
+			p = p * z + r + Float<W>(1.0f);
+
+			// 2^n in two factors, n alone can be out of the normal exponent range.
+			const Int<W> n1 = n.template sra<1>();
+			const Int<W> n2 = n - n1;
+			p = p * (n1 + Int<W>(127)).template shl<23>().castToFloat();
+			p = p * (n2 + Int<W>(127)).template shl<23>().castToFloat();
+
+			p.assign(x > Float<W>(88.72283905f), Float<W>(INFINITY));
+			p.assign(x != x, x);
+			return p;
+		}
+
+		template<int W>
+		SIMD_INLINE Float<W> log(Float<W> const& x)
+		{
+			const Float<W> xn = max(x, Float<W>(1.17549435e-38f));
+
+			// x = m * 2^e with m in [0.5, 1).
+			const Int<W> bits = xn.castToInt();
+			Float<W> e = (bits.template sra<23>() - Int<W>(126)).toFloat();
+			Float<W> m = ((bits & Int<W>(0x007fffff)) | Int<W>(0x3f000000)).castToFloat();
+
+			// Shift m into [sqrt(0.5), sqrt(2)).
+			const Mask<W> small = m < Float<W>(0.707106781186547524f);
+			e = e - masked(small, Float<W>(1.0f));
+			m = m - Float<W>(1.0f) + masked(small, m);
+
+			const Float<W> z = m * m;
+			Float<W> p = Float<W>(7.0376836292e-2f);
+			p = p * m + Float<W>(-1.1514610310e-1f);
+			p = p * m + Float<W>(1.1676998740e-1f);
+			p = p * m + Float<W>(-1.2420140846e-1f);
+			p = p * m + Float<W>(1.4249322787e-1f);
+			p = p * m + Float<W>(-1.6668057665e-1f);
+			p = p * m + Float<W>(2.0000714765e-1f);
+			p = p * m + Float<W>(-2.4999993993e-1f);
+			p = p * m + Float<W>(3.3333331174e-1f);
+			p = p * m * z;
+
+			p = p + e * Float<W>(-2.12194440e-4f);
+			p = p - Float<W>(0.5f) * z;
+			Float<W> r = m + p + e * Float<W>(0.693359375f);
+
+			r.assign(x == Float<W>(INFINITY), x);
+			r.assign(x == Float<W>(0.0f), Float<W>(-INFINITY));
+			r.assign((x < Float<W>(0.0f)) | (x != x), Float<W>(NAN));
+			return r;
+		}
+
+		// x^y for x >= 0. Negative x give NaN, also for integer y.
+		template<int W>
+		SIMD_INLINE Float<W> pow(Float<W> const& x, Float<W> const& y)
+		{
+			Float<W> r = exp(y * log(x));
+			r.assign(y == Float<W>(0.0f), Float<W>(1.0f));
+			return r;
+		}
+
+		template<int W>
+		SIMD_INLINE void sincos(Float<W> const& x, Float<W>& s, Float<W>& c)
+		{
+			const Int<W> signBit(int(0x80000000u));
+
+			const Float<W> ax = abs(x);
+
+			// Octant, rounded up to even, so the reduced argument is in [-pi/4, pi/4].
+			Int<W> j = (ax * Float<W>(1.27323954473516f)).truncateToInt();
+			j = (j + Int<W>(1)) & Int<W>(~1);
+			const Float<W> fj = j.toFloat();
+
+			Float<W> r = ax - fj * Float<W>(0.78515625f);
+			r = r - fj * Float<W>(2.4187564849853515625e-4f);
+			r = r - fj * Float<W>(3.77489497744594108e-8f);
+
+			const Int<W>  sinSign = ((j & Int<W>(4)).template shl<29>()) ^ (x.castToInt() & signBit);
+			const Int<W>  cosSign = ((j - Int<W>(2)) ^ Int<W>(-1)) & Int<W>(4);
+			const Mask<W> sinPoly = (j & Int<W>(2)) == Int<W>(0);
+
+			const Float<W> z = r * r;
+
+			Float<W> pc = Float<W>(2.443315711809948e-5f);
+			pc = pc * z + Float<W>(-1.388731625493765e-3f);
+			pc = pc * z + Float<W>(4.166664568298827e-2f);
+			pc = pc * z * z - Float<W>(0.5f) * z + Float<W>(1.0f);
+
+			Float<W> ps = Float<W>(-1.9515295891e-4f);
+			ps = ps * z + Float<W>(8.3321608736e-3f);
+			ps = ps * z + Float<W>(-1.6666654611e-1f);
+			ps = ps * z * r + r;
+
+			s = (select(sinPoly, ps, pc).castToInt() ^ sinSign).castToFloat();
+			c = (select(sinPoly, pc, ps).castToInt() ^ cosSign.template shl<29>()).castToFloat();
+		}
+
+		template<int W>
+		SIMD_INLINE Float<W> sin(Float<W> const& x)
+		{
+			Float<W> s;
+			Float<W> c;
+			sincos(x, s, c);
+			return s;
+		}
+
+		template<int W>
+		SIMD_INLINE Float<W> cos(Float<W> const& x)
+		{
+			Float<W> s;
+			Float<W> c;
+			sincos(x, s, c);
+			return c;
+		}
+	}
+
+	typedef simd::Float<SIMD_WIDTH>  SimdFloat;
+	typedef simd::Float3<SIMD_WIDTH> SimdFloat3;
+	typedef simd::Int<SIMD_WIDTH>    SimdInt;
+	typedef simd::Mask<SIMD_WIDTH>   SimdMask;
+}
+
+#endif // SIMD_MATH_H
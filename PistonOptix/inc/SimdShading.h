@@ -0,0 +1,163 @@
+#pragma once
+
+#ifndef SIMD_SHADING_H
+#define SIMD_SHADING_H
+
+#include "inc/SimdMath.h"
+
+// The helpers of shaders/shader_common.h over simd::Float<W> lanes, so batches of shading points are evaluated together.
+// The expressions follow the scalar versions step by step. Only the transcendentals differ, see SimdMath.h.
+
+namespace POptix
+{
+	namespace simd
+	{
+		// Tangent-Bitangent-Normal orthonormal space, see ::TBN.
+		template<int W>
+		struct TBN
+		{
+			SIMD_INLINE TBN()
+			{
+			}
+
+			SIMD_INLINE TBN(Float3<W> const& n)
+				: normal(n)
+			{
+				const Mask<W> xDominant = abs(normal.z) < abs(normal.x);
+				bitangent = Float3<W>(select(xDominant, -normal.y, Float<W>(0.0f)),
+				                      select(xDominant, normal.x, -normal.z),
+				                      select(xDominant, Float<W>(0.0f), normal.y));
+
+				bitangent = normalize(bitangent);
+				tangent   = cross(bitangent, normal);
+			}
+
+			SIMD_INLINE TBN(Float3<W> const& t, Float3<W> const& b, Float3<W> const& n)
+				: tangent(t)
+				, bitangent(b)
+				, normal(n)
+			{
+			}
+
+			// Normal is kept, tangent and bitangent are calculated. Normal must be normalized.
+			SIMD_INLINE TBN(Float3<W> const& tangentReference, Float3<W> const& n)
+				: normal(n)
+			{
+				bitangent = normalize(cross(normal, tangentReference));
+				tangent   = cross(bitangent, normal);
+			}
+
+			SIMD_INLINE void negate()
+			{
+				tangent   = -tangent;
+				bitangent = -bitangent;
+				normal    = -normal;
+			}
+
+			SIMD_INLINE Float3<W> transform(Float3<W> const& p) const
+			{
+				return Float3<W>(dot(p, tangent), dot(p, bitangent), dot(p, normal));
+			}
+
+			SIMD_INLINE Float3<W> inverse_transform(Float3<W> const& p) const
+			{
+				return p.x * tangent + p.y * bitangent + p.z * normal;
+			}
+
+			Float3<W> tangent;
+			Float3<W> bitangent;
+			Float3<W> normal;
+		};
+
+		template<int W>
+		SIMD_INLINE Float<W> luminance(Float3<W> const& rgb)
+		{
+			return rgb.x * Float<W>(0.30f) + rgb.y * Float<W>(0.59f) + rgb.z * Float<W>(0.11f);
+		}
+
+		template<int W>
+		SIMD_INLINE Float<W> intensity(Float3<W> const& rgb)
+		{
+			return (rgb.x + rgb.y + rgb.z) * Float<W>(0.3333333333f);
+		}
+
+		template<int W>
+		SIMD_INLINE Float<W> powerHeuristic(Float<W> const& a, Float<W> const& b)
+		{
+			const Float<W> t = a * a;
+			return t / (t + b * b);
+		}
+
+		template<int W>
+		SIMD_INLINE Float<W> PowerHeuristic(const int nf, Float<W> const& fPdf, const int ng, Float<W> const& gPdf)
+		{
+			const Float<W> f = Float<W>(float(nf)) * fPdf;
+			const Float<W> g = Float<W>(float(ng)) * gPdf;
+			return (f * f) / (f * f + g * g);
+		}
+
+		template<int W>
+		SIMD_INLINE Float<W> balanceHeuristic(Float<W> const& a, Float<W> const& b)
+		{
+			return a / (a + b);
+		}
+
+		// Align w with axis.
+		template<int W>
+		SIMD_INLINE void AlignVector(Float3<W> const& axis, Float3<W>& w)
+		{
+			const Float<W> s = copysign(Float<W>(1.0f), axis.z);
+			w.z *= s;
+			const Float3<W> h(axis.x, axis.y, axis.z + s);
+			const Float<W>  k = dot(w, h) / (Float<W>(1.0f) + abs(axis.z));
+			w = k * h - w;
+		}
+
+		template<int W>
+		SIMD_INLINE Float3<W> UniformHemisphereSampling(Float<W> const& u, Float<W> const& v)
+		{
+			const Float<W> cosTheta = u;
+			const Float<W> sinTheta = sqrt(max(Float<W>(0.0f), Float<W>(1.0f) - cosTheta * cosTheta));
+
+			const Float<W> phi = Float<W>(2.0f * M_PIf) * v;
+			Float<W> sinPhi;
+			Float<W> cosPhi;
+			sincos(phi, sinPhi, cosPhi);
+
+			return Float3<W>(sinTheta * cosPhi, sinTheta * sinPhi, cosTheta);
+		}
+
+		template<int W>
+		SIMD_INLINE Float3<W> UnitSquareToCosineHemisphere(Float<W> const& u, Float<W> const& v)
+		{
+			// Choose a point on the local hemisphere coordinates about +z.
+			const Float<W> theta = Float<W>(2.0f * M_PIf) * u;
+			const Float<W> r = sqrt(v);
+			Float<W> sinTheta;
+			Float<W> cosTheta;
+			sincos(theta, sinTheta, cosTheta);
+
+			const Float<W> x = r * cosTheta;
+			const Float<W> y = r * sinTheta;
+			const Float<W> z = Float<W>(1.0f) - x * x - y * y;
+
+			return Float3<W>(x, y, masked(Float<W>(0.0f) < z, sqrt(max(z, Float<W>(0.0f)))));
+		}
+
+		template<int W>
+		SIMD_INLINE Float3<W> CosineWeightedHemisphereSampling(Float<W> const& u, Float<W> const& v, Float<W> const& alpha)
+		{
+			const Float<W> cosTheta = pow(Float<W>(1.0f) - v, Float<W>(1.0f) / (alpha + Float<W>(1.0f)));
+			const Float<W> sinTheta = sqrt(max(Float<W>(0.0f), Float<W>(1.0f) - cosTheta * cosTheta));
+
+			const Float<W> phi = Float<W>(2.0f * M_PIf) * u;
+			Float<W> sinPhi;
+			Float<W> cosPhi;
+			sincos(phi, sinPhi, cosPhi);
+
+			return Float3<W>(sinTheta * cosPhi, sinTheta * sinPhi, cosTheta);
+		}
+	}
+}
+
+#endif // SIMD_SHADING_H
@@ -0,0 +1,140 @@
+#pragma once
+
+#ifndef TILE_SCHEDULER_H
+#define TILE_SCHEDULER_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "inc/NumaTopology.h"
+#include "inc/Timer.h"
+
+namespace POptix
+{
+	struct Tile
+	{
+		int x;       // Lower left pixel.
+		int y;
+		int width;
+		int height;
+		int index;   // Position along the tile order.
+		int slice;   // Sample slice, 0 to getSampleSlices() - 1.
+	};
+
+	enum ETileOrder
+	{
+		TILE_ORDER_SCANLINE,  // Row by row, each thread gets a horizontal strip.
+		TILE_ORDER_HILBERT    // Hilbert curve, each thread gets a compact region and neighbouring tiles stay close in time.
+	};
+
+	struct TileThreadStats
+	{
+		double busyTime;    // Seconds spent inside the tile function.
+		double finishTime;  // Seconds after the pass start at which this thread ran out of work.
+		int    tiles;       // Tiles rendered in this pass.
+		int    steals;      // Tiles taken from other threads' queues.
+	};
+
+	struct TilePassStats
+	{
+		double passTime;     // Wall clock time of the whole pass.
+		double tailLatency;  // Time between the first thread running out of work and the end of the pass.
+		double utilization;  // Sum of busy time over threads * passTime.
+		std::vector<TileThreadStats> threads;
+	};
+
+	// Distributes the tiles of an image over persistent worker threads.
+	// Each worker owns a deque seeded with a contiguous run of the tile order. Owners pop from the front, idle workers
+	// steal from the back of other queues, so the owner keeps working on neighbouring tiles while thieves take the far end.
+	// With a NUMA topology the workers are pinned to the nodes in contiguous blocks of thread indices, proportional to
+	// the CPUs per node, and steal from workers of their own node before crossing to another one.
+	class TileScheduler
+	{
+	public:
+		typedef std::function<void(Tile const& tile, int threadIndex)> TileFunction;
+		typedef std::function<void(int begin, int end, int threadIndex)> RangeFunction;
+
+		// 0 threads means one thread per hardware thread, or per CPU of the topology.
+		explicit TileScheduler(int numThreads = 0, NumaTopology const* topology = nullptr);
+		~TileScheduler();
+
+		void setImageSize(int width, int height);
+		void setTileSize(int tileSize);
+		void setTileOrder(ETileOrder order);
+		void setWorkStealing(bool enable);  // Disabled means static partitioning, every thread only renders its own share.
+
+		// Every tile is dispatched numSlices times per pass, once per slice, right after each other in the tile order.
+		// The slices of a tile may run on different threads at the same time.
+		void setSampleSlices(int numSlices);
+
+		// One progressive pass. Calls function exactly once for every tile and returns when all tiles are done.
+		void run(TileFunction const& function);
+
+		// Runs function over [0, count) in chunks of grainSize on the same workers. Chunks are stolen like tiles.
+		void parallelFor(int count, int grainSize, RangeFunction const& function);
+
+		int getNumThreads() const  { return int(m_workers.size()); }
+		int getNumNodes() const    { return m_topology.getNumNodes(); } // 1 without a NUMA topology.
+		int getThreadNode(int threadIndex) const { return m_threadNodes[threadIndex]; }
+		int getHomeNode(int index, int count) const; // Node of the worker whose queue starts with item index of count.
+		NumaTopology const& getTopology() const  { return m_topology; }
+		int getTileSize() const    { return m_tileSize; }
+		int getSampleSlices() const { return m_numSlices; }
+		int getPassIndex() const   { return m_passIndex; }  // Number of finished passes.
+
+		std::vector<Tile> const& getTiles();                                // As dispatched by the next run(), one entry per slice.
+		TilePassStats const&     getLastPassStats() const  { return m_stats; } // Of the last run() or parallelFor().
+
+	private:
+		struct WorkerQueue
+		{
+			std::mutex      mutex;
+			std::deque<int> tiles;  // Indices into m_tiles.
+		};
+
+		void createTiles();
+		void dispatch(std::vector<Tile> const& tiles, TileFunction const& function);
+		void workerLoop(int threadIndex);
+		bool popTile(int threadIndex, int& tile);
+		bool stealTile(int threadIndex, int& tile);
+
+	private:
+		int        m_width;
+		int        m_height;
+		int        m_tileSize;
+		int        m_numSlices;
+		ETileOrder m_order;
+		bool       m_workStealing;
+		bool       m_tilesDirty;
+
+		NumaTopology     m_topology;
+		bool             m_pinThreads;
+		std::vector<int> m_threadNodes;
+
+		std::vector<Tile> m_tiles;
+		std::vector<Tile> m_ranges;  // parallelFor() chunks, x and width are the element range.
+
+		std::vector<std::thread>                  m_workers;
+		std::vector<std::unique_ptr<WorkerQueue>> m_queues;
+
+		std::mutex               m_mutex;      // Guards the fields below.
+		std::condition_variable  m_startCondition;
+		std::condition_variable  m_doneCondition;
+		const TileFunction*      m_function;
+		const std::vector<Tile>* m_dispatchTiles;
+		unsigned int             m_generation; // Incremented to start a pass.
+		int                      m_running;    // Workers still busy in the current pass.
+		bool                     m_quit;
+
+		int           m_passIndex;
+		Timer         m_passTimer;
+		TilePassStats m_stats;
+	};
+}
+
+#endif // TILE_SCHEDULER_H
@@ -0,0 +1,81 @@
+#pragma once
+
+#ifndef TOP_LEVEL_ACCEL_H
+#define TOP_LEVEL_ACCEL_H
+
+#include <optix.h>
+#include <optixu/optixu_math_namespace.h>
+#include <optixu/optixu_aabb_namespace.h>
+#include <optixu/optixu_matrix_namespace.h>
+
+#include <vector>
+
+#include "inc/Bvh.h"
+
+namespace POptix
+{
+	struct Mesh;
+
+	struct Instance
+	{
+		unsigned int      meshID;
+		optix::Matrix4x4  transform;     // Object to world, row-major like POptix::Node::transform.
+		optix::Aabb       objectBounds;  // Bounds of the referenced mesh in object space.
+	};
+
+	enum ETopLevelUpdate
+	{
+		TOP_LEVEL_UNCHANGED,
+		TOP_LEVEL_REFIT,
+		TOP_LEVEL_REBUILD
+	};
+
+	optix::Aabb computeMeshBounds(Mesh const& mesh);
+	optix::Aabb transformBounds(optix::Aabb const& bounds, optix::Matrix4x4 const& matrix);
+
+	// Host side top level acceleration structure over the instances of the scene.
+	// When only instance transforms change, update() refits the existing hierarchy in O(n) and only rebuilds
+	// when the SAH cost of the refitted tree degraded by more than the rebuild threshold against the cost at build time.
+	class TopLevelAccel
+	{
+	public:
+		TopLevelAccel();
+		~TopLevelAccel();
+
+		unsigned int addInstance(unsigned int meshID, optix::Aabb const& objectBounds, const float* transform);
+		void setTransform(unsigned int instanceIndex, const float* transform);
+
+		// Full rebuild over all instances.
+		void build();
+
+		void                   setBuildOptions(BvhBuildOptions const& options) { m_buildOptions = options; }
+		BvhBuildOptions const& getBuildOptions() const                          { return m_buildOptions; }
+
+		// Brings the hierarchy in sync with the current transforms.
+		ETopLevelUpdate update();
+
+		void  setRebuildThreshold(float threshold) { m_rebuildThreshold = threshold; }
+		float getRebuildThreshold() const          { return m_rebuildThreshold; }
+
+		// Ratio of the current SAH cost against the cost right after the last rebuild. 1.0 means no degradation.
+		float getDegradation() const;
+
+		std::vector<Instance> const&    getInstances() const      { return m_instances; }
+		std::vector<optix::Aabb> const& getInstanceBounds() const { return m_worldBounds; }
+		Bvh const&                      getBvh() const            { return m_bvh; }
+
+	private:
+		std::vector<Instance>    m_instances;
+		std::vector<optix::Aabb> m_worldBounds;  // Per instance bounds in world space, input for the Bvh.
+
+		Bvh             m_bvh;
+		BvhBuildOptions m_buildOptions;
+
+		float m_builtSahCost;      // SAH cost right after the last full build.
+		float m_rebuildThreshold;  // Maximum tolerated m_bvh.sahCost() / m_builtSahCost before a refit turns into a rebuild.
+		bool  m_dirty;             // Transforms changed since the last update().
+		bool  m_topologyChanged;   // Instances were added, a refit is not possible.
+	};
+}
+
+#endif // TOP_LEVEL_ACCEL_H
@@ -0,0 +1,275 @@
+#pragma once
+
+#ifndef TRIANGLE_PACKET_H
+#define TRIANGLE_PACKET_H
+
+#include "shaders/triangle_intersection.h"
+
+// Host side SIMD version of the watertight triangle test. One ray is tested against TRIANGLE_PACKET_WIDTH triangles at once.
+// AVX gives 8 lanes, SSE2 gives 4 lanes, anything else runs the scalar device function per lane.
+#if defined(__AVX__)
+#include <immintrin.h>
+#define TRIANGLE_PACKET_AVX 1
+#define TRIANGLE_PACKET_WIDTH 8
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && 2 <= _M_IX86_FP)
+#include <emmintrin.h>
+#define TRIANGLE_PACKET_SSE 1
+#define TRIANGLE_PACKET_WIDTH 4
+#else
+#define TRIANGLE_PACKET_WIDTH 4
+#endif
+
+namespace POptix
+{
+	// Structure of arrays of up to TRIANGLE_PACKET_WIDTH triangles. v0[axis][lane] etc.
+	struct TrianglePacket
+	{
+		TrianglePacket()
+			: count(0)
+		{
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				for (int lane = 0; lane < TRIANGLE_PACKET_WIDTH; ++lane)
+				{
+					v0[axis][lane] = 0.0f;
+					v1[axis][lane] = 0.0f;
+					v2[axis][lane] = 0.0f;
+				}
+			}
+			for (int lane = 0; lane < TRIANGLE_PACKET_WIDTH; ++lane)
+			{
+				primitive[lane] = ~0u;
+			}
+		}
+
+		// Returns false when the packet is full.
+		bool add(const optix::float3& a, const optix::float3& b, const optix::float3& c, const unsigned int primitiveIndex)
+		{
+			if (TRIANGLE_PACKET_WIDTH <= count)
+			{
+				return false;
+			}
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				v0[axis][count] = optix::getByIndex(a, axis);
+				v1[axis][count] = optix::getByIndex(b, axis);
+				v2[axis][count] = optix::getByIndex(c, axis);
+			}
+			primitive[count++] = primitiveIndex;
+			return true;
+		}
+
+		// Loaded unaligned, std::vector doesn't honour over-aligned types before C++17.
+		float        v0[3][TRIANGLE_PACKET_WIDTH];
+		float        v1[3][TRIANGLE_PACKET_WIDTH];
+		float        v2[3][TRIANGLE_PACKET_WIDTH];
+		unsigned int primitive[TRIANGLE_PACKET_WIDTH];
+		int          count;
+	};
+
+	struct TriangleHit
+	{
+		float        t;
+		float        beta;
+		float        gamma;
+		unsigned int primitive;
+	};
+
+	namespace detail
+	{
+#if defined(TRIANGLE_PACKET_AVX)
+		struct PacketOps
+		{
+			typedef __m256 Float;
+
+			static Float load(const float* p)           { return _mm256_loadu_ps(p); }
+			static void  store(float* p, Float a)       { _mm256_storeu_ps(p, a); }
+			static Float set1(float f)                  { return _mm256_set1_ps(f); }
+			static Float lanes()                        { return _mm256_set_ps(7.0f, 6.0f, 5.0f, 4.0f, 3.0f, 2.0f, 1.0f, 0.0f); }
+			static Float add(Float a, Float b)          { return _mm256_add_ps(a, b); }
+			static Float sub(Float a, Float b)          { return _mm256_sub_ps(a, b); }
+			static Float mul(Float a, Float b)          { return _mm256_mul_ps(a, b); }
+			static Float div(Float a, Float b)          { return _mm256_div_ps(a, b); }
+			static Float and_(Float a, Float b)         { return _mm256_and_ps(a, b); }
+			static Float andnot(Float a, Float b)       { return _mm256_andnot_ps(a, b); } // ~a & b
+			static Float or_(Float a, Float b)          { return _mm256_or_ps(a, b); }
+			static Float xor_(Float a, Float b)         { return _mm256_xor_ps(a, b); }
+			static Float cmpeq(Float a, Float b)        { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+			static Float cmplt(Float a, Float b)        { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+			static Float cmple(Float a, Float b)        { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+			static int   movemask(Float a)              { return _mm256_movemask_ps(a); }
+		};
+#elif defined(TRIANGLE_PACKET_SSE)
+		struct PacketOps
+		{
+			typedef __m128 Float;
+
+			static Float load(const float* p)           { return _mm_loadu_ps(p); }
+			static void  store(float* p, Float a)       { _mm_storeu_ps(p, a); }
+			static Float set1(float f)                  { return _mm_set1_ps(f); }
+			static Float lanes()                        { return _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f); }
+			static Float add(Float a, Float b)          { return _mm_add_ps(a, b); }
+			static Float sub(Float a, Float b)          { return _mm_sub_ps(a, b); }
+			static Float mul(Float a, Float b)          { return _mm_mul_ps(a, b); }
+			static Float div(Float a, Float b)          { return _mm_div_ps(a, b); }
+			static Float and_(Float a, Float b)         { return _mm_and_ps(a, b); }
+			static Float andnot(Float a, Float b)       { return _mm_andnot_ps(a, b); } // ~a & b
+			static Float or_(Float a, Float b)          { return _mm_or_ps(a, b); }
+			static Float xor_(Float a, Float b)         { return _mm_xor_ps(a, b); }
+			static Float cmpeq(Float a, Float b)        { return _mm_cmpeq_ps(a, b); }
+			static Float cmplt(Float a, Float b)        { return _mm_cmplt_ps(a, b); }
+			static Float cmple(Float a, Float b)        { return _mm_cmple_ps(a, b); }
+			static int   movemask(Float a)              { return _mm_movemask_ps(a); }
+		};
+#endif
+	}
+
+	// Closest hit of the ray against all triangles in the packet within (tmin, tmax].
+	// On a hit tmax shrinks to the hit distance. Lane for lane the results are bit-identical to intersectTriangleWatertight(),
+	// which needs the host build without FMA contraction of either version, see triangle_intersection.h.
+	inline bool intersectTrianglePacket(const WatertightRay& ray, const float tmin, float& tmax, TrianglePacket const& packet, TriangleHit& hit)
+	{
+#if defined(TRIANGLE_PACKET_AVX) || defined(TRIANGLE_PACKET_SSE)
+		typedef detail::PacketOps S;
+		typedef S::Float Float;
+
+		const int kx = ray.kx;
+		const int ky = ray.ky;
+		const int kz = ray.kz;
+
+		const Float ox = S::set1(optix::getByIndex(ray.origin, kx));
+		const Float oy = S::set1(optix::getByIndex(ray.origin, ky));
+		const Float oz = S::set1(optix::getByIndex(ray.origin, kz));
+
+		const Float Akz = S::sub(S::load(packet.v0[kz]), oz);
+		const Float Bkz = S::sub(S::load(packet.v1[kz]), oz);
+		const Float Ckz = S::sub(S::load(packet.v2[kz]), oz);
+
+		const Float Sx = S::set1(ray.Sx);
+		const Float Sy = S::set1(ray.Sy);
+		const Float Sz = S::set1(ray.Sz);
+
+		const Float Ax = S::sub(S::sub(S::load(packet.v0[kx]), ox), S::mul(Sx, Akz));
+		const Float Ay = S::sub(S::sub(S::load(packet.v0[ky]), oy), S::mul(Sy, Akz));
+		const Float Bx = S::sub(S::sub(S::load(packet.v1[kx]), ox), S::mul(Sx, Bkz));
+		const Float By = S::sub(S::sub(S::load(packet.v1[ky]), oy), S::mul(Sy, Bkz));
+		const Float Cx = S::sub(S::sub(S::load(packet.v2[kx]), ox), S::mul(Sx, Ckz));
+		const Float Cy = S::sub(S::sub(S::load(packet.v2[ky]), oy), S::mul(Sy, Ckz));
+
+		Float U = S::sub(S::mul(Cx, By), S::mul(Cy, Bx));
+		Float V = S::sub(S::mul(Ax, Cy), S::mul(Ay, Cx));
+		Float W = S::sub(S::mul(Bx, Ay), S::mul(By, Ax));
+
+		const Float zero = S::set1(0.0f);
+
+		// Same double precision fallback as the scalar version for lanes exactly on an edge.
+		if (S::movemask(S::or_(S::or_(S::cmpeq(U, zero), S::cmpeq(V, zero)), S::cmpeq(W, zero))))
+		{
+			float ax[TRIANGLE_PACKET_WIDTH], ay[TRIANGLE_PACKET_WIDTH];
+			float bx[TRIANGLE_PACKET_WIDTH], by[TRIANGLE_PACKET_WIDTH];
+			float cx[TRIANGLE_PACKET_WIDTH], cy[TRIANGLE_PACKET_WIDTH];
+			float u[TRIANGLE_PACKET_WIDTH], v[TRIANGLE_PACKET_WIDTH], w[TRIANGLE_PACKET_WIDTH];
+			S::store(ax, Ax); S::store(ay, Ay);
+			S::store(bx, Bx); S::store(by, By);
+			S::store(cx, Cx); S::store(cy, Cy);
+			S::store(u, U); S::store(v, V); S::store(w, W);
+
+			for (int lane = 0; lane < TRIANGLE_PACKET_WIDTH; ++lane)
+			{
+				if (u[lane] == 0.0f || v[lane] == 0.0f || w[lane] == 0.0f)
+				{
+					u[lane] = float(double(cx[lane]) * double(by[lane]) - double(cy[lane]) * double(bx[lane]));
+					v[lane] = float(double(ax[lane]) * double(cy[lane]) - double(ay[lane]) * double(cx[lane]));
+					w[lane] = float(double(bx[lane]) * double(ay[lane]) - double(by[lane]) * double(ax[lane]));
+				}
+			}
+			U = S::load(u);
+			V = S::load(v);
+			W = S::load(w);
+		}
+
+		const Float anyNegative = S::or_(S::or_(S::cmplt(U, zero), S::cmplt(V, zero)), S::cmplt(W, zero));
+		const Float anyPositive = S::or_(S::or_(S::cmplt(zero, U), S::cmplt(zero, V)), S::cmplt(zero, W));
+
+		const Float det = S::add(S::add(U, V), W);
+
+		Float valid = S::cmplt(S::lanes(), S::set1(float(packet.count)));
+		valid = S::andnot(S::and_(anyNegative, anyPositive), valid);
+		valid = S::andnot(S::cmpeq(det, zero), valid);
+
+		const Float T = S::add(S::add(S::mul(U, S::mul(Sz, Akz)), S::mul(V, S::mul(Sz, Bkz))), S::mul(W, S::mul(Sz, Ckz)));
+
+		// Flip T and det to the positive side of det, then test tmin * det < T. The tmax test follows per lane below.
+		const Float signDet = S::and_(det, S::set1(-0.0f));
+		const Float absDet  = S::xor_(det, signDet);
+		const Float signedT = S::xor_(T, signDet);
+		valid = S::and_(valid, S::cmplt(S::mul(S::set1(tmin), absDet), signedT));
+
+		int mask = S::movemask(valid);
+		if (mask == 0)
+		{
+			return false;
+		}
+
+		const Float invDet = S::div(S::set1(1.0f), det);
+		float t[TRIANGLE_PACKET_WIDTH];
+		float beta[TRIANGLE_PACKET_WIDTH];
+		float gamma[TRIANGLE_PACKET_WIDTH];
+		float scaledT[TRIANGLE_PACKET_WIDTH];
+		float scaledDet[TRIANGLE_PACKET_WIDTH];
+		S::store(t,         S::mul(T, invDet));
+		S::store(beta,      S::mul(V, invDet));
+		S::store(gamma,     S::mul(W, invDet));
+		S::store(scaledT,   signedT);
+		S::store(scaledDet, absDet);
+
+		// Only the few triangles actually pierced by the ray line are left. Test them against the shrinking tmax in lane order,
+		// exactly like the sequential loop over intersectTriangleWatertight(), so ties at shared vertices pick the same triangle.
+		int   closest  = -1;
+		float tClosest = tmax;
+		for (int lane = 0; mask != 0; ++lane, mask >>= 1)
+		{
+			if ((mask & 1) && scaledT[lane] <= tClosest * scaledDet[lane])
+			{
+				closest  = lane;
+				tClosest = t[lane];
+			}
+		}
+		if (closest < 0)
+		{
+			return false;
+		}
+
+		tmax          = t[closest];
+		hit.t         = t[closest];
+		hit.beta      = beta[closest];
+		hit.gamma     = gamma[closest];
+		hit.primitive = packet.primitive[closest];
+		return true;
+#else
+		bool found = false;
+		for (int lane = 0; lane < packet.count; ++lane)
+		{
+			const optix::float3 a = optix::make_float3(packet.v0[0][lane], packet.v0[1][lane], packet.v0[2][lane]);
+			const optix::float3 b = optix::make_float3(packet.v1[0][lane], packet.v1[1][lane], packet.v1[2][lane]);
+			const optix::float3 c = optix::make_float3(packet.v2[0][lane], packet.v2[1][lane], packet.v2[2][lane]);
+
+			float t;
+			float beta;
+			float gamma;
+			if (intersectTriangleWatertight(ray, tmin, tmax, a, b, c, t, beta, gamma))
+			{
+				tmax          = t;
+				hit.t         = t;
+				hit.beta      = beta;
+				hit.gamma     = gamma;
+				hit.primitive = packet.primitive[lane];
+				found = true;
+			}
+		}
+		return found;
+#endif
+	}
+}
+
+#endif // TRIANGLE_PACKET_H
@@ -0,0 +1,167 @@
+#pragma once
+
+#ifndef WAVEFRONT_RENDERER_H
+#define WAVEFRONT_RENDERER_H
+
+#include <optix.h>
+#include <optixu/optixu_math_namespace.h>
+
+#include <vector>
+
+#include "inc/Accumulator.h"
+#include "inc/HostScene.h"
+#include "inc/TileScheduler.h"
+#include "shaders/material_parameter.h"
+#include "shaders/per_ray_data.h"
+
+namespace POptix
+{
+	// Seconds spent in the stages of the last render() call.
+	struct WavefrontStats
+	{
+		double generate;
+		double extend;     // Closest hit rays.
+		double shade;      // Light hits, roulette and the per BRDF kernels.
+		double connect;    // Shadow rays.
+		double compact;    // Queue building between the stages, Russian Roulette.
+		double accumulate;
+		double sort;       // Ray reordering between the bounces.
+
+		long long extensionRays;
+		long long shadowRays;
+
+		// Per depth.
+		std::vector<int>    activePaths;
+		std::vector<double> traceTimes;  // Extension and shadow rays.
+		std::vector<double> sortTimes;   // Reordering before the extension of this depth.
+	};
+
+	// Wavefront version of HostRenderer.
+	// Instead of running every path through the whole integrator, each bounce runs one stage over all active paths:
+	// extend (closest hit), shade (bucketed by EBrdfTypes so every BRDF kernel runs over a dense batch), connect (shadow rays)
+	// and compaction of the surviving paths. The path state lives in structure of arrays buffers indexed by pixel.
+	// The random numbers are consumed in the same order per path, so the image is identical to HostRenderer's.
+	class WavefrontRenderer
+	{
+	public:
+		explicit WavefrontRenderer(HostScene const& scene, int numThreads = 0);
+		~WavefrontRenderer();
+
+		void setResolution(int width, int height);
+		void setCamera(const optix::float3& position, const optix::float3& U, const optix::float3& V, const optix::float3& W);
+		void setPathLengths(int minPathLength, int maxPathLength);
+		void setSceneEpsilon(float epsilon);
+		void setLightSelection(ELightSelection selection); // How the next event estimation picks its light, uniform by default.
+		void setSampler(ESampler sampler);                 // Random numbers of the paths, Sobol by default.
+
+		// Reorders the surviving paths after each bounce by direction octant and Morton code of the origin,
+		// so rays which traverse the same BVH regions are traced together. Does not change the image.
+		void setRaySorting(bool enable) { m_raySorting = enable; }
+		bool getRaySorting() const      { return m_raySorting; }
+
+		void restartAccumulation();
+
+		// One sample per pixel, accumulated into the output buffer.
+		void render();
+
+		TileScheduler&        getScheduler()            { return m_scheduler; }
+		int                   getIterationIndex() const { return m_iterationIndex; }
+		WavefrontStats const& getStats() const          { return m_stats; }
+
+		std::vector<optix::float4> const& getOutputBuffer() const { return m_outputBuffer; } // RGBA32F, row 0 is the bottom of the image.
+
+	private:
+		// Queue keys written by the stages. Anything >= the number of queues of a partition() is dropped.
+		enum EPathKey
+		{
+			KEY_SURFACE,
+			KEY_LIGHT,
+			KEY_TERMINATED
+		};
+
+		void generate();
+		void extend(int depth);
+		void shadeLights();
+		void beginSurfaces();
+		void shadeSurfaces(EBrdfTypes brdf);
+		void connect();
+		void advance(int depth);
+		void accumulate();
+		void sortRays();
+
+		// Sampler state of path for the stages, see sample1D(). Only the seed changes, store it back into m_seed.
+		void loadSampler(const int path, PerRayData& prd) const;
+
+		// Stable split of input into numQueues queues by m_keys[path].
+		void partition(std::vector<int> const& input, const int numQueues, std::vector<int>* queues);
+
+	private:
+		HostScene const& m_scene;
+		TileScheduler    m_scheduler;
+		Accumulator      m_accumulator;
+		std::vector<Tile> m_strips;  // Accumulator layout, full width rows.
+
+		int m_width;
+		int m_height;
+		int m_iterationIndex;
+
+		optix::float3 m_cameraPosition;
+		optix::float3 m_cameraU;
+		optix::float3 m_cameraV;
+		optix::float3 m_cameraW;
+
+		int   m_minPathLength;
+		int   m_maxPathLength;
+		float m_sceneEpsilon;
+		bool  m_raySorting;
+
+		ELightSelection m_lightSelection;
+		ESampler        m_sampler;
+
+		// Path state, one entry per pixel.
+		std::vector<optix::float3> m_origin;      // PerRayData::hit_pos
+		std::vector<optix::float3> m_direction;   // PerRayData::wi
+		std::vector<optix::float3> m_throughput;
+		std::vector<optix::float3> m_radiance;    // Sum over the path.
+		std::vector<optix::float3> m_segmentRadiance; // PerRayData::radiance
+		std::vector<optix::float3> m_fOverPdf;
+		std::vector<float>         m_pdf;
+		std::vector<int>           m_flags;
+		std::vector<int>           m_brdfFlags;
+		std::vector<unsigned int>  m_seed;
+		std::vector<int>           m_dimension;   // PerRayData::dimension
+
+		// Hit state of the last extension.
+		std::vector<TriangleHit>   m_hit;
+		std::vector<optix::float3> m_geometryNormal;
+		std::vector<optix::float3> m_shadingNormal;
+
+		// Shadow rays of the last shade stage. The origin is m_origin.
+		std::vector<optix::float3> m_shadowDirection;
+		std::vector<float>         m_shadowTmax;
+		std::vector<optix::float3> m_shadowRadiance;
+
+		std::vector<unsigned char> m_keys;
+
+		// Queues of path indices.
+		std::vector<int> m_active;
+		std::vector<int> m_hitQueues[2];       // KEY_SURFACE, KEY_LIGHT
+		std::vector<int> m_brdfQueues[NUM_OF_BRDF];
+		std::vector<int> m_shadowQueue;
+		std::vector<int> m_surfaces;           // All surface hits, in the order of m_active.
+
+		// partition() scratch.
+		std::vector<int> m_chunkCounts;
+
+		// sortRays() buffers.
+		std::vector<unsigned int> m_sortKeys;
+		std::vector<unsigned int> m_sortScratchKeys;
+		std::vector<int>          m_sortScratchValues;
+
+		std::vector<optix::float4> m_outputBuffer;
+
+		WavefrontStats m_stats;
+	};
+}
+
+#endif // WAVEFRONT_RENDERER_H
@@ -37,7 +37,7 @@ RT_CALLABLE_PROGRAM void Sample(POptix::Material &mat, State &state, PerRayData
 	float3 N = state.shading_normal;					// In World Coordinate
 	float3 woWorld = -theRay.direction;					// In World Coordinate (viewer direction)
 	
-	float2 r = rng2(prd.seed);
+	float2 r = sample2D(prd, SAMPLE_DIMENSION_BRDF);
 
 	optix::Onb onb(N); // basis
 	float alpha = powf(max(0.001f, mat.roughness), 2.0f);
@@ -22,7 +22,7 @@ RT_CALLABLE_PROGRAM void Sample(POptix::Material &mat, State &state, PerRayData
 	float3 N = state.shading_normal;					// In World Coordinate
 	float3 woWorld = -theRay.direction;					// In World Coordinate (viewer direction)
 
-	float3 dir = UnitSquareToCosineHemisphere(rng2(prd.seed));
+	float3 dir = UnitSquareToCosineHemisphere(sample2D(prd, SAMPLE_DIMENSION_BRDF));
 
 	TBN onb(N);
 	float3 wo = onb.transform(woWorld);
@@ -0,0 +1,41 @@
+#pragma once
+
+#ifndef ADAPTIVE_REDUCE_H
+#define ADAPTIVE_REDUCE_H
+
+#include "app_config.h"
+
+#include <optix.h>
+#include <optixu/optixu_math_namespace.h>
+
+#include "rt_function.h"
+#include "shader_common.h"
+
+// Per block reduction of the adaptive sampling, shared by the adaptive_reduce() entry point in raygeneration.cu and
+// POptix::AdaptiveSampling on the host. Only one float per block has to leave the device.
+// Mean and MeanSquare are anything with an operator()(x, y): the accumulated image and the running mean of the squared
+// luminance per pixel, rtBuffers on the device and arrays on the host.
+
+// Sum over the pixels of block (bx, by) of the sample variance of the luminance relative to L^2 + ADAPTIVE_BLACK_LEVEL^2.
+// The pixels of a block share their sample count n, the caller divides by n - 1 for the unbiased variances.
+template<typename Mean, typename MeanSquare>
+RT_FUNCTION float adaptiveBlockVariance(Mean const& mean, MeanSquare const& meanSquare, const int bx, const int by, const int width, const int height)
+{
+	const int x0 = bx * ADAPTIVE_BLOCK_SIZE;
+	const int y0 = by * ADAPTIVE_BLOCK_SIZE;
+	const int x1 = (x0 + ADAPTIVE_BLOCK_SIZE < width)  ? x0 + ADAPTIVE_BLOCK_SIZE : width;
+	const int y1 = (y0 + ADAPTIVE_BLOCK_SIZE < height) ? y0 + ADAPTIVE_BLOCK_SIZE : height;
+
+	float sum = 0.0f;
+	for (int y = y0; y < y1; ++y)
+	{
+		for (int x = x0; x < x1; ++x)
+		{
+			const float L = luminance(optix::make_float3(mean(x, y)));
+			sum += ::fmaxf(0.0f, meanSquare(x, y) - L * L) / (L * L + ADAPTIVE_BLACK_LEVEL * ADAPTIVE_BLACK_LEVEL);
+		}
+	}
+	return sum;
+}
+
+#endif // ADAPTIVE_REDUCE_H
@@ -19,5 +19,21 @@
 #define USE_SHADER_TONEMAP 0
 #define USE_NEXT_EVENT_ESTIMATION 1
 
+// Edge length in pixels of the blocks for which the adaptive sampling decides convergence, see POptix::AdaptiveSampling.
+#define ADAPTIVE_BLOCK_SIZE 8
+
+// Luminance added in quadrature to the pixel means the adaptive sampling divides its errors by, so dark pixels don't need forever.
+#define ADAPTIVE_BLACK_LEVEL 0.1f
+
+// Quad lights subtending less solid angle in steradians are sampled by area instead of as spherical rectangles, see light_sample.h.
+#define QUAD_LIGHT_MIN_SOLID_ANGLE 1.0e-3f
+
+// ReSTIR DI, see reservoir.h. Light samples resampled per primary hit, reservoirs of neighbours merged by the spatial reuse
+// and their radius in image widths, and the cap of the candidates of the temporal reservoir in multiples of the new ones.
+#define RESTIR_CANDIDATES        32
+#define RESTIR_SPATIAL_NEIGHBORS 5
+#define RESTIR_SPATIAL_RADIUS    0.025f
+#define RESTIR_MAX_HISTORY       20
+
 
 #endif // APP_CONFIG_H
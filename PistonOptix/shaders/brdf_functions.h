@@ -0,0 +1,282 @@
+#pragma once
+
+#ifndef BRDF_FUNCTIONS_H
+#define BRDF_FUNCTIONS_H
+
+#include "app_config.h"
+
+#include <optix.h>
+#include <optixu/optixu_math_namespace.h>
+
+#include "rt_function.h"
+#include "per_ray_data.h"
+#include "material_parameter.h"
+#include "shader_common.h"
+#include "PistonOptix/inc/CudaUtils/State.h"
+
+// BRDF implementations shared by the callable programs (lambert.cu, PhongModified.cu, MicrofacetReflection.cu) and the host renderer.
+// woWorld is the direction to the observer in world space. The callable programs pass -theRay.direction.
+// All functions of a kind share the signature of their callable program, the parameters one of them doesn't read are unnamed.
+// The *SampleDirection() functions are the *Sample() functions for a given unit square sample u, which the path guiding of the
+// host renderer rescales after choosing between the BRDF and its own distribution with it.
+
+//------------------------------------------//
+//				Lambert						//
+//------------------------------------------//
+
+RT_FUNCTION void lambertPdf(POptix::Material const& /*mat*/, State const& state, const float3& woWorld, PerRayData& prd)
+{
+	float3 N = state.shading_normal;					// In World Coordinate
+	float3 wiWorld = prd.wi;
+
+	bool sameHemisphere = dot(wiWorld, N) * dot(woWorld, N) > 0 ? true : false;
+	prd.pdf = sameHemisphere ? fabsf(dot(wiWorld, N)) * M_1_PIf : 0.0f;			// Importance Sampling
+	// prd.pdf = 0.5f * M_1_PI; // (1 / 2PI)									// Uniform Sampling
+}
+
+RT_FUNCTION float3 lambertSampleDirection(POptix::Material const& /*mat*/, State const& state, const float3& woWorld, const float2& u)
+{
+	float3 N = state.shading_normal;					// In World Coordinate
+
+	float3 dir = UnitSquareToCosineHemisphere(u);
+
+	TBN onb(N);
+	float3 wo = onb.transform(woWorld);
+
+	if (wo.z < 0.0f)
+		dir.z *= -1.0f;
+
+	return onb.inverse_transform(dir);
+}
+
+RT_FUNCTION void lambertSample(POptix::Material const& mat, State const& state, const float3& woWorld, PerRayData& prd)
+{
+	prd.wi = lambertSampleDirection(mat, state, woWorld, sample2D(prd, SAMPLE_DIMENSION_BRDF));
+}
+
+RT_FUNCTION float3 lambertEval(POptix::Material const& mat, State const& /*state*/, const float3& /*woWorld*/, PerRayData& /*prd*/)
+{
+	// https://seblagarde.wordpress.com/2011/08/17/hello-world/
+	return mat.albedo * M_1_PIf;
+}
+
+//------------------------------------------//
+//				Phong (modified)			//
+//------------------------------------------//
+
+RT_FUNCTION void phongPdf(POptix::Material const& mat, State const& state, const float3& woWorld, PerRayData& prd)
+{
+	float3 N = state.shading_normal;					// In World Coordinate
+	float3 wiWorld = prd.wi;
+
+	float cosTheta = dot(wiWorld, N);
+	float alpha = mat.roughness;
+
+	bool sameHemisphere = cosTheta * dot(woWorld, N) > 0 ? true : false;
+	prd.pdf = sameHemisphere ? satu(powf(fabsf(cosTheta), alpha)) * M_2_PIf * (alpha + 1.0f) : 0.0f;			// Importance Sampling
+}
+
+RT_FUNCTION float3 phongSampleDirection(POptix::Material const& mat, State const& state, const float3& /*woWorld*/, const float2& u)
+{
+	float3 N = state.shading_normal;					// In World Coordinate
+
+	float3 dir = CosineWeightedHemisphereSampling(u, mat.roughness);
+
+	AlignVector(N, dir);
+
+	return dir;
+}
+
+RT_FUNCTION void phongSample(POptix::Material const& mat, State const& state, const float3& woWorld, PerRayData& prd)
+{
+	prd.wi = phongSampleDirection(mat, state, woWorld, sample2D(prd, SAMPLE_DIMENSION_BRDF));
+}
+
+RT_FUNCTION float3 phongEval(POptix::Material const& mat, State const& state, const float3& /*woWorld*/, PerRayData& prd)
+{
+	float3 N = state.shading_normal;					// In World Coordinate
+	float3 wiWorld = prd.wi;
+
+	float cosTheta = dot(wiWorld, N);
+	float alpha = mat.roughness;
+
+	// https://seblagarde.wordpress.com/2011/08/17/hello-world/
+	return mat.albedo * M_2_PIf * (alpha + 2.0f) * satu(powf(cosTheta, alpha));
+}
+
+//------------------------------------------//
+//				Microfacet reflection		//
+//------------------------------------------//
+
+RT_FUNCTION float smithG_GGX(float NDotv, float alphaG)
+{
+	float a = alphaG * alphaG;
+	float b = NDotv * NDotv;
+	return 1.0f / (NDotv + sqrtf(a + b - a * b));
+}
+
+RT_FUNCTION float TrowbridgeReitzDistribution_D(float cosTheta, float alpha)
+{
+	float Cos2Theta = cosTheta * cosTheta;
+	float Sin2Theta = 1.0f - Cos2Theta;
+	float tan2Theta = Sin2Theta / Cos2Theta;
+
+	if (tan2Theta > 10e12)
+		return 0.0f;
+
+	const float cos4Theta = Cos2Theta * Cos2Theta;
+	float e = (1.0f / (alpha * alpha)) * tan2Theta;
+	return 1.0f * charFunc(cosTheta) / (M_PIf * alpha * alpha * cos4Theta * (1 + e) * (1 + e));
+}
+
+// TrowbridgeReitzDistribution_D() of the half vector about the normal, on both sides of the surface. The sine comes from the cross
+// product, 1 - cos^2 cancels for the half vectors of the smooth surfaces and left D to the rounding of the dot product.
+RT_FUNCTION float TrowbridgeReitzDistribution_D(const float3& halfVec, const float3& normal, float alpha)
+{
+	float cosTheta = dot(halfVec, normal);
+	float3 sinTheta = cross(halfVec, normal);
+
+	float Cos2Theta = cosTheta * cosTheta;
+	if (Cos2Theta <= 0.0f)
+		return 0.0f;
+
+	float tan2Theta = dot(sinTheta, sinTheta) / Cos2Theta;
+	float e = tan2Theta / (alpha * alpha);
+	return 1.0f / (M_PIf * alpha * alpha * Cos2Theta * Cos2Theta * (1 + e) * (1 + e));
+}
+
+RT_FUNCTION float TrowbridgeReitzDistribution_Lambda(float cosTheta, float alpha)
+{
+	float Cos2Theta = cosTheta * cosTheta;
+	float SinTheta = sqrtf(1.0f - Cos2Theta);
+
+	float absTanTheta = fabsf(SinTheta / cosTheta);
+	if (isinf(absTanTheta))
+		return 0.;
+
+	float alpha2Tan2Theta = (alpha * absTanTheta) * (alpha * absTanTheta);
+	return (-1 + sqrtf(1.f + alpha2Tan2Theta)) / 2;
+}
+
+RT_FUNCTION float TrowbridgeReitzDistribution_G(const float3& vec, const float3& halfVec, const float3& normal, float alpha)
+{
+	float vDotH = dot(vec, halfVec);
+	float vDotN = dot(vec, normal);
+
+	float tan2V = (1.0f - (vDotN * vDotN)) / (vDotN * vDotN);
+	float mult = charFunc(vDotH / vDotN);
+	float deno = 1.0f + sqrtf(1.0f + alpha * alpha * tan2V);
+
+	return mult * 2.0f / deno;
+}
+
+RT_FUNCTION float TrowbridgeReitzDistribution_RoughnessToAlpha(float roughness)
+{
+	roughness = fmaxf(roughness, (float)1e-3);
+	float x = logf(roughness);
+	return 1.62142f + 0.819955f * x + 0.1734f * x * x + 0.0171201f * x * x * x + 0.000640711f * x * x * x * x;
+}
+
+// Density of the directions of microfacetReflectionSample(): the half vectors have the density D(cos(theta_h)) * cos(theta_h),
+// the reflection at them maps it to directions with the Jacobian 1 / (4 |wo.h|).
+RT_FUNCTION void microfacetReflectionPdf(POptix::Material const& mat, State const& state, const float3& woWorld, PerRayData& prd)
+{
+	float3 N = state.shading_normal;					// In World Coordinate
+	float3 wiWorld = prd.wi;
+	float3 sum = wiWorld + woWorld;
+
+	prd.pdf = 0.0f;
+	if (sum.x == 0.0f && sum.y == 0.0f && sum.z == 0.0f)
+	{
+		return;
+	}
+	float3 H = normalize(sum);
+
+	float cosThetaH = fabsf(dot(H, N));
+	float cosThetaOH = fabsf(dot(woWorld, H));
+	if (cosThetaOH <= 0.0f)
+	{
+		return;
+	}
+
+	float alpha = powf(fmaxf(0.001f, mat.roughness), 2.0f);
+	float D = TrowbridgeReitzDistribution_D(H, N, alpha);
+
+	prd.pdf = D * cosThetaH / (4.0f * cosThetaOH);	// Importance Sampling
+}
+
+RT_FUNCTION float3 microfacetReflectionSampleDirection(POptix::Material const& mat, State const& state, const float3& woWorld, const float2& r)
+{
+	float3 N = state.shading_normal;					// In World Coordinate
+
+	TBN onb(N); // basis
+	float alpha = powf(fmaxf(0.001f, mat.roughness), 2.0f);
+
+	float phi = r.x * 2.0f * M_PIf;
+	float cosTheta = sqrtf((1.0f - r.y) / (1.0f + (alpha*alpha - 1.0f) * r.y));
+	float sinTheta = sqrtf(1.0f - (cosTheta * cosTheta));
+	float sinPhi = sinf(phi);
+	float cosPhi = cosf(phi);
+
+	float3 half = onb.inverse_transform(make_float3(sinTheta*cosPhi, sinTheta*sinPhi, cosTheta));
+	float3 dir = 2.0f*dot(woWorld, half)*half - woWorld; //reflection vector
+
+	return dir;
+}
+
+RT_FUNCTION void microfacetReflectionSample(POptix::Material const& mat, State const& state, const float3& woWorld, PerRayData& prd)
+{
+	prd.wi = microfacetReflectionSampleDirection(mat, state, woWorld, sample2D(prd, SAMPLE_DIMENSION_BRDF));
+}
+
+RT_FUNCTION float3 microfacetReflectionEval(POptix::Material const& mat, State const& state, const float3& woWorld, PerRayData& prd)
+{
+	float3 N = state.shading_normal;					// In World Coordinate
+	float3 wiWorld = prd.wi;
+	float3 H = normalize(wiWorld + woWorld);
+
+	float cosThetaO = fabsf(dot(woWorld, N));
+	float cosThetaI = fabsf(dot(wiWorld, N));
+
+	if (cosThetaI <= 0.0f || cosThetaO <= 0.0f)
+	{
+		prd.flags |= FLAG_TERMINATE;
+		return make_float3(0.0f);
+	}
+
+	if (H.x == 0 && H.y == 0 && H.z == 0)
+	{
+		prd.flags |= FLAG_TERMINATE;
+		return make_float3(0.0f);
+	}
+
+	float3 dielectricSpecular = make_float3(0.04f, 0.04f, 0.04f);
+	float3 F0 = lerp(dielectricSpecular, mat.albedo, mat.metallic);
+	float3 F = F0 + (1.0f - F0) * powf(1.0f - dot(wiWorld, H), 5.0f);
+
+	// Torrance-Sparrow with the distribution of the half vector.
+	float alpha = powf(fmaxf(0.001f, mat.roughness), 2.0f);
+	float D = TrowbridgeReitzDistribution_D(H, N, alpha);
+	float G = TrowbridgeReitzDistribution_G(woWorld, H, N, alpha) * TrowbridgeReitzDistribution_G(wiWorld, H, N, alpha);
+
+	return F * G * D / (4.0f * cosThetaI * cosThetaO);
+}
+
+//------------------------------------------//
+//				Lobes						//
+//------------------------------------------//
+
+// 1 - F of the Schlick approximation at the half vector of woWorld and wiWorld, the share of the light left to the Lambert lobe
+// by the Fresnel reflection of the microfacet one. closesthit.cu weights the Lambert lobe by it, for the continuation and for
+// the next event estimation alike.
+RT_FUNCTION float3 diffuseFresnelWeight(POptix::Material const& mat, const float3& woWorld, const float3& wiWorld)
+{
+	float3 H = normalize(woWorld + wiWorld);
+
+	float3 dielectricSpecular = make_float3(0.04f, 0.04f, 0.04f);
+	float3 F0 = lerp(dielectricSpecular, mat.albedo, mat.metallic);
+	float3 F = F0 + (1.0f - F0) * powf(1.0f - dot(wiWorld, H), 5.0f);
+	return 1.0f - F;
+}
+
+#endif // BRDF_FUNCTIONS_H
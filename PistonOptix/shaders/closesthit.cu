@@ -7,6 +7,9 @@
 #include "per_ray_data.h"
 #include "material_parameter.h"
 #include "shader_common.h"
+#include "light_tree.h"
+#include "light_alias.h"
+#include "reservoir.h"
 #include "PistonOptix/inc/CudaUtils/State.h"
 #include "PistonOptix/inc/LightParameters.h"
 
@@ -18,6 +21,7 @@ rtDeclareVariable(float, sysSceneEpsilon, , );
 // Semantic variables.
 rtDeclareVariable(optix::Ray, theRay, rtCurrentRay, );
 rtDeclareVariable(float, theIntersectionDistance, rtIntersectionDistance, );
+rtDeclareVariable(uint2, theLaunchIndex, rtLaunchIndex, );
 
 rtDeclareVariable(PerRayData, thePrd, rtPayload, );
 rtDeclareVariable(ShadowPRD, prd_shadow, rtPayload, );
@@ -40,6 +44,30 @@ rtBuffer< rtCallableProgramId<float3(POptix::Material &mat, State &state, PerRay
 rtBuffer< rtCallableProgramId<void(POptix::Light &light, PerRayData &prd, POptix::LightSample &sample, State& state)> > sysLightSample;
 rtBuffer<POptix::Light> sysLightParameters;
 rtDeclareVariable(int, sysNumberOfLights, , );
+rtDeclareVariable(int, sysLightSelection, , );  // POptix::ELightSelection
+rtDeclareVariable(int, sysNumberOfDirectionalLights, , );
+rtBuffer<POptix::LightTreeNode> sysLightTree;
+rtBuffer<int> sysLightTreeMap;
+rtBuffer<POptix::LightAliasEntry> sysLightAliasTable;
+
+rtBuffer<POptix::ReservoirPixel, 3> sysReservoirBuffer; // ReSTIR, see raygeneration.cu.
+
+// The light tree buffers for the traversal in light_tree.h.
+struct LightTreeNodes
+{
+	RT_FUNCTION POptix::LightTreeNode operator[](const int index) const { return sysLightTree[index]; }
+};
+
+struct LightTreeMap
+{
+	RT_FUNCTION int operator[](const int index) const { return sysLightTreeMap[index]; }
+};
+
+// The alias table buffer for light_alias.h.
+struct LightAliasTable
+{
+	RT_FUNCTION POptix::LightAliasEntry operator[](const int index) const { return sysLightAliasTable[index]; }
+};
 
 RT_FUNCTION float3 DirectLighting(POptix::Material &mat, State& state);
 
@@ -71,16 +99,15 @@ RT_PROGRAM void closesthit()
 	thePrd.radiance = make_float3(0.0f);
 	thePrd.f_over_pdf = make_float3(0.0f);
 	thePrd.pdf = 0.0f;
+	thePrd.brdf_flags = 0;
 
 	POptix::Material mat = sysMaterialParameters[parMaterialIndex];
-	float3 baseColor = mat.albedo;
-	float metallic = mat.metallic;
 
 	float3 diffuseBRDF = make_float3(0.0f);
 	float3 specularBRDF = make_float3(0.0f);
 
 	// Roulette-select the ray's path
-	float roulette = rng(thePrd.seed);
+	float roulette = sample1D(thePrd, SAMPLE_DIMENSION_LOBE);
 	float diffChance = 0.5f * (1.0f - mat.metallic);
 	if (roulette < diffChance)
 	{
@@ -105,12 +132,27 @@ RT_PROGRAM void closesthit()
 
 	float3 wiWorld = thePrd.wi;
 	float3 woWorld = -theRay.direction;
-	float3 H = normalize(woWorld + wiWorld);
+	float3 f = diffuseFresnelWeight(mat, woWorld, wiWorld) * diffuseBRDF + specularBRDF;
 
-	float3 dielectricSpecular = make_float3(0.04f, 0.04f, 0.04f);
-	float3 F0 = lerp(dielectricSpecular, baseColor, metallic);
-	float3 F = F0 + (1.0f - F0) * powf(1.0f - dot(wiWorld, H), 5.0f);
-	float3 f = (1.0f - F) * diffuseBRDF + specularBRDF;
+#if USE_NEXT_EVENT_ESTIMATION
+	// raygeneration() resamples the direct light of the primary hit from the reservoirs. They are resampled when the path ends
+	// here too, or the temporal reuse would lose them, but the light is added only where DirectLighting() runs.
+	if ((thePrd.flags & FLAG_RESTIR_PRIMARY) && (thePrd.brdf_flags & (POptix::BSDF_DIFFUSE | POptix::BSDF_GLOSSY)) && sysNumberOfLights > 0)
+	{
+		POptix::ReservoirPixel& pixel = sysReservoirBuffer[make_uint3(theLaunchIndex.x, theLaunchIndex.y, RESTIR_SLOT_CANDIDATES)];
+		pixel.surface.position       = state.hit_position;
+		pixel.surface.materialIndex  = parMaterialIndex;
+		pixel.surface.geometryNormal = geoNormal;
+		pixel.surface.brdf           = (thePrd.brdf_flags & POptix::BSDF_DIFFUSE) ? POptix::EBrdfTypes::LAMBERT : POptix::EBrdfTypes::MICROFACET_REFLECTION;
+		pixel.surface.shadingNormal  = shading_normal;
+		pixel.surface.distance       = theIntersectionDistance;
+		pixel.surface.wo             = thePrd.wo;
+
+		pixel.shaded = (0.0f < thePrd.pdf && 0.0f < optix::dot(thePrd.wi, geoNormal)) ? 1 : 0;
+
+		thePrd.flags |= FLAG_DIRECT_RESAMPLED;
+	}
+#endif // USE_NEXT_EVENT_ESTIMATION
 
 	// Do not sample opaque surfaces below the geometry!
 	// Mind that the geometry normal has been flipped to the side the ray points at.
@@ -123,7 +165,10 @@ RT_PROGRAM void closesthit()
 	thePrd.f_over_pdf = f * fabsf(optix::dot(thePrd.wi, state.shading_normal)) / thePrd.pdf;
 
 #if USE_NEXT_EVENT_ESTIMATION
-	thePrd.radiance += DirectLighting(mat, state);
+	if ((thePrd.flags & FLAG_DIRECT_RESAMPLED) == 0)
+	{
+		thePrd.radiance += DirectLighting(mat, state);
+	}
 #endif // USE_NEXT_EVENT_ESTIMATION
 }
 
@@ -143,8 +188,21 @@ RT_FUNCTION float3 DirectLighting(POptix::Material &mat, State& state)
 		// Setp 1: Sample one of many lights.
 		POptix::LightSample lightSample;
 
-		int lightNum = min((int)(rng(thePrd.seed) * sysNumberOfLights), sysNumberOfLights - 1);
-		float lightPdf = 1.0f / sysNumberOfLights;
+		int lightNum;
+		float lightPdf;
+		if (sysLightSelection == POptix::LIGHT_SELECTION_TREE)
+		{
+			lightNum = sampleLightTree(LightTreeNodes(), LightTreeMap(), sysNumberOfLights, sysNumberOfDirectionalLights, thePrd.hit_pos, sample1D(thePrd, SAMPLE_DIMENSION_LIGHT_SELECTION), lightPdf);
+		}
+		else if (sysLightSelection == POptix::LIGHT_SELECTION_POWER)
+		{
+			lightNum = sampleLightAlias(LightAliasTable(), sysNumberOfLights, sample1D(thePrd, SAMPLE_DIMENSION_LIGHT_SELECTION), lightPdf);
+		}
+		else
+		{
+			lightNum = min((int)(sample1D(thePrd, SAMPLE_DIMENSION_LIGHT_SELECTION) * sysNumberOfLights), sysNumberOfLights - 1);
+			lightPdf = 1.0f / sysNumberOfLights;
+		}
 		POptix::Light sampledlight = sysLightParameters[lightNum];
 
 		// Step 2: lightSample direction and distance and directLightPDF returned in world space!
@@ -161,30 +219,43 @@ RT_FUNCTION float3 DirectLighting(POptix::Material &mat, State& state)
 			return make_float3(0.0f);
 		}
 
-		if (dot(sampledlight.normal, -lightSample.direction) > 0.0f)
+		// Quads emit on the front side only. The environment surrounds everything, spheres are sampled on the cap facing the point.
+		if (sampledlight.lightType == POptix::ENVIRONMENT || sampledlight.lightType == POptix::SPHERE || dot(sampledlight.normal, -lightSample.direction) > 0.0f)
 		{
 			Li = lightSample.emission;
 			directLightPdf = lightSample.pdf;
 		}
 
+		// Like the BSDF samples, nothing arrives from below the surface.
+		const float3 lightDir = normalize(lightSample.direction);
+		if (dot(lightDir, state.geometry_normal) <= 0.0f)
+		{
+			Li = make_float3(0.0f);
+		}
+
 		if (lightSample.pdf > 0.0f && isNotNull(Li))
 		{
 			// Step 3: Compute BSDF value for light sample
+			// Evaluated in the light direction on a copy, thePrd keeps the continuation ray sampled above.
+			PerRayData lightPrd = thePrd;
+			lightPrd.wi = lightDir;
+
 			float3 f = make_float3(0.0f);
 			if (thePrd.brdf_flags & POptix::BSDF_DIFFUSE)
 			{
 				// Diffuse evaluation
-				sysBRDFPdf[POptix::EBrdfTypes::LAMBERT](mat, state, thePrd);
-				f = sysBRDFEval[POptix::EBrdfTypes::LAMBERT](mat, state, thePrd);
-				scatteringPdf = thePrd.pdf;
+				sysBRDFPdf[POptix::EBrdfTypes::LAMBERT](mat, state, lightPrd);
+				f = diffuseFresnelWeight(mat, -theRay.direction, lightDir) * sysBRDFEval[POptix::EBrdfTypes::LAMBERT](mat, state, lightPrd);
+				scatteringPdf = lightPrd.pdf;
 			}
 			else if (thePrd.brdf_flags & POptix::BSDF_GLOSSY)
 			{
 				// Specular evaluation
-				sysBRDFPdf[POptix::EBrdfTypes::MICROFACET_REFLECTION](mat, state, thePrd);
-				f = sysBRDFEval[POptix::EBrdfTypes::MICROFACET_REFLECTION](mat, state, thePrd);
-				scatteringPdf = thePrd.pdf;
+				sysBRDFPdf[POptix::EBrdfTypes::MICROFACET_REFLECTION](mat, state, lightPrd);
+				f = sysBRDFEval[POptix::EBrdfTypes::MICROFACET_REFLECTION](mat, state, lightPrd);
+				scatteringPdf = lightPrd.pdf;
 			}
+			f *= fabsf(dot(lightDir, state.shading_normal));
 
 			if (isNotNull(f)) 
 			{
@@ -194,20 +265,21 @@ RT_FUNCTION float3 DirectLighting(POptix::Material &mat, State& state)
 
 				// Note that the sysSceneEpsilon is applied on both sides of the shadow ray [t_min, t_max] interval 
 				// to prevent self intersections with the actual light geometry in the scene!
-				float3 lightDir = normalize(lightSample.direction);
 				optix::Ray ray = optix::make_Ray(thePrd.hit_pos, lightDir, 1, sysSceneEpsilon, lightSample.distance - sysSceneEpsilon); // Shadow ray.
 				rtTrace(sysTopObject, ray, prdShadow);
 
 				if (prdShadow.visible)
 				{
 					// Add light's contribution to reflected radiance
-					if (sampledlight.isDelta)
+					// The last segment of the path traces no continuation ray which could hit the light.
+					if (sampledlight.isDelta || (thePrd.flags & FLAG_LAST_SEGMENT))
 					{
 						Ld += f * Li / directLightPdf;
 					}
 					else 
 					{
-						float weight = PowerHeuristic(1.f, directLightPdf, 1.0f, scatteringPdf);
+						// The selection probability is part of the light sampling pdf, like in closesthit_light.cu.
+						float weight = PowerHeuristic(1.f, lightPdf * directLightPdf, 1.0f, scatteringPdf);
 						Ld += f * Li * weight / directLightPdf;
 					}
 				}
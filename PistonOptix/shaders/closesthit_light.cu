@@ -7,6 +7,9 @@
 #include "per_ray_data.h"
 #include "material_parameter.h"
 #include "shader_common.h"
+#include "light_tree.h"
+#include "light_alias.h"
+#include "light_sample.h"
 #include "PistonOptix/inc/CudaUtils/State.h"
 #include "PistonOptix/inc/LightParameters.h"
 
@@ -26,6 +29,28 @@ rtDeclareVariable(optix::float3, varGeoNormal, attribute GEO_NORMAL, );
 rtBuffer<POptix::Light> sysLightParameters;
 rtDeclareVariable(int, parMaterialIndex, , );  // Index into the sysLightDefinitions array.
 rtDeclareVariable(int, sysNumberOfLights, , );
+rtDeclareVariable(int, sysLightSelection, , );  // POptix::ELightSelection
+rtDeclareVariable(int, sysNumberOfDirectionalLights, , );
+rtBuffer<POptix::LightTreeNode> sysLightTree;
+rtBuffer<int> sysLightTreeMap;
+rtBuffer<POptix::LightAliasEntry> sysLightAliasTable;
+
+// The light tree buffers for the traversal in light_tree.h.
+struct LightTreeNodes
+{
+	RT_FUNCTION POptix::LightTreeNode operator[](const int index) const { return sysLightTree[index]; }
+};
+
+struct LightTreeMap
+{
+	RT_FUNCTION int operator[](const int index) const { return sysLightTreeMap[index]; }
+};
+
+// The alias table buffer for light_alias.h.
+struct LightAliasTable
+{
+	RT_FUNCTION POptix::LightAliasEntry operator[](const int index) const { return sysLightAliasTable[index]; }
+};
 
 
 RT_PROGRAM void closesthit_light()
@@ -40,13 +65,24 @@ RT_PROGRAM void closesthit_light()
 
 	thePrd.radiance = make_float3(0.0f); // Backside is black.
 
-	if (thePrd.flags & FLAG_FRONTFACE) // Looking at the front face?
+	// Looking at the front face? Behind a primary hit with ReSTIR the direct light was resampled, see reservoir.h.
+	if ((thePrd.flags & FLAG_FRONTFACE) && (thePrd.flags & FLAG_DIRECT_RESAMPLED) == 0)
 	{
 		const POptix::Light light = sysLightParameters[parMaterialIndex];
 		thePrd.radiance = light.emission;
 
 #if USE_NEXT_EVENT_ESTIMATION
-		const float pdfLight = (theIntersectionDistance * theIntersectionDistance) / (light.area * cosTheta);
+		// The probability with which DirectLighting() at the ray origin picks this light.
+		float selectionPmf = 1.0f / sysNumberOfLights;
+		if (sysLightSelection == POptix::LIGHT_SELECTION_TREE)
+		{
+			selectionPmf = lightTreePmf(LightTreeNodes(), LightTreeMap(), sysNumberOfLights, sysNumberOfDirectionalLights, parMaterialIndex, theRay.origin);
+		}
+		else if (sysLightSelection == POptix::LIGHT_SELECTION_POWER)
+		{
+			selectionPmf = lightAliasPmf(LightAliasTable(), parMaterialIndex);
+		}
+		const float pdfLight = selectionPmf * lightSamplePdf(light, theRay.origin, theIntersectionDistance, cosTheta);
 		// If it's an implicit light hit from a diffuse scattering event and the light emission was not returning a zero pdf.
 		if ((thePrd.brdf_flags & (POptix::BSDF_DIFFUSE | POptix::BSDF_GLOSSY)) && DENOMINATOR_EPSILON < pdfLight)
 		{
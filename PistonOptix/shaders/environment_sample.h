@@ -0,0 +1,112 @@
+#pragma once
+
+#ifndef ENVIRONMENT_SAMPLE_H
+#define ENVIRONMENT_SAMPLE_H
+
+#include "app_config.h"
+
+#include <optix.h>
+#include <optixu/optixu_math_namespace.h>
+
+#include "rt_function.h"
+#include "per_ray_data.h"
+#include "random_number_generators.h"
+#include "PistonOptix/inc/LightParameters.h"
+
+// Importance sampling of the environment map, shared by miss.cu, LightSample.cu and the host renderers.
+// The map is addressed like miss.cu does: u is the angle around the y-axis, v = (1 + y) / 2. This cylindrical projection
+// preserves area, every texel covers the same solid angle and a density p(u, v) is p(u, v) / (4 * pi) per solid angle.
+// Marginal holds height + 1 cumulative row weights, Conditional height rows of width + 1 cumulative texel weights, see
+// POptix::EnvironmentMap. Both are anything with an operator[], the rtBuffers on the device and arrays on the host.
+
+RT_FUNCTION float2 environmentUV(const float3& direction)
+{
+	const float theta = atan2f(direction.x, direction.z);
+	return make_float2((theta + M_PIf) * (0.5f * M_1_PIf), 0.5f * (1.0f + optix::clamp(direction.y, -1.0f, 1.0f)));
+}
+
+RT_FUNCTION float3 environmentDirection(const float2& uv)
+{
+	const float theta    = 2.0f * M_PIf * uv.x - M_PIf;
+	const float y        = 2.0f * uv.y - 1.0f;
+	const float sinTheta = sqrtf(fmaxf(0.0f, 1.0f - y * y));
+	return make_float3(sinTheta * sinf(theta), y, sinTheta * cosf(theta));
+}
+
+// Interval k of the count intervals starting at cdf[begin] which contains u, and the position t of u inside it.
+template<typename Cdf>
+RT_FUNCTION int sampleEnvironmentCdf(Cdf const& cdf, const int begin, const int count, const float u, float& t)
+{
+	// Last entry not above u. Intervals of zero width are never returned.
+	int first = 0;
+	int last  = count - 1;
+	while (first < last)
+	{
+		const int middle = (first + last + 1) >> 1;
+		if (cdf[begin + middle] <= u)
+		{
+			first = middle;
+		}
+		else
+		{
+			last = middle - 1;
+		}
+	}
+
+	const float lower = cdf[begin + first];
+	const float width = cdf[begin + first + 1] - lower;
+	t = (0.0f < width) ? fminf((u - lower) / width, 0.99999994f) : 0.5f;
+	return first;
+}
+
+// Texture coordinates proportional to the texel weights and their density per solid angle in pdf.
+template<typename Marginal, typename Conditional>
+RT_FUNCTION float2 sampleEnvironment(Marginal const& marginal, Conditional const& conditional, const int width, const int height, const float u1, const float u2, float& pdf)
+{
+	float tv;
+	const int row = sampleEnvironmentCdf(marginal, 0, height, u2, tv);
+	const int begin = row * (width + 1);
+
+	float tu;
+	const int column = sampleEnvironmentCdf(conditional, begin, width, u1, tu);
+
+	const float rowPmf    = marginal[row + 1] - marginal[row];
+	const float columnPmf = conditional[begin + column + 1] - conditional[begin + column];
+	pdf = rowPmf * columnPmf * float(width * height) * (0.25f * M_1_PIf);
+
+	return make_float2((float(column) + tu) / float(width), (float(row) + tv) / float(height));
+}
+
+// Density per solid angle with which sampleEnvironment() returns direction.
+template<typename Marginal, typename Conditional>
+RT_FUNCTION float environmentPdf(Marginal const& marginal, Conditional const& conditional, const int width, const int height, const float3& direction)
+{
+	const float2 uv = environmentUV(direction);
+
+	const int column = optix::clamp(int(uv.x * float(width)), 0, width - 1);
+	const int row    = optix::clamp(int(uv.y * float(height)), 0, height - 1);
+	const int begin  = row * (width + 1);
+
+	const float rowPmf    = marginal[row + 1] - marginal[row];
+	const float columnPmf = conditional[begin + column + 1] - conditional[begin + column];
+	return rowPmf * columnPmf * float(width * height) * (0.25f * M_1_PIf);
+}
+
+// The environment light of the next event estimation, consumes the SAMPLE_DIMENSION_LIGHT of prd. Radiance returns the filtered map at texture coordinates, scaled by
+// light.emission. The light is at infinity and in every direction, the pdf is per solid angle.
+template<typename Marginal, typename Conditional, typename Radiance>
+RT_FUNCTION void environmentLightSample(POptix::Light const& light, PerRayData& prd, POptix::LightSample& sample, Marginal const& marginal, Conditional const& conditional,
+                                        const int width, const int height, Radiance const& radiance)
+{
+	const float2 r = sample2D(prd, SAMPLE_DIMENSION_LIGHT);
+
+	float pdf;
+	const float2 uv = sampleEnvironment(marginal, conditional, width, height, r.x, r.y, pdf);
+
+	sample.direction = environmentDirection(uv);
+	sample.distance  = RT_DEFAULT_MAX;
+	sample.emission  = light.emission * radiance(uv);
+	sample.pdf       = pdf;
+}
+
+#endif // ENVIRONMENT_SAMPLE_H
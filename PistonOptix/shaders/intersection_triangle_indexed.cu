@@ -3,6 +3,7 @@
 #include <optix.h>
 #include <optixu/optixu_math_namespace.h>
 #include "rt_function.h"
+#include "triangle_intersection.h"
 #include "vertex_attributes.h"
 
 rtBuffer<VertexAttributes> attributesBuffer;
@@ -43,33 +44,8 @@ RT_FUNCTION bool IntersectTriangle(const Ray& ray, const float3& v0, const float
 	const float3 ed1 = v0 - v2;
 	N = cross(ed1, ed0);
 
-	double a = v0.x - v1.x, b = v0.x - v2.x, c = ray.direction.x, d = v0.x - ray.origin.x;
-	double e = v0.y - v1.y, f = v0.y - v2.y, g = ray.direction.y, h = v0.y - ray.origin.y;
-	double i = v0.z - v1.z, j = v0.z - v2.z, k = ray.direction.z, l = v0.z - ray.origin.z;
-
-	double m = f * k - g * j, n = h * k - g * l, p = f * l - h * j;
-	double q = g * i - e * k, s = e * j - f * i;
-	double inv_denom = 1.0 / (a * m + b * q + c * s);
-	double e1 = d * m - b * n - c * p;
-	
-	beta = e1 * inv_denom;
-	if (beta < 0.0)
-		return (false);
-	
-	double r = r = e * l - h * i;
-	double e2 = a * n + d * q + c * r;
-	gamma = e2 * inv_denom;
-	if (gamma < 0.0)
-		return (false);
-	if (beta + gamma > 1.0)
-		return false;
-	
-	double e3 = a * p - b * r + d * s;
-	t = e3 * inv_denom;
-	if (t < ray.tmin && t > ray.tmax)
-		return false;
-	
-	return true;
+	const WatertightRay wray = makeWatertightRay(ray.origin, ray.direction);
+	return intersectTriangleWatertight(wray, ray.tmin, ray.tmax, v0, v1, v2, t, beta, gamma);
 }
 
 // Intersection routine for indexed interleaved triangle data.
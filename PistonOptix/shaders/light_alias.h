@@ -0,0 +1,45 @@
+#pragma once
+
+#ifndef LIGHT_ALIAS_H
+#define LIGHT_ALIAS_H
+
+#include "app_config.h"
+
+#include <optix.h>
+#include <optixu/optixu_math_namespace.h>
+
+#include "rt_function.h"
+#include "PistonOptix/inc/LightParameters.h"
+
+// Power proportional light selection with Walker's alias method, shared by DirectLighting() in closesthit.cu,
+// closesthit_light.cu and the host renderers. Table is anything with an operator[], the rtBuffer on the device and an
+// array on the host, see POptix::LightAliasTable.
+
+// Picks a light with u in [0, 1) in constant time. Returns the light index and its selection probability in pmf.
+template<typename Table>
+RT_FUNCTION int sampleLightAlias(Table const& table, const int numberOfLights, const float u, float& pmf)
+{
+	const float scaled = u * float(numberOfLights);
+
+	int index = int(scaled);
+	if (numberOfLights <= index)
+	{
+		index = numberOfLights - 1;
+	}
+	if (table[index].threshold <= scaled - float(index))
+	{
+		index = table[index].alias;
+	}
+
+	pmf = table[index].pmf;
+	return index;
+}
+
+// Probability with which sampleLightAlias() returns lightIndex.
+template<typename Table>
+RT_FUNCTION float lightAliasPmf(Table const& table, const int lightIndex)
+{
+	return table[lightIndex].pmf;
+}
+
+#endif // LIGHT_ALIAS_H
@@ -0,0 +1,259 @@
+#pragma once
+
+#ifndef LIGHT_SAMPLE_H
+#define LIGHT_SAMPLE_H
+
+#include "app_config.h"
+
+#include <optix.h>
+#include <optixu/optixu_math_namespace.h>
+
+#include "rt_function.h"
+#include "per_ray_data.h"
+#include "shader_common.h"
+#include "PistonOptix/inc/CudaUtils/State.h"
+#include "PistonOptix/inc/LightParameters.h"
+
+// Light sampling routines shared by the callable programs in LightSample.cu and the host renderer.
+
+RT_FUNCTION float3 UniformSampleSphere(float u1, float u2)
+{
+	float z = 1.f - 2.f * u1;
+	float r = sqrtf(fmaxf(0.f, 1.f - z * z));
+	float phi = 2.f * M_PIf * u2;
+	float x = r * cosf(phi);
+	float y = r * sinf(phi);
+
+	return make_float3(x, y, z);
+}
+
+// 1 - cos(thetaMax) of the cone around the direction to the centre which just contains a sphere, from sin^2(thetaMax) = r^2 / d^2.
+// Written as sin^2 / (1 + cos), the difference 1 - cos cancels in float for the small cones of far away spheres.
+RT_FUNCTION float sphereConeOneMinusCos(const float sin2ThetaMax)
+{
+	return sin2ThetaMax / (1.0f + sqrtf(1.0f - sin2ThetaMax));
+}
+
+// Solid angle pdf of sampleSphereLight() for any direction from origin which hits the sphere.
+// Inside the sphere only its black back faces are visible, the pdf is 0.
+RT_FUNCTION float sphereLightPdf(POptix::Light const& light, const float3& origin)
+{
+	const float3 toCenter = light.position - origin;
+	const float  d2 = dot(toCenter, toCenter);
+	const float  r2 = light.radius * light.radius;
+	if (d2 <= r2)
+	{
+		return 0.0f;
+	}
+	return 1.0f / (2.0f * M_PIf * sphereConeOneMinusCos(r2 / d2));
+}
+
+// Uniform direction in the cone of the cap of the sphere visible from origin, see "Sampling Spheres" in PBRT.
+// surfacePos is the first hit of that direction on the sphere, the pdf is per solid angle.
+RT_FUNCTION void sampleSphereLight(POptix::Light const& light, const float3& origin, const float2& u, POptix::LightSample& sample)
+{
+	const float3 toCenter = light.position - origin;
+	const float  d2 = dot(toCenter, toCenter);
+	const float  r2 = light.radius * light.radius;
+	if (d2 <= r2)
+	{
+		sample.pdf = 0.0f;
+		return;
+	}
+
+	const float sin2ThetaMax = r2 / d2;
+	const float sinThetaMax  = sqrtf(sin2ThetaMax);
+	const float oneMinusCosThetaMax = sphereConeOneMinusCos(sin2ThetaMax);
+
+	// cos(theta) uniform in [cos(thetaMax), 1], sin^2(theta) from 1 - cos(theta) to keep the small cones accurate.
+	const float oneMinusCosTheta = oneMinusCosThetaMax * u.x;
+	const float cosTheta  = 1.0f - oneMinusCosTheta;
+	const float sin2Theta = oneMinusCosTheta * (2.0f - oneMinusCosTheta);
+
+	// Angle alpha at the centre between the direction to origin and the point hit by the direction theta.
+	const float cosAlpha = sin2Theta / sinThetaMax + cosTheta * sqrtf(fmaxf(0.0f, 1.0f - sin2Theta / sin2ThetaMax));
+	const float sinAlpha = sqrtf(fmaxf(0.0f, 1.0f - cosAlpha * cosAlpha));
+	const float phi      = 2.0f * M_PIf * u.y;
+
+	const TBN tbn(-toCenter / sqrtf(d2));
+	const float3 normal = tbn.inverse_transform(make_float3(sinAlpha * cosf(phi), sinAlpha * sinf(phi), cosAlpha));
+
+	sample.surfacePos = light.position + light.radius * normal;
+
+	const float3 wi = sample.surfacePos - origin;
+	sample.distance  = length(wi);
+	sample.direction = wi / sample.distance;
+	sample.emission  = light.emission;
+	sample.pdf       = 1.0f / (2.0f * M_PIf * oneMinusCosThetaMax);
+}
+
+RT_FUNCTION void sphereLightSample(POptix::Light const& light, PerRayData& prd, POptix::LightSample& sample, State const& state)
+{
+	sampleSphereLight(light, state.hit_position, sample2D(prd, SAMPLE_DIMENSION_LIGHT), sample);
+}
+
+RT_FUNCTION void directionalLightSample(POptix::Light const& light, PerRayData& /*prd*/, POptix::LightSample& sample, State const& /*state*/)
+{
+	sample.direction = -light.normal;
+	sample.distance = RT_DEFAULT_MAX;
+	sample.emission = light.emission;
+	sample.pdf = 1.0f;
+}
+
+// Spherical rectangle of a quad light seen from origin, see "An Area-Preserving Parametrization for Spherical Rectangles"
+// by Urena, Fajardo and King. x, y and z are the frame of the quad, (x0, y0, z0) its corner relative to origin.
+struct SphericalRectangle
+{
+	float3 x;
+	float3 y;
+	float3 z;
+	float  x0;
+	float  y0;
+	float  z0;
+	float  x1;
+	float  y1;
+	float  b0;
+	float  b1;
+	float  k;
+	float  solidAngle;
+};
+
+// False when the quad is sampled by area: parallelograms which are no rectangles, points behind or in the plane of the light
+// and solid angles below minSolidAngle, where the sum of the angles cancels in float and area sampling is as good.
+RT_FUNCTION bool initSphericalRectangle(POptix::Light const& light, const float3& origin, const float minSolidAngle, SphericalRectangle& rect)
+{
+	const float lengthU = length(light.u);
+	const float lengthV = length(light.v);
+	if (1.0e-4f * lengthU * lengthV < fabsf(dot(light.u, light.v)))
+	{
+		return false;
+	}
+
+	rect.x = light.u / lengthU;
+	rect.y = light.v / lengthV;
+	rect.z = cross(rect.x, rect.y); // The normal of the light, it emits towards points with z0 < 0.
+
+	const float3 d = light.position - origin;
+	rect.z0 = dot(d, rect.z);
+	if (0.0f <= rect.z0)
+	{
+		return false;
+	}
+	rect.x0 = dot(d, rect.x);
+	rect.y0 = dot(d, rect.y);
+	rect.x1 = rect.x0 + lengthU;
+	rect.y1 = rect.y0 + lengthV;
+
+	// Normals of the planes through origin and the edges, the solid angle is the sum of the inner angles minus 2 pi.
+	const float3 v00 = make_float3(rect.x0, rect.y0, rect.z0);
+	const float3 v01 = make_float3(rect.x0, rect.y1, rect.z0);
+	const float3 v10 = make_float3(rect.x1, rect.y0, rect.z0);
+	const float3 v11 = make_float3(rect.x1, rect.y1, rect.z0);
+	const float3 n0  = normalize(cross(v00, v10));
+	const float3 n1  = normalize(cross(v10, v11));
+	const float3 n2  = normalize(cross(v11, v01));
+	const float3 n3  = normalize(cross(v01, v00));
+
+	const float g0 = acosf(clamp(-dot(n0, n1), -1.0f, 1.0f));
+	const float g1 = acosf(clamp(-dot(n1, n2), -1.0f, 1.0f));
+	const float g2 = acosf(clamp(-dot(n2, n3), -1.0f, 1.0f));
+	const float g3 = acosf(clamp(-dot(n3, n0), -1.0f, 1.0f));
+
+	rect.b0 = n0.z;
+	rect.b1 = n2.z;
+	rect.k  = 2.0f * M_PIf - g2 - g3;
+	rect.solidAngle = g0 + g1 - rect.k;
+
+	return minSolidAngle <= rect.solidAngle;
+}
+
+// Point on the quad for the uniform sample u of the solid angle, relative to origin.
+RT_FUNCTION float3 sampleSphericalRectangle(SphericalRectangle const& rect, const float2& u)
+{
+	// x from the area of the spherical rectangle left of it.
+	const float au = u.x * rect.solidAngle + rect.k;
+	const float fu = (cosf(au) * rect.b0 - rect.b1) / sinf(au);
+	const float cu = clamp(((0.0f <= fu) ? 1.0f : -1.0f) / sqrtf(fu * fu + rect.b0 * rect.b0), -1.0f, 1.0f);
+	const float xu = clamp(-(cu * rect.z0) / fmaxf(sqrtf(1.0f - cu * cu), 1.0e-7f), rect.x0, rect.x1);
+
+	// y uniform in the sine of the elevation along the line at x.
+	const float d  = sqrtf(xu * xu + rect.z0 * rect.z0);
+	const float h0 = rect.y0 / sqrtf(d * d + rect.y0 * rect.y0);
+	const float h1 = rect.y1 / sqrtf(d * d + rect.y1 * rect.y1);
+	const float hv = h0 + u.y * (h1 - h0);
+	const float hv2 = hv * hv;
+	const float yv = (hv2 < 1.0f - 1.0e-6f) ? (hv * d) / sqrtf(1.0f - hv2) : rect.y1;
+
+	return xu * rect.x + yv * rect.y + rect.z0 * rect.z;
+}
+
+// Uniform direction in the solid angle of the quad, or a uniform point on its area when initSphericalRectangle() says so.
+// The pdf is per solid angle in both cases, 0 for points behind the light.
+RT_FUNCTION void sampleQuadLight(POptix::Light const& light, const float3& origin, const float2& u, const float minSolidAngle, POptix::LightSample& sample)
+{
+	SphericalRectangle rect;
+	if (initSphericalRectangle(light, origin, minSolidAngle, rect))
+	{
+		const float3 wi = sampleSphericalRectangle(rect, u);
+
+		sample.surfacePos = origin + wi;
+		sample.distance   = length(wi);
+		sample.direction  = wi / sample.distance;
+		sample.emission   = light.emission;
+		sample.pdf        = 1.0f / rect.solidAngle;
+		return;
+	}
+
+	// position on the area light
+	sample.surfacePos = light.position + light.u * u.x + light.v * u.y;
+	sample.pdf = 1.0f / light.area;
+
+	// light ray direction
+	float3 wi = normalize(sample.surfacePos - origin);
+	float distance = length(sample.surfacePos - origin);
+
+	float cosTheta = fabsf(dot(light.normal, -wi));
+	if (cosTheta < DENOMINATOR_EPSILON)
+	{
+		sample.pdf = 0.0f;
+		return;
+	}
+
+	sample.pdf *= (distance * distance) / cosTheta;
+	if (sample.pdf > 10E19)
+		sample.pdf = 0.0f;
+
+	sample.distance = distance;
+	sample.direction = wi;
+	sample.emission = light.emission;
+}
+
+// Solid angle pdf of sampleQuadLight() for the direction from origin which hits the front of the quad after distance
+// with cosTheta to its normal.
+RT_FUNCTION float quadLightPdf(POptix::Light const& light, const float3& origin, const float distance, const float cosTheta, const float minSolidAngle)
+{
+	SphericalRectangle rect;
+	if (initSphericalRectangle(light, origin, minSolidAngle, rect))
+	{
+		return 1.0f / rect.solidAngle;
+	}
+	return (distance * distance) / (light.area * cosTheta);
+}
+
+RT_FUNCTION void quadLightSample(POptix::Light const& light, PerRayData& prd, POptix::LightSample& sample, State const& state)
+{
+	sampleQuadLight(light, state.hit_position, sample2D(prd, SAMPLE_DIMENSION_LIGHT), QUAD_LIGHT_MIN_SOLID_ANGLE, sample);
+}
+
+// Solid angle pdf with which the light sampling above picks the direction from origin to a hit on the front of a quad or
+// sphere light, distance along the ray and cosTheta to the light normal. For the MIS weights of the light hits.
+RT_FUNCTION float lightSamplePdf(POptix::Light const& light, const float3& origin, const float distance, const float cosTheta)
+{
+	if (light.lightType == POptix::SPHERE)
+	{
+		return sphereLightPdf(light, origin);
+	}
+	return quadLightPdf(light, origin, distance, cosTheta, QUAD_LIGHT_MIN_SOLID_ANGLE);
+}
+
+#endif // LIGHT_SAMPLE_H
@@ -0,0 +1,134 @@
+#pragma once
+
+#ifndef LIGHT_TREE_H
+#define LIGHT_TREE_H
+
+#include "app_config.h"
+
+#include <optix.h>
+#include <optixu/optixu_math_namespace.h>
+
+#include "rt_function.h"
+#include "shader_common.h"
+#include "PistonOptix/inc/LightParameters.h"
+
+// Stochastic traversal of the light BVH, shared by DirectLighting() in closesthit.cu, closesthit_light.cu and the host renderers.
+// Nodes and LightMap are anything with an operator[], the rtBuffers on the device and arrays on the host, see POptix::LightTree.
+// LightMap entry i < numberOfLights is the leaf node of light i, or -1 - k when it is the k-th directional light.
+// Entry numberOfLights + k is the light index of the k-th directional light. Environment lights count as directional.
+
+// Upper estimate of the radiance the lights of node send to position, after Conty Estevez and Kulla,
+// "Importance Sampling of Many Lights with Adaptive Tree Splitting". Power over squared distance, reduced by the smallest
+// angle between the emission cone and the direction to position. The receiver normal is not used, so the selection
+// probability of a light hit by a BRDF sample only depends on the ray origin.
+// The angle differences are evaluated on cosines and sines, without inverse trigonometric functions.
+RT_FUNCTION float lightTreeImportance(POptix::LightTreeNode const& node, const float3& position)
+{
+	const float3 center  = (node.boundsMin + node.boundsMax) * 0.5f;
+	const float3 extent  = node.boundsMax - node.boundsMin;
+	const float  radius2 = 0.25f * dot(extent, extent);
+
+	const float3 w = position - center;
+	const float  distance2 = dot(w, w);
+
+	// Inside the bounding sphere every emission direction can reach position.
+	if (distance2 <= radius2)
+	{
+		return node.power / fmaxf(distance2, sqrtf(radius2));
+	}
+
+	// theta between axis and the direction to position, thetaO the normal cone, thetaU the bounding sphere seen from position.
+	const float cosTheta  = optix::clamp(dot(node.axis, w) / sqrtf(distance2), -1.0f, 1.0f);
+	const float sinTheta  = sqrtf(fmaxf(0.0f, 1.0f - cosTheta * cosTheta));
+	const float sinThetaO = sqrtf(fmaxf(0.0f, 1.0f - node.cosThetaO * node.cosThetaO));
+	const float sin2ThetaU = radius2 / distance2;
+	const float cosThetaU = sqrtf(fmaxf(0.0f, 1.0f - sin2ThetaU));
+	const float sinThetaU = sqrtf(sin2ThetaU);
+
+	// cos(max(0, theta - thetaO)).
+	float cosThetaX = 1.0f;
+	float sinThetaX = 0.0f;
+	if (cosTheta < node.cosThetaO)
+	{
+		cosThetaX = cosTheta * node.cosThetaO + sinTheta * sinThetaO;
+		sinThetaX = sinTheta * node.cosThetaO - cosTheta * sinThetaO;
+	}
+
+	// cos(max(0, theta - thetaO - thetaU)).
+	const float cosThetaP = (cosThetaX < cosThetaU) ? cosThetaX * cosThetaU + sinThetaX * sinThetaU : 1.0f;
+	if (cosThetaP <= node.cosThetaE)
+	{
+		return 0.0f;
+	}
+	return node.power * cosThetaP / distance2;
+}
+
+// Probability to descend into the first child of the inner node index.
+template<typename Nodes>
+RT_FUNCTION float lightTreeFirstChildProbability(Nodes const& nodes, const int index, const float3& position)
+{
+	const float importance0 = lightTreeImportance(nodes[index + 1], position);
+	const float importance1 = lightTreeImportance(nodes[nodes[index].child], position);
+	const float sum = importance0 + importance1;
+	return (0.0f < sum) ? importance0 / sum : 0.5f;
+}
+
+// Picks a light with u in [0, 1). Directional lights have no position, they keep the probability uniform selection gives them.
+// Returns the light index and its selection probability in pmf.
+template<typename Nodes, typename LightMap>
+RT_FUNCTION int sampleLightTree(Nodes const& nodes, LightMap const& lightMap, const int numberOfLights, const int numberOfDirectionalLights, const float3& position, float u, float& pmf)
+{
+	const float directionalShare = float(numberOfDirectionalLights) / float(numberOfLights);
+	if (u < directionalShare)
+	{
+		const int k = int(u / directionalShare * numberOfDirectionalLights);
+		pmf = 1.0f / float(numberOfLights);
+		return lightMap[numberOfLights + ((k < numberOfDirectionalLights) ? k : numberOfDirectionalLights - 1)];
+	}
+
+	pmf = 1.0f - directionalShare;
+	u = (u - directionalShare) / pmf;
+
+	int index = 0;
+	while (0 <= nodes[index].child)
+	{
+		const float p = lightTreeFirstChildProbability(nodes, index, position);
+		if (u < p)
+		{
+			u /= p;
+			pmf *= p;
+			++index;
+		}
+		else
+		{
+			u = (u - p) / (1.0f - p);
+			pmf *= 1.0f - p;
+			index = nodes[index].child;
+		}
+		u = fminf(u, 0.99999994f); // Reuse the remaining bits, stay below 1.
+	}
+	return -1 - nodes[index].child;
+}
+
+// Probability with which sampleLightTree() returns lightIndex at position.
+template<typename Nodes, typename LightMap>
+RT_FUNCTION float lightTreePmf(Nodes const& nodes, LightMap const& lightMap, const int numberOfLights, const int numberOfDirectionalLights, const int lightIndex, const float3& position)
+{
+	int node = lightMap[lightIndex];
+	if (node < 0)
+	{
+		return 1.0f / float(numberOfLights);
+	}
+
+	float pmf = 1.0f - float(numberOfDirectionalLights) / float(numberOfLights);
+	while (0 < node)
+	{
+		const int parent = nodes[node].parent;
+		const float p = lightTreeFirstChildProbability(nodes, parent, position);
+		pmf *= (node == parent + 1) ? p : 1.0f - p;
+		node = parent;
+	}
+	return pmf;
+}
+
+#endif // LIGHT_TREE_H
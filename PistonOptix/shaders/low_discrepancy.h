@@ -0,0 +1,244 @@
+#pragma once
+
+#ifndef LOW_DISCREPANCY_H
+#define LOW_DISCREPANCY_H
+
+#include "app_config.h"
+#include "rt_function.h"
+
+#include <optix.h>
+#include <optixu/optixu_math_namespace.h>
+
+// Low discrepancy samples for the path tracer, shared by raygeneration.cu and the host renderers.
+// Every random decision of a path segment reads its own sample dimension, see SAMPLE_DIMENSION_*, so the samples of one
+// pixel are stratified in each decision instead of being consecutive numbers of one LCG stream.
+
+namespace POptix
+{
+	enum ESampler
+	{
+		SAMPLER_LCG,        // rng() seeded by tea<8>(pixel, iteration), no stratification.
+		SAMPLER_SOBOL,      // Owen scrambled Sobol (0, 2)-sequence, shuffled and scrambled per pixel and dimension.
+		SAMPLER_HALTON,     // Owen scrambled Halton sequence, one prime base per dimension, scrambled per pixel.
+		SAMPLER_BLUE_NOISE, // Sobol sequence shared by all pixels, shifted per pixel by a blue noise tile, for previews at few samples per pixel.
+		NUM_OF_SAMPLERS
+	};
+}
+
+// Sample dimensions. The pixel jitter comes first, then each path segment uses the same layout starting at
+// SAMPLE_DIMENSION_CAMERA + segment * SAMPLE_DIMENSIONS_PER_SEGMENT. 2D samples take two dimensions.
+#define SAMPLE_DIMENSION_PIXEL           0  // 2D
+#define SAMPLE_DIMENSION_CAMERA          2  // First dimension of the primary ray segment.
+
+#define SAMPLE_DIMENSION_LOBE            0  // Diffuse or specular BRDF.
+#define SAMPLE_DIMENSION_BRDF            1  // 2D, direction of the BRDF sample.
+#define SAMPLE_DIMENSION_LIGHT_SELECTION 3  // Light of the next event estimation.
+#define SAMPLE_DIMENSION_LIGHT           4  // 2D, point on the light.
+#define SAMPLE_DIMENSION_ROULETTE        6  // Russian Roulette.
+#define SAMPLE_DIMENSIONS_PER_SEGMENT    7
+
+// Column Bit of the generator matrix of Sobol dimension Dim, the direction number of index bit Bit. Dimension 0 is the van der
+// Corput sequence. Dimension 1 has the primitive polynomial x + 1 and m_1 = 1, its matrix is the Pascal matrix mod 2: each column
+// is the previous one xor itself shifted down by one. Only these two dimensions are used, see sobolSample2D().
+template<int Dim, int Bit>
+struct SobolDirection;
+
+template<int Bit>
+struct SobolDirection<0, Bit>
+{
+	static const unsigned int value = 1u << (31 - Bit);
+};
+
+template<int Bit>
+struct SobolDirection<1, Bit>
+{
+	static const unsigned int value = SobolDirection<1, Bit - 1>::value ^ (SobolDirection<1, Bit - 1>::value >> 1);
+};
+
+template<>
+struct SobolDirection<1, 0>
+{
+	static const unsigned int value = 1u << 31;
+};
+
+// XOR of the direction numbers of the set index bits, unrolled by the compiler.
+template<int Dim, int Bit = 0>
+struct SobolGenerator
+{
+	RT_FUNCTION static unsigned int apply(const unsigned int index)
+	{
+		return (((index >> Bit) & 1u) ? SobolDirection<Dim, Bit>::value : 0u) ^ SobolGenerator<Dim, Bit + 1>::apply(index);
+	}
+};
+
+template<int Dim>
+struct SobolGenerator<Dim, 32>
+{
+	RT_FUNCTION static unsigned int apply(const unsigned int)
+	{
+		return 0u;
+	}
+};
+
+// Sobol point index in dimension Dim, 0 <= Dim <= 1, as 32 bit fixed point.
+template<int Dim>
+RT_FUNCTION unsigned int sobol(const unsigned int index)
+{
+	return SobolGenerator<Dim>::apply(index);
+}
+
+RT_FUNCTION unsigned int reverseBits(unsigned int x)
+{
+#if defined(__CUDA_ARCH__)
+	return __brev(x);
+#else
+	x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+	x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+	x = ((x >> 4) & 0x0F0F0F0Fu) | ((x & 0x0F0F0F0Fu) << 4);
+	x = ((x >> 8) & 0x00FF00FFu) | ((x & 0x00FF00FFu) << 8);
+	return (x >> 16) | (x << 16);
+#endif
+}
+
+// Integer hash to derive independent seeds per pixel and dimension.
+RT_FUNCTION unsigned int hashCombine(const unsigned int seed, const unsigned int value)
+{
+	unsigned int x = seed ^ (value + 0x9e3779b9u + (seed << 6) + (seed >> 2));
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return x;
+}
+
+// Owen scrambling of the bits of x, most significant bit first: each bit is flipped depending on the bits above it.
+// Laine and Karras' hash of the reversed bits, with the constants of Burley, "Practical Hash-based Owen Scrambling".
+RT_FUNCTION unsigned int owenScramble(unsigned int x, const unsigned int seed)
+{
+	x = reverseBits(x);
+	x += seed;
+	x ^= x * 0x6c50b47cu;
+	x ^= x * 0xb82f1e52u;
+	x ^= x * 0xc7afe638u;
+	x ^= x * 0x8d22f6e6u;
+	return reverseBits(x);
+}
+
+// 32 bit fixed point to [0, 1). The top 24 bits fit the float mantissa.
+RT_FUNCTION float fixedPointToFloat(const unsigned int x)
+{
+	return float(x >> 8) * (1.0f / float(0x01000000u));
+}
+
+// Burley's shuffled and scrambled Sobol sampler. Shuffling the sample index per dimension decorrelates the dimensions,
+// so the first two Sobol dimensions, a (0, 2)-sequence, are enough for any number of 2D samples.
+// Dimension Dim, 0 or 1, of the point with the shuffled sampleIndex, Owen scrambled, as 32 bit fixed point.
+template<int Dim>
+RT_FUNCTION unsigned int shuffledSobol(const unsigned int sampleIndex, const unsigned int dimensionSeed)
+{
+	return owenScramble(sobol<Dim>(owenScramble(sampleIndex, dimensionSeed)), hashCombine(dimensionSeed, unsigned(Dim + 1)));
+}
+
+RT_FUNCTION float2 sobolSample2D(const unsigned int sampleIndex, const unsigned int dimension, const unsigned int seed)
+{
+	const unsigned int dimensionSeed = hashCombine(seed, dimension);
+
+	return make_float2(fixedPointToFloat(shuffledSobol<0>(sampleIndex, dimensionSeed)),
+	                   fixedPointToFloat(shuffledSobol<1>(sampleIndex, dimensionSeed)));
+}
+
+RT_FUNCTION float sobolSample1D(const unsigned int sampleIndex, const unsigned int dimension, const unsigned int seed)
+{
+	return fixedPointToFloat(shuffledSobol<0>(sampleIndex, hashCombine(seed, dimension)));
+}
+
+// The first 64 primes, the Halton bases of the dimensions. Longer paths start over with other scrambles.
+#define HALTON_NUM_BASES 64
+
+RT_FUNCTION unsigned int haltonBase(const unsigned int dimension)
+{
+	const unsigned int primes[HALTON_NUM_BASES] =
+	{
+		  2,   3,   5,   7,  11,  13,  17,  19,  23,  29,  31,  37,  41,  43,  47,  53,
+		 59,  61,  67,  71,  73,  79,  83,  89,  97, 101, 103, 107, 109, 113, 127, 131,
+		137, 139, 149, 151, 157, 163, 167, 173, 179, 181, 191, 193, 197, 199, 211, 223,
+		227, 229, 233, 239, 241, 251, 257, 263, 269, 271, 277, 281, 283, 293, 307, 311
+	};
+	return primes[dimension % HALTON_NUM_BASES];
+}
+
+// Radical inverse of index in base with Owen scrambling: each digit is shifted by a hash of the digits before it, a random
+// permutation of the digit values per prefix. The digits of the zero tail are scrambled too until the float precision is reached.
+RT_FUNCTION float haltonSample1D(unsigned int index, const unsigned int dimension, const unsigned int seed)
+{
+	const unsigned int base = haltonBase(dimension);
+	const float invBase = 1.0f / float(base);
+
+	unsigned int prefix = hashCombine(seed, dimension);
+	float result = 0.0f;
+	float scale  = invBase;
+	while (1.0e-7f < scale)
+	{
+		const unsigned int digit = index % base;
+		index /= base;
+
+		const unsigned int scrambled = (digit + prefix) % base;
+		result += float(scrambled) * scale;
+
+		prefix = hashCombine(prefix, digit);
+		scale *= invBase;
+	}
+	return fminf(result, 0.99999994f);
+}
+
+RT_FUNCTION float2 haltonSample2D(const unsigned int sampleIndex, const unsigned int dimension, const unsigned int seed)
+{
+	return make_float2(haltonSample1D(sampleIndex, dimension, seed), haltonSample1D(sampleIndex, dimension + 1, seed));
+}
+
+// Side length of the blue noise tile, its texels hold the void-and-cluster ranks 0 to BLUE_NOISE_TILE_SIZE^2 - 1.
+#define BLUE_NOISE_TILE_SIZE  64
+#define BLUE_NOISE_RANK_BITS  12
+
+// Blue noise sampler. All pixels share the shuffled and scrambled Sobol sequence of a dimension, digitally shifted per pixel,
+// XOR with a key, so that the first sample of the pixel is its rank in the blue noise tile. Neighboring pixels get distant
+// ranks, so the error of the first sample is spread as blue noise over the screen. The digital shift keeps the (0, 2)-sequence
+// of every pixel intact and its samples stratified over the iterations, unlike a Cranley-Patterson rotation.
+// Each dimension reads the tile with another toroidal shift, along the R2 sequence, to decorrelate the dimensions.
+// pixel holds x in the low and y in the high 16 bits. Tile is anything with an operator()(x, y) returning the rank, the rtBuffer
+// on the device and POptix::BlueNoiseTile on the host.
+template<typename Tile>
+RT_FUNCTION unsigned int blueNoiseKey(Tile const& tile, const unsigned int dimension, const unsigned int pixel)
+{
+	// R2 offsets with the plastic number, 0.7548776662 and 0.5698402910 in 32 bit fixed point.
+	const unsigned int shiftX = (dimension * 3242174889u) >> (32 - 6);
+	const unsigned int shiftY = (dimension * 2447445414u) >> (32 - 6);
+	const unsigned int x = ((pixel & 0xFFFFu) + shiftX) & (BLUE_NOISE_TILE_SIZE - 1);
+	const unsigned int y = ((pixel >> 16)     + shiftY) & (BLUE_NOISE_TILE_SIZE - 1);
+
+	// The rank in the high bits, hashed bits below it make the first sample continuous.
+	return (tile(x, y) << (32 - BLUE_NOISE_RANK_BITS)) | (hashCombine(pixel, dimension) >> BLUE_NOISE_RANK_BITS);
+}
+
+template<int Dim, typename Tile>
+RT_FUNCTION float blueNoiseSobol(Tile const& tile, const unsigned int sampleIndex, const unsigned int dimension, const unsigned int pixel)
+{
+	const unsigned int dimensionSeed = hashCombine(0u, dimension);
+
+	return fixedPointToFloat(shuffledSobol<Dim>(sampleIndex, dimensionSeed) ^ shuffledSobol<Dim>(0u, dimensionSeed) ^ blueNoiseKey(tile, dimension + Dim, pixel));
+}
+
+template<typename Tile>
+RT_FUNCTION float blueNoiseSample1D(Tile const& tile, const unsigned int sampleIndex, const unsigned int dimension, const unsigned int pixel)
+{
+	return blueNoiseSobol<0>(tile, sampleIndex, dimension, pixel);
+}
+
+template<typename Tile>
+RT_FUNCTION float2 blueNoiseSample2D(Tile const& tile, const unsigned int sampleIndex, const unsigned int dimension, const unsigned int pixel)
+{
+	return make_float2(blueNoiseSobol<0>(tile, sampleIndex, dimension, pixel), blueNoiseSobol<1>(tile, sampleIndex, dimension, pixel));
+}
+
+#endif // LOW_DISCREPANCY_H
@@ -5,21 +5,87 @@
 
 #include "rt_function.h"
 #include "per_ray_data.h"
+#include "shader_common.h"
+#include "light_tree.h"
+#include "light_alias.h"
+#include "environment_sample.h"
+#include "PistonOptix/inc/LightParameters.h"
 
 rtDeclareVariable(PerRayData, thePrd, rtPayload, );
 rtDeclareVariable(optix::Ray, ray, rtCurrentRay, );
 
 rtTextureSampler<float4, 2> envmap;
 
+rtBuffer<POptix::Light> sysLightParameters;
+rtDeclareVariable(int, sysNumberOfLights, , );
+rtDeclareVariable(int, sysEnvironmentLight, , );  // Index of the environment light in sysLightParameters, -1 without one.
+rtDeclareVariable(int, sysLightSelection, , );    // POptix::ELightSelection
+rtDeclareVariable(int, sysNumberOfDirectionalLights, , );
+rtBuffer<POptix::LightTreeNode> sysLightTree;
+rtBuffer<int> sysLightTreeMap;
+rtBuffer<POptix::LightAliasEntry> sysLightAliasTable;
+rtBuffer<float> sysEnvironmentMarginal;
+rtBuffer<float> sysEnvironmentConditional;
+rtDeclareVariable(int2, sysEnvironmentSize, , );
+
+// The light tree buffers for the traversal in light_tree.h.
+struct LightTreeNodes
+{
+	RT_FUNCTION POptix::LightTreeNode operator[](const int index) const { return sysLightTree[index]; }
+};
+
+struct LightTreeMap
+{
+	RT_FUNCTION int operator[](const int index) const { return sysLightTreeMap[index]; }
+};
+
+// The alias table buffer for light_alias.h.
+struct LightAliasTable
+{
+	RT_FUNCTION POptix::LightAliasEntry operator[](const int index) const { return sysLightAliasTable[index]; }
+};
+
+// The cumulative distributions for environment_sample.h.
+struct EnvironmentMarginal
+{
+	RT_FUNCTION float operator[](const int index) const { return sysEnvironmentMarginal[index]; }
+};
+
+struct EnvironmentConditional
+{
+	RT_FUNCTION float operator[](const int index) const { return sysEnvironmentConditional[index]; }
+};
+
 
 RT_PROGRAM void miss_environment_constant()
 {
-	float theta = atan2f(ray.direction.x, ray.direction.z);
-	float phi = M_PIf * 0.5f - acosf(ray.direction.y);
-	float u = (theta + M_PIf) * (0.5f * M_1_PIf);
-	float v = 0.5f * (1.0f + sin(phi));
-	float3 result = make_float3(tex2D(envmap, u, v));
-
-	thePrd.radiance = make_float3(0.0f); // Constant white emission. No next event estimation (direct lighting).
-	thePrd.flags |= FLAG_TERMINATE;    // End of path.
+	thePrd.radiance = make_float3(0.0f); // Black without an environment light.
+
+	// Behind a primary hit with ReSTIR the direct light was resampled, see reservoir.h.
+	if (0 <= sysEnvironmentLight && (thePrd.flags & FLAG_DIRECT_RESAMPLED) == 0)
+	{
+		const POptix::Light light = sysLightParameters[sysEnvironmentLight];
+		const float2 uv = environmentUV(ray.direction);
+		thePrd.radiance = light.emission * make_float3(tex2D(envmap, uv.x, uv.y));
+
+#if USE_NEXT_EVENT_ESTIMATION
+		// The probability with which DirectLighting() at the ray origin picks the environment and this direction.
+		float selectionPmf = 1.0f / sysNumberOfLights;
+		if (sysLightSelection == POptix::LIGHT_SELECTION_TREE)
+		{
+			selectionPmf = lightTreePmf(LightTreeNodes(), LightTreeMap(), sysNumberOfLights, sysNumberOfDirectionalLights, sysEnvironmentLight, ray.origin);
+		}
+		else if (sysLightSelection == POptix::LIGHT_SELECTION_POWER)
+		{
+			selectionPmf = lightAliasPmf(LightAliasTable(), sysEnvironmentLight);
+		}
+		const float pdfLight = selectionPmf * environmentPdf(EnvironmentMarginal(), EnvironmentConditional(), sysEnvironmentSize.x, sysEnvironmentSize.y, ray.direction);
+		if ((thePrd.brdf_flags & (POptix::BSDF_DIFFUSE | POptix::BSDF_GLOSSY)) && DENOMINATOR_EPSILON < pdfLight)
+		{
+			thePrd.radiance *= powerHeuristic(thePrd.pdf, pdfLight);
+		}
+#endif // USE_NEXT_EVENT_ESTIMATION
+	}
+
+	thePrd.flags |= FLAG_TERMINATE; // End of path.
 }
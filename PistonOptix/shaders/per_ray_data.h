@@ -5,10 +5,37 @@
 
 #include "app_config.h"
 #include "random_number_generators.h"
+#include "low_discrepancy.h"
+
+#if defined(__CUDACC__)
+rtBuffer<unsigned short, 2> sysBlueNoise; // BLUE_NOISE_TILE_SIZE^2 ranks of POptix::BlueNoiseTile.
+
+struct BlueNoiseRanks
+{
+	RT_FUNCTION unsigned int operator()(const unsigned int x, const unsigned int y) const { return sysBlueNoise[make_uint2(x, y)]; }
+};
+#else
+#include "PistonOptix/inc/BlueNoiseTile.h"
+
+struct BlueNoiseRanks
+{
+	unsigned int operator()(const unsigned int x, const unsigned int y) const { return POptix::BlueNoiseTile::getRank(x, y); }
+};
+#endif
 
 // Set if (0.0f <= wo_dot_ng), means looking onto the front face. (Edge-on is explicitly handled as frontface for the material stack.)
 #define FLAG_FRONTFACE      0x00000010
 
+// The direct light of the primary hit comes from the reservoirs, see reservoir.h. Lights hit by the next segment add nothing.
+#define FLAG_DIRECT_RESAMPLED 0x00000020
+
+// Set on the primary ray with ReSTIR, closesthit() writes the surface of the hit into sysReservoirBuffer.
+#define FLAG_RESTIR_PRIMARY   0x00000040
+
+// Set on the last segment of the path. The continuation ray of its hit is never traced, so the next event estimation there
+// has no BRDF sample to share the light with and takes it at full weight.
+#define FLAG_LAST_SEGMENT     0x00000080
+
 // Highest bit set means terminate path.
 #define FLAG_TERMINATE      0x80000000
 
@@ -31,9 +58,83 @@ struct PerRayData
 	optix::float3 f_over_pdf;     // BSDF sample throughput, pre-multiplied f_over_pdf = bsdf.f * fabsf(dot(wi, ns) / bsdf.pdf; 
 	float         pdf;            // The last BSDF sample's pdf, tracked for multiple importance sampling.
 
-	unsigned int  seed;           // Random number generator input.
+	unsigned int  seed;           // Random number generator input. The scramble seed of the pixel with Sobol and Halton, the pixel with blue noise.
+	unsigned int  sample_index;   // Index of the pixel sample in the low discrepancy sequence.
+	int           dimension;      // First sample dimension of the current path segment, see SAMPLE_DIMENSION_*.
+	int           sampler;        // POptix::ESampler.
 };
 
+// Sample of the decision at offset of the current path segment, e.g. SAMPLE_DIMENSION_LOBE.
+// The LCG ignores the dimension and returns the next number of its stream, the results of rng() and rng2().
+RT_FUNCTION float sample1D(PerRayData& prd, const int offset)
+{
+	if (prd.sampler == POptix::SAMPLER_SOBOL)
+	{
+		return sobolSample1D(prd.sample_index, unsigned(prd.dimension + offset), prd.seed);
+	}
+	if (prd.sampler == POptix::SAMPLER_HALTON)
+	{
+		return haltonSample1D(prd.sample_index, unsigned(prd.dimension + offset), prd.seed);
+	}
+	if (prd.sampler == POptix::SAMPLER_BLUE_NOISE)
+	{
+		return blueNoiseSample1D(BlueNoiseRanks(), prd.sample_index, unsigned(prd.dimension + offset), prd.seed);
+	}
+	return rng(prd.seed);
+}
+
+RT_FUNCTION optix::float2 sample2D(PerRayData& prd, const int offset)
+{
+	if (prd.sampler == POptix::SAMPLER_SOBOL)
+	{
+		return sobolSample2D(prd.sample_index, unsigned(prd.dimension + offset), prd.seed);
+	}
+	if (prd.sampler == POptix::SAMPLER_HALTON)
+	{
+		return haltonSample2D(prd.sample_index, unsigned(prd.dimension + offset), prd.seed);
+	}
+	if (prd.sampler == POptix::SAMPLER_BLUE_NOISE)
+	{
+		return blueNoiseSample2D(BlueNoiseRanks(), prd.sample_index, unsigned(prd.dimension + offset), prd.seed);
+	}
+	return rng2(prd.seed);
+}
+
+// Starts the sampler of the pixel sample sampleIndex at pixel (x, y) of an image width pixels wide and returns the jitter
+// of the fragment in the pixel. The LCG seed is tea<8>(linear pixel index, sampleIndex) as before, the low discrepancy
+// samplers keep one scramble per pixel and advance along the sequence instead.
+RT_FUNCTION optix::float2 beginSample(PerRayData& prd, const int sampler, const unsigned int x, const unsigned int y, const unsigned int width, const unsigned int sampleIndex)
+{
+	const unsigned int pixel = y * width + x;
+
+	prd.sampler      = sampler;
+	prd.sample_index = sampleIndex;
+	prd.dimension    = SAMPLE_DIMENSION_PIXEL;
+	if (sampler == POptix::SAMPLER_LCG)
+	{
+		prd.seed = tea<8>(pixel, sampleIndex);
+	}
+	else if (sampler == POptix::SAMPLER_BLUE_NOISE)
+	{
+		prd.seed = (y << 16) | (x & 0xFFFFu);
+	}
+	else
+	{
+		prd.seed = tea<8>(pixel, 0u);
+	}
+
+	const optix::float2 jitter = sample2D(prd, 0);
+
+	prd.dimension = SAMPLE_DIMENSION_CAMERA;
+	return jitter;
+}
+
+// Moves on to the sample dimensions of the next path segment.
+RT_FUNCTION void nextSegment(PerRayData& prd)
+{
+	prd.dimension += SAMPLE_DIMENSIONS_PER_SEGMENT;
+}
+
 struct ShadowPRD
 {
 	bool visible;
@@ -6,15 +6,41 @@
 #include "rt_function.h"
 #include "per_ray_data.h"
 #include "shader_common.h"
+#include "light_tree.h"
+#include "light_alias.h"
+#include "reservoir.h"
+#include "adaptive_reduce.h"
 
 #include "rt_assert.h"
 
 rtBuffer<float4, 2> sysOutputBuffer; // RGBA32F
 
+// Adaptive sampling, see POptix::AdaptiveSampling.
+rtBuffer<float, 2>         sysLuminanceSquaredBuffer; // Running mean of the squared luminance per pixel, accumulated like sysOutputBuffer.
+rtBuffer<unsigned char, 2> sysAdaptiveMask;           // One entry per ADAPTIVE_BLOCK_SIZE^2 pixel block, 0 once the block converged.
+rtDeclareVariable(int, sysAdaptive, , );              // 1 == Skip the pixels of converged blocks.
+rtBuffer<float, 2>         sysAdaptiveVariance;       // One entry per block, written by adaptive_reduce() for the read back.
+
+// ReSTIR DI, see reservoir.h. The first pass raygeneration() leaves the sample to the second pass restir_spatial().
+rtBuffer<POptix::ReservoirPixel, 3> sysReservoirBuffer; // RESTIR_SLOTS per pixel, written by closesthit() at the primary hit.
+rtDeclareVariable(int, sysRestir, , );                  // POptix::ERestir
+
+rtBuffer<POptix::Material> sysMaterialParameters;
+rtBuffer< rtCallableProgramId<void(POptix::Light &light, PerRayData &prd, POptix::LightSample &sample, State& state)> > sysLightSample;
+rtBuffer<POptix::Light> sysLightParameters;
+rtDeclareVariable(int, sysNumberOfLights, , );
+rtDeclareVariable(int, sysLightSelection, , );  // POptix::ELightSelection
+rtDeclareVariable(int, sysNumberOfDirectionalLights, , );
+rtBuffer<POptix::LightTreeNode> sysLightTree;
+rtBuffer<int> sysLightTreeMap;
+rtBuffer<POptix::LightAliasEntry> sysLightAliasTable;
+rtTextureSampler<float4, 2> envmap;
+
 rtDeclareVariable(rtObject, sysTopObject, , );
 rtDeclareVariable(float, sysSceneEpsilon, , );
 rtDeclareVariable(int2, sysPathLengths, , );
 rtDeclareVariable(int, sysIterationIndex, , );
+rtDeclareVariable(int, sysSampler, , );  // POptix::ESampler
 
 rtDeclareVariable(float3, sysCameraPosition, , );
 rtDeclareVariable(float3, sysCameraU, , );
@@ -26,6 +52,105 @@ rtDeclareVariable(uint2, theLaunchIndex, rtLaunchIndex, );
 
 using namespace optix;
 
+// The light tree buffers for the traversal in light_tree.h.
+struct LightTreeNodes
+{
+	RT_FUNCTION POptix::LightTreeNode operator[](const int index) const { return sysLightTree[index]; }
+};
+
+struct LightTreeMap
+{
+	RT_FUNCTION int operator[](const int index) const { return sysLightTreeMap[index]; }
+};
+
+// The alias table buffer for light_alias.h.
+struct LightAliasTable
+{
+	RT_FUNCTION POptix::LightAliasEntry operator[](const int index) const { return sysLightAliasTable[index]; }
+};
+
+// The Scene of reservoir.h. Shadow rays like those of DirectLighting().
+struct RestirScene
+{
+	RT_FUNCTION POptix::Light    light(const int index) const       { return sysLightParameters[index]; }
+	RT_FUNCTION POptix::Material material(const int index) const    { return sysMaterialParameters[index]; }
+	RT_FUNCTION float3           environment(const float2& uv) const { return make_float3(tex2D(envmap, uv.x, uv.y)); }
+
+	RT_FUNCTION bool visible(const float3& origin, const float3& direction, const float distance) const
+	{
+		ShadowPRD prdShadow;
+		prdShadow.visible = true; // Initialize for miss.
+
+		optix::Ray ray = optix::make_Ray(origin, direction, 1, sysSceneEpsilon, distance - sysSceneEpsilon); // Shadow ray.
+		rtTrace(sysTopObject, ray, prdShadow);
+		return prdShadow.visible;
+	}
+};
+
+// The light samples of DirectLighting() as candidates of restirCandidates(), drawn with the LCG of its seed.
+struct RestirLightSampler
+{
+	RT_FUNCTION int sample(const float3& position, unsigned int& seed, float3& point, float& pdf) const
+	{
+		int lightIndex;
+		float selectionPmf;
+		if (sysLightSelection == POptix::LIGHT_SELECTION_TREE)
+		{
+			lightIndex = sampleLightTree(LightTreeNodes(), LightTreeMap(), sysNumberOfLights, sysNumberOfDirectionalLights, position, rng(seed), selectionPmf);
+		}
+		else if (sysLightSelection == POptix::LIGHT_SELECTION_POWER)
+		{
+			lightIndex = sampleLightAlias(LightAliasTable(), sysNumberOfLights, rng(seed), selectionPmf);
+		}
+		else
+		{
+			lightIndex = min((int)(rng(seed) * sysNumberOfLights), sysNumberOfLights - 1);
+			selectionPmf = 1.0f / sysNumberOfLights;
+		}
+		POptix::Light light = sysLightParameters[lightIndex];
+
+		PerRayData prd;
+		prd.sampler   = POptix::SAMPLER_LCG;
+		prd.seed      = seed;
+		prd.dimension = 0;
+
+		State state;
+		state.hit_position = position;
+
+		POptix::LightSample lightSample;
+		sysLightSample[light.lightType](light, prd, lightSample, state);
+		seed = prd.seed;
+
+		if (lightSample.pdf <= 0.0f || lightSample.distance == 0.0f)
+		{
+			return -1;
+		}
+		point = (light.lightType == POptix::ENVIRONMENT || light.lightType == POptix::DIRECTIONAL) ? lightSample.direction : lightSample.surfacePos;
+		pdf   = selectionPmf * lightSample.pdf;
+		return lightIndex;
+	}
+};
+
+// The accumulated image and its second moment for adaptiveBlockVariance().
+struct AdaptiveMean
+{
+	RT_FUNCTION float4 operator()(const int x, const int y) const { return sysOutputBuffer[make_uint2(x, y)]; }
+};
+
+struct AdaptiveMeanSquare
+{
+	RT_FUNCTION float operator()(const int x, const int y) const { return sysLuminanceSquaredBuffer[make_uint2(x, y)]; }
+};
+
+// The ReservoirPixel of the first pass, the candidates of restirSpatial().
+struct RestirCandidates
+{
+	RT_FUNCTION POptix::ReservoirPixel operator()(const int x, const int y) const
+	{
+		return sysReservoirBuffer[make_uint3(x, y, RESTIR_SLOT_CANDIDATES)];
+	}
+};
+
 #if !USE_SHADER_TONEMAP
 rtDeclareVariable(float, invWhitePoint, , );
 rtDeclareVariable(float3, colorBalance, , );
@@ -65,11 +190,15 @@ RT_FUNCTION void integrator(PerRayData& prd, float3& radiance)
 	float3 throughput = make_float3(1.0f);		// The throughput for the next radiance, starts with 1.0f.
 	int depth = 0;								// Path segment index. Primary ray is 0.
 
+	prd.brdf_flags = 0;							// The primary ray has no BSDF sample, lights and environment it hits are not MIS weighted.
+
 	while (depth < sysPathLengths.y)
 	{
 		prd.wo = -prd.wi;						// wi is the next path segment ray.direction. wo is the direction to the observer.
-		prd.flags = 0;							// Clear all non-persistent flags. None in this version.
-		prd.brdf_flags = 0;						// As the ray didn't hit something its brdf flags need be cleared out
+		prd.flags &= (depth == 1) ? FLAG_DIRECT_RESAMPLED : 0; // Clear all non-persistent flags. The resampled direct light holds for the segment after the primary hit.
+		prd.flags |= (depth == 0 && sysRestir != POptix::RESTIR_OFF) ? FLAG_RESTIR_PRIMARY : 0;
+		prd.flags |= (depth == sysPathLengths.y - 1) ? FLAG_LAST_SEGMENT : 0;
+		// brdf_flags are those of the BSDF sample which generated this ray, the light and miss programs weight by them.
 
 		// Note that the primary rays wouldn't need to offset the ray t_min by sysSceneEpsilon.
 		optix::Ray ray = optix::make_Ray(prd.hit_pos, prd.wi, 0, sysSceneEpsilon, RT_DEFAULT_MAX);
@@ -87,39 +216,25 @@ RT_FUNCTION void integrator(PerRayData& prd, float3& radiance)
 		// PERF f_over_pdf already contains the proper throughput adjustment for diffuse materials: f * (fabsf(optix::dot(prd.wi, state.normal)) / prd.pdf);
 		throughput *= prd.f_over_pdf;
 
-		// Russian Roulette path termination after a specified number of bounces in sysPathLengths.x would go here. See next examples.
+		// Russian Roulette path termination after sysPathLengths.x path segments.
+		if (sysPathLengths.x <= depth)
+		{
+			const float probability = russianRouletteProbability(throughput);
+			if (probability <= sample1D(prd, SAMPLE_DIMENSION_ROULETTE))
+			{
+				break;
+			}
+			throughput /= probability;
+		}
 
 		++depth; // Next path segment.
+		nextSegment(prd);
 	}
 }
 
-// Entry point for pinhole camera with manual accumulation, non-VCA.
-RT_PROGRAM void raygeneration()
+// Tone maps the sample of the pixel and accumulates it into sysOutputBuffer.
+RT_FUNCTION void accumulate(float3 radiance)
 {
-	PerRayData prd;
-
-	// Initialize the random number generator seed from the linear pixel index and the iteration index.
-	prd.seed = tea<8>(theLaunchIndex.y * theLaunchDim.x + theLaunchIndex.x, sysIterationIndex);
-
-	// Pinhole camera implementation:
-	// The launch index is the pixel coordinate.
-	// Note that launchIndex = (0, 0) is the bottom left corner of the image,
-	// which matches the origin in the OpenGL texture used to display the result.
-	const float2 pixel = make_float2(theLaunchIndex);
-	// Sample the ray in the center of the pixel.
-	const float2 fragment = pixel + rng2(prd.seed); // Random jitter of the fragment location in this pixel.
-	// The launch dimension (set with rtContextLaunch) is the full client window in this demo's setup.
-	const float2 screen = make_float2(theLaunchDim);
-	// Normalized device coordinates in range [-1, 1].
-	const float2 ndc = (fragment / screen) * 2.0f - 1.0f;
-
-	// The integrator expects the next path segments ray.origin in prd.pos and the next ray.direction in prd.wi.
-	prd.hit_pos = sysCameraPosition;
-	prd.wi = optix::normalize(ndc.x * sysCameraU + ndc.y * sysCameraV + sysCameraW);
-
-	float3 radiance;
-	integrator(prd, radiance); // In this case a unidirectional path tracer.
-
 #if !USE_SHADER_TONEMAP
 	radiance = ToneMap(radiance);
 #endif
@@ -144,17 +259,118 @@ RT_PROGRAM void raygeneration()
 	if (!(isnan(radiance.x) || isnan(radiance.y) || isnan(radiance.z)))
 #endif
 	{
+		const float L = luminance(radiance);
+
 		if (0 < sysIterationIndex)
 		{
 			float4 dst = sysOutputBuffer[theLaunchIndex];  // RGBA32F
 			sysOutputBuffer[theLaunchIndex] = optix::lerp(dst, make_float4(radiance, 1.0f), 1.0f / (float)(sysIterationIndex + 1));
+			sysLuminanceSquaredBuffer[theLaunchIndex] = optix::lerp(sysLuminanceSquaredBuffer[theLaunchIndex], L * L, 1.0f / (float)(sysIterationIndex + 1));
 		}
 		else
 		{
 			// sysIterationIndex 0 will fill the buffer.
 			// If this isn't done separately, the result of the lerp() above is undefined, e.g. dst could be NaN.
 			sysOutputBuffer[theLaunchIndex] = make_float4(radiance, 1.0f);
+			sysLuminanceSquaredBuffer[theLaunchIndex] = L * L;
+		}
+	}
+}
+
+// Entry point for pinhole camera with manual accumulation, non-VCA.
+RT_PROGRAM void raygeneration()
+{
+	const uint3 candidatesIndex = make_uint3(theLaunchIndex.x, theLaunchIndex.y, RESTIR_SLOT_CANDIDATES);
+
+	// closesthit() writes the surface of a primary hit with direct light to resample, skipped pixels have none for the neighbours.
+	if (sysRestir != POptix::RESTIR_OFF)
+	{
+		sysReservoirBuffer[candidatesIndex].surface.materialIndex = -1;
+	}
+
+	// Converged blocks keep their accumulated result. Blocks never become active again during an accumulation,
+	// so all traced pixels have sysIterationIndex samples.
+	if (sysAdaptive && sysAdaptiveMask[make_uint2(theLaunchIndex.x / ADAPTIVE_BLOCK_SIZE, theLaunchIndex.y / ADAPTIVE_BLOCK_SIZE)] == 0)
+	{
+		return;
+	}
+
+	PerRayData prd;
+
+	// Initialize the sampler from the pixel and the iteration index, the pixel sample.
+	const float2 jitter = beginSample(prd, sysSampler, theLaunchIndex.x, theLaunchIndex.y, theLaunchDim.x, sysIterationIndex);
+
+	// Pinhole camera implementation:
+	// The launch index is the pixel coordinate.
+	// Note that launchIndex = (0, 0) is the bottom left corner of the image,
+	// which matches the origin in the OpenGL texture used to display the result.
+	const float2 pixel = make_float2(theLaunchIndex);
+	// Sample the ray in the center of the pixel.
+	const float2 fragment = pixel + jitter; // Random jitter of the fragment location in this pixel.
+	// The launch dimension (set with rtContextLaunch) is the full client window in this demo's setup.
+	const float2 screen = make_float2(theLaunchDim);
+	// Normalized device coordinates in range [-1, 1].
+	const float2 ndc = (fragment / screen) * 2.0f - 1.0f;
+
+	// The integrator expects the next path segments ray.origin in prd.pos and the next ray.direction in prd.wi.
+	prd.hit_pos = sysCameraPosition;
+	prd.wi = optix::normalize(ndc.x * sysCameraU + ndc.y * sysCameraV + sysCameraW);
+
+	float3 radiance;
+	integrator(prd, radiance); // In this case a unidirectional path tracer.
+
+	if (sysRestir != POptix::RESTIR_OFF)
+	{
+		// restir_spatial() adds the direct light of the primary hit and accumulates the sample.
+		POptix::ReservoirPixel& candidates = sysReservoirBuffer[candidatesIndex];
+		candidates.radiance = radiance;
+		if (0 <= candidates.surface.materialIndex)
+		{
+			const POptix::ReservoirPixel previous = sysReservoirBuffer[make_uint3(theLaunchIndex.x, theLaunchIndex.y, RESTIR_SLOT_FINAL)];
+
+			unsigned int seed = restirSeed(theLaunchIndex.y * theLaunchDim.x + theLaunchIndex.x, sysIterationIndex, 0);
+			candidates.reservoir = restirInitial(RestirScene(), RestirLightSampler(), sysRestir, candidates.surface, (0 < sysIterationIndex) ? &previous : nullptr, seed);
+		}
+		return;
+	}
+
+	accumulate(radiance);
+}
+
+// Entry point 1 with ReSTIR, launched after raygeneration(): the spatial reuse, the direct light of the primary hit and the
+// accumulation of the sample.
+RT_PROGRAM void restir_spatial()
+{
+	if (sysAdaptive && sysAdaptiveMask[make_uint2(theLaunchIndex.x / ADAPTIVE_BLOCK_SIZE, theLaunchIndex.y / ADAPTIVE_BLOCK_SIZE)] == 0)
+	{
+		return;
+	}
+
+	const POptix::ReservoirPixel own   = sysReservoirBuffer[make_uint3(theLaunchIndex.x, theLaunchIndex.y, RESTIR_SLOT_CANDIDATES)];
+	POptix::ReservoirPixel&      final = sysReservoirBuffer[make_uint3(theLaunchIndex.x, theLaunchIndex.y, RESTIR_SLOT_FINAL)];
+
+	final.surface   = own.surface;
+	final.reservoir = restirEmptyReservoir();
+
+	float3 radiance = own.radiance;
+	if (0 <= own.surface.materialIndex)
+	{
+		unsigned int seed = restirSeed(theLaunchIndex.y * theLaunchDim.x + theLaunchIndex.x, sysIterationIndex, 1);
+		const float3 direct = restirSpatial(RestirScene(), RestirCandidates(), sysRestir, int(theLaunchIndex.x), int(theLaunchIndex.y), int(theLaunchDim.x), int(theLaunchDim.y),
+		                                    final.reservoir, seed);
+		if (own.shaded)
+		{
+			radiance += direct;
 		}
 	}
+
+	accumulate(radiance);
 }
 
+// Entry point 2, launched with one index per ADAPTIVE_BLOCK_SIZE^2 block: reduces the image and its second moment per block,
+// so the adaptive sampling reads back one float per block instead of both full size buffers.
+RT_PROGRAM void adaptive_reduce()
+{
+	const uint2 size = make_uint2(sysOutputBuffer.size());
+	sysAdaptiveVariance[theLaunchIndex] = adaptiveBlockVariance(AdaptiveMean(), AdaptiveMeanSquare(), int(theLaunchIndex.x), int(theLaunchIndex.y), int(size.x), int(size.y));
+}
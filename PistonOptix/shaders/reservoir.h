@@ -0,0 +1,417 @@
+#pragma once
+
+#ifndef RESERVOIR_H
+#define RESERVOIR_H
+
+#include "app_config.h"
+
+#include <optix.h>
+#include <optixu/optixu_math_namespace.h>
+
+#include "rt_function.h"
+#include "per_ray_data.h"
+#include "material_parameter.h"
+#include "shader_common.h"
+#include "brdf_functions.h"
+#include "environment_sample.h"
+#include "random_number_generators.h"
+#include "PistonOptix/inc/CudaUtils/State.h"
+#include "PistonOptix/inc/LightParameters.h"
+
+// Reservoir-based spatiotemporal importance resampling of the direct light at the primary hits, see "Spatiotemporal
+// Reservoir Resampling for Real-Time Ray Tracing with Dynamic Direct Lighting" by Bitterli et al. Shared by raygeneration.cu
+// and the HostRenderer.
+// The first pass resamples RESTIR_CANDIDATES light samples into a reservoir per pixel and merges the reservoir the pixel had
+// after the previous pass. The second pass merges the reservoirs of random neighbours and shades the primary hit with the
+// sample they keep. The target function is the unshadowed contribution of a sample with the BRDF lobe the primary hit
+// selected, so the images converge to those of DirectLighting().
+// Samples are points on quad and sphere lights and the directions of environment and directional lights, which every pixel
+// can reuse as they are. The resampling weights are per area on the lights and per solid angle for the directions.
+// Scene is anything with
+//   POptix::Light    light(int index) const;
+//   POptix::Material material(int index) const;
+//   float3           environment(const float2& uv) const;  // The map of the environment light, without its emission.
+//   bool             visible(const float3& origin, const float3& direction, float distance) const;
+// which the device implements with its buffers and shadow rays and the HostRenderer with the HostScene.
+
+namespace POptix
+{
+	enum ERestir
+	{
+		RESTIR_OFF,      // DirectLighting() at every hit.
+		RESTIR_BIASED,   // Reused reservoirs count all their candidates, which darkens the edges of shadows and objects.
+		RESTIR_UNBIASED, // MIS weights of the reused reservoirs with the visibility at their surfaces, one shadow ray per reused reservoir.
+		NUM_OF_RESTIR
+	};
+
+	struct Reservoir
+	{
+		optix::float3 point;      // On a quad or sphere light, the direction of environment and directional lights.
+		int           lightIndex; // -1 while empty.
+		float         weightSum;  // Resampling weights of all candidates.
+		int           M;          // Number of candidates.
+		float         W;          // Unbiased contribution weight of point, 0 once it is known to be occluded.
+		float         targetPdf;  // Target function of point at the surface of the reservoir.
+	};
+
+	// Primary hit of a pixel. Reservoirs reused from other pixels are weighted with the target function at this surface.
+	struct RestirSurface
+	{
+		optix::float3 position;
+		int           materialIndex;  // -1 without direct light to resample: the primary ray missed, hit a light or a specular lobe.
+		optix::float3 geometryNormal; // Both normals flipped to the side of wo.
+		int           brdf;           // EBrdfTypes of the lobe selected at the hit.
+		optix::float3 shadingNormal;
+		float         distance;       // Along the primary ray.
+		optix::float3 wo;
+	};
+
+	// Entry of sysReservoirBuffer, RESTIR_SLOTS per pixel. The fields after the surface are used in RESTIR_SLOT_CANDIDATES only.
+	struct ReservoirPixel
+	{
+		Reservoir     reservoir;
+		RestirSurface surface;
+		optix::float3 radiance; // Of the path without the direct light of the primary hit.
+		int           shaded;   // 0 when the path ended at the primary hit, where DirectLighting() adds no light. The reservoirs are resampled anyway.
+	};
+}
+
+#define RESTIR_SLOT_CANDIDATES 0 // Written by the first pass, read by the spatial reuse of the neighbours.
+#define RESTIR_SLOT_FINAL      1 // Written by the second pass, read by the temporal reuse of the next first pass.
+#define RESTIR_SLOTS           2
+
+// Where a sample is seen from a surface: the shadow ray and the factor from the solid angle at the surface to the measure of
+// the sample, the cosine at the light over the squared distance for points on lights and 1 for directions.
+struct RestirConnection
+{
+	float3 direction;
+	float  distance;
+	float  geometry;
+};
+
+RT_FUNCTION POptix::Reservoir restirEmptyReservoir()
+{
+	POptix::Reservoir reservoir;
+	reservoir.point      = make_float3(0.0f);
+	reservoir.lightIndex = -1;
+	reservoir.weightSum  = 0.0f;
+	reservoir.M          = 0;
+	reservoir.W          = 0.0f;
+	reservoir.targetPdf  = 0.0f;
+	return reservoir;
+}
+
+// LCG seed of the resampling decisions of pass 0, the candidates, and pass 1, the neighbours, apart from the path samples.
+RT_FUNCTION unsigned int restirSeed(const unsigned int pixel, const unsigned int sampleIndex, const unsigned int pass)
+{
+	return tea<4>(pixel, 2u * sampleIndex + pass);
+}
+
+// Unshadowed contribution of the sample point of lightIndex at surface, per area of the light or solid angle of the direction:
+// the BRDF of the lobe of the surface times the emission, the cosine at the surface and the geometry of the connection.
+// Its luminance is the target function.
+template<typename Scene>
+RT_FUNCTION float3 restirContribution(Scene const& scene, POptix::RestirSurface const& surface, const int lightIndex, const float3& point, RestirConnection& connection)
+{
+	const POptix::Light light = scene.light(lightIndex);
+
+	float3 emission = light.emission;
+	connection.geometry = 1.0f;
+	if (light.lightType == POptix::ENVIRONMENT || light.lightType == POptix::DIRECTIONAL)
+	{
+		connection.direction = point;
+		connection.distance  = RT_DEFAULT_MAX;
+		if (light.lightType == POptix::ENVIRONMENT)
+		{
+			emission *= scene.environment(environmentUV(point));
+		}
+	}
+	else
+	{
+		const float3 wi = point - surface.position;
+		const float  distance2 = dot(wi, wi);
+		if (distance2 <= 0.0f)
+		{
+			return make_float3(0.0f);
+		}
+		connection.distance  = sqrtf(distance2);
+		connection.direction = wi / connection.distance;
+
+		// Quads emit on the front side only, the back of a sphere is hidden by its front.
+		const float3 normal   = (light.lightType == POptix::SPHERE) ? normalize(point - light.position) : light.normal;
+		const float  cosTheta = -dot(normal, connection.direction);
+		if (cosTheta <= 0.0f)
+		{
+			return make_float3(0.0f);
+		}
+		connection.geometry = cosTheta / distance2;
+	}
+
+	// Like the BRDF samples, nothing arrives from below the surface.
+	if (dot(connection.direction, surface.geometryNormal) <= 0.0f)
+	{
+		return make_float3(0.0f);
+	}
+
+	State state;
+	state.hit_position    = surface.position;
+	state.shading_normal  = surface.shadingNormal;
+	state.geometry_normal = surface.geometryNormal;
+
+	PerRayData prd;
+	prd.wi    = connection.direction;
+	prd.flags = 0;
+
+	const POptix::Material mat = scene.material(surface.materialIndex);
+	const float3 f = (surface.brdf == POptix::LAMBERT) ? diffuseFresnelWeight(mat, surface.wo, connection.direction) * lambertEval(mat, state, surface.wo, prd)
+	                                                    : microfacetReflectionEval(mat, state, surface.wo, prd);
+
+	return f * emission * (fabsf(dot(connection.direction, surface.shadingNormal)) * connection.geometry);
+}
+
+// Streaming resampling: adds M candidates of the resampling weight weight and keeps point with the probability weight / weightSum.
+// Returns true when point replaced the sample of the reservoir.
+RT_FUNCTION bool restirUpdate(POptix::Reservoir& reservoir, const int lightIndex, const float3& point, const float targetPdf, const float weight, const int M, const float u)
+{
+	reservoir.weightSum += weight;
+	reservoir.M         += M;
+	if (0.0f < weight && u * reservoir.weightSum < weight)
+	{
+		reservoir.lightIndex = lightIndex;
+		reservoir.point      = point;
+		reservoir.targetPdf  = targetPdf;
+		return true;
+	}
+	return false;
+}
+
+// The contribution weight of the kept sample for the Z candidates which could have produced it.
+RT_FUNCTION void restirFinalize(POptix::Reservoir& reservoir, const float Z)
+{
+	reservoir.W = (0 <= reservoir.lightIndex && 0.0f < reservoir.targetPdf && 0.0f < Z) ? reservoir.weightSum / (Z * reservoir.targetPdf) : 0.0f;
+}
+
+// Resamples count light samples at surface. sampler.sample(position, seed, point, pdf) returns the light index of a sample
+// from position, -1 for none, its point like in Reservoir and its solid angle pdf times the selection probability in pdf.
+// Directional lights have the pdf 1. Failed samples still count as candidates.
+template<typename Scene, typename Sampler>
+RT_FUNCTION POptix::Reservoir restirCandidates(Scene const& scene, Sampler const& sampler, POptix::RestirSurface const& surface, const int count, unsigned int& seed)
+{
+	POptix::Reservoir reservoir = restirEmptyReservoir();
+
+	for (int i = 0; i < count; ++i)
+	{
+		float3 point;
+		float  pdf;
+		const int lightIndex = sampler.sample(surface.position, seed, point, pdf);
+
+		float targetPdf = 0.0f;
+		float weight    = 0.0f;
+		if (0 <= lightIndex && 0.0f < pdf)
+		{
+			RestirConnection connection;
+			targetPdf = luminance(restirContribution(scene, surface, lightIndex, point, connection));
+
+			// The geometry turns the solid angle pdf into the measure of the target function.
+			weight = targetPdf / (pdf * connection.geometry);
+		}
+		restirUpdate(reservoir, lightIndex, point, targetPdf, weight, 1, rng(seed));
+	}
+	restirFinalize(reservoir, float(reservoir.M));
+	return reservoir;
+}
+
+// Merges count reservoirs into one at surfaces[0], the surface of reservoirs[0]. The others come from other pixels or passes
+// and enter with the target function at surfaces[0]. RESTIR_BIASED normalizes by all their candidates.
+// RESTIR_UNBIASED uses pairwise MIS: reservoirs[0] is the canonical one, each other reservoir i shares a part of the weight,
+// proportional to its candidates plus the canonical ones over count - 1, with it in a balance heuristic of M_i p_i and
+// M_0 / (count - 1) p_0. p_i is the target function at surface i times the visibility, which the reservoirs of
+// restirInitial() and restirSpatial() include. Needs a shadow ray per other reservoir, like the MIS weight of the selected
+// sample only, but doesn't weight the others up where a sample is occluded at one of them.
+template<typename Scene>
+RT_FUNCTION POptix::Reservoir restirCombine(Scene const& scene, const int mode, POptix::RestirSurface const* surfaces, POptix::Reservoir const* reservoirs, const int count, unsigned int& seed)
+{
+	POptix::Reservoir result = restirEmptyReservoir();
+
+	if (mode != POptix::RESTIR_UNBIASED || count == 1)
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			POptix::Reservoir const& reservoir = reservoirs[i];
+
+			float targetPdf = reservoir.targetPdf;
+			if (0 < i && 0 <= reservoir.lightIndex)
+			{
+				RestirConnection connection;
+				targetPdf = luminance(restirContribution(scene, surfaces[0], reservoir.lightIndex, reservoir.point, connection));
+			}
+			restirUpdate(result, reservoir.lightIndex, reservoir.point, targetPdf, targetPdf * reservoir.W * float(reservoir.M), reservoir.M, rng(seed));
+		}
+		restirFinalize(result, float(result.M));
+		return result;
+	}
+
+	POptix::Reservoir const& canonical = reservoirs[0];
+
+	float confidence = 0.0f;
+	for (int i = 0; i < count; ++i)
+	{
+		confidence += float(reservoirs[i].M);
+	}
+	const float canonicalM = float(canonical.M) / float(count - 1);
+
+	float canonicalMis = 0.0f;
+	for (int i = 1; i < count; ++i)
+	{
+		POptix::Reservoir const& reservoir = reservoirs[i];
+
+		const float M     = float(reservoir.M);
+		const float share = (M + canonicalM) / confidence;
+
+		// The canonical sample at surface i.
+		float neighbourPdf = 0.0f;
+		if (0 <= canonical.lightIndex)
+		{
+			RestirConnection connection;
+			neighbourPdf = luminance(restirContribution(scene, surfaces[i], canonical.lightIndex, canonical.point, connection));
+			if (0.0f < neighbourPdf && !scene.visible(surfaces[i].position, connection.direction, connection.distance))
+			{
+				neighbourPdf = 0.0f;
+			}
+		}
+		const float canonicalSum = M * neighbourPdf + canonicalM * canonical.targetPdf;
+		canonicalMis += (0.0f < canonicalSum) ? share * canonicalM * canonical.targetPdf / canonicalSum : 0.0f;
+
+		// The sample of reservoir i at the canonical surface.
+		float targetPdf = 0.0f;
+		if (0 <= reservoir.lightIndex)
+		{
+			RestirConnection connection;
+			targetPdf = luminance(restirContribution(scene, surfaces[0], reservoir.lightIndex, reservoir.point, connection));
+		}
+		const float sum = M * reservoir.targetPdf + canonicalM * targetPdf;
+		const float mis = (0.0f < sum) ? share * M * reservoir.targetPdf / sum : 0.0f;
+
+		restirUpdate(result, reservoir.lightIndex, reservoir.point, targetPdf, mis * targetPdf * reservoir.W, reservoir.M, rng(seed));
+	}
+	restirUpdate(result, canonical.lightIndex, canonical.point, canonical.targetPdf, canonicalMis * canonical.targetPdf * canonical.W, canonical.M, rng(seed));
+
+	// The MIS weights replace the normalization by the candidates.
+	restirFinalize(result, 1.0f);
+	return result;
+}
+
+// Reuse only between surfaces with normals within 25 degrees and distances from the camera within 10 percent, other
+// reservoirs are mostly wasted and in the biased mode they darken the image.
+RT_FUNCTION bool restirSimilar(POptix::RestirSurface const& surface, POptix::RestirSurface const& other)
+{
+	return 0 <= other.materialIndex &&
+	       0.906f <= dot(surface.geometryNormal, other.geometryNormal) &&
+	       fabsf(surface.distance - other.distance) <= 0.1f * surface.distance;
+}
+
+// First pass at the primary hit of a pixel: the candidates, the visibility of the sample they keep and the temporal reuse of
+// previous, the final reservoir of the pixel after the last pass, nullptr in the first pass of an accumulation.
+// RESTIR_UNBIASED checks the visibility of a kept sample of previous again, the MIS weights of the spatial reuse rely on it.
+template<typename Scene, typename Sampler>
+RT_FUNCTION POptix::Reservoir restirInitial(Scene const& scene, Sampler const& sampler, const int mode, POptix::RestirSurface const& surface, POptix::ReservoirPixel const* previous, unsigned int& seed)
+{
+	POptix::Reservoir reservoir = restirCandidates(scene, sampler, surface, RESTIR_CANDIDATES, seed);
+
+	// An occluded sample is worth nothing here and to the neighbours.
+	if (0.0f < reservoir.W)
+	{
+		RestirConnection connection;
+		restirContribution(scene, surface, reservoir.lightIndex, reservoir.point, connection);
+		if (!scene.visible(surface.position, connection.direction, connection.distance))
+		{
+			reservoir.W = 0.0f;
+		}
+	}
+
+	if (previous != nullptr && restirSimilar(surface, previous->surface))
+	{
+		POptix::RestirSurface surfaces[2] = { surface, previous->surface };
+		POptix::Reservoir     reservoirs[2] = { reservoir, previous->reservoir };
+
+		// Capped, or an old sample would hardly ever be replaced.
+		if (RESTIR_MAX_HISTORY * reservoir.M < reservoirs[1].M)
+		{
+			reservoirs[1].M = RESTIR_MAX_HISTORY * reservoir.M;
+		}
+		reservoir = restirCombine(scene, mode, surfaces, reservoirs, 2, seed);
+
+		const bool reused = reservoir.lightIndex != reservoirs[0].lightIndex ||
+		                    reservoir.point.x != reservoirs[0].point.x || reservoir.point.y != reservoirs[0].point.y || reservoir.point.z != reservoirs[0].point.z;
+		if (mode == POptix::RESTIR_UNBIASED && reused && 0.0f < reservoir.W)
+		{
+			RestirConnection connection;
+			restirContribution(scene, surface, reservoir.lightIndex, reservoir.point, connection);
+			if (!scene.visible(surface.position, connection.direction, connection.distance))
+			{
+				reservoir.W = 0.0f;
+			}
+		}
+	}
+	return reservoir;
+}
+
+// Second pass at a pixel of the image size with a surface: merges its reservoir with those of up to RESTIR_SPATIAL_NEIGHBORS
+// random neighbours in the radius RESTIR_SPATIAL_RADIUS times the width and returns the direct light of the sample they keep.
+// candidates(x, y) returns the ReservoirPixel of the first pass at a pixel. The merged reservoir is returned in reservoir. RESTIR_UNBIASED sets
+// its weight to 0 when the shadow ray of the shading finds the sample occluded, like for the candidates of restirInitial(),
+// the MIS weights of its reuse rely on it. The biased one would count all the candidates of the occluded samples of the past
+// frames in the next temporal reuse and darken from frame to frame.
+template<typename Scene, typename Candidates>
+RT_FUNCTION float3 restirSpatial(Scene const& scene, Candidates const& candidates, const int mode, const int x, const int y, const int width, const int height,
+                                 POptix::Reservoir& reservoir, unsigned int& seed)
+{
+	POptix::RestirSurface surfaces[1 + RESTIR_SPATIAL_NEIGHBORS];
+	POptix::Reservoir     reservoirs[1 + RESTIR_SPATIAL_NEIGHBORS];
+
+	const POptix::ReservoirPixel center = candidates(x, y);
+	surfaces[0]   = center.surface;
+	reservoirs[0] = center.reservoir;
+
+	int count = 1;
+	for (int i = 0; i < RESTIR_SPATIAL_NEIGHBORS; ++i)
+	{
+		// Uniform in the disk.
+		const float2 u      = rng2(seed);
+		const float  radius = RESTIR_SPATIAL_RADIUS * float(width) * sqrtf(u.x);
+		const float  phi    = 2.0f * M_PIf * u.y;
+
+		const int nx = optix::clamp(x + int(radius * cosf(phi)), 0, width - 1);
+		const int ny = optix::clamp(y + int(radius * sinf(phi)), 0, height - 1);
+		if (nx == x && ny == y)
+		{
+			continue;
+		}
+
+		const POptix::ReservoirPixel neighbour = candidates(nx, ny);
+		if (restirSimilar(center.surface, neighbour.surface))
+		{
+			surfaces[count]   = neighbour.surface;
+			reservoirs[count] = neighbour.reservoir;
+			++count;
+		}
+	}
+	reservoir = restirCombine(scene, mode, surfaces, reservoirs, count, seed);
+
+	if (0.0f < reservoir.W)
+	{
+		RestirConnection connection;
+		const float3 contribution = restirContribution(scene, center.surface, reservoir.lightIndex, reservoir.point, connection);
+		if (scene.visible(center.surface.position, connection.direction, connection.distance))
+		{
+			return contribution * reservoir.W;
+		}
+		if (mode == POptix::RESTIR_UNBIASED)
+		{
+			reservoir.W = 0.0f;
+		}
+	}
+	return make_float3(0.0f);
+}
+
+#endif // RESERVOIR_H
@@ -91,6 +91,13 @@ RT_FUNCTION float luminance(const optix::float3& rgb)
   return optix::dot(rgb, ntsc_luminance);
 }
 
+// Survival probability of the Russian Roulette path termination, the luminance of the path throughput clamped to [0.05, 1].
+// Surviving paths divide their throughput by it, which keeps the estimator unbiased. The lower bound limits that weight to 20.
+RT_FUNCTION float russianRouletteProbability(const optix::float3& throughput)
+{
+	return optix::clamp(luminance(throughput), 0.05f, 1.0f);
+}
+
 RT_FUNCTION float intensity(const optix::float3& rgb)
 {
 	return (rgb.x + rgb.y + rgb.z) * 0.3333333333f;
@@ -277,7 +284,7 @@ RT_FUNCTION float3 CosineWeightedHemisphereSampling(float2 sample, float alpha)
 	const float cosTheta = powf((1.0f - sample.y), 1.0f / (alpha + 1.0f));
 	const float sinTheta = sqrtf(fmaxf(0.0f, 1.0f - cosTheta * cosTheta));
 
-	float phi = 2 * M_PIf * sample.y;
+	float phi = 2 * M_PIf * sample.x;
 	float cosPhi = cosf(phi);
 	float sinPhi = sinf(phi);
 
@@ -0,0 +1,162 @@
+#pragma once
+
+#ifndef TRIANGLE_INTERSECTION_H
+#define TRIANGLE_INTERSECTION_H
+
+#include "app_config.h"
+
+#include <optix.h>
+#include <optixu/optixu_math_namespace.h>
+
+#include "rt_function.h"
+
+// Watertight ray/triangle intersection in single precision.
+// Woop, Benthin, Wald, "Watertight Ray/Triangle Intersection", JCGT 2(1), 2013.
+// The vertices are transformed into a ray space where the ray is the +z axis, so the edge tests of two triangles
+// sharing an edge are evaluated on bit-identical values and a ray can never slip through between them.
+// That only holds if every product and difference is rounded on its own. A fused multiply-add rounds a * b - c * d
+// once, in an order that depends on the triangle, so the arithmetic below must not be contracted: the device uses
+// the explicitly rounded intrinsics, the host build compiles with -ffp-contract=off (see CMakeLists.txt).
+
+RT_FUNCTION float watertightMul(const float a, const float b)
+{
+#if defined(__CUDA_ARCH__)
+	return __fmul_rn(a, b);
+#else
+	return a * b;
+#endif
+}
+
+RT_FUNCTION float watertightAdd(const float a, const float b)
+{
+#if defined(__CUDA_ARCH__)
+	return __fadd_rn(a, b);
+#else
+	return a + b;
+#endif
+}
+
+RT_FUNCTION float watertightSub(const float a, const float b)
+{
+#if defined(__CUDA_ARCH__)
+	return __fsub_rn(a, b);
+#else
+	return a - b;
+#endif
+}
+
+// Per ray precomputation, shared by all triangles tested against the same ray.
+struct WatertightRay
+{
+	optix::float3 origin;
+	int           kx;  // Permutation of the dimensions which makes kz the largest direction component.
+	int           ky;
+	int           kz;
+	float         Sx;  // Shear constants.
+	float         Sy;
+	float         Sz;
+};
+
+RT_FUNCTION WatertightRay makeWatertightRay(const optix::float3& origin, const optix::float3& direction)
+{
+	WatertightRay ray;
+	ray.origin = origin;
+
+	const float ax = fabsf(direction.x);
+	const float ay = fabsf(direction.y);
+	const float az = fabsf(direction.z);
+
+	ray.kz = (ax > ay) ? ((ax > az) ? 0 : 2) : ((ay > az) ? 1 : 2);
+	ray.kx = (ray.kz == 2) ? 0 : ray.kz + 1;
+	ray.ky = (ray.kx == 2) ? 0 : ray.kx + 1;
+
+	// Swap kx and ky to preserve the winding direction of the triangles.
+	const float dirZ = optix::getByIndex(direction, ray.kz);
+	if (dirZ < 0.0f)
+	{
+		const int k = ray.kx;
+		ray.kx = ray.ky;
+		ray.ky = k;
+	}
+
+	ray.Sx = optix::getByIndex(direction, ray.kx) / dirZ;
+	ray.Sy = optix::getByIndex(direction, ray.ky) / dirZ;
+	ray.Sz = 1.0f / dirZ;
+	return ray;
+}
+
+// Returns the hit distance t in (tmin, tmax] and the barycentric coordinates of v1 (beta) and v2 (gamma).
+// Hits on edges and vertices are reported by every triangle sharing them. Backfaces are hit as well.
+RT_FUNCTION bool intersectTriangleWatertight(const WatertightRay& ray, const float tmin, const float tmax,
+                                             const optix::float3& v0, const optix::float3& v1, const optix::float3& v2,
+                                             float& t, float& beta, float& gamma)
+{
+	const optix::float3 A = v0 - ray.origin;
+	const optix::float3 B = v1 - ray.origin;
+	const optix::float3 C = v2 - ray.origin;
+
+	const float Akz = optix::getByIndex(A, ray.kz);
+	const float Bkz = optix::getByIndex(B, ray.kz);
+	const float Ckz = optix::getByIndex(C, ray.kz);
+
+	// Shear and scale the vertices.
+	const float Ax = watertightSub(optix::getByIndex(A, ray.kx), watertightMul(ray.Sx, Akz));
+	const float Ay = watertightSub(optix::getByIndex(A, ray.ky), watertightMul(ray.Sy, Akz));
+	const float Bx = watertightSub(optix::getByIndex(B, ray.kx), watertightMul(ray.Sx, Bkz));
+	const float By = watertightSub(optix::getByIndex(B, ray.ky), watertightMul(ray.Sy, Bkz));
+	const float Cx = watertightSub(optix::getByIndex(C, ray.kx), watertightMul(ray.Sx, Ckz));
+	const float Cy = watertightSub(optix::getByIndex(C, ray.ky), watertightMul(ray.Sy, Ckz));
+
+	// Scaled barycentric coordinates.
+	float U = watertightSub(watertightMul(Cx, By), watertightMul(Cy, Bx));
+	float V = watertightSub(watertightMul(Ax, Cy), watertightMul(Ay, Cx));
+	float W = watertightSub(watertightMul(Bx, Ay), watertightMul(By, Ax));
+
+	// Exactly zero means the ray hits an edge within float precision. Re-evaluate these rare cases in double
+	// so that neighbouring triangles agree on the sign.
+	if (U == 0.0f || V == 0.0f || W == 0.0f)
+	{
+		U = float(double(Cx) * double(By) - double(Cy) * double(Bx));
+		V = float(double(Ax) * double(Cy) - double(Ay) * double(Cx));
+		W = float(double(Bx) * double(Ay) - double(By) * double(Ax));
+	}
+
+	if ((U < 0.0f || V < 0.0f || W < 0.0f) && (U > 0.0f || V > 0.0f || W > 0.0f))
+	{
+		return false;
+	}
+
+	const float det = watertightAdd(watertightAdd(U, V), W);
+	if (det == 0.0f)
+	{
+		return false;
+	}
+
+	// Scaled hit distance, compared against the interval without dividing by det yet.
+	const float Az = watertightMul(ray.Sz, Akz);
+	const float Bz = watertightMul(ray.Sz, Bkz);
+	const float Cz = watertightMul(ray.Sz, Ckz);
+	const float T  = watertightAdd(watertightAdd(watertightMul(U, Az), watertightMul(V, Bz)), watertightMul(W, Cz));
+	if (0.0f < det)
+	{
+		if (T <= watertightMul(tmin, det) || watertightMul(tmax, det) < T)
+		{
+			return false;
+		}
+	}
+	else
+	{
+		if (T >= watertightMul(tmin, det) || watertightMul(tmax, det) > T)
+		{
+			return false;
+		}
+	}
+
+	const float invDet = 1.0f / det;
+	t     = T * invDet;
+	beta  = V * invDet;
+	gamma = W * invDet;
+	return true;
+}
+
+#endif // TRIANGLE_INTERSECTION_H
@@ -0,0 +1,233 @@
+#include "inc/Accumulator.h"
+
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <utility>
+
+#include "inc/MyAssert.h"
+#include "shaders/shader_common.h"
+
+namespace POptix
+{
+	static bool sameTiles(std::vector<Tile> const& a, std::vector<Tile> const& b)
+	{
+		if (a.size() != b.size())
+		{
+			return false;
+		}
+		for (size_t i = 0; i < a.size(); ++i)
+		{
+			if (a[i].x != b[i].x || a[i].y != b[i].y || a[i].width != b[i].width || a[i].height != b[i].height || a[i].slice != b[i].slice)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	Accumulator::Accumulator()
+		: m_width(0)
+		, m_height(0)
+		, m_numNodes(0)
+		, m_numPasses(0)
+	{
+	}
+
+	Accumulator::~Accumulator()
+	{
+	}
+
+	void Accumulator::setLayout(int width, int height, std::vector<Tile> const& tiles, TileScheduler const& scheduler)
+	{
+		const int numNodes = scheduler.getNumNodes();
+		if (width != m_width || height != m_height || numNodes != m_numNodes)
+		{
+			m_width    = width;
+			m_height   = height;
+			m_numNodes = numNodes;
+			m_splatSums.assign(size_t(m_width) * m_height * 3, 0.0);
+
+			m_nodeSums.clear();
+			m_nodeSums.resize(m_numNodes);
+			m_nodeSquares.clear();
+			m_nodeSquares.resize(m_numNodes);
+			for (int node = 0; node < m_numNodes; ++node)
+			{
+				std::function<void()> allocate = [this, node]()
+				{
+					m_nodeSums[node].assign(size_t(m_width) * m_height * 4, 0.0);
+					m_nodeSquares[node].assign(size_t(m_width) * m_height, 0.0);
+				};
+				if (m_numNodes == 1)
+				{
+					allocate();
+				}
+				else
+				{
+					scheduler.getTopology().runOnNode(node, allocate);
+				}
+			}
+			m_numPasses = 0;
+		}
+
+		// Cheap, and the same tiles can have other home nodes with another scheduler.
+		m_tileNodes.resize(tiles.size());
+		for (Tile const& tile : tiles)
+		{
+			m_tileNodes[tile.index] = scheduler.getHomeNode(tile.index, int(tiles.size()));
+		}
+
+		if (sameTiles(tiles, m_tiles))
+		{
+			return;
+		}
+		m_tiles = tiles;
+
+		// Regions in the order of their first tile, slices in ascending order.
+		std::map<std::pair<int, int>, int> regionOfOrigin;
+		m_regions.clear();
+		for (Tile const& tile : m_tiles)
+		{
+			MY_ASSERT(0 <= tile.x && 0 <= tile.y && tile.x + tile.width <= m_width && tile.y + tile.height <= m_height);
+
+			const std::pair<int, int> origin(tile.x, tile.y);
+			std::map<std::pair<int, int>, int>::const_iterator it = regionOfOrigin.find(origin);
+			if (it == regionOfOrigin.end())
+			{
+				it = regionOfOrigin.insert(std::make_pair(origin, int(m_regions.size()))).first;
+				m_regions.push_back(std::vector<int>());
+			}
+			std::vector<int>& region = m_regions[it->second];
+			MY_ASSERT(region.empty() || (m_tiles[region[0]].width == tile.width && m_tiles[region[0]].height == tile.height));
+
+			size_t position = region.size();
+			while (0 < position && tile.slice < m_tiles[region[position - 1]].slice)
+			{
+				--position;
+			}
+			region.insert(region.begin() + position, tile.index);
+		}
+
+		// Left uninitialized, the renderers write them before resolve() reads them.
+		m_tileBuffers.clear();
+		m_tileBuffers.resize(m_tiles.size());
+		for (Tile const& tile : m_tiles)
+		{
+			m_tileBuffers[tile.index].reset(new optix::float4[size_t(tile.width) * tile.height]);
+		}
+		m_tileSplats.clear();
+		m_tileSplats.resize(m_tiles.size());
+	}
+
+	void Accumulator::clear()
+	{
+		m_numPasses = 0;
+	}
+
+	void Accumulator::resolve(TileScheduler& scheduler, std::vector<optix::float4>& output, std::vector<float>* meanSquares)
+	{
+		MY_ASSERT(output.size() == size_t(m_width) * m_height);
+		MY_ASSERT(meanSquares == nullptr || meanSquares->size() == output.size());
+
+		const bool first = (m_numPasses == 0);
+
+		// The splats of a tile land anywhere in the image, so they are gathered on this thread, tile after tile.
+		bool splats = false;
+		for (std::vector<Splat>& tileSplats : m_tileSplats)
+		{
+			for (Splat const& splat : tileSplats)
+			{
+				MY_ASSERT(0 <= splat.pixel && splat.pixel < m_width * m_height);
+
+				double* sum = &m_splatSums[size_t(splat.pixel) * 3];
+				sum[0] += splat.radiance.x;
+				sum[1] += splat.radiance.y;
+				sum[2] += splat.radiance.z;
+			}
+			splats |= !tileSplats.empty();
+			tileSplats.clear();
+		}
+
+		scheduler.parallelFor(int(m_regions.size()), 1, [&](int begin, int end, int /*threadIndex*/)
+		{
+			for (int r = begin; r < end; ++r)
+			{
+				std::vector<int> const& region = m_regions[r];
+				Tile const& rect = m_tiles[region[0]];
+
+				for (int y = 0; y < rect.height; ++y)
+				{
+					const size_t   row = size_t(rect.y + y) * m_width + rect.x;
+					optix::float4* dst = &output[row];
+
+					if (first)
+					{
+						for (int node = 0; node < m_numNodes; ++node)
+						{
+							std::fill(&m_nodeSums[node][row * 4], &m_nodeSums[node][row * 4] + rect.width * 4, 0.0);
+							std::fill(&m_nodeSquares[node][row], &m_nodeSquares[node][row] + rect.width, 0.0);
+						}
+					}
+
+					// Slice after slice, every pixel still gets its samples in slice order on each node.
+					for (int tileIndex : region)
+					{
+						double*      sums    = &m_nodeSums[m_tileNodes[tileIndex]][row * 4];
+						double*      squares = &m_nodeSquares[m_tileNodes[tileIndex]][row];
+						const float* samples = &m_tileBuffers[tileIndex][size_t(y) * rect.width].x;
+						for (int i = 0; i < rect.width * 4; ++i)
+						{
+							sums[i] += samples[i];
+						}
+
+						// One sample per entry, skipped ones are all zero.
+						for (int x = 0; x < rect.width; ++x)
+						{
+							const double L = luminance(optix::make_float3(samples[x * 4], samples[x * 4 + 1], samples[x * 4 + 2]));
+							squares[x] += L * L;
+						}
+					}
+
+					if (splats)
+					{
+						double* sums      = &m_nodeSums[m_tileNodes[region[0]]][row * 4];
+						double* splatSums = &m_splatSums[row * 3];
+						for (int x = 0; x < rect.width; ++x)
+						{
+							sums[x * 4]     += splatSums[x * 3];
+							sums[x * 4 + 1] += splatSums[x * 3 + 1];
+							sums[x * 4 + 2] += splatSums[x * 3 + 2];
+						}
+						std::fill(splatSums, splatSums + rect.width * 3, 0.0);
+					}
+
+					for (int x = 0; x < rect.width; ++x)
+					{
+						// Across the nodes in node order. A single node is taken as is.
+						double sum[4] = { m_nodeSums[0][(row + x) * 4], m_nodeSums[0][(row + x) * 4 + 1], m_nodeSums[0][(row + x) * 4 + 2], m_nodeSums[0][(row + x) * 4 + 3] };
+						double square = m_nodeSquares[0][row + x];
+						for (int node = 1; node < m_numNodes; ++node)
+						{
+							for (int c = 0; c < 4; ++c)
+							{
+								sum[c] += m_nodeSums[node][(row + x) * 4 + c];
+							}
+							square += m_nodeSquares[node][row + x];
+						}
+
+						const double scale = (0.0 < sum[3]) ? 1.0 / sum[3] : 0.0;
+						dst[x] = optix::make_float4(float(sum[0] * scale), float(sum[1] * scale), float(sum[2] * scale), (0.0 < sum[3]) ? 1.0f : 0.0f);
+
+						if (meanSquares != nullptr)
+						{
+							(*meanSquares)[row + x] = (0.0 < sum[3]) ? float(square / sum[3]) : 0.0f;
+						}
+					}
+				}
+			}
+		});
+
+		++m_numPasses;
+	}
+}
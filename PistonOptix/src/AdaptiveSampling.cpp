@@ -0,0 +1,179 @@
+#include "inc/AdaptiveSampling.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#include "inc/MyAssert.h"
+#include "shaders/adaptive_reduce.h"
+
+namespace POptix
+{
+	// The accessors of adaptiveBlockVariance() for the host images.
+	struct HostMean
+	{
+		const optix::float4* data;
+		int                  width;
+
+		optix::float4 operator()(const int x, const int y) const { return data[size_t(y) * width + x]; }
+	};
+
+	struct HostMeanSquare
+	{
+		const float* data;
+		int          width;
+
+		float operator()(const int x, const int y) const { return data[size_t(y) * width + x]; }
+	};
+
+	AdaptiveSampling::AdaptiveSampling()
+		: m_width(0)
+		, m_height(0)
+		, m_blocksX(0)
+		, m_blocksY(0)
+		, m_warmup(16)
+		, m_targetError(0.1f)
+		, m_numActive(0)
+		, m_error(FLT_MAX)
+		, m_numSamples(0)
+	{
+	}
+
+	AdaptiveSampling::~AdaptiveSampling()
+	{
+	}
+
+	void AdaptiveSampling::setImageSize(int width, int height)
+	{
+		m_width   = width;
+		m_height  = height;
+		m_blocksX = (width  + ADAPTIVE_BLOCK_SIZE - 1) / ADAPTIVE_BLOCK_SIZE;
+		m_blocksY = (height + ADAPTIVE_BLOCK_SIZE - 1) / ADAPTIVE_BLOCK_SIZE;
+		restart();
+	}
+
+	void AdaptiveSampling::setWarmup(int samples)
+	{
+		MY_ASSERT(0 < samples);
+		m_warmup = samples;
+	}
+
+	void AdaptiveSampling::setTargetError(float error)
+	{
+		MY_ASSERT(0.0f < error);
+		m_targetError = error;
+	}
+
+	void AdaptiveSampling::restart()
+	{
+		const int numBlocks = m_blocksX * m_blocksY;
+
+		m_mask.assign(numBlocks, 1);
+		m_blockSamples.assign(numBlocks, 0);
+		m_blockErrors.assign(numBlocks, FLT_MAX);
+
+		m_numActive  = numBlocks;
+		m_error      = FLT_MAX;
+		m_numSamples = 0;
+	}
+
+	void AdaptiveSampling::update(const optix::float4* mean, const float* meanSquare, int samples)
+	{
+		const HostMean       hostMean       = { mean, m_width };
+		const HostMeanSquare hostMeanSquare = { meanSquare, m_width };
+
+		std::vector<float> blockVariances(m_blocksX * m_blocksY);
+		for (int by = 0; by < m_blocksY; ++by)
+		{
+			for (int bx = 0; bx < m_blocksX; ++bx)
+			{
+				blockVariances[by * m_blocksX + bx] = adaptiveBlockVariance(hostMean, hostMeanSquare, bx, by, m_width, m_height);
+			}
+		}
+		updateBlocks(blockVariances.data(), samples);
+	}
+
+	void AdaptiveSampling::updateBlocks(const float* blockVariances, int samples)
+	{
+		MY_ASSERT(0 < samples);
+
+		const int numBlocks = m_blocksX * m_blocksY;
+
+		// Per block the summed relative variances of the pixel means.
+		std::vector<double> variances(numBlocks, 0.0);
+		std::vector<int>    pixels(numBlocks, 0);
+
+		m_numSamples = 0;
+		for (int by = 0; by < m_blocksY; ++by)
+		{
+			for (int bx = 0; bx < m_blocksX; ++bx)
+			{
+				const int block = by * m_blocksX + bx;
+				const int n     = m_mask[block] ? samples : m_blockSamples[block];
+
+				pixels[block] = (std::min(m_width, (bx + 1) * ADAPTIVE_BLOCK_SIZE) - bx * ADAPTIVE_BLOCK_SIZE) *
+				                (std::min(m_height, (by + 1) * ADAPTIVE_BLOCK_SIZE) - by * ADAPTIVE_BLOCK_SIZE);
+
+				// Unbiased sample variance, divided by n for the variance of the mean.
+				variances[block] = (1 < n) ? double(blockVariances[block]) / double(n - 1) : 0.0;
+
+				m_numSamples += (long long)(n) * pixels[block];
+			}
+		}
+
+		double totalVariance = 0.0;
+		for (int block = 0; block < numBlocks; ++block)
+		{
+			totalVariance += variances[block];
+		}
+		m_error = float(sqrt(totalVariance / (double(m_width) * m_height)));
+
+		if (samples < m_warmup)
+		{
+			return;
+		}
+
+		for (int block = 0; block < numBlocks; ++block)
+		{
+			if (m_mask[block])
+			{
+				m_blockErrors[block] = float(sqrt(variances[block] / pixels[block]));
+			}
+		}
+
+		// Noise often shows in only one of two adjacent blocks. Checking the neighbours as well keeps the edges of noisy
+		// regions active and a single lucky estimate from stopping a block too early.
+		std::vector<int> converged;
+		for (int by = 0; by < m_blocksY; ++by)
+		{
+			for (int bx = 0; bx < m_blocksX; ++bx)
+			{
+				const int block = by * m_blocksX + bx;
+				if (!m_mask[block])
+				{
+					continue;
+				}
+
+				float error = 0.0f;
+				for (int ny = std::max(0, by - 1); ny <= std::min(m_blocksY - 1, by + 1); ++ny)
+				{
+					for (int nx = std::max(0, bx - 1); nx <= std::min(m_blocksX - 1, bx + 1); ++nx)
+					{
+						error = std::max(error, m_blockErrors[ny * m_blocksX + nx]);
+					}
+				}
+				if (error <= m_targetError)
+				{
+					converged.push_back(block);
+				}
+			}
+		}
+
+		for (int block : converged)
+		{
+			m_mask[block]         = 0;
+			m_blockSamples[block] = samples;
+			--m_numActive;
+		}
+	}
+}
@@ -7,6 +7,7 @@
 #include <optixu/optixu_math_namespace.h>
 #include <optixu/optixu_matrix_namespace.h>
 
+#include <algorithm>
 #include <cstring>
 #include <iostream>
 #include <sstream>
@@ -36,7 +37,8 @@ Application::Application(GLFWwindow* window,
 	const int height,
 	const unsigned int devices,
 	const unsigned int stackSize,
-	const bool interop)
+	const bool interop,
+	const std::string& builder)
 	: m_window(window)
 	, m_width(width)
 	, m_height(height)
@@ -69,15 +71,35 @@ Application::Application(GLFWwindow* window,
 	m_minPathLength = 2;    // Minimum path length after which Russian Roulette path termination starts.
 	m_maxPathLength = 5;    // Maximum path length. 
 	m_sceneEpsilonFactor = 500;  // Factor on 1e-7 used to offset ray origins along the path to reduce self intersections. 
+	m_lightSelection = POptix::LIGHT_SELECTION_UNIFORM;
+	m_sampler = POptix::SAMPLER_SOBOL;
+	m_adaptive = false;
+	m_targetError = 0.1f;
+	m_adaptiveMaskDirty = true;
+	m_restir = POptix::RESTIR_OFF;
+	m_sceneRadius = 0.0f;
+	m_environmentLight = -1;
 
 	m_present = false;  // Update once per second. (The first half second shows all frames to get some initial accumulation).
 	m_presentNext = true;
 	m_presentAtSecond = 1.0;
 	m_frameCount = 0;
-	m_builder = std::string("Trbvh");
+	m_builder = builder;
+
+	// OptiX 5 has no plain LBVH builder, its Trbvh is the LBVH with treelet restructuring. The host side top level BVH uses the real one.
+	if (m_builder == std::string("Lbvh"))
+	{
+		m_builder = std::string("Trbvh");
+
+		POptix::BvhBuildOptions options;
+		options.builder = POptix::BVH_BUILDER_LBVH;
+		m_topLevelAccel.setBuildOptions(options);
+	}
 
 	m_frames = 0; // Samples per pixel. 0 == render forever.
 
+	m_instancesDirty = false;
+
 	// GLSL shaders objects and program. 
 	m_glslVS = 0;
 	m_glslFS = 0;
@@ -152,6 +174,13 @@ void Application::reshape(int width, int height)
 				glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
 				m_bufferOutput->registerGLBuffer();
 			}
+
+			m_bufferLuminanceSquared->setSize(m_width, m_height);
+			m_adaptiveSampling.setImageSize(m_width, m_height);
+			m_bufferAdaptiveMask->setSize(m_adaptiveSampling.getBlocksX(), m_adaptiveSampling.getBlocksY());
+			m_bufferAdaptiveVariance->setSize(m_adaptiveSampling.getBlocksX(), m_adaptiveSampling.getBlocksY());
+
+			updateReservoirBuffer();
 		}
 		catch (optix::Exception& e)
 		{
@@ -342,7 +371,7 @@ void Application::initRenderer()
 {
 	try
 	{
-		m_context->setEntryPointCount(1); // 0 = render // Tonemapper is a GLSL shader in this case.
+		m_context->setEntryPointCount(3); // 0 = render, 1 = ReSTIR spatial reuse, 2 = adaptive sampling reduction // Tonemapper is a GLSL shader in this case.
 		m_context->setRayTypeCount(2);    // 0 = radiance and 1 = shadow ray
 
 		m_context->setStackSize(m_stackSize);
@@ -358,6 +387,9 @@ void Application::initRenderer()
 		// Add context-global variables here.
 		m_context["sysSceneEpsilon"]->setFloat(m_sceneEpsilonFactor * 1e-7f);
 		m_context["sysPathLengths"]->setInt(m_minPathLength, m_maxPathLength);
+		m_context["sysLightSelection"]->setInt(m_lightSelection);
+		m_context["sysSampler"]->setInt(m_sampler);
+		initBlueNoise();
 		m_context["sysIterationIndex"]->setInt(0); // With manual accumulation, 0 fills the buffer, accumulation starts at 1. On the VCA this variable is unused!
 
 		// RT_BUFFER_INPUT_OUTPUT to support accumulation.
@@ -369,13 +401,26 @@ void Application::initRenderer()
 
 		m_context["sysOutputBuffer"]->set(m_bufferOutput);
 
+		initAdaptiveSampling();
+		initRestir();
+
 		std::map<std::string, optix::Program>::const_iterator it = m_mapOfPrograms.find("raygeneration");
 		MY_ASSERT(it != m_mapOfPrograms.end());
 		m_context->setRayGenerationProgram(0, it->second); // entrypoint
 
+		it = m_mapOfPrograms.find("restir_spatial");
+		MY_ASSERT(it != m_mapOfPrograms.end());
+		m_context->setRayGenerationProgram(1, it->second); // entrypoint
+
+		it = m_mapOfPrograms.find("adaptive_reduce");
+		MY_ASSERT(it != m_mapOfPrograms.end());
+		m_context->setRayGenerationProgram(2, it->second); // entrypoint
+
 		it = m_mapOfPrograms.find("exception");
 		MY_ASSERT(it != m_mapOfPrograms.end());
 		m_context->setExceptionProgram(0, it->second); // entrypoint
+		m_context->setExceptionProgram(1, it->second); // entrypoint
+		m_context->setExceptionProgram(2, it->second); // entrypoint
 
 		it = m_mapOfPrograms.find("miss");
 		MY_ASSERT(it != m_mapOfPrograms.end());
@@ -441,9 +486,37 @@ void Application::restartAccumulation()
 	m_presentNext = true;
 	m_presentAtSecond = 1.0;
 
+	m_adaptiveSampling.restart();
+	m_adaptiveMaskDirty = true;
+
 	m_timer.restart();
 }
 
+// Reduces the accumulated image and its second moment per block on the device, reads back the block sums and uploads the new block mask.
+void Application::updateAdaptiveSampling()
+{
+	m_context->launch(2, m_adaptiveSampling.getBlocksX(), m_adaptiveSampling.getBlocksY());
+
+	const float* blockVariances = static_cast<const float*>(m_bufferAdaptiveVariance->map(0, RT_BUFFER_MAP_READ));
+	m_adaptiveSampling.updateBlocks(blockVariances, m_iterationIndex);
+	m_bufferAdaptiveVariance->unmap();
+
+	m_adaptiveMaskDirty = true;
+}
+
+// The reservoirs cover the image while ReSTIR is on, the programs only need a valid buffer otherwise.
+void Application::updateReservoirBuffer()
+{
+	if (m_restir != POptix::RESTIR_OFF)
+	{
+		m_bufferReservoirs->setSize(m_width, m_height, RESTIR_SLOTS);
+	}
+	else
+	{
+		m_bufferReservoirs->setSize(1, 1, RESTIR_SLOTS);
+	}
+}
+
 bool Application::render()
 {
 	bool repaint = false;
@@ -455,6 +528,12 @@ bool Application::render()
 		optix::float3 cameraV;
 		optix::float3 cameraW;
 
+		if (m_instancesDirty)
+		{
+			updateRootAcceleration();
+			restartAccumulation();
+		}
+
 		const bool cameraChanged = m_pinholeCamera.getFrustum(cameraPosition, cameraU, cameraV, cameraW);
 		if (cameraChanged)
 		{
@@ -467,11 +546,30 @@ bool Application::render()
 		}
 
 		// Continue manual accumulation rendering if there is no limit (m_frames == 0) or the number of frames has not been reached.
-		if (0 == m_frames || m_iterationIndex < m_frames)
+		// With adaptive sampling the accumulation also stops when all blocks reached the target error.
+		if ((0 == m_frames || m_iterationIndex < m_frames) && !(m_adaptive && m_adaptiveSampling.isConverged()))
 		{
+			if (m_adaptiveMaskDirty)
+			{
+				std::vector<unsigned char> const& mask = m_adaptiveSampling.getMask();
+				memcpy(m_bufferAdaptiveMask->map(0, RT_BUFFER_MAP_WRITE_DISCARD), mask.data(), mask.size());
+				m_bufferAdaptiveMask->unmap();
+				m_adaptiveMaskDirty = false;
+			}
+
 			m_context["sysIterationIndex"]->setInt(m_iterationIndex); // Iteration index is zero-based!
 			m_context->launch(0, m_width, m_height);
+			if (m_restir != POptix::RESTIR_OFF)
+			{
+				m_context->launch(1, m_width, m_height); // The neighbours of a pixel are done with the first pass only after the launch.
+			}
 			m_iterationIndex++;
+
+			// The read back of the block sums stalls the pipeline, every 8th launch is often enough for the decisions.
+			if (m_adaptive && m_adaptiveSampling.getWarmup() <= m_iterationIndex && (m_iterationIndex % 8) == 0)
+			{
+				updateAdaptiveSampling();
+			}
 		}
 
 		// Only update the texture when a restart happened or one second passed to reduce required bandwidth.
@@ -727,6 +825,32 @@ void Application::guiWindow()
 			m_context["sysSceneEpsilon"]->setFloat(m_sceneEpsilonFactor * 1e-7f);
 			restartAccumulation();
 		}
+		if (ImGui::Combo("Light Selection", &m_lightSelection, "Uniform\0Light Tree\0Power\0\0"))
+		{
+			m_context["sysLightSelection"]->setInt(m_lightSelection);
+			restartAccumulation();
+		}
+		if (ImGui::Combo("Sampler", &m_sampler, "LCG\0Sobol\0Halton\0Blue Noise\0\0"))
+		{
+			m_context["sysSampler"]->setInt(m_sampler);
+			restartAccumulation();
+		}
+		if (ImGui::Combo("ReSTIR", &m_restir, "Off\0Biased\0Unbiased\0\0"))
+		{
+			updateReservoirBuffer();
+			m_context["sysRestir"]->setInt(m_restir);
+			restartAccumulation();
+		}
+		if (ImGui::Checkbox("Adaptive", &m_adaptive))
+		{
+			m_context["sysAdaptive"]->setInt((m_adaptive) ? 1 : 0);
+			restartAccumulation();
+		}
+		if (ImGui::DragFloat("Target Error", &m_targetError, 0.001f, 0.001f, 1.0f, "%.3f"))
+		{
+			m_adaptiveSampling.setTargetError(m_targetError);
+			restartAccumulation(); // Converged blocks never become active again.
+		}
 		if (ImGui::DragInt("Frames", &m_frames, 1.0f, 0, 10000))
 		{
 			if (m_frames != 0 && m_frames < m_iterationIndex) // If we already rendered more frames, start again.
@@ -871,6 +995,32 @@ void Application::guiWindow()
 			restartAccumulation();
 		}
 	}
+	if (ImGui::CollapsingHeader("Instances"))
+	{
+		for (int i = 0; i < int(m_instanceTransforms.size()); ++i)
+		{
+			if (ImGui::TreeNode((void*)(intptr_t)i, "Instance %d", i))
+			{
+				// Row-major, the translation is the last column.
+				float transform[16];
+				float inverse[16];
+				m_instanceTransforms[i]->getMatrix(false, transform, inverse);
+
+				float translation[3] = { transform[3], transform[7], transform[11] };
+				if (ImGui::DragFloat3("Translation", translation, 0.05f))
+				{
+					transform[3]  = translation[0];
+					transform[7]  = translation[1];
+					transform[11] = translation[2];
+
+					// The next launch refits or rebuilds the root acceleration and restarts the accumulation.
+					setInstanceTransform(i, transform);
+				}
+
+				ImGui::TreePop();
+			}
+		}
+	}
 
 	ImGui::PopItemWidth();
 	ImGui::End();
@@ -972,8 +1122,10 @@ void Application::guiEventHandler()
 	}
 }
 
-void Application::createGeometry(optix::Geometry& geometry, optix::Material& material, uint materialID, float * transform)
+optix::Transform Application::createGeometry(optix::Geometry& geometry, optix::Material& material, uint materialID, float * transform, std::string const& builder)
 {
+	optix::Transform trGeo(nullptr);
+
 	try
 	{
 		optix::GeometryInstance giGeo = m_context->createGeometryInstance(); // This connects Geometries with Materials.
@@ -982,8 +1134,11 @@ void Application::createGeometry(optix::Geometry& geometry, optix::Material& mat
 		giGeo->setMaterial(0, material);
 		giGeo["parMaterialIndex"]->setInt(materialID); // This is all! This defines which material parameters in sysMaterialParametrers to use.
 
-		optix::Acceleration accGeo = m_context->createAcceleration(m_builder);
-		setAccelerationProperties(accGeo);
+		// A mesh can override the builder in the scene file, e.g. "Sbvh" for long thin triangles.
+		const std::string& meshBuilder = builder.empty() ? m_builder : builder;
+
+		optix::Acceleration accGeo = m_context->createAcceleration(meshBuilder);
+		setAccelerationProperties(accGeo, meshBuilder);
 
 		optix::GeometryGroup ggGeo = m_context->createGeometryGroup(); // This connects GeometryInstances with Acceleration structures. (All OptiX nodes with "Group" in the name hold an Acceleration.)
 		ggGeo->setAcceleration(accGeo);
@@ -992,7 +1147,7 @@ void Application::createGeometry(optix::Geometry& geometry, optix::Material& mat
 
 		optix::Matrix4x4 matrixPlane(transform);
 
-		optix::Transform trGeo = m_context->createTransform();
+		trGeo = m_context->createTransform();
 		trGeo->setChild(ggGeo);
 		trGeo->setMatrix(false, matrixPlane.getData(), matrixPlane.inverse().getData());
 
@@ -1005,6 +1160,7 @@ void Application::createGeometry(optix::Geometry& geometry, optix::Material& mat
 	{
 		std::cerr << e.getErrorString() << std::endl;
 	}
+	return trGeo;
 }
 
 // This part is always identical in the generated geometry creation routines.
@@ -1058,11 +1214,11 @@ void Application::initPrograms()
 
 		// Renderer
 		m_mapOfPrograms["raygeneration"] = m_context->createProgramFromPTXFile(ptxPath("raygeneration.cu"), "raygeneration"); // entry point 0
-		m_mapOfPrograms["exception"] = m_context->createProgramFromPTXFile(ptxPath("exception.cu"), "exception"); // entry point 0
+		m_mapOfPrograms["restir_spatial"] = m_context->createProgramFromPTXFile(ptxPath("raygeneration.cu"), "restir_spatial"); // entry point 1
+		m_mapOfPrograms["adaptive_reduce"] = m_context->createProgramFromPTXFile(ptxPath("raygeneration.cu"), "adaptive_reduce"); // entry point 2
+		m_mapOfPrograms["exception"] = m_context->createProgramFromPTXFile(ptxPath("exception.cu"), "exception"); // entry point 0 to 2
 
-		m_mapOfPrograms["miss"] = m_context->createProgramFromPTXFile(ptxPath("miss.cu"), "miss_environment_constant"); // raytype 0
-		const std::string& texture_filename = std::string(sutil::samplesDir()) + "\\resources\\kiara_9_dusk_2k.hdr";
-		m_context["envmap"]->setTextureSampler(sutil::loadTexture(m_context, texture_filename, optix::make_float3(1.0f)));
+		m_mapOfPrograms["miss"] = m_context->createProgramFromPTXFile(ptxPath("miss.cu"), "miss_environment_constant"); // raytype 0, the envmap is set by initEnvironment().
 
 		// Geometry
 		m_mapOfPrograms["boundingbox_triangle_indexed"] = m_context->createProgramFromPTXFile(ptxPath("boundingbox_triangle_indexed.cu"), "boundingbox_triangle_indexed");
@@ -1147,6 +1303,8 @@ void Application::initLightProgrames()
 		lightsample[POptix::ELightType::QUAD] = prg->getId();
 		prg = m_context->createProgramFromPTXFile(ptxPath("LightSample.cu"), "directional_sample");
 		lightsample[POptix::ELightType::DIRECTIONAL] = prg->getId();
+		prg = m_context->createProgramFromPTXFile(ptxPath("LightSample.cu"), "environment_sample");
+		lightsample[POptix::ELightType::ENVIRONMENT] = prg->getId();
 		m_bufferLightSample->unmap();
 		m_context["sysLightSample"]->setBuffer(m_bufferLightSample);
 	}
@@ -1176,6 +1334,8 @@ void Application::updateMaterialParameters()
 
 void Application::updateLightParameters()
 {
+	std::vector<POptix::Light> lights;
+
 	POptix::Light* dst = static_cast<POptix::Light*>(m_bufferLightParameters->map(0, RT_BUFFER_MAP_WRITE_DISCARD));
 	for (size_t i = 0; i < scene->mLightList.size(); ++i, ++dst) 
 	{
@@ -1190,8 +1350,45 @@ void Application::updateLightParameters()
 		dst->normal		= mat->normal;
 		dst->lightType	= mat->lightType;
 		dst->isDelta	= mat->isDelta;
+
+		lights.push_back(*dst);
 	}
 	m_bufferLightParameters->unmap();
+
+	// The light tree depends on the positions and the emission, rebuild it with every change.
+	m_lightTree.build(lights);
+
+	std::vector<POptix::LightTreeNode> const& nodes = m_lightTree.getNodes();
+	std::vector<int> const& lightMap = m_lightTree.getLightMap();
+
+	// OptiX buffers can't be empty, e.g. without lights or with directional lights only.
+	m_bufferLightTree->setSize(std::max(nodes.size(), size_t(1)));
+	if (!nodes.empty())
+	{
+		memcpy(m_bufferLightTree->map(0, RT_BUFFER_MAP_WRITE_DISCARD), nodes.data(), nodes.size() * sizeof(POptix::LightTreeNode));
+		m_bufferLightTree->unmap();
+	}
+
+	m_bufferLightTreeMap->setSize(std::max(lightMap.size(), size_t(1)));
+	if (!lightMap.empty())
+	{
+		memcpy(m_bufferLightTreeMap->map(0, RT_BUFFER_MAP_WRITE_DISCARD), lightMap.data(), lightMap.size() * sizeof(int));
+		m_bufferLightTreeMap->unmap();
+	}
+
+	m_context["sysNumberOfDirectionalLights"]->setInt(m_lightTree.getNumDirectionalLights());
+
+	// Same for the alias table, it depends on the emission and the size of the lights.
+	m_lightAliasTable.build(lights, m_sceneRadius, m_environment.getAverageLuminance());
+
+	std::vector<POptix::LightAliasEntry> const& entries = m_lightAliasTable.getEntries();
+
+	m_bufferLightAliasTable->setSize(std::max(entries.size(), size_t(1)));
+	if (!entries.empty())
+	{
+		memcpy(m_bufferLightAliasTable->map(0, RT_BUFFER_MAP_WRITE_DISCARD), entries.data(), entries.size() * sizeof(POptix::LightAliasEntry));
+		m_bufferLightAliasTable->unmap();
+	}
 }
 
 void Application::initMaterials()
@@ -1260,9 +1457,41 @@ void Application::initLights()
 		m_bufferLightParameters->setElementSize(sizeof(POptix::Light));
 		m_bufferLightParameters->setSize(m_lightsList.size());
 
+		m_bufferLightTree = m_context->createBuffer(RT_BUFFER_INPUT, RT_FORMAT_USER);
+		m_bufferLightTree->setElementSize(sizeof(POptix::LightTreeNode));
+		m_bufferLightTree->setSize(1);
+
+		m_bufferLightTreeMap = m_context->createBuffer(RT_BUFFER_INPUT, RT_FORMAT_INT);
+		m_bufferLightTreeMap->setSize(1);
+
+		m_bufferLightAliasTable = m_context->createBuffer(RT_BUFFER_INPUT, RT_FORMAT_USER);
+		m_bufferLightAliasTable->setElementSize(sizeof(POptix::LightAliasEntry));
+		m_bufferLightAliasTable->setSize(1);
+
+		// The meshes are not in the top level acceleration yet, bound them here.
+		optix::Aabb sceneBounds;
+		for (const POptix::Node* node : scene->mNodeList)
+		{
+			for (unsigned int meshID : node->mMeshIDList)
+			{
+				std::map<unsigned int, POptix::Mesh*>::const_iterator it = scene->mMeshList.find(meshID);
+				if (it != scene->mMeshList.end())
+				{
+					sceneBounds.include(POptix::transformBounds(POptix::computeMeshBounds(*it->second), optix::Matrix4x4(node->transform)));
+				}
+			}
+		}
+		m_sceneRadius = sceneBounds.valid() ? 0.5f * optix::length(sceneBounds.extent()) : 0.0f;
+
+		// Before updateLightParameters(), the alias table needs the brightness of the environment.
+		initEnvironment();
+
 		updateLightParameters();
 		
 		m_context["sysLightParameters"]->setBuffer(m_bufferLightParameters);
+		m_context["sysLightTree"]->setBuffer(m_bufferLightTree);
+		m_context["sysLightTreeMap"]->setBuffer(m_bufferLightTreeMap);
+		m_context["sysLightAliasTable"]->setBuffer(m_bufferLightAliasTable);
 		m_context["sysNumberOfLights"]->setInt(static_cast<int>(m_lightsList.size()));
 	}
 	catch (optix::Exception& e)
@@ -1271,6 +1500,110 @@ void Application::initLights()
 	}
 }
 
+// The image of the first environment light and its cumulative distributions for the importance sampling in environment_sample.h.
+// miss.cu and LightSample.cu read the same texture, so the host EnvironmentMap is uploaded instead of loading the file twice.
+void Application::initEnvironment()
+{
+	m_environmentLight = -1;
+	for (size_t i = 0; i < scene->mLightList.size() && m_environmentLight < 0; ++i)
+	{
+		if (scene->mLightList[i]->lightType == POptix::ELightType::ENVIRONMENT)
+		{
+			m_environmentLight = static_cast<int>(i);
+		}
+	}
+
+	if (m_environmentLight < 0 || !m_environment.load(scene->mEnvironmentFile))
+	{
+		if (0 <= m_environmentLight)
+		{
+			std::cerr << "ERROR: initEnvironment() can't read " << scene->mEnvironmentFile << std::endl;
+		}
+		const float black[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+		m_environment.build(1, 1, black);
+	}
+
+	const int width  = m_environment.getWidth();
+	const int height = m_environment.getHeight();
+
+	// Same sampler settings as sutil::loadHDRTexture().
+	optix::Buffer texels = m_context->createBuffer(RT_BUFFER_INPUT, RT_FORMAT_FLOAT4, width, height);
+	memcpy(texels->map(0, RT_BUFFER_MAP_WRITE_DISCARD), m_environment.getTexels().data(), m_environment.getTexels().size() * sizeof(float));
+	texels->unmap();
+
+	optix::TextureSampler sampler = m_context->createTextureSampler();
+	sampler->setWrapMode(0, RT_WRAP_REPEAT);
+	sampler->setWrapMode(1, RT_WRAP_REPEAT);
+	sampler->setWrapMode(2, RT_WRAP_REPEAT);
+	sampler->setIndexingMode(RT_TEXTURE_INDEX_NORMALIZED_COORDINATES);
+	sampler->setReadMode(RT_TEXTURE_READ_NORMALIZED_FLOAT);
+	sampler->setMaxAnisotropy(1.0f);
+	sampler->setMipLevelCount(1u);
+	sampler->setArraySize(1u);
+	sampler->setBuffer(0u, 0u, texels);
+	sampler->setFilteringModes(RT_FILTER_LINEAR, RT_FILTER_LINEAR, RT_FILTER_NONE);
+
+	std::vector<float> const& marginal    = m_environment.getMarginalCdf();
+	std::vector<float> const& conditional = m_environment.getConditionalCdf();
+
+	m_bufferEnvironmentMarginal = m_context->createBuffer(RT_BUFFER_INPUT, RT_FORMAT_FLOAT, marginal.size());
+	memcpy(m_bufferEnvironmentMarginal->map(0, RT_BUFFER_MAP_WRITE_DISCARD), marginal.data(), marginal.size() * sizeof(float));
+	m_bufferEnvironmentMarginal->unmap();
+
+	m_bufferEnvironmentConditional = m_context->createBuffer(RT_BUFFER_INPUT, RT_FORMAT_FLOAT, conditional.size());
+	memcpy(m_bufferEnvironmentConditional->map(0, RT_BUFFER_MAP_WRITE_DISCARD), conditional.data(), conditional.size() * sizeof(float));
+	m_bufferEnvironmentConditional->unmap();
+
+	m_context["envmap"]->setTextureSampler(sampler);
+	m_context["sysEnvironmentMarginal"]->setBuffer(m_bufferEnvironmentMarginal);
+	m_context["sysEnvironmentConditional"]->setBuffer(m_bufferEnvironmentConditional);
+	m_context["sysEnvironmentSize"]->setInt(width, height);
+	m_context["sysEnvironmentLight"]->setInt(m_environmentLight);
+}
+
+// The rank mask of the blue noise sampler, loaded by main() at startup. Without the file it holds white noise.
+void Application::initBlueNoise()
+{
+	std::vector<unsigned short> const& ranks = POptix::BlueNoiseTile::getRanks();
+
+	m_bufferBlueNoise = m_context->createBuffer(RT_BUFFER_INPUT, RT_FORMAT_UNSIGNED_SHORT, BLUE_NOISE_TILE_SIZE, BLUE_NOISE_TILE_SIZE);
+	memcpy(m_bufferBlueNoise->map(0, RT_BUFFER_MAP_WRITE_DISCARD), ranks.data(), ranks.size() * sizeof(unsigned short));
+	m_bufferBlueNoise->unmap();
+
+	m_context["sysBlueNoise"]->setBuffer(m_bufferBlueNoise);
+}
+
+// Second moment and block mask of the adaptive sampling. Resized with the output buffer in reshape().
+void Application::initAdaptiveSampling()
+{
+	m_adaptiveSampling.setImageSize(m_width, m_height);
+	m_adaptiveSampling.setTargetError(m_targetError);
+
+	m_bufferLuminanceSquared = m_context->createBuffer(RT_BUFFER_INPUT_OUTPUT, RT_FORMAT_FLOAT, m_width, m_height);
+	m_context["sysLuminanceSquaredBuffer"]->set(m_bufferLuminanceSquared);
+
+	m_bufferAdaptiveMask = m_context->createBuffer(RT_BUFFER_INPUT, RT_FORMAT_UNSIGNED_BYTE, m_adaptiveSampling.getBlocksX(), m_adaptiveSampling.getBlocksY());
+	m_context["sysAdaptiveMask"]->set(m_bufferAdaptiveMask);
+
+	m_bufferAdaptiveVariance = m_context->createBuffer(RT_BUFFER_OUTPUT, RT_FORMAT_FLOAT, m_adaptiveSampling.getBlocksX(), m_adaptiveSampling.getBlocksY());
+	m_context["sysAdaptiveVariance"]->set(m_bufferAdaptiveVariance);
+	m_adaptiveMaskDirty = true;
+
+	m_context["sysAdaptive"]->setInt((m_adaptive) ? 1 : 0);
+}
+
+// Reservoirs of ReSTIR DI, see reservoir.h. Resized with the output buffer in reshape().
+void Application::initRestir()
+{
+	// Read and written by both entry points.
+	m_bufferReservoirs = m_context->createBuffer(RT_BUFFER_INPUT_OUTPUT, RT_FORMAT_USER);
+	m_bufferReservoirs->setElementSize(sizeof(POptix::ReservoirPixel));
+	updateReservoirBuffer();
+	m_context["sysReservoirBuffer"]->set(m_bufferReservoirs);
+
+	m_context["sysRestir"]->setInt(m_restir);
+}
+
 
 // Scene testing all materials on a single geometry instanced via transforms and sharing one acceleration structure.
 void Application::createScene()
@@ -1298,10 +1631,12 @@ void Application::createScene()
 				if (it != scene->mMeshList.end()) 
 				{
 					optix::Geometry geo = createGeometry(it->second->attributes, it->second->indices);
-					createGeometry(geo, m_opaqueMaterial, node->materialID, node->transform);
+					m_instanceTransforms.push_back(createGeometry(geo, m_opaqueMaterial, node->materialID, node->transform, it->second->builder));
+					m_topLevelAccel.addInstance(meshID, POptix::computeMeshBounds(*it->second), node->transform);
 				}
 			}
 		}
+		m_topLevelAccel.build();
 
 		// Create Light Geometry
 		for (int i = 0; i < scene->mLightList.size(); ++i)
@@ -1311,13 +1646,15 @@ void Application::createScene()
 			
 			if (light->lightType == POptix::ELightType::QUAD)
 			{
-				lightMesh = POptix::Scene::createParallelogram(make_float3(0.0f), light->u, light->v, light->normal);
+				// position is a corner of the quad, like in quadLightSample(), the parallelogram is built around its center.
+				lightMesh = POptix::Scene::createParallelogram(0.5f * (light->u + light->v), light->u, light->v, light->normal);
 			}
 			else if (light->lightType == POptix::ELightType::SPHERE)
 			{
-				lightMesh = POptix::Scene::createSphere(10, 10, light->radius, M_PIf);
+				// Fine enough that the hits match the analytic sphere of sampleSphereLight() within about 1% of its solid angle.
+				lightMesh = POptix::Scene::createSphere(32, 32, light->radius, M_PIf);
 			}
-			else if (light->lightType == POptix::ELightType::DIRECTIONAL)
+			else if (light->lightType == POptix::ELightType::DIRECTIONAL || light->lightType == POptix::ELightType::ENVIRONMENT)
 			{
 				// Render No Geometry
 			}
@@ -1345,12 +1682,42 @@ void Application::createScene()
 
 
 
-void Application::setAccelerationProperties(optix::Acceleration acceleration)
+void Application::setInstanceTransform(unsigned int instanceIndex, const float* transform)
+{
+	MY_ASSERT(instanceIndex < m_instanceTransforms.size());
+
+	try
+	{
+		optix::Matrix4x4 matrix(transform);
+		m_instanceTransforms[instanceIndex]->setMatrix(false, matrix.getData(), matrix.inverse().getData());
+		m_topLevelAccel.setTransform(instanceIndex, transform);
+		m_instancesDirty = true;
+	}
+	catch (optix::Exception& e)
+	{
+		std::cerr << e.getErrorString() << std::endl;
+	}
+}
+
+void Application::updateRootAcceleration()
+{
+	// All transforms changed since the last launch are handled by one update.
+	// The host side hierarchy tracks the SAH degradation of refitting and the OptiX root acceleration follows its decision.
+	const POptix::ETopLevelUpdate update = m_topLevelAccel.update();
+	if (update != POptix::TOP_LEVEL_UNCHANGED)
+	{
+		m_rootAcceleration->setProperty("refit", (update == POptix::TOP_LEVEL_REFIT) ? "1" : "0");
+		m_rootAcceleration->markDirty();
+	}
+	m_instancesDirty = false;
+}
+
+void Application::setAccelerationProperties(optix::Acceleration acceleration, std::string const& builder)
 {
 	// To speed up the acceleration structure build for triangles, skip calls to the bounding box program and
 	// invoke the special splitting BVH builder for indexed triangles by setting the necessary acceleration properties.
 	// Using the fast Trbvh builder which does splitting has a positive effect on the rendering performanc as well.
-	if (m_builder == std::string("Trbvh") || m_builder == std::string("Sbvh"))
+	if (builder == std::string("Trbvh") || builder == std::string("Sbvh"))
 	{
 		// This requires that the position is the first element and it must be float x, y, z.
 		acceleration->setProperty("vertex_buffer_name", "attributesBuffer");
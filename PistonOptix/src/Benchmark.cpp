@@ -0,0 +1,70 @@
+#include "inc/Benchmark.h"
+#include "inc/BenchmarkCommon.h"
+
+#include <iostream>
+
+namespace POptix
+{
+	typedef int (*BenchmarkFunction)();
+
+	struct BenchmarkEntry
+	{
+		const char*       name;
+		const char*       description;
+		BenchmarkFunction function;
+	};
+
+	static const BenchmarkEntry g_benchmarks[] =
+	{
+		{ "refit",      "Top level BVH refit vs. rebuild for 10k animated instances.", benchmarkRefit },
+		{ "watertight", "Rays at shared edges and vertices, counts cracks of the triangle intersection kernels.", benchmarkWatertight },
+		{ "triangles",  "Triangle intersection throughput, legacy double vs. watertight scalar and SIMD packet.", benchmarkTriangles },
+		{ "tiles",      "Host path tracer, static scanline strips vs. Hilbert ordered tiles with work stealing.", benchmarkTiles },
+		{ "wavefront",  "Host path tracer, megakernel loop vs. wavefront stages with per BRDF queues at depths 1 to 8.", benchmarkWavefront },
+		{ "raysort",    "Wavefront path tracer with and without ray reordering between the bounces, per depth cost and gain.", benchmarkRaySort },
+		{ "sbvh",       "Binned SAH vs. spatial split BVH on long diagonal triangles, SAH cost and traversal steps.", benchmarkSbvh },
+		{ "lbvh",       "Build time vs. trace time of the binned SAH, LBVH and treelet restructured LBVH builders on the repository models.", benchmarkLbvh },
+		{ "compressed", "Full precision binary BVH vs. 64 byte nodes with quantized child bounds, memory, throughput and bytes per ray.", benchmarkCompressed },
+		{ "shadow",     "Shadow rays to the quad light, closest hit vs. any hit occlusion query with and without the shadow cache.", benchmarkShadow },
+		{ "bvhcache",   "Host scene build with a cold and a warm on-disk BVH cache, hit and miss counts.", benchmarkBvhCache },
+		{ "simd",       "SIMD shading helpers and transcendentals at 4, 8 and 16 lanes vs. the scalar shader_common.h versions, throughput and accuracy.", benchmarkSimd },
+		{ "numa",       "Host path tracer, shared scene vs. workers pinned per NUMA node with node local scene copies.", benchmarkNuma },
+		{ "accumulation", "Host path tracer over thread counts, tile sizes and samples per pass, resolve cost and bitwise identical images.", benchmarkAccumulation },
+		{ "roulette",   "Wavefront path tracer without and with Russian Roulette, path length, rays/s and time to equal noise against a converged image.", benchmarkRoulette },
+		{ "lighttree",  "Next event estimation on 1000 quad lights, uniform light selection vs. the light tree, variance per sample and efficiency.", benchmarkLightTree },
+		{ "lightpower", "One bright and 255 dim quad lights, uniform vs. power proportional alias table light selection, noise over samples per point.", benchmarkLightPower },
+		{ "sampler",    "LCG vs. Owen scrambled Sobol and Halton and blue noise samplers on the TestScene, RMSE over 1 to 256 samples per pixel and convergence rate.", benchmarkSampler },
+		{ "bluenoise",  "Screen space error of the samplers at 1, 4 and 16 samples per pixel and of single iterations, RMSE, perceptual error and low frequency share.", benchmarkBlueNoise },
+		{ "adaptive",   "Host path tracer with adaptive sampling of converged pixel blocks vs. uniform sampling, samples and time to equal RMSE.", benchmarkAdaptive },
+		{ "environment", "Direct lighting from the bundled HDR environments, BRDF sampling vs. the importance sampled map with MIS, RMSE at equal time.", benchmarkEnvironment },
+		{ "microfacet",  "Chi-square test of the microfacet reflection samples against microfacetReflectionPdf() over roughnesses and incident angles.", benchmarkMicrofacet },
+		{ "spherelight", "Solid angle sampling of sphere lights, chi-square test against the pdf, irradiance and variance vs. area sampling, MIS on the light geometry.", benchmarkSphereLight },
+		{ "quadlight",   "Spherical rectangle vs. area sampling of quad lights, chi-square test against the solid angle, RMSE at equal time on the TestScene.", benchmarkQuadLight },
+		{ "guiding",     "Online path guiding with an SD-tree vs. path tracing in a room lit through a door, D-tree pdf check, RMSE at equal time.", benchmarkGuiding },
+		{ "restir",      "ReSTIR DI vs. DirectLighting() on 256 quad lights, RMSE of single frames at 1 spp, biased and unbiased reuse, mean of the converged image.", benchmarkRestir },
+		{ "bdpt",        "Bidirectional vs. unidirectional path tracing on a small lamp with caustics and a room lit through a door, RMSE at equal time.", benchmarkBidirectional },
+	};
+
+	void printBenchmarks()
+	{
+		for (const BenchmarkEntry& entry : g_benchmarks)
+		{
+			std::cerr << "    " << entry.name << ": " << entry.description << "\n";
+		}
+	}
+
+	int runBenchmark(std::string const& name)
+	{
+		for (const BenchmarkEntry& entry : g_benchmarks)
+		{
+			if (name == entry.name)
+			{
+				return entry.function();
+			}
+		}
+
+		std::cerr << "Unknown benchmark '" << name << "'. Available benchmarks:\n";
+		printBenchmarks();
+		return 1;
+	}
+}
@@ -0,0 +1,1166 @@
+#include "inc/BenchmarkCommon.h"
+#include "inc/Bvh.h"
+#include "inc/BvhCache.h"
+#include "inc/CompressedBvh.h"
+#include "inc/TileScheduler.h"
+#include "inc/TopLevelAccel.h"
+#include "inc/TrianglePacket.h"
+
+#include <sutil.h>
+
+#include <optixu/optixu_matrix_namespace.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace POptix
+{
+	// Random rays through the given bounds, shared by the traversal measurements.
+	static std::vector<BvhRay> createRandomRays(optix::Aabb const& bounds, const int count, const unsigned int seed)
+	{
+		std::mt19937 generator(seed);
+		std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+		const optix::float3 extent = bounds.extent();
+
+		std::vector<BvhRay> rays;
+		rays.reserve(count);
+		for (int i = 0; i < count; ++i)
+		{
+			const optix::float3 origin = bounds.m_min + extent * optix::make_float3(uniform(generator), uniform(generator), uniform(generator));
+			const optix::float3 target = bounds.m_min + extent * optix::make_float3(uniform(generator), uniform(generator), uniform(generator));
+			const optix::float3 direction = target - origin;
+			if (optix::dot(direction, direction) <= 0.0f)
+			{
+				continue;
+			}
+			rays.push_back(BvhRay(origin, optix::normalize(direction), 0.0f, RT_DEFAULT_MAX));
+		}
+		return rays;
+	}
+
+	// Rays through the pixel centers of camera.
+	static std::vector<BvhRay> createCameraRays(BenchmarkCamera const& camera)
+	{
+		std::vector<BvhRay> rays;
+		rays.reserve(size_t(camera.width) * camera.height);
+		for (int y = 0; y < camera.height; ++y)
+		{
+			for (int x = 0; x < camera.width; ++x)
+			{
+				rays.push_back(BvhRay(camera.position, camera.getDirection(x + 0.5f, y + 0.5f), 0.0f, RT_DEFAULT_MAX));
+			}
+		}
+		return rays;
+	}
+
+	// Closest hit against the world bounds of the instances, counting the traversal work.
+	static BvhTraversalStats traceInstanceBounds(TopLevelAccel const& accel, std::vector<BvhRay> const& rays)
+	{
+		std::vector<optix::Aabb> const& bounds = accel.getInstanceBounds();
+
+		auto intersectInstance = [&bounds](unsigned int instance, BvhRay& ray)
+		{
+			float tnear;
+			if (intersectAabb(bounds[instance], ray, tnear))
+			{
+				ray.tmax = tnear;
+			}
+		};
+
+		BvhTraversalStats stats;
+		for (BvhRay ray : rays)
+		{
+			accel.getBvh().intersect(ray, intersectInstance, &stats);
+		}
+		return stats;
+	}
+
+	// Animates 10k instances per frame and compares refitting the top level hierarchy against rebuilding it.
+	int benchmarkRefit()
+	{
+		const int   numInstances = 10000;
+		const int   numFrames    = 120;
+		const int   numRays      = 16384;
+		const float worldSize    = 200.0f;
+		const float amplitude    = 8.0f;
+
+		std::mt19937 generator(1234u);
+		std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+		const optix::Aabb unitBox(optix::make_float3(-0.5f), optix::make_float3(0.5f));
+
+		struct Motion
+		{
+			optix::float3 base;
+			optix::float3 axis;
+			float         frequency;
+			float         scale;
+		};
+		std::vector<Motion> motions(numInstances);
+
+		TopLevelAccel refitAccel;    // Refits forever.
+		TopLevelAccel rebuildAccel;  // Rebuilds every frame.
+		TopLevelAccel adaptiveAccel; // Refits until the SAH degradation threshold triggers a rebuild.
+		refitAccel.setRebuildThreshold(1.0e30f);
+
+		for (int i = 0; i < numInstances; ++i)
+		{
+			Motion& motion = motions[i];
+			motion.base      = optix::make_float3(uniform(generator), uniform(generator), uniform(generator)) * worldSize;
+			motion.axis      = optix::normalize(optix::make_float3(uniform(generator), uniform(generator), uniform(generator)) - 0.5f);
+			motion.frequency = 0.5f + uniform(generator);
+			motion.scale     = 0.5f + 2.0f * uniform(generator);
+
+			const float transform[16] =
+			{
+				motion.scale, 0.0f, 0.0f, motion.base.x,
+				0.0f, motion.scale, 0.0f, motion.base.y,
+				0.0f, 0.0f, motion.scale, motion.base.z,
+				0.0f, 0.0f, 0.0f, 1.0f
+			};
+			refitAccel.addInstance(0, unitBox, transform);
+			rebuildAccel.addInstance(0, unitBox, transform);
+			adaptiveAccel.addInstance(0, unitBox, transform);
+		}
+		refitAccel.build();
+		rebuildAccel.build();
+		adaptiveAccel.build();
+
+		const optix::Aabb world(optix::make_float3(-amplitude), optix::make_float3(worldSize + amplitude));
+		const std::vector<BvhRay> rays = createRandomRays(world, numRays, 4321u);
+
+		const BvhTraversalStats initialStats = traceInstanceBounds(refitAccel, rays);
+
+		std::cout << "refit: " << numInstances << " instances, " << numFrames << " frames, " << rays.size() << " rays per measurement" << std::endl;
+		std::cout << "frame   refit[ms] rebuild[ms] adaptive[ms]  SAH(refit/rebuild)  nodes/ray(refit/rebuild)" << std::endl;
+
+		Timer timer;
+		double refitTime    = 0.0;
+		double rebuildTime  = 0.0;
+		double adaptiveTime = 0.0;
+		int    adaptiveRebuilds = 0;
+
+		for (int frame = 1; frame <= numFrames; ++frame)
+		{
+			const float time = float(frame) / 30.0f;
+
+			for (int i = 0; i < numInstances; ++i)
+			{
+				const Motion& motion = motions[i];
+				// Random walk along a per instance direction plus a slow drift, so the original clustering slowly degrades.
+				const optix::float3 position = motion.base + motion.axis * (amplitude * sinf(motion.frequency * time) + 0.25f * amplitude * time);
+				const float c = cosf(time * motion.frequency) * motion.scale;
+				const float s = sinf(time * motion.frequency) * motion.scale;
+
+				const float transform[16] =
+				{
+					   c, 0.0f,    s, position.x,
+					0.0f, motion.scale, 0.0f, position.y,
+					  -s, 0.0f,    c, position.z,
+					0.0f, 0.0f, 0.0f, 1.0f
+				};
+				refitAccel.setTransform(i, transform);
+				rebuildAccel.setTransform(i, transform);
+				adaptiveAccel.setTransform(i, transform);
+			}
+
+			timer.restart();
+			refitAccel.update();
+			const double timeRefit = timer.getTime();
+
+			timer.restart();
+			rebuildAccel.build();
+			const double timeRebuild = timer.getTime();
+
+			timer.restart();
+			if (adaptiveAccel.update() == TOP_LEVEL_REBUILD)
+			{
+				++adaptiveRebuilds;
+			}
+			const double timeAdaptive = timer.getTime();
+
+			refitTime    += timeRefit;
+			rebuildTime  += timeRebuild;
+			adaptiveTime += timeAdaptive;
+
+			if (frame % 10 == 0)
+			{
+				const BvhTraversalStats refitStats   = traceInstanceBounds(refitAccel, rays);
+				const BvhTraversalStats rebuildStats = traceInstanceBounds(rebuildAccel, rays);
+
+				char line[256];
+				snprintf(line, sizeof(line), "%5d %11.3f %11.3f %12.3f %9.2f / %-9.2f %10.1f / %-10.1f",
+					frame, timeRefit * 1000.0, timeRebuild * 1000.0, timeAdaptive * 1000.0,
+					refitAccel.getBvh().sahCost(), rebuildAccel.getBvh().sahCost(),
+					double(refitStats.nodesVisited) / rays.size(), double(rebuildStats.nodesVisited) / rays.size());
+				std::cout << line << std::endl;
+			}
+		}
+
+		const BvhTraversalStats refitStats   = traceInstanceBounds(refitAccel, rays);
+		const BvhTraversalStats rebuildStats = traceInstanceBounds(rebuildAccel, rays);
+
+		std::cout << "{" << std::endl;
+		std::cout << "  average refit    = " << refitTime * 1000.0 / numFrames << " ms" << std::endl;
+		std::cout << "  average rebuild  = " << rebuildTime * 1000.0 / numFrames << " ms" << std::endl;
+		std::cout << "  average adaptive = " << adaptiveTime * 1000.0 / numFrames << " ms (" << adaptiveRebuilds << " rebuilds, threshold " << adaptiveAccel.getRebuildThreshold() << ")" << std::endl;
+		std::cout << "  traversal cost drift (nodes per ray, refit vs. rebuild) = " << double(refitStats.nodesVisited) / double(rebuildStats.nodesVisited)
+		          << " (initial " << double(initialStats.nodesVisited) / rays.size() << " nodes per ray)" << std::endl;
+		std::cout << "  SAH degradation after " << numFrames << " refits = " << refitAccel.getDegradation() << std::endl;
+		std::cout << "}" << std::endl;
+		return 0;
+	}
+
+	// Host copy of the double precision Cramer's rule test formerly used in intersection_triangle_indexed.cu, kept as the baseline
+	// for the watertight kernel. Only the interval test is fixed ("t < tmin && t > tmax" never rejected anything).
+	static bool intersectTriangleLegacy(const BvhRay& ray, const optix::float3& v0, const optix::float3& v1, const optix::float3& v2, float& t, float& beta, float& gamma)
+	{
+		double a = v0.x - v1.x, b = v0.x - v2.x, c = ray.direction.x, d = v0.x - ray.origin.x;
+		double e = v0.y - v1.y, f = v0.y - v2.y, g = ray.direction.y, h = v0.y - ray.origin.y;
+		double i = v0.z - v1.z, j = v0.z - v2.z, k = ray.direction.z, l = v0.z - ray.origin.z;
+
+		double m = f * k - g * j, n = h * k - g * l, p = f * l - h * j;
+		double q = g * i - e * k, s = e * j - f * i;
+		double inv_denom = 1.0 / (a * m + b * q + c * s);
+		double e1 = d * m - b * n - c * p;
+
+		beta = float(e1 * inv_denom);
+		if (beta < 0.0)
+			return false;
+
+		double r = e * l - h * i;
+		double e2 = a * n + d * q + c * r;
+		gamma = float(e2 * inv_denom);
+		if (gamma < 0.0)
+			return false;
+		if (beta + gamma > 1.0)
+			return false;
+
+		double e3 = a * p - b * r + d * s;
+		t = float(e3 * inv_denom);
+		if (t <= ray.tmin || t > ray.tmax)
+			return false;
+
+		return true;
+	}
+
+	struct TriangleSoup
+	{
+		std::vector<optix::float3> vertices;
+		std::vector<optix::uint3>  indices;
+	};
+
+	static void createPackets(TriangleSoup const& soup, std::vector<TrianglePacket>& packets)
+	{
+		packets.clear();
+		for (size_t i = 0; i < soup.indices.size(); ++i)
+		{
+			if (packets.empty() || packets.back().count == TRIANGLE_PACKET_WIDTH)
+			{
+				packets.push_back(TrianglePacket());
+			}
+			const optix::uint3 tri = soup.indices[i];
+			packets.back().add(soup.vertices[tri.x], soup.vertices[tri.y], soup.vertices[tri.z], static_cast<unsigned int>(i));
+		}
+	}
+
+	// The three kernels below return the closest hit over all triangles (brute force) and the hit primitive, or ~0u.
+	static unsigned int closestHitLegacy(TriangleSoup const& soup, BvhRay ray, float& tHit)
+	{
+		unsigned int closest = ~0u;
+		for (size_t i = 0; i < soup.indices.size(); ++i)
+		{
+			const optix::uint3 tri = soup.indices[i];
+			float t, beta, gamma;
+			if (intersectTriangleLegacy(ray, soup.vertices[tri.x], soup.vertices[tri.y], soup.vertices[tri.z], t, beta, gamma))
+			{
+				ray.tmax = t;
+				closest = static_cast<unsigned int>(i);
+			}
+		}
+		tHit = ray.tmax;
+		return closest;
+	}
+
+	static unsigned int closestHitWatertight(TriangleSoup const& soup, BvhRay const& ray, float& tHit)
+	{
+		const WatertightRay wray = makeWatertightRay(ray.origin, ray.direction);
+
+		float tmax = ray.tmax;
+		unsigned int closest = ~0u;
+		for (size_t i = 0; i < soup.indices.size(); ++i)
+		{
+			const optix::uint3 tri = soup.indices[i];
+			float t, beta, gamma;
+			if (intersectTriangleWatertight(wray, ray.tmin, tmax, soup.vertices[tri.x], soup.vertices[tri.y], soup.vertices[tri.z], t, beta, gamma))
+			{
+				tmax = t;
+				closest = static_cast<unsigned int>(i);
+			}
+		}
+		tHit = tmax;
+		return closest;
+	}
+
+	static unsigned int closestHitPacket(std::vector<TrianglePacket> const& packets, BvhRay const& ray, float& tHit)
+	{
+		const WatertightRay wray = makeWatertightRay(ray.origin, ray.direction);
+
+		float tmax = ray.tmax;
+		TriangleHit hit;
+		hit.primitive = ~0u;
+		for (TrianglePacket const& packet : packets)
+		{
+			intersectTrianglePacket(wray, ray.tmin, tmax, packet, hit);
+		}
+		tHit = tmax;
+		return hit.primitive;
+	}
+
+	// Fires rays exactly at shared vertices and edges of a jittered, rotated height field far from the origin.
+	// Every ray crosses the closed interior of the surface, so each miss is a crack between neighbouring triangles.
+	int benchmarkWatertight()
+	{
+		const int   resolution = 32;     // Quads per side.
+		const int   numRays    = 20000;  // Per target category.
+		const float bump       = 0.05f;  // Small height variation keeps the surface slope below 12 degrees ...
+		const float minCosine  = 0.3f;   // ... so rays which are at least 17 degrees above the sheet always cross it.
+
+		std::mt19937 generator(2718u);
+		std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+		// Random orthonormal frame and a large offset, so all dominant axis permutations and big exponents are exercised.
+		const optix::float3 normal = optix::normalize(optix::make_float3(uniform(generator), uniform(generator), uniform(generator)) - 0.5f);
+		optix::float3 tangent;
+		optix::float3 bitangent;
+		{
+			const optix::float3 up = (fabsf(normal.y) < 0.9f) ? optix::make_float3(0.0f, 1.0f, 0.0f) : optix::make_float3(1.0f, 0.0f, 0.0f);
+			tangent   = optix::normalize(optix::cross(up, normal));
+			bitangent = optix::cross(normal, tangent);
+		}
+		const optix::float3 offset = optix::make_float3(1024.3f, -517.7f, 333.1f);
+
+		TriangleSoup soup;
+		for (int y = 0; y <= resolution; ++y)
+		{
+			for (int x = 0; x <= resolution; ++x)
+			{
+				const float u = float(x) + 0.25f * (uniform(generator) - 0.5f);
+				const float v = float(y) + 0.25f * (uniform(generator) - 0.5f);
+				const float h = bump * (uniform(generator) - 0.5f);
+				soup.vertices.push_back(offset + tangent * u + bitangent * v + normal * h);
+			}
+		}
+		for (int y = 0; y < resolution; ++y)
+		{
+			for (int x = 0; x < resolution; ++x)
+			{
+				const unsigned int i0 = y * (resolution + 1) + x;
+				const unsigned int i1 = i0 + 1;
+				const unsigned int i2 = i0 + resolution + 1;
+				const unsigned int i3 = i2 + 1;
+				// Alternate the diagonal and the winding to get all kinds of edge configurations.
+				if ((x + y) & 1)
+				{
+					soup.indices.push_back(optix::make_uint3(i0, i1, i3));
+					soup.indices.push_back(optix::make_uint3(i3, i2, i0));
+				}
+				else
+				{
+					soup.indices.push_back(optix::make_uint3(i0, i1, i2));
+					soup.indices.push_back(optix::make_uint3(i1, i2, i3));
+				}
+			}
+		}
+
+		std::vector<TrianglePacket> packets;
+		createPackets(soup, packets);
+
+		// Targets inside the cells [2, resolution - 2) only, to stay away from the open border.
+		auto interiorTriangle = [&]() -> optix::uint3
+		{
+			const int x = 2 + int(uniform(generator) * float(resolution - 4)) % (resolution - 4);
+			const int y = 2 + int(uniform(generator) * float(resolution - 4)) % (resolution - 4);
+			return soup.indices[2 * (y * resolution + x) + (uniform(generator) < 0.5f ? 0 : 1)];
+		};
+
+		auto createRay = [&](const optix::float3& target) -> BvhRay
+		{
+			const float cosTheta = minCosine + (1.0f - minCosine) * uniform(generator);
+			const float sinTheta = sqrtf(1.0f - cosTheta * cosTheta);
+			const float phi      = 2.0f * M_PIf * uniform(generator);
+			const optix::float3 w = tangent * (cosf(phi) * sinTheta) + bitangent * (sinf(phi) * sinTheta) + normal * cosTheta;
+			const float distance = 1.0f + 50.0f * uniform(generator);
+
+			const optix::float3 origin = target + w * distance;
+			return BvhRay(origin, optix::normalize(target - origin), 0.0f, RT_DEFAULT_MAX);
+		};
+
+		const char* categories[3] = { "vertices", "edges", "faces" };
+		std::vector<BvhRay> rays[3];
+		for (int i = 0; i < numRays; ++i)
+		{
+			const optix::uint3 tri = interiorTriangle();
+			const optix::float3 a = soup.vertices[tri.x];
+			const optix::float3 b = soup.vertices[tri.y];
+			const optix::float3 c = soup.vertices[tri.z];
+
+			const int corner = int(uniform(generator) * 3.0f) % 3;
+			rays[0].push_back(createRay((corner == 0) ? a : (corner == 1) ? b : c));
+
+			const float s = uniform(generator);
+			rays[1].push_back(createRay((corner == 0) ? optix::lerp(a, b, s) : (corner == 1) ? optix::lerp(b, c, s) : optix::lerp(c, a, s)));
+
+			float r1 = uniform(generator);
+			float r2 = uniform(generator);
+			if (1.0f < r1 + r2)
+			{
+				r1 = 1.0f - r1;
+				r2 = 1.0f - r2;
+			}
+			rays[2].push_back(createRay(a + (b - a) * r1 + (c - a) * r2));
+		}
+
+		std::cout << "watertight: " << soup.indices.size() << " triangles, " << numRays << " rays per category, packet width " << TRIANGLE_PACKET_WIDTH << std::endl;
+		std::cout << "category    legacy(double)  watertight  packet  packet!=scalar" << std::endl;
+
+		int failures = 0;
+		for (int category = 0; category < 3; ++category)
+		{
+			int missesLegacy     = 0;
+			int missesWatertight = 0;
+			int missesPacket     = 0;
+			int mismatches       = 0;
+
+			for (BvhRay const& ray : rays[category])
+			{
+				float tLegacy;
+				float tWatertight;
+				float tPacket;
+				const unsigned int hitLegacy     = closestHitLegacy(soup, ray, tLegacy);
+				const unsigned int hitWatertight = closestHitWatertight(soup, ray, tWatertight);
+				const unsigned int hitPacket     = closestHitPacket(packets, ray, tPacket);
+
+				missesLegacy     += (hitLegacy     == ~0u) ? 1 : 0;
+				missesWatertight += (hitWatertight == ~0u) ? 1 : 0;
+				missesPacket     += (hitPacket     == ~0u) ? 1 : 0;
+				mismatches       += (hitWatertight != hitPacket || memcmp(&tWatertight, &tPacket, sizeof(float)) != 0) ? 1 : 0;
+			}
+
+			char line[256];
+			snprintf(line, sizeof(line), "%-10s %15d %11d %7d %15d", categories[category], missesLegacy, missesWatertight, missesPacket, mismatches);
+			std::cout << line << std::endl;
+
+			// The packet kernel rounds exactly like the scalar one, any difference in the hit or its distance is an error.
+			failures += missesWatertight + missesPacket + mismatches;
+		}
+
+		std::cout << ((failures == 0) ? "PASSED: no cracks in the watertight kernels, packet and scalar hits identical." : "FAILED: the watertight kernels missed rays or disagree.") << std::endl;
+		return (failures == 0) ? 0 : 1;
+	}
+
+	// Closest hit throughput of the legacy double precision kernel, the scalar watertight kernel and the packet kernel.
+	int benchmarkTriangles()
+	{
+		const int numTriangles = 1024; // Stays inside the L1/L2 caches, this measures the arithmetic only.
+		const int numRays      = 4096;
+		const int numPasses    = 4;
+
+		std::mt19937 generator(31415u);
+		std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+		TriangleSoup soup;
+		for (int i = 0; i < numTriangles; ++i)
+		{
+			const optix::float3 center = optix::make_float3(uniform(generator), uniform(generator), uniform(generator));
+			for (int j = 0; j < 3; ++j)
+			{
+				soup.vertices.push_back(center + (optix::make_float3(uniform(generator), uniform(generator), uniform(generator)) - 0.5f) * 0.1f);
+			}
+			soup.indices.push_back(optix::make_uint3(3 * i, 3 * i + 1, 3 * i + 2));
+		}
+
+		std::vector<TrianglePacket> packets;
+		createPackets(soup, packets);
+
+		const optix::Aabb bounds(optix::make_float3(-0.1f), optix::make_float3(1.1f));
+		const std::vector<BvhRay> rays = createRandomRays(bounds, numRays, 2718u);
+
+		const double numTests = double(rays.size()) * double(numTriangles) * double(numPasses);
+
+		std::vector<unsigned int> hitsLegacy(rays.size());
+		std::vector<unsigned int> hitsWatertight(rays.size());
+		std::vector<unsigned int> hitsPacket(rays.size());
+
+		Timer timer;
+		double checksum = 0.0;
+
+		timer.restart();
+		for (int pass = 0; pass < numPasses; ++pass)
+		{
+			for (size_t i = 0; i < rays.size(); ++i)
+			{
+				float t;
+				hitsLegacy[i] = closestHitLegacy(soup, rays[i], t);
+				checksum += t;
+			}
+		}
+		const double timeLegacy = timer.getTime();
+
+		timer.restart();
+		for (int pass = 0; pass < numPasses; ++pass)
+		{
+			for (size_t i = 0; i < rays.size(); ++i)
+			{
+				float t;
+				hitsWatertight[i] = closestHitWatertight(soup, rays[i], t);
+				checksum += t;
+			}
+		}
+		const double timeWatertight = timer.getTime();
+
+		timer.restart();
+		for (int pass = 0; pass < numPasses; ++pass)
+		{
+			for (size_t i = 0; i < rays.size(); ++i)
+			{
+				float t;
+				hitsPacket[i] = closestHitPacket(packets, rays[i], t);
+				checksum += t;
+			}
+		}
+		const double timePacket = timer.getTime();
+
+		int differentLegacy = 0;
+		int differentPacket = 0;
+		for (size_t i = 0; i < rays.size(); ++i)
+		{
+			differentLegacy += (hitsLegacy[i] != hitsWatertight[i]) ? 1 : 0;
+			differentPacket += (hitsPacket[i] != hitsWatertight[i]) ? 1 : 0;
+		}
+
+		std::cout << "triangles: " << numTriangles << " triangles, " << rays.size() << " rays, " << numPasses << " passes, packet width " << TRIANGLE_PACKET_WIDTH << std::endl;
+		std::cout << "{" << std::endl;
+		std::cout << "  legacy double     = " << numTests / timeLegacy * 1.0e-6     << " Mtests/s" << std::endl;
+		std::cout << "  watertight scalar = " << numTests / timeWatertight * 1.0e-6 << " Mtests/s (" << timeLegacy / timeWatertight << "x)" << std::endl;
+		std::cout << "  watertight packet = " << numTests / timePacket * 1.0e-6     << " Mtests/s (" << timeLegacy / timePacket << "x)" << std::endl;
+		std::cout << "  closest hit differs from watertight scalar: legacy " << differentLegacy << ", packet " << differentPacket << " of " << rays.size() << " rays" << std::endl;
+		std::cout << "  checksum = " << checksum << std::endl;
+		std::cout << "}" << std::endl;
+		return (differentPacket == 0) ? 0 : 1;
+	}
+
+	// Adds long thin slats rotated around two axes, the worst case for object splits: their bounds are huge and overlap everywhere.
+	// Returns the mesh ID of the slats.
+	static unsigned int addDiagonalGeometry(Scene& scene, const int count)
+	{
+		const unsigned int meshID = unsigned(scene.mMeshList.size()) + 2000;
+		scene.mMeshList.insert(std::make_pair(meshID, Scene::createParallelogram(optix::make_float3(-8.0f, 0.0f, -0.04f),
+			optix::make_float3(16.0f, 0.0f, 0.0f), optix::make_float3(0.0f, 0.0f, 0.08f), optix::make_float3(0.0f, 1.0f, 0.0f))));
+
+		std::mt19937 generator(31);
+		std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+		for (int i = 0; i < count; ++i)
+		{
+			const float yaw   = 2.0f * M_PIf * uniform(generator);
+			const float pitch = 0.5f * (uniform(generator) - 0.5f);
+			const optix::Matrix4x4 matrix = optix::Matrix4x4::translate(optix::make_float3(4.0f * (uniform(generator) - 0.5f), 0.5f + 3.0f * uniform(generator), 4.0f * (uniform(generator) - 0.5f))) *
+			                                optix::Matrix4x4::rotate(yaw, optix::make_float3(0.0f, 1.0f, 0.0f)) *
+			                                optix::Matrix4x4::rotate(pitch, optix::make_float3(0.0f, 0.0f, 1.0f));
+
+			Node* node = new Node();
+			node->name = "Diagonal Slat";
+			node->materialID = i % int(scene.mMaterialList.size());
+			node->mMeshIDList.push_back(meshID);
+			memcpy(node->transform, matrix.getData(), 16 * sizeof(float));
+			scene.mNodeList.push_back(node);
+		}
+		return meshID;
+	}
+
+	// Binned SAH vs. spatial splits on a scene with long diagonal triangles.
+	// The SBVH is built once for all triangles and once only for the slat mesh, selected with the per mesh builder entry.
+	int benchmarkSbvh()
+	{
+		const int numRays = 1 << 18;
+		const int width   = 640;
+		const int height  = 360;
+
+		Scene scene;
+		createBenchmarkScene(scene);
+		Mesh* slats = scene.mMeshList[addDiagonalGeometry(scene, 256)];
+
+		struct Configuration
+		{
+			const char* name;
+			EBvhBuilder builder;
+			const char* slatBuilder;
+		};
+		const Configuration configurations[] =
+		{
+			{ "binned sah",  BVH_BUILDER_BINNED_SAH, "" },
+			{ "sbvh slats",  BVH_BUILDER_BINNED_SAH, "Sbvh" },
+			{ "sbvh all",    BVH_BUILDER_SBVH,       "" }
+		};
+		const int numConfigurations = int(sizeof(configurations) / sizeof(configurations[0]));
+
+		// Camera rays of the default view and random rays through the scene.
+		std::vector<BvhRay> rays = createCameraRays(getBenchmarkCamera(width, height));
+		const size_t numCameraRays = rays.size();
+
+		std::vector<float> referenceHits;
+		int failures = 0;
+		double baseline[2] = { 0.0, 0.0 };
+
+		std::cout << "sbvh: " << numCameraRays << " camera rays, " << numRays << " random rays" << std::endl;
+		std::cout << "{" << std::endl;
+		std::cout << "  builder      triangles  references  nodes  build ms  sah cost  camera nodes/ray  camera tris/ray  random nodes/ray  random tris/ray  trace ms" << std::endl;
+
+		for (int c = 0; c < numConfigurations; ++c)
+		{
+			slats->builder = configurations[c].slatBuilder;
+
+			BvhBuildOptions options;
+			options.builder = configurations[c].builder;
+
+			Timer timer;
+			timer.start();
+			HostScene hostScene;
+			hostScene.build(scene, options);
+			const double buildTime = timer.getTime();
+
+			if (c == 0)
+			{
+				const std::vector<BvhRay> randomRays = createRandomRays(hostScene.getBounds(), numRays, 31);
+				rays.insert(rays.end(), randomRays.begin(), randomRays.end());
+			}
+
+			BvhTraversalStats stats[2];
+			std::vector<float> hits(rays.size());
+
+			timer.restart();
+			for (size_t i = 0; i < rays.size(); ++i)
+			{
+				TriangleHit hit;
+				const bool found = hostScene.intersect(rays[i].origin, rays[i].direction, rays[i].tmin, rays[i].tmax, hit, &stats[(i < numCameraRays) ? 0 : 1]);
+				hits[i] = found ? hit.t : -1.0f;
+			}
+			const double traceTime = timer.getTime();
+
+			if (c == 0)
+			{
+				referenceHits = hits;
+			}
+			else if (hits != referenceHits)
+			{
+				++failures;
+			}
+
+			const double counts[2] = { double(numCameraRays), double(rays.size() - numCameraRays) };
+
+			Bvh const& bvh = hostScene.getBvh();
+			char line[256];
+			snprintf(line, sizeof(line), "  %-11s  %9u  %10zu  %5zu  %8.2f  %8.2f  %16.2f  %15.2f  %16.2f  %15.2f  %8.2f", configurations[c].name,
+			         hostScene.getNumTriangles(), bvh.getPrimitiveIndices().size(), bvh.getNodes().size(), buildTime * 1000.0, bvh.sahCost(),
+			         stats[0].nodesVisited / counts[0], stats[0].primitivesTested / counts[0],
+			         stats[1].nodesVisited / counts[1], stats[1].primitivesTested / counts[1], traceTime * 1000.0);
+			std::cout << line << std::endl;
+
+			const double steps[2] = { double(stats[0].nodesVisited + stats[0].primitivesTested), double(stats[1].nodesVisited + stats[1].primitivesTested) };
+			if (c == 0)
+			{
+				baseline[0] = steps[0];
+				baseline[1] = steps[1];
+			}
+			else
+			{
+				std::cout << "               traversal steps " << 100.0 * (1.0 - steps[0] / baseline[0]) << "% fewer for camera rays, "
+				          << 100.0 * (1.0 - steps[1] / baseline[1]) << "% fewer for random rays" << std::endl;
+			}
+		}
+		std::cout << "  closest hits " << ((failures == 0) ? "identical" : "DIFFERENT") << std::endl;
+		std::cout << "}" << std::endl;
+
+		return (failures == 0) ? 0 : 1;
+	}
+
+	// Repository models for the builder comparison, relative to the samples directory.
+	static const char* g_assetModels[] =
+	{
+		"resources/Models/OBJFiles/ShaderBall/TestShaderballShellStand.obj",
+		"resources/Models/OBJFiles/ShaderBall/BallMainCentMatL1.obj",
+		"resources/Models/OBJFiles/ShaderBall/ShaderballShellGrp.obj",
+		"resources/Models/OBJFiles/ShaderBall/ShaderballPedestalGrp.obj",
+		"data/wedding-band.obj"
+	};
+
+	// Rebuild time vs. trace time of the binned SAH, LBVH and LBVH with treelet restructuring builders.
+	// The break-even column is the number of rays after which the slower build of the binned SAH BVH has paid for itself.
+	int benchmarkLbvh()
+	{
+		const int numRays = 1 << 18;
+
+		struct Configuration
+		{
+			const char* name;
+			EBvhBuilder builder;
+			int         treeletPasses;
+		};
+		const Configuration configurations[] =
+		{
+			{ "binned sah",     BVH_BUILDER_BINNED_SAH, 0 },
+			{ "lbvh",           BVH_BUILDER_LBVH,       0 },
+			{ "lbvh treelet1",  BVH_BUILDER_LBVH,       1 },
+			{ "lbvh treelet3",  BVH_BUILDER_LBVH,       3 }
+		};
+		const int numConfigurations = int(sizeof(configurations) / sizeof(configurations[0]));
+
+		TileScheduler scheduler;
+
+		const int numAssets = int(sizeof(g_assetModels) / sizeof(g_assetModels[0]));
+		int failures = 0;
+
+		for (int asset = -1; asset < numAssets; ++asset)
+		{
+			Scene scene;
+			std::string name = "benchmark scene";
+			if (asset < 0)
+			{
+				createBenchmarkScene(scene);
+			}
+			else
+			{
+				const std::string path = std::string(sutil::samplesDir()) + "/" + g_assetModels[asset];
+				FILE* file = fopen(path.c_str(), "r");
+				if (file == nullptr)
+				{
+					std::cout << "lbvh: " << path << " not found, skipped" << std::endl;
+					continue;
+				}
+				fclose(file);
+
+				name = path.substr(path.find_last_of("/\\") + 1);
+				scene.mMeshList.insert(std::make_pair(0u, Scene::LoadOBJ(path)));
+
+				const float identity[16] = { 1.0f, 0.0f, 0.0f, 0.0f,  0.0f, 1.0f, 0.0f, 0.0f,  0.0f, 0.0f, 1.0f, 0.0f,  0.0f, 0.0f, 0.0f, 1.0f };
+				Node* node = new Node();
+				node->name = name;
+				node->materialID = 0;
+				node->mMeshIDList.push_back(0);
+				memcpy(node->transform, identity, sizeof(identity));
+				scene.mNodeList.push_back(node);
+			}
+
+			HostScene hostScene;
+			hostScene.build(scene);
+			const std::vector<BvhRay> rays = createRandomRays(hostScene.getBounds(), numRays, 32);
+
+			std::cout << "lbvh: " << name << ", " << hostScene.getNumTriangles() << " triangles, " << rays.size() << " random rays, " << scheduler.getNumThreads() << " threads" << std::endl;
+			std::cout << "{" << std::endl;
+			std::cout << "  builder        serial ms  parallel ms  sah cost  nodes/ray  tris/ray  Mrays/s  break-even rays" << std::endl;
+
+			double baseBuild = 0.0;
+			double baseTrace = 0.0;
+			std::vector<float> referenceHits;
+
+			for (int c = 0; c < numConfigurations; ++c)
+			{
+				BvhBuildOptions options;
+				options.builder       = configurations[c].builder;
+				options.treeletPasses = configurations[c].treeletPasses;
+
+				const std::vector<optix::float3> vertices(hostScene.getVertices().begin(), hostScene.getVertices().end());
+
+				Bvh bvh;
+				Timer timer;
+				timer.start();
+				bvh.build(vertices, options);
+				const double serialTime = timer.getTime();
+
+				options.scheduler = &scheduler;
+				timer.restart();
+				bvh.build(vertices, options);
+				const double parallelTime = timer.getTime();
+
+				options.scheduler = nullptr;
+				HostScene tracedScene;
+				tracedScene.build(scene, options);
+
+				BvhTraversalStats stats;
+				std::vector<float> hits(rays.size());
+				timer.restart();
+				for (size_t i = 0; i < rays.size(); ++i)
+				{
+					TriangleHit hit;
+					hits[i] = tracedScene.intersect(rays[i].origin, rays[i].direction, rays[i].tmin, rays[i].tmax, hit, &stats) ? hit.t : -1.0f;
+				}
+				const double traceTime = timer.getTime();
+
+				if (c == 0)
+				{
+					referenceHits = hits;
+					baseBuild = parallelTime;
+					baseTrace = traceTime;
+				}
+				else
+				{
+					// Nearly coplanar triangles can swap places in the last bits of t depending on the test order.
+					for (size_t i = 0; i < hits.size(); ++i)
+					{
+						if ((hits[i] < 0.0f) != (referenceHits[i] < 0.0f) || 1.0e-5f * std::max(1.0f, hits[i]) < fabsf(hits[i] - referenceHits[i]))
+						{
+							++failures;
+						}
+					}
+				}
+
+				// Rays after which (build + trace) of the binned SAH BVH is cheaper.
+				char breakEven[64] = "-";
+				if (0 < c && parallelTime < baseBuild && baseTrace < traceTime)
+				{
+					snprintf(breakEven, sizeof(breakEven), "%.0f", (baseBuild - parallelTime) / ((traceTime - baseTrace) / rays.size()));
+				}
+
+				char line[256];
+				snprintf(line, sizeof(line), "  %-13s  %9.2f  %11.2f  %8.2f  %9.2f  %8.2f  %7.2f  %15s", configurations[c].name,
+				         serialTime * 1000.0, parallelTime * 1000.0, bvh.sahCost(),
+				         double(stats.nodesVisited) / rays.size(), double(stats.primitivesTested) / rays.size(), rays.size() / traceTime * 1.0e-6, breakEven);
+				std::cout << line << std::endl;
+			}
+			std::cout << "}" << std::endl;
+		}
+
+		if (failures != 0)
+		{
+			std::cout << "lbvh: " << failures << " closest hits DIFFERENT from the binned SAH BVH" << std::endl;
+		}
+		return (failures == 0) ? 0 : 1;
+	}
+
+	// Full precision binary BVH vs. the 64 byte four wide nodes with 8 bit child bounds.
+	// Bytes per ray is the node and triangle data a ray touches, the traffic the caches have to serve.
+	int benchmarkCompressed()
+	{
+		const int numRays = 1 << 18;
+		const int width   = 640;
+		const int height  = 360;
+
+		int failures = 0;
+
+		for (int dense = 0; dense < 2; ++dense)
+		{
+			Scene scene;
+			createBenchmarkScene(scene);
+			if (dense)
+			{
+				addDenseGeometry(scene, 8, 160);
+			}
+
+			HostScene hostScene;
+			hostScene.build(scene);
+
+			Timer timer;
+			timer.start();
+			CompressedBvh compressed;
+			compressed.build(hostScene.getBvh(), hostScene.getVertices());
+			const double buildTime = timer.getTime();
+
+			// Camera rays of the default view followed by random rays through the scene.
+			std::vector<BvhRay> rays = createCameraRays(getBenchmarkCamera(width, height));
+			const size_t numCameraRays = rays.size();
+			const std::vector<BvhRay> randomRays = createRandomRays(hostScene.getBounds(), numRays, 33);
+			rays.insert(rays.end(), randomRays.begin(), randomRays.end());
+
+			Bvh const& bvh = hostScene.getBvh();
+			const size_t fullNodeBytes       = bvh.getNodes().size() * sizeof(BvhNode);
+			const size_t fullBytes           = fullNodeBytes + bvh.getPrimitiveIndices().size() * sizeof(unsigned int) + hostScene.getVertices().size() * sizeof(optix::float3);
+			const size_t compressedNodeBytes = compressed.getNodes().size() * sizeof(CompressedBvhNode);
+			const size_t compressedBytes     = compressed.getMemorySize();
+
+			std::cout << "compressed: " << hostScene.getNumTriangles() << " triangles, " << numCameraRays << " camera rays, " << randomRays.size() << " random rays" << std::endl;
+			std::cout << "{" << std::endl;
+			std::cout << "  full:       " << bvh.getNodes().size() << " nodes, " << fullNodeBytes / (1024.0 * 1024.0) << " MB nodes, " << fullBytes / (1024.0 * 1024.0) << " MB with triangles" << std::endl;
+			std::cout << "  compressed: " << compressed.getNodes().size() << " nodes, " << compressedNodeBytes / (1024.0 * 1024.0) << " MB nodes, " << compressedBytes / (1024.0 * 1024.0) << " MB with triangles, built in " << buildTime * 1000.0 << " ms" << std::endl;
+			std::cout << "  memory:     nodes " << 100.0 * (1.0 - double(compressedNodeBytes) / fullNodeBytes) << "% smaller, total " << 100.0 * (1.0 - double(compressedBytes) / fullBytes) << "% smaller" << std::endl;
+			std::cout << "  rays    layout      Mrays/s  nodes/ray  tris/ray  bytes/ray" << std::endl;
+
+			for (int random = 0; random < 2; ++random)
+			{
+				const size_t begin = random ? numCameraRays : 0;
+				const size_t end   = random ? rays.size() : numCameraRays;
+				const double count = double(end - begin);
+
+				std::vector<float> hits[2];
+				for (int layout = 0; layout < 2; ++layout)
+				{
+					BvhTraversalStats stats;
+					hits[layout].resize(end - begin);
+
+					timer.restart();
+					for (size_t i = begin; i < end; ++i)
+					{
+						TriangleHit hit;
+						const bool found = layout ? compressed.intersect(rays[i].origin, rays[i].direction, rays[i].tmin, rays[i].tmax, hit, &stats)
+						                          : hostScene.intersect(rays[i].origin, rays[i].direction, rays[i].tmin, rays[i].tmax, hit, &stats);
+						hits[layout][i - begin] = found ? hit.t : -1.0f;
+					}
+					const double traceTime = timer.getTime();
+
+					const double bytes = layout ? stats.nodesVisited * double(sizeof(CompressedBvhNode)) + stats.primitivesTested * double(sizeof(CompressedBvhTriangle))
+					                            : stats.nodesVisited * double(sizeof(BvhNode)) + stats.primitivesTested * double(sizeof(unsigned int) + 3 * sizeof(optix::float3));
+
+					char line[256];
+					snprintf(line, sizeof(line), "  %-6s  %-10s  %7.2f  %9.2f  %8.2f  %9.0f", random ? "random" : "camera", layout ? "compressed" : "full",
+					         count / traceTime * 1.0e-6, stats.nodesVisited / count, stats.primitivesTested / count, bytes / count);
+					std::cout << line << std::endl;
+				}
+
+				// The traversal order differs, nearly coplanar triangles can swap places in the last bits of t.
+				for (size_t i = 0; i < hits[0].size(); ++i)
+				{
+					if ((hits[0][i] < 0.0f) != (hits[1][i] < 0.0f) || 1.0e-5f * std::max(1.0f, hits[0][i]) < fabsf(hits[0][i] - hits[1][i]))
+					{
+						++failures;
+					}
+				}
+			}
+			std::cout << "}" << std::endl;
+		}
+
+		std::cout << "compressed: closest hits " << ((failures == 0) ? "identical" : "DIFFERENT") << std::endl;
+		return (failures == 0) ? 0 : 1;
+	}
+
+	// Shadow rays from the primary hits of the default view to random points on the TestScene quad light.
+	// Closest hit query vs. the any hit occluded() traversal with and without the shadow cache, in pixel order and shuffled.
+	int benchmarkShadow()
+	{
+		const int   width          = 640;
+		const int   height         = 360;
+		const int   samplesPerHit  = 4;
+		const float sceneEpsilon   = 500.0f * 1.0e-7f;
+
+		Scene scene;
+		createBenchmarkScene(scene);
+
+		HostScene hostScene;
+		hostScene.build(scene);
+
+		const BenchmarkCamera camera = getBenchmarkCamera(width, height);
+
+		Light const& light = hostScene.getLights()[0]; // The quad light of createBenchmarkScene().
+
+		std::mt19937 generator(34);
+		std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+		std::vector<BvhRay> rays;
+		for (int y = 0; y < height; ++y)
+		{
+			for (int x = 0; x < width; ++x)
+			{
+				const optix::float3 direction = camera.getDirection(x + 0.5f, y + 0.5f);
+
+				TriangleHit hit;
+				if (!hostScene.intersect(camera.position, direction, sceneEpsilon, RT_DEFAULT_MAX, hit) || 0 <= hostScene.getLightIndex(hit.primitive))
+				{
+					continue;
+				}
+
+				const optix::float3 origin = camera.position + direction * hit.t;
+				for (int s = 0; s < samplesPerHit; ++s)
+				{
+					const optix::float3 target = light.position + light.u * uniform(generator) + light.v * uniform(generator);
+					const float distance = optix::length(target - origin);
+					rays.push_back(BvhRay(origin, (target - origin) / distance, sceneEpsilon, distance - sceneEpsilon));
+				}
+			}
+		}
+
+		std::vector<BvhRay> shuffled = rays;
+		std::shuffle(shuffled.begin(), shuffled.end(), generator);
+
+		std::vector<unsigned char> reference;
+		int failures = 0;
+
+		std::cout << "shadow: " << hostScene.getNumTriangles() << " triangles, " << rays.size() << " shadow rays to the quad light" << std::endl;
+		std::cout << "{" << std::endl;
+		std::cout << "  order     query                Mrays/s  nodes/ray  tris/ray  cache hits  occluded" << std::endl;
+
+		for (int order = 0; order < 2; ++order)
+		{
+			std::vector<BvhRay> const& orderedRays = order ? shuffled : rays;
+
+			for (int query = 0; query < 3; ++query)
+			{
+				static const char* names[3] = { "closest hit", "occluded", "occluded + cache" };
+
+				BvhTraversalStats stats;
+				ShadowCache cache;
+				std::vector<unsigned char> blocked(orderedRays.size());
+
+				Timer timer;
+				timer.start();
+				for (size_t i = 0; i < orderedRays.size(); ++i)
+				{
+					BvhRay const& ray = orderedRays[i];
+					if (query == 0)
+					{
+						TriangleHit hit;
+						blocked[i] = hostScene.intersect(ray.origin, ray.direction, ray.tmin, ray.tmax, hit, &stats) ? 1 : 0;
+					}
+					else
+					{
+						blocked[i] = hostScene.occluded(ray.origin, ray.direction, ray.tmin, ray.tmax, (query == 2) ? &cache : nullptr, &stats) ? 1 : 0;
+					}
+				}
+				const double time = timer.getTime();
+
+				if (query == 0)
+				{
+					reference = blocked;
+				}
+				else if (blocked != reference)
+				{
+					++failures;
+				}
+
+				size_t numBlocked = 0;
+				for (unsigned char b : blocked)
+				{
+					numBlocked += b;
+				}
+
+				const double count = double(orderedRays.size());
+				char hitRate[32] = "-";
+				if (query == 2)
+				{
+					snprintf(hitRate, sizeof(hitRate), "%.1f%%", (0 < cache.lookups) ? 100.0 * cache.hits / cache.lookups : 0.0);
+				}
+
+				char line[256];
+				snprintf(line, sizeof(line), "  %-8s  %-17s  %7.2f  %9.2f  %8.2f  %10s  %7.1f%%", order ? "shuffled" : "pixel", names[query],
+				         count / time * 1.0e-6, stats.nodesVisited / count, stats.primitivesTested / count, hitRate, 100.0 * numBlocked / count);
+				std::cout << line << std::endl;
+			}
+		}
+		std::cout << "  occlusion " << ((failures == 0) ? "identical" : "DIFFERENT") << " to the closest hit query" << std::endl;
+		std::cout << "}" << std::endl;
+
+		return (failures == 0) ? 0 : 1;
+	}
+
+	// Host scene build without, with a cold and with a warm BVH cache on the dense scene.
+	// The cold run pays for the scene hash and the file write on top of the build. The warm run only hashes the scene and
+	// maps the file, it neither flattens the meshes nor builds the BVH. Its rays then read the mapped arrays.
+	int benchmarkBvhCache()
+	{
+		Scene scene;
+		createBenchmarkScene(scene);
+		addDenseGeometry(scene, 8, 160);
+
+		BvhCache cache("bvhcache");
+
+		int failures = 0;
+
+		std::cout << "bvhcache: cache directory " << cache.getDirectory() << std::endl;
+		std::cout << "{" << std::endl;
+
+		for (int builder = 0; builder < 2; ++builder)
+		{
+			BvhBuildOptions options;
+			options.builder = builder ? BVH_BUILDER_LBVH : BVH_BUILDER_BINNED_SAH;
+
+			Timer timer;
+
+			timer.start();
+			HostScene uncached;
+			uncached.build(scene, options);
+			const double uncachedTime = timer.getTime();
+
+			timer.restart();
+			const unsigned long long key = BvhCache::computeKey(scene, options);
+			const double hashTime = timer.getTime();
+
+			// Make sure the first cached build is a miss.
+			cache.remove(key);
+
+			const int misses = cache.getMisses();
+			timer.restart();
+			HostScene cold;
+			cold.build(scene, options, &cache);
+			const double coldTime = timer.getTime();
+			if (cache.getMisses() != misses + 1)
+			{
+				++failures;
+			}
+
+			const int hits = cache.getHits();
+			timer.restart();
+			HostScene warm;
+			warm.build(scene, options, &cache);
+			const double warmTime = timer.getTime();
+			if (cache.getHits() != hits + 1)
+			{
+				++failures;
+			}
+
+			SharedArray<BvhNode> const&      coldNodes   = cold.getBvh().getNodes();
+			SharedArray<BvhNode> const&      warmNodes   = warm.getBvh().getNodes();
+			SharedArray<unsigned int> const& coldIndices = cold.getBvh().getPrimitiveIndices();
+			SharedArray<unsigned int> const& warmIndices = warm.getBvh().getPrimitiveIndices();
+			bool identical = coldNodes.size() == warmNodes.size() &&
+			                 memcmp(coldNodes.data(), warmNodes.data(), coldNodes.size() * sizeof(BvhNode)) == 0 &&
+			                 coldIndices.size() == warmIndices.size() &&
+			                 std::equal(coldIndices.begin(), coldIndices.end(), warmIndices.begin()) &&
+			                 cold.getVertices().size() == warm.getVertices().size() &&
+			                 memcmp(cold.getVertices().data(), warm.getVertices().data(), cold.getVertices().size() * sizeof(optix::float3)) == 0;
+
+			// The same closest hits through the mapped arrays, rays from the center of the scene in random directions.
+			std::mt19937 generator(35);
+			std::normal_distribution<float> normal(0.0f, 1.0f);
+			const optix::float3 origin = cold.getBounds().center();
+			for (int i = 0; i < 4096 && identical; ++i)
+			{
+				const optix::float3 direction = optix::normalize(optix::make_float3(normal(generator), normal(generator), normal(generator)));
+				TriangleHit coldHit;
+				TriangleHit warmHit;
+				const bool coldFound = cold.intersect(origin, direction, 0.0f, RT_DEFAULT_MAX, coldHit);
+				const bool warmFound = warm.intersect(origin, direction, 0.0f, RT_DEFAULT_MAX, warmHit);
+				identical = (coldFound == warmFound) && (!coldFound || (coldHit.primitive == warmHit.primitive && coldHit.t == warmHit.t));
+			}
+			if (!identical || !warm.getVertices().isReferenced() || !warmNodes.isReferenced())
+			{
+				++failures;
+			}
+
+			// Any build setting of the key must miss.
+			BvhBuildOptions changed = options;
+			changed.maxLeafSize += 1;
+			if (BvhCache::computeKey(scene, changed) == key)
+			{
+				++failures;
+			}
+
+			const size_t bytes = coldNodes.size() * sizeof(BvhNode) + coldIndices.size() * sizeof(unsigned int) +
+			                     cold.getVertices().size() * 2 * sizeof(optix::float3) + cold.getNumTriangles() * 2 * sizeof(int);
+
+			char line[256];
+			snprintf(line, sizeof(line), "  %-10s  %u triangles, %.1f MB: uncached %.3f s, hash %.3f s, cold %.3f s, warm %.3f s (%.1fx), %s",
+			         builder ? "LBVH" : "binned SAH", uncached.getNumTriangles(), bytes / (1024.0 * 1024.0),
+			         uncachedTime, hashTime, coldTime, warmTime, uncachedTime / warmTime, identical ? "identical" : "DIFFERENT");
+			std::cout << line << std::endl;
+		}
+
+		std::cout << "  " << cache.getHits() << " hits, " << cache.getMisses() << " misses" << std::endl;
+		std::cout << "}" << std::endl;
+
+		return (failures == 0) ? 0 : 1;
+	}
+}
@@ -0,0 +1,446 @@
+#include "inc/BenchmarkCommon.h"
+#include "inc/HostRenderer.h"
+#include "inc/PinholeCamera.h"
+#include "shaders/environment_sample.h"
+
+#include <sutil.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+
+namespace POptix
+{
+	void createBenchmarkScene(Scene& scene)
+	{
+		scene.build();
+		scene.mMaterialList[0]->roughness = 0.4f;
+
+		Light* quadLight = new Light();
+		quadLight->lightType = QUAD;
+		quadLight->position  = optix::make_float3(0.0f, 4.0f, 0.0f);
+		quadLight->u         = optix::make_float3(1.0f, 4.0f, 0.0f) - quadLight->position;
+		quadLight->v         = optix::make_float3(0.0f, 4.0f, 1.0f) - quadLight->position;
+		quadLight->area      = optix::length(optix::cross(quadLight->u, quadLight->v));
+		quadLight->normal    = optix::normalize(optix::cross(quadLight->u, quadLight->v));
+		quadLight->emission  = optix::make_float3(50.0f);
+		scene.mLightList.push_back(quadLight);
+	}
+
+	void createSunScene(Scene& scene)
+	{
+		createBenchmarkScene(scene);
+
+		scene.mLightList[0]->normal = optix::normalize(optix::make_float3(-1.0f, -1.0f, 1.0f));
+		delete scene.mLightList.back();
+		scene.mLightList.pop_back();
+	}
+
+	void addDenseGeometry(Scene& scene, const int gridSize, const int tessellation)
+	{
+		const unsigned int meshID = unsigned(scene.mMeshList.size()) + 1000;
+		scene.mMeshList.insert(std::make_pair(meshID, Scene::createSphere(tessellation, tessellation, 0.8f, M_PIf)));
+
+		for (int z = 0; z < gridSize; ++z)
+		{
+			for (int x = 0; x < gridSize; ++x)
+			{
+				const float spacing = 16.0f / gridSize;
+				const float transform[16] =
+				{
+					1.0f, 0.0f, 0.0f, -8.0f + spacing * (x + 0.5f),
+					0.0f, 1.0f, 0.0f, 0.8f,
+					0.0f, 0.0f, 1.0f, -8.0f + spacing * (z + 0.5f),
+					0.0f, 0.0f, 0.0f, 1.0f
+				};
+
+				Node* node = new Node();
+				node->name = "Dense Sphere";
+				node->materialID = (x + z) % int(scene.mMaterialList.size());
+				node->mMeshIDList.push_back(meshID);
+				memcpy(node->transform, transform, sizeof(transform));
+				scene.mNodeList.push_back(node);
+			}
+		}
+	}
+
+	void addManyLights(Scene& scene, const int count, const unsigned int seed)
+	{
+		std::mt19937 generator(seed);
+		std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+		const float size = 0.3f;
+
+		for (int i = 0; i < count; ++i)
+		{
+			const optix::float3 position = optix::make_float3(-9.0f + 18.0f * uniform(generator), 4.5f + 3.0f * uniform(generator), -9.0f + 18.0f * uniform(generator));
+
+			const float cosTheta = 1.0f - (1.0f - cosf(M_PIf / 6.0f)) * uniform(generator);
+			const float sinTheta = sqrtf(1.0f - cosTheta * cosTheta);
+			const float phi      = 2.0f * M_PIf * uniform(generator);
+			const optix::float3 normal = optix::make_float3(sinTheta * cosf(phi), -cosTheta, sinTheta * sinf(phi));
+
+			const TBN tbn(normal);
+
+			Light* light = new Light();
+			light->lightType = QUAD;
+			light->position  = position;
+			light->u         = tbn.tangent * size;
+			light->v         = tbn.bitangent * size;
+			light->area      = optix::length(optix::cross(light->u, light->v));
+			light->normal    = optix::normalize(optix::cross(light->u, light->v));
+			light->emission  = optix::make_float3(0.5f + uniform(generator), 0.5f + uniform(generator), 0.5f + uniform(generator)) * 2.0f * powf(10.0f, 2.0f * uniform(generator));
+			scene.mLightList.push_back(light);
+		}
+	}
+
+	std::unique_ptr<Scene> loadGuidingScene()
+	{
+		const std::string path = std::string(sutil::samplesDir()) + "/resources/Scenes/GuidingScene/GuidingScene.scn";
+		FILE* file = fopen(path.c_str(), "r");
+		if (file == nullptr)
+		{
+			std::cout << "  " << path << " not found, skipped" << std::endl;
+			return std::unique_ptr<Scene>();
+		}
+		fclose(file);
+
+		return std::unique_ptr<Scene>(Scene::LoadScene(path.c_str()));
+	}
+
+	BenchmarkCamera getBenchmarkCamera(const int width, const int height, const float distance)
+	{
+		PinholeCamera pinholeCamera;
+		pinholeCamera.setViewport(width, height);
+		pinholeCamera.setCameraVariables(optix::make_float3(0.0f), 0.83f, 0.77f, distance);
+
+		BenchmarkCamera camera;
+		camera.width  = width;
+		camera.height = height;
+		pinholeCamera.getFrustum(camera.position, camera.U, camera.V, camera.W, true);
+		return camera;
+	}
+
+	BenchmarkCamera getGuidingSceneCamera(const int width, const int height)
+	{
+		const optix::float3 eye    = optix::make_float3(0.6f, 2.2f, 4.6f);
+		const optix::float3 target = optix::make_float3(-4.0f, 1.0f, -1.0f);
+		const float         fovY   = 60.0f; // Degrees.
+
+		const float tanHalf = tanf(0.5f * fovY * M_PIf / 180.0f);
+
+		BenchmarkCamera camera;
+		camera.width    = width;
+		camera.height   = height;
+		camera.position = eye;
+		camera.W        = optix::normalize(target - eye);
+		camera.U        = optix::normalize(optix::cross(camera.W, optix::make_float3(0.0f, 1.0f, 0.0f))) * tanHalf * float(width) / float(height);
+		camera.V        = optix::normalize(optix::cross(camera.U, camera.W)) * tanHalf;
+		return camera;
+	}
+
+	bool identicalImages(std::vector<optix::float4> const& a, std::vector<optix::float4> const& b)
+	{
+		return a.size() == b.size() && memcmp(a.data(), b.data(), a.size() * sizeof(optix::float4)) == 0;
+	}
+
+	double meanLuminance(std::vector<optix::float4> const& image)
+	{
+		double mean = 0.0;
+		for (optix::float4 const& pixel : image)
+		{
+			mean += luminance(optix::make_float3(pixel));
+		}
+		return mean / double(image.size());
+	}
+
+	std::vector<double> errorImage(std::vector<optix::float4> const& image, std::vector<optix::float4> const& reference)
+	{
+		std::vector<double> error(reference.size());
+		for (size_t i = 0; i < reference.size(); ++i)
+		{
+			error[i] = luminance(optix::make_float3(image[i])) - luminance(optix::make_float3(reference[i]));
+		}
+		return error;
+	}
+
+	double imageError(std::vector<optix::float4> const& image, std::vector<optix::float4> const& reference)
+	{
+		return imageError(image, reference, std::vector<char>(reference.size(), 1));
+	}
+
+	double imageError(std::vector<optix::float4> const& image, std::vector<optix::float4> const& reference, std::vector<char> const& mask)
+	{
+		double squaredError = 0.0;
+		size_t count        = 0;
+		for (size_t i = 0; i < reference.size(); ++i)
+		{
+			if (mask[i])
+			{
+				const double error = luminance(optix::make_float3(image[i])) - luminance(optix::make_float3(reference[i]));
+				squaredError += error * error;
+				++count;
+			}
+		}
+		return sqrt(squaredError / double(count));
+	}
+
+	double relativeError(std::vector<optix::float4> const& image, std::vector<optix::float4> const& reference)
+	{
+		double squaredError = 0.0;
+		for (size_t i = 0; i < reference.size(); ++i)
+		{
+			const double value = luminance(optix::make_float3(image[i]));
+			const double L     = luminance(optix::make_float3(reference[i]));
+			squaredError += (value - L) * (value - L) / (L * L + 0.01);
+		}
+		return sqrt(squaredError / double(reference.size()));
+	}
+
+	double renderEqualTime(HostRenderer& renderer, std::vector<optix::float4> const& reference, double const* budgets, const int numBudgets,
+	                       std::vector<double>& rmse, std::vector<int>& samples)
+	{
+		Timer timer;
+
+		double time = 0.0;
+		int    next = 0;
+		while (next < numBudgets)
+		{
+			timer.restart();
+			renderer.render();
+			time += timer.getTime();
+
+			while (next < numBudgets && budgets[next] <= time)
+			{
+				rmse.push_back(imageError(renderer.getOutputBuffer(), reference));
+				samples.push_back(renderer.getIterationIndex());
+				++next;
+			}
+		}
+		return meanLuminance(renderer.getOutputBuffer());
+	}
+
+	double chiSquareTest(std::vector<double> const& observed, std::vector<double> const& expected, double& statistic, int& dof)
+	{
+		std::vector<int> order(expected.size());
+		for (size_t i = 0; i < order.size(); ++i)
+		{
+			order[i] = int(i);
+		}
+		std::sort(order.begin(), order.end(), [&expected](int a, int b) { return expected[a] < expected[b]; });
+
+		statistic = 0.0;
+		dof = -1;
+
+		double pooledObserved = 0.0;
+		double pooledExpected = 0.0;
+		for (int i : order)
+		{
+			if (expected[i] == 0.0 && 0.0 < observed[i])
+			{
+				return 0.0;
+			}
+			pooledObserved += observed[i];
+			pooledExpected += expected[i];
+			if (5.0 <= pooledExpected)
+			{
+				statistic += (pooledObserved - pooledExpected) * (pooledObserved - pooledExpected) / pooledExpected;
+				pooledObserved = 0.0;
+				pooledExpected = 0.0;
+				++dof;
+			}
+		}
+		if (dof < 1)
+		{
+			return 1.0;
+		}
+
+		const double k = double(dof);
+		const double z = (pow(statistic / k, 1.0 / 3.0) - (1.0 - 2.0 / (9.0 * k))) / sqrt(2.0 / (9.0 * k));
+		return 0.5 * erfc(z / sqrt(2.0));
+	}
+
+	void getShadingPoints(HostScene const& scene, const int width, const int height, const float sceneEpsilon, std::vector<State>& points, std::vector<optix::float3>& directions)
+	{
+		const BenchmarkCamera camera = getBenchmarkCamera(width, height, 20.0f);
+
+		for (int y = 0; y < height; ++y)
+		{
+			for (int x = 0; x < width; ++x)
+			{
+				const optix::float3 direction = camera.getDirection(x + 0.5f, y + 0.5f);
+
+				TriangleHit hit;
+				if (!scene.intersect(camera.position, direction, sceneEpsilon, RT_DEFAULT_MAX, hit) || 0 <= scene.getLightIndex(hit.primitive))
+				{
+					continue;
+				}
+
+				State state;
+				scene.getState(camera.position, direction, hit, state);
+				if (0.0f < optix::dot(direction, state.geometry_normal))
+				{
+					state.geometry_normal = -state.geometry_normal;
+					state.shading_normal  = -state.shading_normal;
+				}
+				points.push_back(state);
+				directions.push_back(direction);
+			}
+		}
+	}
+
+	std::vector<char> getInteriorPixels(HostScene const& scene, const int width, const int height, const float distance)
+	{
+		const BenchmarkCamera camera = getBenchmarkCamera(width, height, distance);
+
+		std::vector<char> interior(size_t(width) * height, 0);
+		for (int y = 0; y < height; ++y)
+		{
+			for (int x = 0; x < width; ++x)
+			{
+				int  material = -1;
+				bool same     = true;
+				for (int corner = 0; corner < 4 && same; ++corner)
+				{
+					const optix::float3 direction = camera.getDirection(float(x + (corner & 1)), float(y + (corner >> 1)));
+
+					TriangleHit hit;
+					const int index = (scene.intersect(camera.position, direction, 0.0f, RT_DEFAULT_MAX, hit) && scene.getLightIndex(hit.primitive) < 0) ? scene.getMaterialIndex(hit.primitive) : -1;
+
+					same     = 0 <= index && (corner == 0 || index == material);
+					material = index;
+				}
+				interior[size_t(y) * width + x] = same ? 1 : 0;
+			}
+		}
+		return interior;
+	}
+
+	// The PerRayData of one diffuse sample at state seen from wo. The LCG is one stream over all samples of the point.
+	static PerRayData beginDiffuseSample(State const& state, const optix::float3& wo, const unsigned int seed)
+	{
+		PerRayData prd;
+		prd.hit_pos    = state.hit_position;
+		prd.wo         = wo;
+		prd.flags      = 0;
+		prd.brdf_flags = BSDF_REFLECTION | BSDF_DIFFUSE;
+		prd.seed       = seed;
+		prd.sampler    = SAMPLER_LCG;
+		prd.dimension  = SAMPLE_DIMENSION_CAMERA;
+		return prd;
+	}
+
+	// Traces the BRDF sample prd.wi from state. Returns the light it hits, the environment light if it escapes, -1 for other
+	// geometry or when it escapes into a scene without environment.
+	static int traceBrdfSample(HostScene const& scene, State const& state, PerRayData const& prd, const float sceneEpsilon, TriangleHit& hit)
+	{
+		if (!scene.intersect(state.hit_position, prd.wi, sceneEpsilon, RT_DEFAULT_MAX, hit))
+		{
+			return scene.getEnvironmentLight();
+		}
+		return scene.getLightIndex(hit.primitive);
+	}
+
+	float sampleDirectLightingEstimate(HostScene const& scene, LightSelector const* selector, Material const& mat, State const& state, const optix::float3& wo, const float sceneEpsilon, unsigned int& seed)
+	{
+		std::vector<Light> const& lights = scene.getLights();
+
+		PerRayData prd = beginDiffuseSample(state, wo, seed);
+
+		float value = 0.0f;
+
+		ShadowRay shadowRay;
+		if (selector != nullptr && sampleDirectLighting(lights, *selector, mat, state, prd, sceneEpsilon, shadowRay) &&
+		    !scene.occluded(shadowRay.origin, shadowRay.direction, shadowRay.tmin, shadowRay.tmax))
+		{
+			value += luminance(shadowRay.radiance);
+		}
+
+		TriangleHit hit;
+		const int lightIndex = sampleSurface(LAMBERT, mat, state, prd) ? traceBrdfSample(scene, state, prd, sceneEpsilon, hit) : -1;
+		if (0 <= lightIndex)
+		{
+			Light const& light = lights[lightIndex];
+
+			PerRayData lightPrd;
+			lightPrd.wo         = -prd.wi;
+			lightPrd.flags      = 0;
+			lightPrd.brdf_flags = prd.brdf_flags;
+			lightPrd.pdf        = prd.pdf;
+			lightPrd.radiance   = optix::make_float3(0.0f);
+
+			if (light.lightType == ENVIRONMENT)
+			{
+				if (selector != nullptr)
+				{
+					shadeMiss(lights, *selector, lightIndex, state.hit_position, prd.wi, lightPrd);
+				}
+				else
+				{
+					lightPrd.radiance = light.emission * scene.getEnvironment().eval(environmentUV(prd.wi));
+				}
+			}
+			else
+			{
+				State lightState;
+				scene.getState(state.hit_position, prd.wi, hit, lightState);
+
+				if (selector != nullptr)
+				{
+					shadeLight(light, lightSelectionPmf(lights, *selector, lightIndex, state.hit_position), state.hit_position, hit.t, lightState.geometry_normal, lightPrd);
+				}
+				else if (0.0f <= optix::dot(lightPrd.wo, lightState.geometry_normal))
+				{
+					lightPrd.radiance = light.emission;
+				}
+			}
+
+			value += luminance(prd.f_over_pdf * lightPrd.radiance);
+		}
+
+		seed = prd.seed;
+		return value;
+	}
+
+	float sampleQuadLightEstimate(HostScene const& scene, Material const& mat, State const& state, const optix::float3& wo, const float minSolidAngle, const float sceneEpsilon, unsigned int& seed)
+	{
+		Light const& light = scene.getLights()[0];
+
+		PerRayData prd = beginDiffuseSample(state, wo, seed);
+
+		float value = 0.0f;
+
+		LightSample lightSample;
+		sampleQuadLight(light, state.hit_position, sample2D(prd, SAMPLE_DIMENSION_LIGHT), minSolidAngle, lightSample);
+		if (0.0f < lightSample.pdf && 0.0f < optix::dot(light.normal, -lightSample.direction) && 0.0f < optix::dot(lightSample.direction, state.geometry_normal))
+		{
+			PerRayData lightPrd = prd;
+			lightPrd.wi = lightSample.direction;
+			g_brdfPdf[LAMBERT](mat, state, wo, lightPrd);
+			const optix::float3 f = g_brdfEval[LAMBERT](mat, state, wo, lightPrd) * fabsf(optix::dot(lightSample.direction, state.shading_normal));
+
+			if (!scene.occluded(state.hit_position, lightSample.direction, sceneEpsilon, lightSample.distance - sceneEpsilon))
+			{
+				const float weight = PowerHeuristic(1, lightSample.pdf, 1, lightPrd.pdf);
+				value += luminance(f * light.emission) * weight / lightSample.pdf;
+			}
+		}
+
+		TriangleHit hit;
+		if (sampleSurface(LAMBERT, mat, state, prd) && traceBrdfSample(scene, state, prd, sceneEpsilon, hit) == 0)
+		{
+			const float cosTheta = optix::dot(-prd.wi, light.normal);
+			if (0.0f < cosTheta)
+			{
+				const float pdfLight = quadLightPdf(light, state.hit_position, hit.t, cosTheta, minSolidAngle);
+				value += luminance(prd.f_over_pdf * light.emission) * powerHeuristic(prd.pdf, pdfLight);
+			}
+		}
+
+		seed = prd.seed;
+		return value;
+	}
+}
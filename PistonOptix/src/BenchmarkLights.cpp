@@ -0,0 +1,1215 @@
+#include "inc/BenchmarkCommon.h"
+#include "inc/EnvironmentMap.h"
+#include "inc/HostRenderer.h"
+#include "inc/LightAliasTable.h"
+#include "inc/LightTree.h"
+#include "inc/WavefrontRenderer.h"
+
+#include <sutil.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace POptix
+{
+	// Uniform light selection vs. the light tree on 1000 quad lights. The variance per sample is the one of the direct lighting
+	// estimate at the surfaces seen by the camera, with a diffuse material so the BRDF sampling matches its evaluation.
+	// Both selections use the same power heuristic and converge to the same direct lighting.
+	int benchmarkLightTree()
+	{
+		const int   width            = 160;
+		const int   height           = 90;
+		const int   numLights        = 1000;
+		const int   samplesPerPoint  = 64;
+		const int   numRenderSamples = 8;
+		const int   numPmfPoints     = 10000;
+		const float sceneEpsilon     = 500.0f * 1.0e-7f;
+
+		Scene scene;
+		scene.build();
+
+		addManyLights(scene, numLights, 1234u);
+
+		HostScene hostScene;
+		hostScene.build(scene);
+
+		LightTree const& lightTree = hostScene.getLightTree();
+
+		Timer timer;
+		timer.start();
+		LightTree rebuiltTree;
+		rebuiltTree.build(hostScene.getLights());
+		const double buildTime = timer.getTime();
+
+		int failures = 0;
+
+		// The MIS weights need exact probabilities: they must sum to one and match the ones of the sampling.
+		std::mt19937 generator(4321u);
+		std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+		double maxSumError    = 0.0;
+		double maxSampleError = 0.0;
+		for (int i = 0; i < numPmfPoints; ++i)
+		{
+			const optix::float3 position = optix::make_float3(-10.0f + 20.0f * uniform(generator), 8.0f * uniform(generator), -10.0f + 20.0f * uniform(generator));
+
+			double sum = 0.0;
+			for (int light = 0; light < lightTree.getNumLights(); ++light)
+			{
+				sum += lightTree.pmf(light, position);
+			}
+			maxSumError = std::max(maxSumError, fabs(sum - 1.0));
+
+			float pmf = 0.0f;
+			const int light = lightTree.sample(position, uniform(generator), pmf);
+			maxSampleError = std::max(maxSampleError, fabs(double(pmf) / lightTree.pmf(light, position) - 1.0));
+		}
+		if (1.0e-4 < maxSumError || 1.0e-5 < maxSampleError)
+		{
+			++failures;
+		}
+
+		// Megakernel and wavefront consume the same random numbers with the tree.
+		HostRenderer hostRenderer(hostScene);
+		setCamera(hostRenderer, getBenchmarkCamera(width, height, 20.0f));
+		hostRenderer.setLightSelection(LIGHT_SELECTION_TREE);
+
+		WavefrontRenderer renderer(hostScene);
+		setCamera(renderer, getBenchmarkCamera(width, height, 20.0f));
+		renderer.setLightSelection(LIGHT_SELECTION_TREE);
+
+		for (int sample = 0; sample < 2; ++sample)
+		{
+			hostRenderer.render();
+			renderer.render();
+		}
+		const bool identical = identicalImages(hostRenderer.getOutputBuffer(), renderer.getOutputBuffer());
+		if (!identical)
+		{
+			++failures;
+		}
+
+		std::vector<State>         points;
+		std::vector<optix::float3> directions;
+		getShadingPoints(hostScene, width, height, sceneEpsilon, points, directions);
+
+		Material diffuse;
+		diffuse.albedo    = optix::make_float3(0.8f);
+		diffuse.metallic  = 0.0f;
+		diffuse.roughness = 1.0f;
+
+		std::cout << "lighttree: " << hostScene.getLights().size() << " lights, " << lightTree.getNodes().size() << " nodes, depth " << lightTree.getDepth()
+		          << ", build " << buildTime * 1000.0 << " ms, " << points.size() << " shading points, " << samplesPerPoint << " samples per point" << std::endl;
+		std::cout << "{" << std::endl;
+		std::cout << "  pmf sum error " << maxSumError << ", sampled vs. evaluated pmf error " << maxSampleError << " at " << numPmfPoints << " points" << std::endl;
+		std::cout << "  megakernel and wavefront images " << (identical ? "identical" : "DIFFER") << std::endl;
+		std::cout << "  selection  us/sample  variance/sample      mean  efficiency  render ms/sample" << std::endl;
+
+		const ELightSelection selections[] = { LIGHT_SELECTION_UNIFORM, LIGHT_SELECTION_TREE };
+		const char* names[] = { "uniform", "tree" };
+
+		double baseCost = 0.0;
+		double baseMean = 0.0;
+
+		for (ELightSelection selection : selections)
+		{
+			const LightSelector selector(selection, lightTree, hostScene.getLightAliasTable(), hostScene.getEnvironment());
+
+			double variance = 0.0;
+			double mean     = 0.0;
+
+			timer.restart();
+			for (size_t i = 0; i < points.size(); ++i)
+			{
+				unsigned int seed = tea<8>(unsigned(i), 0u);
+
+				double sum        = 0.0;
+				double sumSquares = 0.0;
+				for (int sample = 0; sample < samplesPerPoint; ++sample)
+				{
+					const double value = sampleDirectLightingEstimate(hostScene, &selector, diffuse, points[i], -directions[i], sceneEpsilon, seed);
+					sum        += value;
+					sumSquares += value * value;
+				}
+				const double pointMean = sum / samplesPerPoint;
+				variance += (sumSquares / samplesPerPoint - pointMean * pointMean) * samplesPerPoint / (samplesPerPoint - 1);
+				mean     += pointMean;
+			}
+			const double time = timer.getTime() / (double(points.size()) * samplesPerPoint);
+
+			variance /= double(points.size());
+			mean     /= double(points.size());
+
+			// Variance times time per sample, lower is better. Efficiency is relative to uniform selection.
+			const double cost = variance * time;
+			if (selection == LIGHT_SELECTION_UNIFORM)
+			{
+				baseCost = cost;
+				baseMean = mean;
+			}
+			else if (0.02 < fabs(mean / baseMean - 1.0))
+			{
+				++failures;
+			}
+
+			// Cost of the selection in the full path tracer.
+			renderer.setLightSelection(selection);
+			timer.restart();
+			for (int sample = 0; sample < numRenderSamples; ++sample)
+			{
+				renderer.render();
+			}
+			const double renderTime = timer.getTime() / numRenderSamples;
+
+			char line[256];
+			snprintf(line, sizeof(line), "  %9s  %9.3f  %15.4f  %8.4f  %9.2fx  %16.2f", names[selection], time * 1.0e6, variance, mean, baseCost / cost, renderTime * 1000.0);
+			std::cout << line << std::endl;
+		}
+
+		std::cout << "}" << std::endl;
+
+		return (failures == 0) ? 0 : 1;
+	}
+
+	// Uniform vs. power proportional light selection with one bright key light and many dim fill lights, next to the directional
+	// light of Scene::build(). Noise is the RMS error of the per point direct lighting estimates against a converged reference,
+	// over the number of samples per point. The alias table must reproduce its pmf exactly, the MIS weights rely on it.
+	int benchmarkLightPower()
+	{
+		const int   width            = 80;
+		const int   height           = 45;
+		const int   numDimLights     = 255;
+		const int   referenceSamples = 4096;
+		const int   numRenderSamples = 8;
+		const float sceneEpsilon     = 500.0f * 1.0e-7f;
+		const int   sampleCounts[]   = { 1, 4, 16, 64 };
+
+		Scene scene;
+		scene.build();
+
+		// The directional light of Scene::build() points up through the floor, turn it into a dim sun from above.
+		scene.mLightList[0]->normal   = optix::normalize(optix::make_float3(-1.0f, -1.0f, 1.0f));
+		scene.mLightList[0]->emission = optix::make_float3(1.0f);
+
+		addManyLights(scene, numDimLights, 5678u);
+		for (size_t i = 1; i < scene.mLightList.size(); ++i)
+		{
+			scene.mLightList[i]->emission = optix::make_float3(0.2f);
+		}
+
+		// The key light, 2 x 2 units above the center.
+		Light* keyLight = new Light();
+		keyLight->lightType = QUAD;
+		keyLight->position  = optix::make_float3(-1.0f, 8.0f, -1.0f);
+		keyLight->u         = optix::make_float3(2.0f, 0.0f, 0.0f);
+		keyLight->v         = optix::make_float3(0.0f, 0.0f, 2.0f);
+		keyLight->area      = optix::length(optix::cross(keyLight->u, keyLight->v));
+		keyLight->normal    = optix::normalize(optix::cross(keyLight->u, keyLight->v));
+		keyLight->emission  = optix::make_float3(50.0f);
+		scene.mLightList.push_back(keyLight);
+
+		HostScene hostScene;
+		hostScene.build(scene);
+
+		std::vector<Light> const& lights = hostScene.getLights();
+		LightAliasTable const& aliasTable = hostScene.getLightAliasTable();
+
+		Timer timer;
+		timer.start();
+		LightAliasTable rebuiltTable;
+		rebuiltTable.build(lights, 0.5f * optix::length(hostScene.getBounds().extent()), 0.0f);
+		const double buildTime = timer.getTime();
+
+		int failures = 0;
+
+		// Probability of each light as sampleLightAlias() realizes it: its own share of its entry plus the shares it is the alias of.
+		std::vector<LightAliasEntry> const& entries = aliasTable.getEntries();
+		std::vector<double> realized(entries.size(), 0.0);
+		for (size_t i = 0; i < entries.size(); ++i)
+		{
+			realized[i] += entries[i].threshold / double(entries.size());
+			realized[entries[i].alias] += (1.0 - entries[i].threshold) / double(entries.size());
+		}
+		double pmfSum   = 0.0;
+		double maxError = 0.0;
+		for (size_t i = 0; i < entries.size(); ++i)
+		{
+			pmfSum  += entries[i].pmf;
+			maxError = std::max(maxError, fabs(realized[i] - entries[i].pmf));
+		}
+		if (1.0e-5 < fabs(pmfSum - 1.0) || 1.0e-6 < maxError)
+		{
+			++failures;
+		}
+
+		// Megakernel and wavefront consume the same random numbers with the alias table.
+		HostRenderer hostRenderer(hostScene);
+		setCamera(hostRenderer, getBenchmarkCamera(width, height, 20.0f));
+		hostRenderer.setLightSelection(LIGHT_SELECTION_POWER);
+
+		WavefrontRenderer renderer(hostScene);
+		setCamera(renderer, getBenchmarkCamera(width, height, 20.0f));
+		renderer.setLightSelection(LIGHT_SELECTION_POWER);
+
+		for (int sample = 0; sample < 2; ++sample)
+		{
+			hostRenderer.render();
+			renderer.render();
+		}
+		const bool identical = identicalImages(hostRenderer.getOutputBuffer(), renderer.getOutputBuffer());
+		if (!identical)
+		{
+			++failures;
+		}
+
+		std::vector<State>         points;
+		std::vector<optix::float3> directions;
+		getShadingPoints(hostScene, width, height, sceneEpsilon, points, directions);
+
+		Material diffuse;
+		diffuse.albedo    = optix::make_float3(0.8f);
+		diffuse.metallic  = 0.0f;
+		diffuse.roughness = 1.0f;
+
+		// Converged direct lighting per point. The random numbers differ from the ones of the measurements below.
+		const LightSelector referenceSelector(LIGHT_SELECTION_TREE, hostScene.getLightTree(), aliasTable, hostScene.getEnvironment());
+
+		std::vector<double> reference(points.size());
+		for (size_t i = 0; i < points.size(); ++i)
+		{
+			unsigned int seed = tea<8>(unsigned(i), 1u);
+
+			double sum = 0.0;
+			for (int sample = 0; sample < referenceSamples; ++sample)
+			{
+				sum += sampleDirectLightingEstimate(hostScene, &referenceSelector, diffuse, points[i], -directions[i], sceneEpsilon, seed);
+			}
+			reference[i] = sum / referenceSamples;
+		}
+
+		double referenceMean = 0.0;
+		for (double value : reference)
+		{
+			referenceMean += value;
+		}
+		referenceMean /= double(points.size());
+
+		std::cout << "lightpower: " << lights.size() << " lights, key light pmf " << aliasTable.pmf(int(lights.size()) - 1) << ", directional light pmf " << aliasTable.pmf(0)
+		          << ", build " << buildTime * 1000.0 << " ms, " << points.size() << " shading points, reference " << referenceSamples << " samples per point" << std::endl;
+		std::cout << "{" << std::endl;
+		std::cout << "  pmf sum " << pmfSum << ", realized vs. stored pmf error " << maxError << ", reference mean " << referenceMean << std::endl;
+		std::cout << "  megakernel and wavefront images " << (identical ? "identical" : "DIFFER") << std::endl;
+		std::cout << "  selection  us/sample   RMSE 1 spp   RMSE 4 spp  RMSE 16 spp  RMSE 64 spp      mean  render ms/sample" << std::endl;
+
+		const ELightSelection selections[] = { LIGHT_SELECTION_UNIFORM, LIGHT_SELECTION_POWER, LIGHT_SELECTION_TREE };
+		const char* names[] = { "uniform", "tree", "power" };
+
+		for (ELightSelection selection : selections)
+		{
+			const LightSelector selector(selection, hostScene.getLightTree(), aliasTable, hostScene.getEnvironment());
+
+			double rmse[4]    = { 0.0, 0.0, 0.0, 0.0 };
+			double mean       = 0.0;
+			double sumSquares = 0.0;
+			int    numSamples = 0;
+
+			timer.restart();
+			for (int count = 0; count < 4; ++count)
+			{
+				double squaredError = 0.0;
+				for (size_t i = 0; i < points.size(); ++i)
+				{
+					unsigned int seed = tea<8>(unsigned(i), 2u + unsigned(count));
+
+					double sum = 0.0;
+					for (int sample = 0; sample < sampleCounts[count]; ++sample)
+					{
+						const double value = sampleDirectLightingEstimate(hostScene, &selector, diffuse, points[i], -directions[i], sceneEpsilon, seed);
+						sum        += value;
+						sumSquares += value * value;
+					}
+					const double estimate = sum / sampleCounts[count];
+					squaredError += (estimate - reference[i]) * (estimate - reference[i]);
+					mean         += sum;
+				}
+				rmse[count] = sqrt(squaredError / double(points.size()));
+				numSamples += sampleCounts[count];
+			}
+			const double time  = timer.getTime() / (double(points.size()) * numSamples);
+			const double total = double(points.size()) * numSamples;
+			mean /= total;
+
+			// All selections converge to the same direct lighting. Uniform selection rarely picks the key light, so the
+			// tolerance is the standard error of the mean, not a fixed fraction.
+			const double standardError = sqrt(std::max(0.0, sumSquares / total - mean * mean) / total);
+			if (4.0 * standardError + 1.0e-3 * referenceMean < fabs(mean - referenceMean))
+			{
+				++failures;
+			}
+
+			renderer.setLightSelection(selection);
+			timer.restart();
+			for (int sample = 0; sample < numRenderSamples; ++sample)
+			{
+				renderer.render();
+			}
+			const double renderTime = timer.getTime() / numRenderSamples;
+
+			char line[256];
+			snprintf(line, sizeof(line), "  %9s  %9.3f  %11.4f  %11.4f  %11.4f  %11.4f  %8.4f  %16.2f", names[selection], time * 1.0e6, rmse[0], rmse[1], rmse[2], rmse[3], mean, renderTime * 1000.0);
+			std::cout << line << std::endl;
+		}
+
+		std::cout << "}" << std::endl;
+
+		return (failures == 0) ? 0 : 1;
+	}
+
+	// The bundled HDR environments as the only light of Scene::build(). BRDF sampling alone vs. the next event estimation with
+	// the importance sampled map and MIS, RMS error of the per point direct lighting at equal time against a converged reference.
+	// The sampled directions must come with the pdf environmentPdf() returns for them, the MIS weights of miss.cu rely on it.
+	int benchmarkEnvironment()
+	{
+		const int   width            = 80;
+		const int   height           = 45;
+		const int   referenceSamples = 1024;
+		const int   samplesPerPoint  = 16;
+		const int   numPdfSamples    = 100000;
+		const float sceneEpsilon     = 500.0f * 1.0e-7f;
+
+		const char* environments[] = { "CedarCity.hdr", "NV_Default_HDR_3000x1500.hdr" };
+
+		int failures = 0;
+
+		std::cout << "environment: BRDF sampling vs. importance sampled environment with MIS, " << samplesPerPoint << " samples per point, reference "
+		          << referenceSamples << " samples per point" << std::endl;
+		std::cout << "{" << std::endl;
+
+		for (const char* environment : environments)
+		{
+			Scene scene;
+			scene.build();
+
+			// The directional light of Scene::build() becomes the environment.
+			Light* light = scene.mLightList[0];
+			light->lightType = ENVIRONMENT;
+			light->emission  = optix::make_float3(1.0f);
+			light->isDelta   = false;
+			light->area      = 0.0f;
+			scene.mEnvironmentFile = std::string(sutil::samplesDir()) + "/data/" + environment;
+
+			Timer timer;
+			timer.start();
+			HostScene hostScene;
+			hostScene.build(scene);
+			const double buildTime = timer.getTime();
+
+			EnvironmentMap const& map = hostScene.getEnvironment();
+			if (map.getWidth() <= 1)
+			{
+				std::cout << "  " << environment << " can't be read" << std::endl;
+				++failures;
+				continue;
+			}
+
+			// Sampled pdf vs. environmentPdf(), and the pdf integrated over the sphere with uniform directions.
+			std::mt19937 generator(4321u);
+			std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+			int    pdfMismatches = 0;
+			double pdfIntegral   = 0.0;
+			for (int i = 0; i < numPdfSamples; ++i)
+			{
+				float pdf;
+				const optix::float3 direction = map.sample(uniform(generator), uniform(generator), pdf);
+				pdfMismatches += (1.0e-3 * pdf < fabs(map.pdf(direction) - pdf)) ? 1 : 0;
+
+				pdfIntegral += map.pdf(environmentDirection(optix::make_float2(uniform(generator), uniform(generator))));
+			}
+			pdfIntegral *= 4.0 * M_PI / numPdfSamples;
+
+			// Directions at a texel border may round into the neighbour texel, that must stay rare.
+			if (numPdfSamples / 1000 < pdfMismatches || 2.0e-2 < fabs(pdfIntegral - 1.0))
+			{
+				++failures;
+			}
+
+			// Megakernel and wavefront consume the same random numbers with the environment.
+			HostRenderer hostRenderer(hostScene);
+			setCamera(hostRenderer, getBenchmarkCamera(width, height, 20.0f));
+
+			WavefrontRenderer renderer(hostScene);
+			setCamera(renderer, getBenchmarkCamera(width, height, 20.0f));
+
+			for (int sample = 0; sample < 2; ++sample)
+			{
+				hostRenderer.render();
+				renderer.render();
+			}
+			const bool identical = identicalImages(hostRenderer.getOutputBuffer(), renderer.getOutputBuffer());
+			if (!identical)
+			{
+				++failures;
+			}
+
+			std::vector<State>         points;
+			std::vector<optix::float3> directions;
+			getShadingPoints(hostScene, width, height, sceneEpsilon, points, directions);
+
+			Material diffuse;
+			diffuse.albedo    = optix::make_float3(0.8f);
+			diffuse.metallic  = 0.0f;
+			diffuse.roughness = 1.0f;
+
+			const LightSelector selector(LIGHT_SELECTION_UNIFORM, hostScene.getLightTree(), hostScene.getLightAliasTable(), map);
+
+			std::vector<double> reference(points.size());
+			double referenceMean = 0.0;
+			for (size_t i = 0; i < points.size(); ++i)
+			{
+				unsigned int seed = tea<8>(unsigned(i), 1u);
+
+				double sum = 0.0;
+				for (int sample = 0; sample < referenceSamples; ++sample)
+				{
+					sum += sampleDirectLightingEstimate(hostScene, &selector, diffuse, points[i], -directions[i], sceneEpsilon, seed);
+				}
+				reference[i] = sum / referenceSamples;
+				referenceMean += reference[i];
+			}
+			referenceMean /= double(points.size());
+
+			char line[256];
+			snprintf(line, sizeof(line), "  %s: %d x %d, build %.1f ms, pdf integral %.5f, %d of %d sampled pdfs differ, %d shading points, reference mean %.4f",
+			         environment, map.getWidth(), map.getHeight(), buildTime * 1000.0, pdfIntegral, pdfMismatches, numPdfSamples, int(points.size()), referenceMean);
+			std::cout << line << std::endl;
+			std::cout << "    megakernel and wavefront images " << (identical ? "identical" : "DIFFER") << std::endl;
+			std::cout << "    estimator   us/sample        RMSE      mean  RMSE at equal time  speedup" << std::endl;
+
+			double baseTime = 0.0;
+			double baseRmse = 0.0;
+			for (int method = 0; method < 2; ++method)
+			{
+				double squaredError = 0.0;
+				double mean         = 0.0;
+				double sumSquares   = 0.0;
+
+				timer.restart();
+				for (size_t i = 0; i < points.size(); ++i)
+				{
+					unsigned int seed = tea<8>(unsigned(i), 2u);
+
+					double sum = 0.0;
+					for (int sample = 0; sample < samplesPerPoint; ++sample)
+					{
+						const double value = (method == 0) ? sampleDirectLightingEstimate(hostScene, nullptr, diffuse, points[i], -directions[i], sceneEpsilon, seed)
+						                                   : sampleDirectLightingEstimate(hostScene, &selector, diffuse, points[i], -directions[i], sceneEpsilon, seed);
+						sum        += value;
+						sumSquares += value * value;
+					}
+					const double estimate = sum / samplesPerPoint;
+					squaredError += (estimate - reference[i]) * (estimate - reference[i]);
+					mean         += sum;
+				}
+				const double time  = timer.getTime();
+				const double total = double(points.size()) * samplesPerPoint;
+				const double rmse  = sqrt(squaredError / double(points.size()));
+				mean /= total;
+
+				// Both converge to the same direct lighting.
+				const double standardError = sqrt(std::max(0.0, sumSquares / total - mean * mean) / total);
+				if (4.0 * standardError + 1.0e-3 * referenceMean < fabs(mean - referenceMean))
+				{
+					++failures;
+				}
+
+				if (method == 0)
+				{
+					baseTime = time;
+					baseRmse = rmse;
+				}
+
+				// The error falls with the square root of the samples, so in the time of the BRDF sampling it would be this.
+				const double equalTimeRmse = rmse * sqrt(time / baseTime);
+
+				snprintf(line, sizeof(line), "    %9s  %10.3f  %10.5f  %8.4f  %18.5f  %6.2fx", (method == 0) ? "brdf" : "nee+mis",
+				         time / total * 1.0e6, rmse, mean, equalTimeRmse, (baseRmse * baseRmse) / (equalTimeRmse * equalTimeRmse));
+				std::cout << line << std::endl;
+			}
+		}
+
+		std::cout << "}" << std::endl;
+
+		return (failures == 0) ? 0 : 1;
+	}
+
+	// Solid angle sampling of sphere lights. A chi-square test of the sampled directions against the pdf for spheres from just
+	// above the surface to 2000 radii away, the irradiance estimate against the closed form and its variance compared to uniform
+	// sampling of the sphere surface, and the direct lighting with MIS against the light geometry of a HostScene.
+	int benchmarkSphereLight()
+	{
+		const int    numSamples   = 1 << 20;
+		const int    thetaBins    = 10;
+		const int    phiBins      = 12;
+		const int    subdivisions = 8;
+		const double significance = 0.01;
+		const float  distances[]  = { 1.01f, 1.5f, 4.0f, 60.0f, 2000.0f };
+		const int    numDistances = int(sizeof(distances) / sizeof(distances[0]));
+
+		std::mt19937 generator(42u);
+		std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+		Light light = Light();
+		light.lightType = SPHERE;
+		light.radius    = 1.0f;
+		light.area      = 4.0f * M_PIf;
+		light.emission  = optix::make_float3(1.0f);
+
+		const optix::float3 origin = optix::make_float3(0.3f, -0.2f, 0.1f);
+		const optix::float3 axis   = optix::normalize(optix::make_float3(0.2f, 1.0f, -0.4f));
+
+		int failures = 0;
+
+		std::cout << "spherelight: " << numSamples << " samples per distance, " << thetaBins << "x" << phiBins << " bins, significance "
+		          << significance << " over " << numDistances << " tests" << std::endl;
+		std::cout << "{" << std::endl;
+		std::cout << "  distance  thetaMax  chi-square  dof  p-value  mass    radius error  distance error  E error  area/cone variance  cone ns  area ns" << std::endl;
+
+		for (int d = 0; d < numDistances; ++d)
+		{
+			light.position = origin + axis * distances[d];
+
+			// Test frame around the direction to the centre, the tangents differ from the ones of the sampler.
+			const double cx = double(light.position.x) - origin.x;
+			const double cy = double(light.position.y) - origin.y;
+			const double cz = double(light.position.z) - origin.z;
+			const double dc = sqrt(cx * cx + cy * cy + cz * cz);
+			const double a[3] = { cx / dc, cy / dc, cz / dc };
+
+			const double reference[3] = { 0.36, 0.48, 0.8 };
+			double t[3] = { a[1] * reference[2] - a[2] * reference[1], a[2] * reference[0] - a[0] * reference[2], a[0] * reference[1] - a[1] * reference[0] };
+			const double tl = sqrt(t[0] * t[0] + t[1] * t[1] + t[2] * t[2]);
+			t[0] /= tl; t[1] /= tl; t[2] /= tl;
+			const double b[3] = { a[1] * t[2] - a[2] * t[1], a[2] * t[0] - a[0] * t[2], a[0] * t[1] - a[1] * t[0] };
+
+			const double r2       = double(light.radius) * light.radius;
+			const double sin2Max  = r2 / (dc * dc);
+			const double thetaMax = asin(sqrt(sin2Max));
+			const double pdf      = sphereLightPdf(light, origin);
+
+			// 1 - cos(theta) in 10 bins, the edge of the cone halfway through the last one. So the rounding of the float directions
+			// at 2000 radii doesn't put samples into bins without any probability and the edge is on a subdivision of the integration.
+			const double binWidth = 2.0 * sin(0.5 * thetaMax) * sin(0.5 * thetaMax) / (thetaBins - 0.5);
+
+			std::vector<double> observed(thetaBins * phiBins, 0.0);
+			std::vector<double> expected(thetaBins * phiBins, 0.0);
+
+			double maxRadiusError   = 0.0;
+			double maxDistanceError = 0.0;
+			bool   pdfMatches       = true;
+
+			// Irradiance on a surface whose normal is tilted away from the sphere but still sees all of it: E = pi L sin^2(thetaMax) cos(tilt).
+			const double tilt = 0.5 * (0.5 * M_PI - thetaMax);
+			const double n[3] = { a[0] * cos(tilt) + t[0] * sin(tilt), a[1] * cos(tilt) + t[1] * sin(tilt), a[2] * cos(tilt) + t[2] * sin(tilt) };
+			const double irradiance = M_PI * sin2Max * cos(tilt);
+
+			double coneSum = 0.0;
+			double coneSquares = 0.0;
+
+			Timer timer;
+			timer.start();
+			for (int i = 0; i < numSamples; ++i)
+			{
+				const optix::float2 u = optix::make_float2(uniform(generator), uniform(generator));
+
+				LightSample sample;
+				sampleSphereLight(light, origin, u, sample);
+
+				pdfMatches = pdfMatches && (sample.pdf == float(pdf));
+
+				const double w[3] = { sample.direction.x, sample.direction.y, sample.direction.z };
+
+				// The point is on the sphere and the first hit of the direction.
+				const double px = double(sample.surfacePos.x) - light.position.x;
+				const double py = double(sample.surfacePos.y) - light.position.y;
+				const double pz = double(sample.surfacePos.z) - light.position.z;
+				maxRadiusError = std::max(maxRadiusError, fabs(sqrt(px * px + py * py + pz * pz) - light.radius) / light.radius);
+
+				const double along = w[0] * cx + w[1] * cy + w[2] * cz;
+				const double hitT  = along - sqrt(std::max(0.0, along * along - (dc * dc - r2)));
+				maxDistanceError = std::max(maxDistanceError, fabs(hitT - sample.distance) / hitT);
+
+				const double cosA  = w[0] * a[0] + w[1] * a[1] + w[2] * a[2];
+				const double sinA  = sqrt((w[1] * a[2] - w[2] * a[1]) * (w[1] * a[2] - w[2] * a[1]) + (w[2] * a[0] - w[0] * a[2]) * (w[2] * a[0] - w[0] * a[2]) +
+				                          (w[0] * a[1] - w[1] * a[0]) * (w[0] * a[1] - w[1] * a[0]));
+				const double theta = atan2(sinA, cosA);
+				const double phi   = atan2(w[0] * b[0] + w[1] * b[1] + w[2] * b[2], w[0] * t[0] + w[1] * t[1] + w[2] * t[2]) + M_PI;
+
+				const int thetaBin = int(2.0 * sin(0.5 * theta) * sin(0.5 * theta) / binWidth);
+				const int phiBin   = std::min(phiBins - 1, int(phi / (2.0 * M_PI) * phiBins));
+				if (thetaBin < thetaBins)
+				{
+					observed[thetaBin * phiBins + phiBin] += 1.0;
+				}
+				else
+				{
+					pdfMatches = false; // Outside of the binned range, far outside of the cone.
+				}
+
+				const double cosN = std::max(0.0, w[0] * n[0] + w[1] * n[1] + w[2] * n[2]);
+				coneSum     += cosN / sample.pdf;
+				coneSquares += (cosN / sample.pdf) * (cosN / sample.pdf);
+			}
+			const double coneTime = timer.getTime();
+
+			// Uniform points on the whole sphere, the back half sees nothing.
+			double areaSum = 0.0;
+			double areaSquares = 0.0;
+			timer.restart();
+			for (int i = 0; i < numSamples; ++i)
+			{
+				const float u1 = uniform(generator);
+				const float u2 = uniform(generator);
+
+				const optix::float3 normal = UniformSampleSphere(u1, u2);
+				const optix::float3 point  = light.position + normal * light.radius;
+				const optix::float3 wi     = point - origin;
+				const float distance  = optix::length(wi);
+				const optix::float3 w = wi / distance;
+				const float cosLight  = optix::dot(normal, -w);
+				if (0.0f < cosLight)
+				{
+					const double areaPdf = double(distance) * distance / (double(light.area) * cosLight);
+					const double cosN    = std::max(0.0, w.x * n[0] + w.y * n[1] + w.z * n[2]);
+					areaSum     += cosN / areaPdf;
+					areaSquares += (cosN / areaPdf) * (cosN / areaPdf);
+				}
+			}
+			const double areaTime = timer.getTime();
+
+			// Expected counts, the pdf integrated over the bins with the directions which hit the sphere.
+			double mass = 0.0;
+			for (int i = 0; i < thetaBins; ++i)
+			{
+				for (int j = 0; j < phiBins; ++j)
+				{
+					double integral = 0.0;
+					for (int si = 0; si < subdivisions; ++si)
+					{
+						for (int sj = 0; sj < subdivisions; ++sj)
+						{
+							const double x   = (i + (si + 0.5) / subdivisions) * binWidth; // 1 - cos(theta)
+							const double phi = (j + (sj + 0.5) / subdivisions) / phiBins * 2.0 * M_PI - M_PI;
+							const double sinTheta = sqrt(x * (2.0 - x));
+							const double cosPhi = cos(phi);
+							const double sinPhi = sin(phi);
+
+							double w[3];
+							for (int k = 0; k < 3; ++k)
+							{
+								w[k] = a[k] * (1.0 - x) + (t[k] * cosPhi + b[k] * sinPhi) * sinTheta;
+							}
+							const double along = w[0] * cx + w[1] * cy + w[2] * cz;
+							if (0.0 < along && dc * dc - r2 <= along * along)
+							{
+								integral += pdf;
+							}
+						}
+					}
+					const double cell = binWidth * (2.0 * M_PI / phiBins) / (subdivisions * subdivisions);
+					expected[i * phiBins + j] = integral * cell * numSamples;
+					mass += integral * cell;
+				}
+			}
+
+			double statistic;
+			int    dof;
+			const double pValue = chiSquareTest(observed, expected, statistic, dof);
+
+			const double coneMean     = coneSum / numSamples;
+			const double coneVariance = coneSquares / numSamples - coneMean * coneMean;
+			const double areaMean     = areaSum / numSamples;
+			const double areaVariance = areaSquares / numSamples - areaMean * areaMean;
+
+			char line[256];
+			snprintf(line, sizeof(line), "  %8.2f  %7.3f°  %10.2f  %3d  %7.4f  %.4f  %12.2e  %14.2e  %+6.3f%%  %18.1fx  %7.1f  %7.1f", distances[d], thetaMax * 180.0 / M_PI, statistic, dof,
+			         pValue, mass, maxRadiusError, maxDistanceError, (coneMean - irradiance) / irradiance * 100.0, areaVariance / std::max(coneVariance, 1.0e-30),
+			         coneTime / numSamples * 1.0e9, areaTime / numSamples * 1.0e9);
+			std::cout << line << std::endl;
+
+			// The distribution is the claimed pdf, the pdf integrates to 1 and the points are the first hits on the sphere.
+			if (!pdfMatches || pValue < significance / numDistances || 1.0e-3 < fabs(mass - 1.0) || 1.0e-4 < maxRadiusError || 1.0e-3 < maxDistanceError)
+			{
+				++failures;
+			}
+			// Unbiased irradiance with less variance than area sampling.
+			if (4.0 * sqrt(coneVariance / numSamples) + 1.0e-5 * irradiance < fabs(coneMean - irradiance) || areaVariance <= coneVariance)
+			{
+				++failures;
+			}
+		}
+
+		// Next event estimation plus BRDF sampling with MIS against the tessellated light geometry of the HostScene, at a white
+		// diffuse point below the sphere. The sampled directions hitting the mesh tell how well it matches the analytic sphere.
+		const int   numLightingSamples = 1 << 16;
+		const float sceneEpsilon       = 500.0f * 1.0e-7f;
+		const float lightDistances[]   = { 1.5f, 4.0f };
+
+		std::cout << "  direct lighting with MIS on the light geometry:" << std::endl;
+		std::cout << "  distance  estimate  closed form  error      mesh hits" << std::endl;
+
+		Material diffuse;
+		diffuse.albedo    = optix::make_float3(1.0f);
+		diffuse.metallic  = 0.0f;
+		diffuse.roughness = 1.0f;
+
+		for (float distance : lightDistances)
+		{
+			Scene scene;
+			Light* sphere = new Light(light);
+			sphere->position = optix::make_float3(0.0f, distance, 0.0f);
+			scene.mLightList.push_back(sphere);
+
+			HostScene hostScene;
+			hostScene.build(scene);
+			const LightSelector selector(LIGHT_SELECTION_UNIFORM, hostScene.getLightTree(), hostScene.getLightAliasTable(), hostScene.getEnvironment());
+
+			State state;
+			state.hit_position    = optix::make_float3(0.0f);
+			state.geometry_normal = optix::make_float3(0.0f, 1.0f, 0.0f);
+			state.shading_normal  = state.geometry_normal;
+
+			unsigned int seed = 7u;
+			double sum = 0.0;
+			double squares = 0.0;
+			for (int i = 0; i < numLightingSamples; ++i)
+			{
+				const double value = sampleDirectLightingEstimate(hostScene, &selector, diffuse, state, state.geometry_normal, sceneEpsilon, seed);
+				sum     += value;
+				squares += value * value;
+			}
+			const double mean   = sum / numLightingSamples;
+			const double sigma  = sqrt(std::max(0.0, squares / numLightingSamples - mean * mean) / numLightingSamples);
+			const double radius = double(light.radius) / distance;
+			const double exact  = radius * radius; // albedo / pi * pi L sin^2(thetaMax)
+
+			int meshHits = 0;
+			for (int i = 0; i < numLightingSamples; ++i)
+			{
+				LightSample sample;
+				sampleSphereLight(*sphere, state.hit_position, optix::make_float2(uniform(generator), uniform(generator)), sample);
+
+				TriangleHit hit;
+				if (hostScene.intersect(state.hit_position, sample.direction, sceneEpsilon, RT_DEFAULT_MAX, hit) && hostScene.getLightIndex(hit.primitive) == 0)
+				{
+					++meshHits;
+				}
+			}
+			const double meshShare = double(meshHits) / numLightingSamples;
+
+			char line[256];
+			snprintf(line, sizeof(line), "  %8.2f  %8.5f  %11.5f  %+6.3f%%  %8.2f%%", distance, mean, exact, (mean - exact) / exact * 100.0, meshShare * 100.0);
+			std::cout << line << std::endl;
+
+			// The light geometry is a polyhedron inside the sphere, the share of the solid angle it misses biases the BRDF samples.
+			if (4.0 * sigma + (1.0 - meshShare) * exact < fabs(mean - exact) || meshShare < 0.98)
+			{
+				++failures;
+			}
+		}
+		std::cout << "}" << std::endl;
+
+		return (failures == 0) ? 0 : 1;
+	}
+
+	// Solid angle of the triangle (a, b, c) relative to the viewer, see "The Solid Angle of a Plane Triangle" by Van Oosterom and Strackee.
+	static double triangleSolidAngle(const double* a, const double* b, const double* c)
+	{
+		const double la = sqrt(a[0] * a[0] + a[1] * a[1] + a[2] * a[2]);
+		const double lb = sqrt(b[0] * b[0] + b[1] * b[1] + b[2] * b[2]);
+		const double lc = sqrt(c[0] * c[0] + c[1] * c[1] + c[2] * c[2]);
+
+		const double triple = a[0] * (b[1] * c[2] - b[2] * c[1]) + a[1] * (b[2] * c[0] - b[0] * c[2]) + a[2] * (b[0] * c[1] - b[1] * c[0]);
+		const double ab = a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+		const double ac = a[0] * c[0] + a[1] * c[1] + a[2] * c[2];
+		const double bc = b[0] * c[0] + b[1] * c[1] + b[2] * c[2];
+
+		return 2.0 * fabs(atan2(triple, la * lb * lc + ab * lc + ac * lb + bc * la));
+	}
+
+	// Solid angle of the part [s0, s1] x [t0, t1] of the quad light seen from origin, in double.
+	static double quadSolidAngle(Light const& light, const optix::float3& origin, const double s0, const double s1, const double t0, const double t1)
+	{
+		double corners[4][3];
+		const double s[4] = { s0, s1, s1, s0 };
+		const double t[4] = { t0, t0, t1, t1 };
+		for (int i = 0; i < 4; ++i)
+		{
+			corners[i][0] = double(light.position.x) - origin.x + s[i] * light.u.x + t[i] * light.v.x;
+			corners[i][1] = double(light.position.y) - origin.y + s[i] * light.u.y + t[i] * light.v.y;
+			corners[i][2] = double(light.position.z) - origin.z + s[i] * light.u.z + t[i] * light.v.z;
+		}
+		return triangleSolidAngle(corners[0], corners[1], corners[2]) + triangleSolidAngle(corners[0], corners[2], corners[3]);
+	}
+
+	// Spherical rectangle vs. area sampling of quad lights. The sampler is checked with a chi-square test of the hit points in 8x8
+	// cells of the light against their solid angles from points just below to far away from the TestScene light, then both
+	// estimate the direct lighting at the surfaces seen by the camera, in the TestScene and with a large light just above the sphere.
+	int benchmarkQuadLight()
+	{
+		const int   numSamples       = 1 << 18;
+		const int   cells            = 8;
+		const int   width            = 80;
+		const int   height           = 45;
+		const int   referenceSamples = 2048;
+		const int   samplesPerPoint  = 16;
+		const float sceneEpsilon     = 500.0f * 1.0e-7f;
+
+		// Same as createBenchmarkScene().
+		Light light = Light();
+		light.lightType = QUAD;
+		light.position  = optix::make_float3(0.0f, 4.0f, 0.0f);
+		light.u         = optix::make_float3(1.0f, 0.0f, 0.0f);
+		light.v         = optix::make_float3(0.0f, 0.0f, 1.0f);
+		light.area      = optix::length(optix::cross(light.u, light.v));
+		light.normal    = optix::normalize(optix::cross(light.u, light.v));
+		light.emission  = optix::make_float3(50.0f);
+
+		const optix::float3 origins[] =
+		{
+			optix::make_float3(0.4f, 3.98f, 0.7f),  // Just below.
+			optix::make_float3(0.1f, 3.7f, 0.3f),
+			optix::make_float3(0.5f, 0.0f, 0.5f),   // Floor below the light.
+			optix::make_float3(-3.0f, 3.9f, 2.0f),  // Grazing.
+			optix::make_float3(-8.0f, 0.0f, -6.0f),
+			optix::make_float3(0.5f, -60.0f, 0.5f)  // Below QUAD_LIGHT_MIN_SOLID_ANGLE, sampled by area.
+		};
+		const int numOrigins = int(sizeof(origins) / sizeof(origins[0]));
+
+		std::mt19937 generator(42u);
+		std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+		int failures = 0;
+
+		std::cout << "quadlight: " << numSamples << " samples per point, " << cells << "x" << cells << " cells, " << samplesPerPoint
+		          << " samples per shading point, reference " << referenceSamples << " samples per point" << std::endl;
+		std::cout << "{" << std::endl;
+		std::cout << "  solid angle  sampling     chi-square  dof  p-value  solid angle error  max pdf error  max plane error  ns/sample" << std::endl;
+
+		for (const optix::float3& origin : origins)
+		{
+			SphericalRectangle rect;
+			const bool   spherical  = initSphericalRectangle(light, origin, QUAD_LIGHT_MIN_SOLID_ANGLE, rect);
+			const double solidAngle = quadSolidAngle(light, origin, 0.0, 1.0, 0.0, 1.0);
+
+			std::vector<double> observed(cells * cells, 0.0);
+			std::vector<double> expected(cells * cells, 0.0);
+			double maxPdfError   = 0.0;
+			double maxPlaneError = 0.0;
+
+			Timer timer;
+			timer.start();
+			for (int i = 0; i < numSamples; ++i)
+			{
+				LightSample sample;
+				sampleQuadLight(light, origin, optix::make_float2(uniform(generator), uniform(generator)), QUAD_LIGHT_MIN_SOLID_ANGLE, sample);
+
+				// The pdf of the direction as the MIS weight of a hit sees it.
+				const float cosTheta = optix::dot(-sample.direction, light.normal);
+				const float pdf      = quadLightPdf(light, origin, sample.distance, cosTheta, QUAD_LIGHT_MIN_SOLID_ANGLE);
+				maxPdfError = std::max(maxPdfError, fabs(double(pdf) - sample.pdf) / pdf);
+
+				// Coordinates of the point on the light.
+				const optix::float3 p = sample.surfacePos - light.position;
+				const double s = optix::dot(p, light.u) / optix::dot(light.u, light.u);
+				const double t = optix::dot(p, light.v) / optix::dot(light.v, light.v);
+				maxPlaneError = std::max(maxPlaneError, fabs(double(optix::dot(p, light.normal))));
+				maxPlaneError = std::max(maxPlaneError, std::max(std::max(-s, s - 1.0), std::max(-t, t - 1.0)));
+
+				const int cs = std::min(cells - 1, std::max(0, int(s * cells)));
+				const int ct = std::min(cells - 1, std::max(0, int(t * cells)));
+				observed[ct * cells + cs] += 1.0;
+			}
+			const double time = timer.getTime();
+
+			for (int ct = 0; ct < cells; ++ct)
+			{
+				for (int cs = 0; cs < cells; ++cs)
+				{
+					const double share = spherical ? quadSolidAngle(light, origin, double(cs) / cells, double(cs + 1) / cells, double(ct) / cells, double(ct + 1) / cells) / solidAngle
+					                               : 1.0 / (cells * cells);
+					expected[ct * cells + cs] = share * numSamples;
+				}
+			}
+
+			double statistic;
+			int    dof;
+			const double pValue = chiSquareTest(observed, expected, statistic, dof);
+			const double solidAngleError = spherical ? (rect.solidAngle - solidAngle) / solidAngle : 0.0;
+
+			char line[256];
+			snprintf(line, sizeof(line), "  %11.6f  %-9s  %10.2f  %3d  %7.4f  %+17.2e  %13.2e  %15.2e  %9.1f", solidAngle, spherical ? "spherical" : "area",
+			         statistic, dof, pValue, solidAngleError, maxPdfError, maxPlaneError, time / numSamples * 1.0e9);
+			std::cout << line << std::endl;
+
+			// Uniform in the solid angle or the area, the exact pdf of the MIS weights and points on the light. The solid angle
+			// is the sum of four angles minus 2 pi, in float it loses about 1e-7 * 2 pi of the few 1e-3 of the small ones.
+			if (pValue < 0.01 / numOrigins || 1.0e-3 < maxPdfError || 1.0e-4 < maxPlaneError || (spherical && 1.0e-3 < fabs(solidAngleError)))
+			{
+				++failures;
+			}
+		}
+
+		// The TestScene without its directional light, which points up through the floor and lights nothing, and a 6x6 light half
+		// a unit above the top of the sphere.
+		Material diffuse;
+		diffuse.albedo    = optix::make_float3(0.8f);
+		diffuse.metallic  = 0.0f;
+		diffuse.roughness = 1.0f;
+
+		for (int configuration = 0; configuration < 2; ++configuration)
+		{
+			Scene scene;
+			createBenchmarkScene(scene);
+			delete scene.mLightList[0];
+			scene.mLightList.erase(scene.mLightList.begin());
+
+			if (configuration == 1)
+			{
+				Light* large = scene.mLightList[0];
+				large->position = optix::make_float3(-3.0f, 4.5f, -6.0f);
+				large->u        = optix::make_float3(6.0f, 0.0f, 0.0f);
+				large->v        = optix::make_float3(0.0f, 0.0f, 6.0f);
+				large->area     = optix::length(optix::cross(large->u, large->v));
+				large->emission = optix::make_float3(50.0f / large->area);
+			}
+
+			HostScene hostScene;
+			hostScene.build(scene);
+			const LightSelector selector(LIGHT_SELECTION_UNIFORM, hostScene.getLightTree(), hostScene.getLightAliasTable(), hostScene.getEnvironment());
+
+			std::vector<State>         points;
+			std::vector<optix::float3> directions;
+			getShadingPoints(hostScene, width, height, sceneEpsilon, points, directions);
+
+			// Half of the reference from each sampling.
+			std::vector<double> reference(points.size());
+			double referenceMean = 0.0;
+			for (size_t i = 0; i < points.size(); ++i)
+			{
+				unsigned int seed = tea<8>(unsigned(i), 1u);
+
+				double sum = 0.0;
+				for (int sample = 0; sample < referenceSamples; ++sample)
+				{
+					sum += sampleQuadLightEstimate(hostScene, diffuse, points[i], -directions[i], (sample & 1) ? FLT_MAX : QUAD_LIGHT_MIN_SOLID_ANGLE, sceneEpsilon, seed);
+				}
+				reference[i] = sum / referenceSamples;
+				referenceMean += reference[i];
+			}
+			referenceMean /= double(points.size());
+
+			char line[256];
+			snprintf(line, sizeof(line), "  %s: %d shading points, reference mean %.4f", (configuration == 0) ? "TestScene" : "6x6 light above the sphere", int(points.size()), referenceMean);
+			std::cout << line << std::endl;
+			std::cout << "    sampling    us/sample        RMSE      mean  RMSE at equal time  speedup" << std::endl;
+
+			// The renderer samples the same way as the spherical rectangle estimate.
+			const char*  names[3]         = { "area", "spherical", "renderer" };
+			const float  minSolidAngles[] = { FLT_MAX, QUAD_LIGHT_MIN_SOLID_ANGLE, QUAD_LIGHT_MIN_SOLID_ANGLE };
+			double baseTime = 0.0;
+			double baseRmse = 0.0;
+			for (int method = 0; method < 3; ++method)
+			{
+				double squaredError = 0.0;
+				double mean         = 0.0;
+				double sumSquares   = 0.0;
+
+				Timer timer;
+				timer.start();
+				for (size_t i = 0; i < points.size(); ++i)
+				{
+					unsigned int seed = tea<8>(unsigned(i), 2u + method);
+
+					double sum = 0.0;
+					for (int sample = 0; sample < samplesPerPoint; ++sample)
+					{
+						const double value = (method < 2) ? sampleQuadLightEstimate(hostScene, diffuse, points[i], -directions[i], minSolidAngles[method], sceneEpsilon, seed)
+						                                  : sampleDirectLightingEstimate(hostScene, &selector, diffuse, points[i], -directions[i], sceneEpsilon, seed);
+						sum        += value;
+						sumSquares += value * value;
+					}
+					const double estimate = sum / samplesPerPoint;
+					squaredError += (estimate - reference[i]) * (estimate - reference[i]);
+					mean         += sum;
+				}
+				const double time  = timer.getTime();
+				const double total = double(points.size()) * samplesPerPoint;
+				const double rmse  = sqrt(squaredError / double(points.size()));
+				mean /= total;
+
+				// All converge to the same direct lighting.
+				const double standardError = sqrt(std::max(0.0, sumSquares / total - mean * mean) / total);
+				if (4.0 * standardError + 1.0e-3 * referenceMean < fabs(mean - referenceMean))
+				{
+					++failures;
+				}
+
+				if (method == 0)
+				{
+					baseTime = time;
+					baseRmse = rmse;
+				}
+
+				// Less noise than the area sampling in the same time.
+				const double equalTimeRmse = rmse * sqrt(time / baseTime);
+				if (method == 1 && baseRmse <= equalTimeRmse)
+				{
+					++failures;
+				}
+
+				snprintf(line, sizeof(line), "    %9s  %10.3f  %10.5f  %8.4f  %18.5f  %6.2fx", names[method], time / total * 1.0e6, rmse, mean, equalTimeRmse,
+				         (baseRmse * baseRmse) / (equalTimeRmse * equalTimeRmse));
+				std::cout << line << std::endl;
+			}
+		}
+
+		std::cout << "}" << std::endl;
+
+		return (failures == 0) ? 0 : 1;
+	}
+
+	// ReSTIR DI on the 256 quad lights of the lighttree benchmark, error of single frames at 1 spp against a converged image of
+	// DirectLighting(). The first frame resamples the candidates and the neighbours, the later ones the previous frames too.
+	// The accumulation averages the frames, so frame k is recovered as (k + 1) * output_k - k * output_k-1.
+	// The floor is the only surface which reflects, with one glossy lobe. The lobe selection between diffuse and glossy is
+	// noise no light sampling can remove, and the light the paths bring back from other surfaces would be the same in all
+	// modes. The paths have two segments, the continuation rays of the primary hits find the lights which DirectLighting()
+	// weights with MIS. The errors are taken in the interior pixels of the objects, the means over the whole image.
+	int benchmarkRestir()
+	{
+		const int   width            = 160;
+		const int   height           = 90;
+		const float distance         = 20.0f;
+		const int   numLights        = 256;
+		const int   referenceSamples = 1024;
+		const int   numFrames        = 16;
+		const int   convergedFrames  = 128;
+
+		Scene scene;
+		scene.build();
+
+		addManyLights(scene, numLights, 1234u);
+
+		// Black sphere and torus, the occluders.
+		for (Material* mat : scene.mMaterialList)
+		{
+			mat->albedo    = optix::make_float3(0.0f);
+			mat->metallic  = 1.0f;
+			mat->roughness = 1.0f;
+		}
+		scene.mMaterialList[2]->albedo    = optix::make_float3(0.8f);
+		scene.mMaterialList[2]->roughness = 0.5f;
+
+		HostScene hostScene;
+		hostScene.build(scene);
+
+		const std::vector<char> interior = getInteriorPixels(hostScene, width, height, distance);
+
+		HostRenderer renderer(hostScene);
+		setCamera(renderer, getBenchmarkCamera(width, height, distance));
+		renderer.setPathLengths(2, 2);
+		renderer.setLightSelection(LIGHT_SELECTION_TREE);
+
+		// Halton reference, so the Sobol samples of the measured runs are not part of it.
+		renderer.setSampler(SAMPLER_HALTON);
+		renderSamples(renderer, referenceSamples);
+		const std::vector<optix::float4> reference = renderer.getOutputBuffer();
+		renderer.setSampler(SAMPLER_SOBOL);
+
+		const double referenceMean = meanLuminance(reference);
+
+		std::cout << "restir: " << width << "x" << height << ", " << hostScene.getLights().size() << " lights, " << RESTIR_CANDIDATES << " candidates, "
+		          << RESTIR_SPATIAL_NEIGHBORS << " neighbours in " << RESTIR_SPATIAL_RADIUS * width << " pixels, reference " << referenceSamples << " samples per pixel" << std::endl;
+		std::cout << "{" << std::endl;
+		std::cout << "  mode      ms/frame  RMSE frame 1  RMSE frame " << numFrames << "  efficiency  mean of " << convergedFrames << " frames  reference" << std::endl;
+
+		const ERestir modes[] = { RESTIR_OFF, RESTIR_BIASED, RESTIR_UNBIASED };
+		const char* names[] = { "off", "biased", "unbiased" };
+
+		int failures = 0;
+
+		double baseCost  = 0.0;
+		double baseError = 0.0;
+
+		for (ERestir mode : modes)
+		{
+			renderer.setRestir(mode);
+
+			std::vector<optix::float4> previous(reference.size(), optix::make_float4(0.0f));
+			std::vector<optix::float4> frame(reference.size());
+
+			Timer  timer;
+			double time       = 0.0;
+			double firstError = 0.0;
+			double lastError  = 0.0;
+			for (int k = 0; k < numFrames; ++k)
+			{
+				timer.restart();
+				renderer.render();
+				time += timer.getTime();
+
+				std::vector<optix::float4> const& output = renderer.getOutputBuffer();
+				for (size_t i = 0; i < output.size(); ++i)
+				{
+					frame[i] = float(k + 1) * output[i] - float(k) * previous[i];
+				}
+				previous = output;
+
+				lastError = imageError(frame, reference, interior);
+				if (k == 0)
+				{
+					firstError = lastError;
+				}
+			}
+			time /= numFrames;
+
+			for (int k = numFrames; k < convergedFrames; ++k)
+			{
+				renderer.render();
+			}
+			const double mean = meanLuminance(renderer.getOutputBuffer());
+
+			// Squared error times time per frame, lower is better. Efficiency is relative to DirectLighting().
+			const double cost = lastError * lastError * time;
+			if (mode == RESTIR_OFF)
+			{
+				baseCost  = cost;
+				baseError = lastError;
+			}
+			else if (baseError <= lastError)
+			{
+				++failures;
+			}
+
+			if (mode != RESTIR_BIASED && 0.02 * referenceMean < fabs(mean - referenceMean))
+			{
+				++failures;
+			}
+
+			char line[256];
+			snprintf(line, sizeof(line), "  %-8s  %8.2f  %12.5f  %13.5f  %9.2fx  %17.5f  %9.5f", names[mode], time * 1000.0, firstError, lastError, baseCost / cost, mean, referenceMean);
+			std::cout << line << std::endl;
+		}
+		renderer.setRestir(RESTIR_OFF);
+
+		std::cout << "}" << std::endl;
+
+		return (failures == 0) ? 0 : 1;
+	}
+}
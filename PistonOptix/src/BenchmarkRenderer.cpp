@@ -0,0 +1,649 @@
+#include "inc/BenchmarkCommon.h"
+#include "inc/HostRenderer.h"
+#include "inc/TileScheduler.h"
+#include "inc/WavefrontRenderer.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace POptix
+{
+	// Progressive host rendering with static scanline strips vs. Hilbert ordered tiles with work stealing.
+	int benchmarkTiles()
+	{
+		const int width         = 640;
+		const int height        = 360;
+		const int numIterations = 8;
+
+		Scene scene;
+		createBenchmarkScene(scene);
+
+		HostScene hostScene;
+		hostScene.build(scene);
+
+		HostRenderer renderer(hostScene);
+		setCamera(renderer, getBenchmarkCamera(width, height));
+
+		TileScheduler& scheduler = renderer.getScheduler();
+
+		struct Configuration
+		{
+			const char* name;
+			ETileOrder  order;
+			bool        workStealing;
+			int         tileSize;
+		};
+
+		const Configuration configurations[] =
+		{
+			{ "scanline static",   TILE_ORDER_SCANLINE, false, 32 },
+			{ "hilbert static",    TILE_ORDER_HILBERT,  false, 32 },
+			{ "hilbert stealing",  TILE_ORDER_HILBERT,  true,  16 },
+			{ "hilbert stealing",  TILE_ORDER_HILBERT,  true,  32 },
+			{ "hilbert stealing",  TILE_ORDER_HILBERT,  true,  64 },
+		};
+
+		std::cout << "tiles: " << hostScene.getNumTriangles() << " triangles, " << width << "x" << height << ", " << numIterations << " iterations, " << scheduler.getNumThreads() << " threads" << std::endl;
+
+		std::vector<optix::float4> reference;
+		int failures = 0;
+
+		for (const Configuration& configuration : configurations)
+		{
+			scheduler.setTileOrder(configuration.order);
+			scheduler.setWorkStealing(configuration.workStealing);
+			scheduler.setTileSize(configuration.tileSize);
+			renderer.restartAccumulation();
+
+			std::cout << configuration.name << ", tile size " << configuration.tileSize << std::endl;
+			std::cout << "{" << std::endl;
+
+			double totalTime = 0.0;
+			for (int iteration = 0; iteration < numIterations; ++iteration)
+			{
+				renderer.render();
+
+				TilePassStats const& stats = renderer.getPassStats();
+				totalTime += stats.passTime;
+
+				char line[256];
+				snprintf(line, sizeof(line), "  iteration %d: %7.2f ms, utilization %5.1f%%, tail latency %6.2f ms, threads", iteration, stats.passTime * 1000.0, stats.utilization * 100.0, stats.tailLatency * 1000.0);
+				std::cout << line;
+				for (TileThreadStats const& thread : stats.threads)
+				{
+					snprintf(line, sizeof(line), " %3.0f%%", (0.0 < stats.passTime) ? thread.busyTime / stats.passTime * 100.0 : 100.0);
+					std::cout << line;
+					if (0 < thread.steals)
+					{
+						std::cout << "(" << thread.steals << ")";
+					}
+				}
+				std::cout << std::endl;
+			}
+
+			// Every pixel has its own random sequence, the scheduling must not change the image.
+			if (reference.empty())
+			{
+				reference = renderer.getOutputBuffer();
+			}
+			else if (!identicalImages(reference, renderer.getOutputBuffer()))
+			{
+				std::cout << "  image differs from the first configuration" << std::endl;
+				++failures;
+			}
+
+			std::cout << "  average " << totalTime / numIterations * 1000.0 << " ms, " << double(width) * height * numIterations / totalTime * 1.0e-6 << " Mpaths/s" << std::endl;
+			std::cout << "}" << std::endl;
+		}
+
+		return (failures == 0) ? 0 : 1;
+	}
+
+	// Megakernel HostRenderer vs. WavefrontRenderer for maximum path lengths 1 to 8.
+	int benchmarkWavefront()
+	{
+		const int width         = 640;
+		const int height        = 360;
+		const int numIterations = 4;
+
+		Scene scene;
+		createBenchmarkScene(scene);
+
+		HostScene hostScene;
+		hostScene.build(scene);
+
+		HostRenderer megakernel(hostScene);
+		setCamera(megakernel, getBenchmarkCamera(width, height));
+
+		WavefrontRenderer wavefront(hostScene);
+		setCamera(wavefront, getBenchmarkCamera(width, height));
+
+		std::cout << "wavefront: " << hostScene.getNumTriangles() << " triangles, " << width << "x" << height << ", " << numIterations << " iterations, " << wavefront.getScheduler().getNumThreads() << " threads" << std::endl;
+		std::cout << "depth  megakernel ms  wavefront ms  speedup  wavefront Mrays/s  extend  shade  connect  compact  other  image" << std::endl;
+
+		int failures = 0;
+		Timer timer;
+
+		for (int depth = 1; depth <= 8; ++depth)
+		{
+			megakernel.setPathLengths(2, depth);
+			wavefront.setPathLengths(2, depth);
+
+			timer.restart();
+			for (int iteration = 0; iteration < numIterations; ++iteration)
+			{
+				megakernel.render();
+			}
+			const double timeMegakernel = timer.getTime();
+
+			WavefrontStats total = WavefrontStats();
+			timer.restart();
+			for (int iteration = 0; iteration < numIterations; ++iteration)
+			{
+				wavefront.render();
+
+				WavefrontStats const& stats = wavefront.getStats();
+				total.generate      += stats.generate;
+				total.extend        += stats.extend;
+				total.shade         += stats.shade;
+				total.connect       += stats.connect;
+				total.compact       += stats.compact;
+				total.accumulate    += stats.accumulate;
+				total.extensionRays += stats.extensionRays;
+				total.shadowRays    += stats.shadowRays;
+			}
+			const double timeWavefront = timer.getTime();
+
+			// Same random numbers per path, the images must match exactly.
+			const bool identical = identicalImages(megakernel.getOutputBuffer(), wavefront.getOutputBuffer());
+			failures += identical ? 0 : 1;
+
+			const double rays = double(total.extensionRays + total.shadowRays);
+
+			char line[256];
+			snprintf(line, sizeof(line), "%5d  %13.2f  %12.2f  %6.2fx  %17.2f  %5.1f%%  %4.1f%%  %6.1f%%  %6.1f%%  %4.1f%%  %s", depth,
+			         timeMegakernel / numIterations * 1000.0, timeWavefront / numIterations * 1000.0, timeMegakernel / timeWavefront, rays / timeWavefront * 1.0e-6,
+			         total.extend / timeWavefront * 100.0, total.shade / timeWavefront * 100.0, total.connect / timeWavefront * 100.0, total.compact / timeWavefront * 100.0,
+			         (total.generate + total.accumulate) / timeWavefront * 100.0, identical ? "identical" : "DIFFERENT");
+			std::cout << line << std::endl;
+		}
+
+		WavefrontStats const& stats = wavefront.getStats();
+		std::cout << "active paths per depth:";
+		for (int active : stats.activePaths)
+		{
+			std::cout << " " << active;
+		}
+		std::cout << std::endl;
+
+		return (failures == 0) ? 0 : 1;
+	}
+
+	// Wavefront rendering with and without reordering the rays by direction octant and origin Morton code between the bounces.
+	int benchmarkRaySort()
+	{
+		const int width         = 640;
+		const int height        = 360;
+		const int numIterations = 4;
+		const int maxDepth      = 8;
+
+		int failures = 0;
+
+		for (int dense = 0; dense < 2; ++dense)
+		{
+			Scene scene;
+			createBenchmarkScene(scene);
+			if (dense)
+			{
+				addDenseGeometry(scene, 8, 160);
+			}
+
+			HostScene hostScene;
+			hostScene.build(scene);
+
+			WavefrontRenderer renderer(hostScene);
+			setCamera(renderer, getBenchmarkCamera(width, height));
+			renderer.setPathLengths(2, maxDepth);
+
+			std::vector<double> traceTimes[2];
+			std::vector<double> sortTimes(maxDepth, 0.0);
+			std::vector<int>    activePaths(maxDepth, 0);
+			double frameTimes[2] = { 0.0, 0.0 };
+			std::vector<optix::float4> images[2];
+
+			for (int sorting = 0; sorting < 2; ++sorting)
+			{
+				renderer.setRaySorting(sorting != 0);
+				renderer.restartAccumulation();
+				traceTimes[sorting].assign(maxDepth, 0.0);
+
+				for (int iteration = 0; iteration < numIterations; ++iteration)
+				{
+					renderer.render();
+
+					WavefrontStats const& stats = renderer.getStats();
+					for (size_t depth = 0; depth < stats.traceTimes.size(); ++depth)
+					{
+						traceTimes[sorting][depth] += stats.traceTimes[depth];
+						if (sorting)
+						{
+							sortTimes[depth] += stats.sortTimes[depth];
+						}
+						activePaths[depth] = stats.activePaths[depth];
+					}
+					frameTimes[sorting] += stats.generate + stats.extend + stats.shade + stats.connect + stats.compact + stats.accumulate + stats.sort;
+				}
+				images[sorting] = renderer.getOutputBuffer();
+			}
+
+			const bool identical = identicalImages(images[0], images[1]);
+			failures += identical ? 0 : 1;
+
+			std::cout << "raysort: " << hostScene.getNumTriangles() << " triangles, " << width << "x" << height << ", " << numIterations << " iterations, " << renderer.getScheduler().getNumThreads() << " threads" << std::endl;
+			std::cout << "{" << std::endl;
+			std::cout << "  depth  active paths  trace ms  sorted trace ms  sort ms  net gain ms" << std::endl;
+			for (int depth = 0; depth < maxDepth; ++depth)
+			{
+				const double unsorted = traceTimes[0][depth] / numIterations * 1000.0;
+				const double sorted   = traceTimes[1][depth] / numIterations * 1000.0;
+				const double sort     = sortTimes[depth] / numIterations * 1000.0;
+
+				char line[256];
+				snprintf(line, sizeof(line), "  %5d  %12d  %8.2f  %15.2f  %7.2f  %11.2f%s", depth, activePaths[depth], unsorted, sorted, sort, unsorted - sorted - sort,
+				         (0 < depth && unsorted - sorted - sort > 0.0) ? "  pays off" : "");
+				std::cout << line << std::endl;
+			}
+			std::cout << "  frame " << frameTimes[0] / numIterations * 1000.0 << " ms unsorted, " << frameTimes[1] / numIterations * 1000.0 << " ms sorted, image " << (identical ? "identical" : "DIFFERENT") << std::endl;
+			std::cout << "}" << std::endl;
+		}
+
+		return (failures == 0) ? 0 : 1;
+	}
+
+	// Host path tracer with a shared scene vs. workers pinned per node with node local scene replicas. Only a machine with more
+	// than one node measures the locality, e.g. "numactl --cpunodebind=0,1 --membind=0,1 PistonOptix --benchmark numa" on a two
+	// socket system. With a single node the topology is simulated, which checks the image but says nothing about the speed.
+	int benchmarkNuma()
+	{
+		const int width         = 640;
+		const int height        = 360;
+		const int numIterations = 8;
+
+		Scene scene;
+		createBenchmarkScene(scene);
+		addDenseGeometry(scene, 8, 160);
+
+		HostScene hostScene;
+		hostScene.build(scene);
+
+		// Without a second node the NUMA paths still run, they just can't win anything.
+		NumaTopology topology = NumaTopology::detect();
+		if (topology.getNumNodes() < 2)
+		{
+			topology = NumaTopology::simulate(2);
+		}
+
+		std::cout << "numa: " << hostScene.getNumTriangles() << " triangles, " << width << "x" << height << ", " << numIterations << " iterations, "
+		          << topology.getNumNodes() << (topology.isSimulated() ? " simulated" : "") << " nodes, " << topology.getNumCpus() << " cpus" << std::endl;
+		std::cout << "{" << std::endl;
+		if (topology.isSimulated())
+		{
+			std::cout << "  single node machine: the timings below do not show any NUMA effect, the gain of the numa mode is unproven" << std::endl;
+		}
+
+		std::vector<optix::float4> reference;
+		std::vector<optix::float4> slicedReference;
+		int failures = 0;
+
+		// Shared, numa, then numa twice with two samples per pass, whose slices of a tile can land on different nodes.
+		for (int run = 0; run < 4; ++run)
+		{
+			const bool numa           = (0 < run);
+			const int  samplesPerPass = (2 <= run) ? 2 : 1;
+
+			Timer timer;
+			timer.start();
+			HostRenderer renderer(hostScene, topology.getNumCpus(), numa ? &topology : nullptr);
+			setCamera(renderer, getBenchmarkCamera(width, height));
+			renderer.setSamplesPerPass(samplesPerPass);
+			const double setupTime = timer.getTime();
+
+			double totalTime   = 0.0;
+			double resolveTime = 0.0;
+			for (int iteration = 0; iteration < numIterations / samplesPerPass; ++iteration)
+			{
+				renderer.render();
+				totalTime   += renderer.getPassStats().passTime;
+				resolveTime += renderer.getResolveTime();
+			}
+
+			char line[256];
+			snprintf(line, sizeof(line), "  %-6s %d spp  setup %8.2f ms, sample %7.2f ms, %6.2f Mpaths/s, resolve %6.2f ms",
+			         numa ? "numa" : "shared", samplesPerPass, setupTime * 1000.0, totalTime / numIterations * 1000.0, double(width) * height * numIterations / totalTime * 1.0e-6,
+			         resolveTime * samplesPerPass / numIterations * 1000.0);
+			std::cout << line;
+
+			std::vector<optix::float4> const& image = renderer.getOutputBuffer();
+			if (reference.empty())
+			{
+				reference = image;
+			}
+			else if (samplesPerPass == 1)
+			{
+				// Every sample of a pixel lands on the home node of its tile, the other nodes add zero.
+				if (!identicalImages(reference, image))
+				{
+					std::cout << ", image differs";
+					++failures;
+				}
+			}
+			else
+			{
+				// The node sums are added in another order than the shared sums, but the same on every run.
+				if (slicedReference.empty())
+				{
+					slicedReference = image;
+				}
+				else if (!identicalImages(slicedReference, image))
+				{
+					std::cout << ", not deterministic";
+					++failures;
+				}
+
+				float maxDifference = 0.0f;
+				for (size_t i = 0; i < image.size(); ++i)
+				{
+					const optix::float3 a = optix::make_float3(reference[i]);
+					const optix::float3 b = optix::make_float3(image[i]);
+					maxDifference = std::max(maxDifference, optix::length(a - b) / std::max(optix::length(a), 1.0e-3f));
+				}
+				std::cout << ", vs. shared " << maxDifference;
+				if (!(maxDifference < 1.0e-5f))
+				{
+					++failures;
+				}
+			}
+			std::cout << std::endl;
+		}
+
+		std::cout << "}" << std::endl;
+
+		return (failures == 0) ? 0 : 1;
+	}
+
+	// Host path tracer with the Accumulator over thread counts, tile sizes and samples per pass, all images must be identical.
+	int benchmarkAccumulation()
+	{
+		const int width      = 640;
+		const int height     = 360;
+		const int numSamples = 8;
+
+		Scene scene;
+		createBenchmarkScene(scene);
+
+		HostScene hostScene;
+		hostScene.build(scene);
+
+		const int hardwareThreads = std::max(1, int(std::thread::hardware_concurrency()));
+
+		struct Configuration
+		{
+			int threads;
+			int tileSize;
+			int samplesPerPass;
+		};
+
+		const Configuration configurations[] =
+		{
+			{ 1,                   32, 1 },
+			{ 2,                   32, 1 },
+			{ 4,                   32, 1 },
+			{ hardwareThreads,     16, 1 },
+			{ hardwareThreads,     64, 1 },
+			{ hardwareThreads,     32, 2 },
+			{ hardwareThreads,     32, 8 },
+			{ 2 * hardwareThreads, 64, 4 },
+		};
+
+		std::cout << "accumulation: " << hostScene.getNumTriangles() << " triangles, " << width << "x" << height << ", " << numSamples << " samples per pixel" << std::endl;
+		std::cout << "{" << std::endl;
+		std::cout << "  threads  tile  samples/pass    ms/sample  resolve ms/sample  steals  image" << std::endl;
+
+		std::vector<optix::float4> reference;
+		int failures = 0;
+
+		for (const Configuration& configuration : configurations)
+		{
+			HostRenderer renderer(hostScene, configuration.threads);
+			setCamera(renderer, getBenchmarkCamera(width, height));
+			renderer.getScheduler().setTileSize(configuration.tileSize);
+			renderer.setSamplesPerPass(configuration.samplesPerPass);
+
+			double totalTime   = 0.0;
+			double resolveTime = 0.0;
+			int    steals      = 0;
+			for (int pass = 0; pass < numSamples / configuration.samplesPerPass; ++pass)
+			{
+				renderer.render();
+
+				TilePassStats const& stats = renderer.getPassStats();
+				totalTime   += stats.passTime + renderer.getResolveTime();
+				resolveTime += renderer.getResolveTime();
+				for (TileThreadStats const& thread : stats.threads)
+				{
+					steals += thread.steals;
+				}
+			}
+
+			bool identical = true;
+			if (reference.empty())
+			{
+				reference = renderer.getOutputBuffer();
+			}
+			else
+			{
+				identical = identicalImages(reference, renderer.getOutputBuffer());
+			}
+			if (!identical)
+			{
+				++failures;
+			}
+
+			char line[256];
+			snprintf(line, sizeof(line), "  %7d  %4d  %12d  %11.2f  %17.3f  %6d  %s", configuration.threads, configuration.tileSize, configuration.samplesPerPass,
+			         totalTime / numSamples * 1000.0, resolveTime / numSamples * 1000.0, steals, identical ? "identical" : "DIFFERS");
+			std::cout << line << std::endl;
+		}
+
+		std::cout << "}" << std::endl;
+
+		return (failures == 0) ? 0 : 1;
+	}
+
+	// Wavefront path tracer without and with Russian Roulette after 0 to 4 segments. Each configuration renders the same number
+	// of samples, its error against a converged image without roulette gives the time it needs for the noise level without roulette.
+	int benchmarkRoulette()
+	{
+		const int width            = 320;
+		const int height           = 180;
+		const int maxPathLength    = 8;
+		const int numSamples       = 32;
+		const int referenceSamples = 256;
+
+		Scene scene;
+		createBenchmarkScene(scene);
+
+		HostScene hostScene;
+		hostScene.build(scene);
+
+		WavefrontRenderer renderer(hostScene);
+		setCamera(renderer, getBenchmarkCamera(width, height, 12.0f));
+
+		std::cout << "roulette: " << hostScene.getNumTriangles() << " triangles, " << width << "x" << height << ", max path length " << maxPathLength << ", "
+		          << numSamples << " samples vs. " << referenceSamples << " reference samples, " << renderer.getScheduler().getNumThreads() << " threads" << std::endl;
+
+		renderer.setPathLengths(maxPathLength, maxPathLength);
+		renderSamples(renderer, referenceSamples);
+		const std::vector<optix::float4> reference = renderer.getOutputBuffer();
+
+		std::cout << "{" << std::endl;
+		std::cout << "  min length  path length  Mrays/s  ms/sample      rmse  mean vs. off  time to equal noise" << std::endl;
+
+		const int minPathLengths[] = { maxPathLength, 0, 1, 2, 3, 4 };
+
+		double baseTime  = 0.0;
+		double baseError = 0.0;
+		double baseMean  = 0.0;
+		int failures = 0;
+
+		for (int minPathLength : minPathLengths)
+		{
+			renderer.setPathLengths(minPathLength, maxPathLength);
+
+			long long rays = 0;
+			long long extensionRays = 0;
+			Timer timer;
+			timer.start();
+			for (int sample = 0; sample < numSamples; ++sample)
+			{
+				renderer.render();
+				rays          += renderer.getStats().extensionRays + renderer.getStats().shadowRays;
+				extensionRays += renderer.getStats().extensionRays;
+			}
+			const double time = timer.getTime();
+
+			const double rmse = imageError(renderer.getOutputBuffer(), reference);
+			const double mean = meanLuminance(renderer.getOutputBuffer());
+
+			if (minPathLength == maxPathLength)
+			{
+				baseTime  = time;
+				baseError = rmse;
+				baseMean  = mean;
+			}
+
+			// The variance falls with 1 / samples, so equal noise needs (rmse / baseError)^2 times the samples.
+			const double equalNoiseTime = time * (rmse * rmse) / (baseError * baseError);
+
+			// Roulette must not move the mean. The runs share the random sequences up to the first roulette decision,
+			// so their means are much closer than the noise of numSamples samples.
+			const double bias = mean / baseMean - 1.0;
+			if (0.02 < fabs(bias))
+			{
+				++failures;
+			}
+
+			char line[256];
+			snprintf(line, sizeof(line), "  %10s  %11.2f  %7.2f  %9.2f  %8.5f  %+10.3f%%  %8.2f ms (%5.2fx)",
+			         (minPathLength == maxPathLength) ? "off" : std::to_string(minPathLength).c_str(),
+			         double(extensionRays) / (double(width) * height * numSamples), double(rays) / time * 1.0e-6, time / numSamples * 1000.0,
+			         rmse, bias * 100.0, equalNoiseTime / numSamples * 1000.0, baseTime / equalNoiseTime);
+			std::cout << line << std::endl;
+		}
+
+		std::cout << "}" << std::endl;
+
+		return (failures == 0) ? 0 : 1;
+	}
+
+	// Adaptive sampling against uniform sampling at equal quality. The adaptive run stops when all blocks reached the target error,
+	// its relative error against a converged image is the quality the uniform run has to reach, one sample per pixel after the other.
+	// Both render with the HostRenderer and Sobol, the times include the convergence decisions and exclude the error measurements.
+	int benchmarkAdaptive()
+	{
+		const int width            = 128;
+		const int height           = 72;
+		const int referenceSamples = 1024;
+		const int maxSamples       = 1024;
+		const int maxPathLength    = 3;
+		const int warmup           = 16;
+		const float targets[]      = { 0.2f, 0.1f };
+		const int numTargets       = int(sizeof(targets) / sizeof(targets[0]));
+
+		Scene scene;
+		createSunScene(scene);
+
+		HostScene hostScene;
+		hostScene.build(scene);
+
+		// Halton reference, so the Sobol samples of the measured runs are not part of it.
+		WavefrontRenderer referenceRenderer(hostScene);
+		setCamera(referenceRenderer, getBenchmarkCamera(width, height, 12.0f));
+		referenceRenderer.setPathLengths(2, maxPathLength);
+		referenceRenderer.setSampler(SAMPLER_HALTON);
+		renderSamples(referenceRenderer, referenceSamples);
+		std::vector<optix::float4> const& reference = referenceRenderer.getOutputBuffer();
+
+		const double referenceMean = meanLuminance(reference);
+
+		HostRenderer renderer(hostScene);
+		setCamera(renderer, getBenchmarkCamera(width, height, 12.0f));
+		renderer.setPathLengths(2, maxPathLength);
+		renderer.getAdaptiveSampling().setWarmup(warmup);
+
+		std::cout << "adaptive: " << width << "x" << height << ", " << ADAPTIVE_BLOCK_SIZE << "x" << ADAPTIVE_BLOCK_SIZE << " blocks, warm-up " << warmup
+		          << " samples per pixel, reference " << referenceSamples << " samples per pixel" << std::endl;
+		std::cout << "{" << std::endl;
+		std::cout << "  target  estimated  adaptive error  adaptive spp  adaptive s  uniform spp  uniform s  sample savings  time savings" << std::endl;
+
+		int failures = 0;
+
+		for (int t = 0; t < numTargets; ++t)
+		{
+			Timer timer;
+
+			AdaptiveSampling& adaptive = renderer.getAdaptiveSampling();
+			adaptive.setTargetError(targets[t]);
+			renderer.setAdaptive(true);
+
+			timer.restart();
+			while (!renderer.isConverged() && renderer.getIterationIndex() < maxSamples)
+			{
+				renderer.render();
+			}
+			const double adaptiveTime = timer.getTime();
+
+			const bool   converged      = adaptive.isConverged();
+			const double estimatedError = adaptive.getError();
+			const double adaptiveSpp    = double(adaptive.getNumSamples()) / (double(width) * height);
+
+			const double adaptiveError = relativeError(renderer.getOutputBuffer(), reference);
+			const double adaptiveMean  = meanLuminance(renderer.getOutputBuffer());
+
+			renderer.setAdaptive(false);
+
+			double uniformTime  = 0.0;
+			double uniformError = DBL_MAX;
+			while (adaptiveError < uniformError && renderer.getIterationIndex() < maxSamples)
+			{
+				timer.restart();
+				renderer.render();
+				uniformTime += timer.getTime();
+
+				uniformError = relativeError(renderer.getOutputBuffer(), reference);
+			}
+			const int uniformSpp = renderer.getIterationIndex();
+
+			char line[256];
+			snprintf(line, sizeof(line), "  %6.3f  %9.4f  %14.5f  %12.1f  %10.3f  %10d%s  %9.3f  %13.2fx  %11.2fx", targets[t], estimatedError, adaptiveError, adaptiveSpp, adaptiveTime,
+			         uniformSpp, (uniformError <= adaptiveError) ? " " : "+", uniformTime, uniformSpp / adaptiveSpp, uniformTime / adaptiveTime);
+			std::cout << line << std::endl;
+
+			// Converged, unbiased and fewer samples than uniform sampling for the same error. The time savings are smaller, the
+			// blocks which stay active are the objects with the longer paths.
+			if (!converged || 0.01 * referenceMean < fabs(adaptiveMean - referenceMean) || uniformSpp <= adaptiveSpp)
+			{
+				++failures;
+			}
+		}
+		std::cout << "  errors relative to the luminance, + uniform stopped at the limit of " << maxSamples << " samples per pixel" << std::endl;
+		std::cout << "}" << std::endl;
+
+		return (failures == 0) ? 0 : 1;
+	}
+}
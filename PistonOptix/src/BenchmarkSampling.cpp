@@ -0,0 +1,821 @@
+#include "inc/BenchmarkCommon.h"
+#include "inc/BlueNoiseTile.h"
+#include "inc/HostRenderer.h"
+#include "inc/WavefrontRenderer.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace POptix
+{
+	// Convergence of the LCG, Sobol, Halton and blue noise samplers on the TestScene, RMS error over the samples per pixel against a
+	// converged image. The first samples of a sequence are part of a reference rendered with the same sampler, which would hide
+	// their error, so each sampler is measured against the reference of another one.
+	int benchmarkSampler()
+	{
+		const int width            = 96;
+		const int height           = 54;
+		const int maxSamples       = 256;
+		const int referenceSamples = 2048;
+		const int maxPathLength    = 3;
+
+		Scene scene;
+		createSunScene(scene);
+
+		HostScene hostScene;
+		hostScene.build(scene);
+
+		WavefrontRenderer renderer(hostScene);
+		setCamera(renderer, getBenchmarkCamera(width, height, 12.0f));
+		renderer.setPathLengths(2, maxPathLength);
+
+		int failures = 0;
+
+		// Megakernel and wavefront read the same sample dimensions.
+		HostRenderer hostRenderer(hostScene);
+		setCamera(hostRenderer, getBenchmarkCamera(width, height, 12.0f));
+		hostRenderer.setPathLengths(2, maxPathLength);
+
+		bool identical = true;
+		for (int sampler = 0; sampler < NUM_OF_SAMPLERS; ++sampler)
+		{
+			renderer.setSampler(ESampler(sampler));
+			hostRenderer.setSampler(ESampler(sampler));
+			for (int sample = 0; sample < 2; ++sample)
+			{
+				renderer.render();
+				hostRenderer.render();
+			}
+			identical = identical && identicalImages(hostRenderer.getOutputBuffer(), renderer.getOutputBuffer());
+		}
+		if (!identical)
+		{
+			++failures;
+		}
+
+		Timer timer;
+
+		// Sobol and Halton references. The LCG, Halton and blue noise are measured against Sobol, Sobol against Halton.
+		std::vector<optix::float4> references[NUM_OF_SAMPLERS];
+		double referenceTime = 0.0;
+		for (int sampler = SAMPLER_SOBOL; sampler <= SAMPLER_HALTON; ++sampler)
+		{
+			renderer.setSampler(ESampler(sampler));
+			referenceTime += renderSamples(renderer, referenceSamples);
+			references[sampler] = renderer.getOutputBuffer();
+		}
+		references[SAMPLER_LCG] = references[SAMPLER_SOBOL];
+
+		const double referenceDifference = imageError(references[SAMPLER_HALTON], references[SAMPLER_SOBOL]);
+		const double referenceMean       = meanLuminance(references[SAMPLER_HALTON]);
+
+		const ESampler referenceOf[NUM_OF_SAMPLERS] = { SAMPLER_SOBOL, SAMPLER_HALTON, SAMPLER_SOBOL, SAMPLER_SOBOL };
+
+		std::cout << "sampler: " << width << "x" << height << ", up to " << maxSamples << " samples per pixel, references " << referenceSamples
+		          << " samples per pixel in " << referenceTime << " s" << std::endl;
+		std::cout << "{" << std::endl;
+		std::cout << "  megakernel and wavefront images " << (identical ? "identical" : "DIFFER") << ", Sobol vs. Halton reference RMSE " << referenceDifference
+		          << ", mean " << referenceMean << std::endl;
+
+		// RMSE at 1, 2, 4, ... samples per pixel.
+		std::vector<int> counts;
+		for (int count = 1; count <= maxSamples; count *= 2)
+		{
+			counts.push_back(count);
+		}
+
+		std::vector<double> rmse[NUM_OF_SAMPLERS];
+		double msPerSample[NUM_OF_SAMPLERS];
+		double slope[NUM_OF_SAMPLERS];
+
+		for (int sampler = 0; sampler < NUM_OF_SAMPLERS; ++sampler)
+		{
+			renderer.setSampler(ESampler(sampler));
+
+			double time = 0.0;
+			int    next = 0;
+			for (int sample = 1; sample <= maxSamples; ++sample)
+			{
+				timer.restart();
+				renderer.render();
+				time += timer.getTime();
+
+				if (sample == counts[next])
+				{
+					rmse[sampler].push_back(imageError(renderer.getOutputBuffer(), references[referenceOf[sampler]]));
+					++next;
+				}
+			}
+			msPerSample[sampler] = time / maxSamples * 1000.0;
+
+			const double mean = meanLuminance(renderer.getOutputBuffer());
+
+			// All samplers converge to the same image.
+			if (0.01 * referenceMean < fabs(mean - referenceMean))
+			{
+				++failures;
+			}
+
+			// Convergence rate, least squares slope of log(RMSE) over log(samples) from 4 samples on.
+			double sx = 0.0, sy = 0.0, sxx = 0.0, sxy = 0.0;
+			int n = 0;
+			for (size_t i = 2; i < counts.size(); ++i, ++n)
+			{
+				const double x = log(double(counts[i]));
+				const double y = log(rmse[sampler][i]);
+				sx  += x;
+				sy  += y;
+				sxx += x * x;
+				sxy += x * y;
+			}
+			slope[sampler] = (n * sxy - sx * sy) / (n * sxx - sx * sx);
+		}
+
+		std::cout << "  samples    LCG RMSE  Sobol RMSE  Halton RMSE  Blue noise RMSE  Sobol gain" << std::endl;
+		for (size_t i = 0; i < counts.size(); ++i)
+		{
+			char line[256];
+			snprintf(line, sizeof(line), "  %7d  %10.5f  %10.5f  %11.5f  %15.5f  %9.2fx", counts[i], rmse[SAMPLER_LCG][i], rmse[SAMPLER_SOBOL][i], rmse[SAMPLER_HALTON][i],
+			         rmse[SAMPLER_BLUE_NOISE][i], (rmse[SAMPLER_LCG][i] * rmse[SAMPLER_LCG][i]) / (rmse[SAMPLER_SOBOL][i] * rmse[SAMPLER_SOBOL][i]));
+			std::cout << line << std::endl;
+		}
+
+		char line[256];
+		snprintf(line, sizeof(line), "  slope    %10.3f  %10.3f  %11.3f  %15.3f", slope[SAMPLER_LCG], slope[SAMPLER_SOBOL], slope[SAMPLER_HALTON], slope[SAMPLER_BLUE_NOISE]);
+		std::cout << line << std::endl;
+		snprintf(line, sizeof(line), "  ms/spp   %10.2f  %10.2f  %11.2f  %15.2f", msPerSample[SAMPLER_LCG], msPerSample[SAMPLER_SOBOL], msPerSample[SAMPLER_HALTON], msPerSample[SAMPLER_BLUE_NOISE]);
+		std::cout << line << std::endl;
+		std::cout << "}" << std::endl;
+
+		// The stratified samplers must not be noisier than the LCG once there are enough samples to stratify.
+		if (rmse[SAMPLER_LCG].back() < rmse[SAMPLER_SOBOL].back() || rmse[SAMPLER_LCG].back() < rmse[SAMPLER_HALTON].back())
+		{
+			++failures;
+		}
+
+		return (failures == 0) ? 0 : 1;
+	}
+
+	// RMS of the error after a Gaussian blur with a standard deviation of one pixel, a simple model of the low-pass filter of
+	// the eye at a normal viewing distance. Error at high frequencies, blue noise, is mostly filtered away.
+	static double perceptualError(std::vector<double> const& error, const int width, const int height)
+	{
+		const int   radius = 3;
+		double weights[2 * radius + 1];
+		double sum = 0.0;
+		for (int i = -radius; i <= radius; ++i)
+		{
+			weights[i + radius] = exp(-0.5 * double(i * i));
+			sum += weights[i + radius];
+		}
+
+		// Separable, clamped to the edges.
+		std::vector<double> rows(error.size());
+		for (int y = 0; y < height; ++y)
+		{
+			for (int x = 0; x < width; ++x)
+			{
+				double value = 0.0;
+				for (int i = -radius; i <= radius; ++i)
+				{
+					value += weights[i + radius] * error[y * width + std::min(std::max(x + i, 0), width - 1)];
+				}
+				rows[y * width + x] = value / sum;
+			}
+		}
+
+		double squaredError = 0.0;
+		for (int y = 0; y < height; ++y)
+		{
+			for (int x = 0; x < width; ++x)
+			{
+				double value = 0.0;
+				for (int i = -radius; i <= radius; ++i)
+				{
+					value += weights[i + radius] * rows[std::min(std::max(y + i, 0), height - 1) * width + x];
+				}
+				value /= sum;
+				squaredError += value * value;
+			}
+		}
+		return sqrt(squaredError / double(error.size()));
+	}
+
+	// Share of the error power at frequencies below cutoff, in cycles per pixel. Separable discrete Fourier transform.
+	static double lowFrequencyShare(std::vector<double> const& error, const int width, const int height, const double cutoff)
+	{
+		std::vector<double> rowsRe(error.size());
+		std::vector<double> rowsIm(error.size());
+		for (int y = 0; y < height; ++y)
+		{
+			for (int kx = 0; kx < width; ++kx)
+			{
+				double re = 0.0;
+				double im = 0.0;
+				for (int x = 0; x < width; ++x)
+				{
+					const double angle = -2.0 * M_PI * double(kx * x) / double(width);
+					re += error[y * width + x] * cos(angle);
+					im += error[y * width + x] * sin(angle);
+				}
+				rowsRe[y * width + kx] = re;
+				rowsIm[y * width + kx] = im;
+			}
+		}
+
+		double low   = 0.0;
+		double total = 0.0;
+		for (int kx = 0; kx < width; ++kx)
+		{
+			for (int ky = 0; ky < height; ++ky)
+			{
+				double re = 0.0;
+				double im = 0.0;
+				for (int y = 0; y < height; ++y)
+				{
+					const double angle = -2.0 * M_PI * double(ky * y) / double(height);
+					const double c = cos(angle);
+					const double s = sin(angle);
+					re += rowsRe[y * width + kx] * c - rowsIm[y * width + kx] * s;
+					im += rowsRe[y * width + kx] * s + rowsIm[y * width + kx] * c;
+				}
+
+				const double fx = double(std::min(kx, width - kx)) / double(width);
+				const double fy = double(std::min(ky, height - ky)) / double(height);
+				const double power = re * re + im * im;
+
+				total += power;
+				if (fx * fx + fy * fy < cutoff * cutoff)
+				{
+					low += power;
+				}
+			}
+		}
+		return (0.0 < total) ? low / total : 0.0;
+	}
+
+	// Screen space distribution of the error at 1, 4 and 16 samples per pixel. Next to the RMSE the perceptual error, the RMSE
+	// of the blurred error, and the share of the error power below a quarter cycle per pixel, pi / 16 or 20% for white noise.
+	// The blue noise sampler spreads the error of the first sample and of every later iteration on its own, the accumulated
+	// iterations converge like Sobol.
+	int benchmarkBlueNoise()
+	{
+		const int width            = 128;
+		const int height           = 72;
+		const int referenceSamples = 1024;
+		const int maxPathLength    = 3;
+		const int unbiasedSamples  = 256;
+		const double cutoff        = 0.25;
+
+		Scene scene;
+		createSunScene(scene);
+
+		HostScene hostScene;
+		hostScene.build(scene);
+
+		WavefrontRenderer renderer(hostScene);
+		setCamera(renderer, getBenchmarkCamera(width, height, 12.0f));
+		renderer.setPathLengths(2, maxPathLength);
+
+		// Sobol reference, Sobol itself is measured against the Halton one.
+		std::vector<optix::float4> references[2];
+		const ESampler referenceSamplers[2] = { SAMPLER_SOBOL, SAMPLER_HALTON };
+		for (int i = 0; i < 2; ++i)
+		{
+			renderer.setSampler(referenceSamplers[i]);
+			renderSamples(renderer, referenceSamples);
+			references[i] = renderer.getOutputBuffer();
+		}
+
+		const double referenceMean = meanLuminance(references[0]);
+
+		const char* names[NUM_OF_SAMPLERS] = { "LCG", "Sobol", "Halton", "blue noise" };
+		const int   counts[] = { 1, 4, 16 };
+		const int   numCounts = int(sizeof(counts) / sizeof(counts[0]));
+
+		double rmse[NUM_OF_SAMPLERS][numCounts];
+		double perceptual[NUM_OF_SAMPLERS][numCounts];
+		double lowShare[NUM_OF_SAMPLERS][numCounts];
+		double frameLowShare[NUM_OF_SAMPLERS]; // Of the single iterations 2 to 16, each on its own.
+		double mean[NUM_OF_SAMPLERS];
+
+		for (int sampler = 0; sampler < NUM_OF_SAMPLERS; ++sampler)
+		{
+			std::vector<optix::float4> const& reference = references[(sampler == SAMPLER_SOBOL) ? 1 : 0];
+
+			renderer.setSampler(ESampler(sampler));
+
+			std::vector<optix::float4> previous;
+			frameLowShare[sampler] = 0.0;
+
+			int next = 0;
+			for (int sample = 1; sample <= unbiasedSamples; ++sample)
+			{
+				renderer.render();
+
+				std::vector<optix::float4> const& output = renderer.getOutputBuffer();
+				if (2 <= sample && sample <= counts[numCounts - 1])
+				{
+					// The iteration alone out of the running averages.
+					std::vector<optix::float4> frame(output.size());
+					for (size_t i = 0; i < output.size(); ++i)
+					{
+						frame[i] = float(sample) * output[i] - float(sample - 1) * previous[i];
+					}
+					frameLowShare[sampler] += lowFrequencyShare(errorImage(frame, reference), width, height, cutoff) / double(counts[numCounts - 1] - 1);
+				}
+				previous = output;
+
+				if (next < numCounts && sample == counts[next])
+				{
+					const std::vector<double> error = errorImage(renderer.getOutputBuffer(), reference);
+
+					rmse[sampler][next]       = imageError(renderer.getOutputBuffer(), reference);
+					perceptual[sampler][next] = perceptualError(error, width, height);
+					lowShare[sampler][next]   = lowFrequencyShare(error, width, height, cutoff);
+					++next;
+				}
+			}
+			mean[sampler] = meanLuminance(renderer.getOutputBuffer());
+		}
+
+		std::cout << "bluenoise: " << width << "x" << height << ", references " << referenceSamples << " samples per pixel, "
+		          << (BlueNoiseTile::isBlueNoise() ? "blue noise tile loaded" : "NO blue noise tile, white noise ranks") << std::endl;
+		std::cout << "{" << std::endl;
+		std::cout << "  samples  sampler           RMSE  perceptual  low frequency  perceptual gain" << std::endl;
+
+		for (int i = 0; i < numCounts; ++i)
+		{
+			for (int sampler = 0; sampler < NUM_OF_SAMPLERS; ++sampler)
+			{
+				char line[256];
+				snprintf(line, sizeof(line), "  %7d  %-10s  %10.5f  %10.5f  %12.1f%%  %14.2fx", counts[i], names[sampler], rmse[sampler][i], perceptual[sampler][i],
+				         lowShare[sampler][i] * 100.0, (perceptual[SAMPLER_LCG][i] * perceptual[SAMPLER_LCG][i]) / (perceptual[sampler][i] * perceptual[sampler][i]));
+				std::cout << line << std::endl;
+			}
+		}
+
+		char line[256];
+		snprintf(line, sizeof(line), "  low frequency of the single iterations 2 to %d: LCG %.1f%%, Sobol %.1f%%, Halton %.1f%%, blue noise %.1f%%", counts[numCounts - 1],
+		         frameLowShare[SAMPLER_LCG] * 100.0, frameLowShare[SAMPLER_SOBOL] * 100.0, frameLowShare[SAMPLER_HALTON] * 100.0, frameLowShare[SAMPLER_BLUE_NOISE] * 100.0);
+		std::cout << line << std::endl;
+		snprintf(line, sizeof(line), "  mean at %d samples per pixel: reference %.5f, LCG %.5f, Sobol %.5f, Halton %.5f, blue noise %.5f", unbiasedSamples, referenceMean,
+		         mean[SAMPLER_LCG], mean[SAMPLER_SOBOL], mean[SAMPLER_HALTON], mean[SAMPLER_BLUE_NOISE]);
+		std::cout << line << std::endl;
+		std::cout << "}" << std::endl;
+
+		int failures = 0;
+
+		// Blue noise has the lowest perceptual error at one sample per pixel and moves the error to high frequencies, in every iteration.
+		if (perceptual[SAMPLER_LCG][0] <= perceptual[SAMPLER_BLUE_NOISE][0] || perceptual[SAMPLER_SOBOL][0] <= perceptual[SAMPLER_BLUE_NOISE][0] ||
+		    lowShare[SAMPLER_LCG][0] <= 2.0 * lowShare[SAMPLER_BLUE_NOISE][0] || frameLowShare[SAMPLER_LCG] <= 2.0 * frameLowShare[SAMPLER_BLUE_NOISE])
+		{
+			++failures;
+		}
+
+		// Without giving up the stratification of Sobol at more samples.
+		for (int i = 1; i < numCounts; ++i)
+		{
+			if (1.1 * perceptual[SAMPLER_SOBOL][i] < perceptual[SAMPLER_BLUE_NOISE][i])
+			{
+				++failures;
+			}
+		}
+
+		// And converges to the same image.
+		if (0.01 * referenceMean < fabs(mean[SAMPLER_BLUE_NOISE] - referenceMean))
+		{
+			++failures;
+		}
+
+		return (failures == 0) ? 0 : 1;
+	}
+
+	// Chi-square test of the directions of microfacetReflectionSample() against microfacetReflectionPdf() for a range of roughnesses
+	// and incident angles. The bins are rings around the mirror direction, spaced by 1 - cos(theta) / (1 - cos(theta) + c) with c
+	// about the width of the lobe, so the narrow lobes of the smooth surfaces are resolved as well as the wide ones.
+	int benchmarkMicrofacet()
+	{
+		const int    numSamples   = 1 << 20;
+		const int    ringBins     = 16;
+		const int    phiBins      = 16;
+		const int    gridSize     = 2048; // Of the integration over the half vectors.
+		const double significance = 0.01;
+		const float  roughnesses[] = { 0.1f, 0.3f, 0.6f, 1.0f };
+		const float  angles[]      = { 0.2f, 0.9f, 1.4f }; // Of wo to the normal.
+		const int    numTests      = int(sizeof(roughnesses) / sizeof(roughnesses[0]) * sizeof(angles) / sizeof(angles[0]));
+
+		std::mt19937 generator(42u);
+
+		State state;
+		state.hit_position    = optix::make_float3(0.0f);
+		state.geometry_normal = optix::make_float3(0.0f, 0.0f, 1.0f);
+		state.shading_normal  = state.geometry_normal;
+
+		Material mat;
+		mat.albedo   = optix::make_float3(0.8f);
+		mat.metallic = 1.0f;
+
+		int failures = 0;
+
+		std::cout << "microfacet: " << numSamples << " samples per test, " << ringBins << "x" << phiBins << " bins, significance " << significance << " over "
+		          << numTests << " tests" << std::endl;
+		std::cout << "{" << std::endl;
+		std::cout << "  roughness  theta_o  chi-square  dof  p-value  mass    below the surface" << std::endl;
+
+		for (float roughness : roughnesses)
+		{
+			mat.roughness = roughness;
+
+			const double alpha = pow(std::max(0.001, double(roughness)), 2.0);
+			const double c     = std::max(4.0 * alpha * alpha, 1.0e-4);
+			const double qMax  = 2.0 / (2.0 + c); // 1 - cos(theta) = 2, the opposite of the mirror direction.
+
+			for (float angle : angles)
+			{
+				const optix::float3 wo = optix::make_float3(sinf(angle), 0.0f, cosf(angle));
+
+				// Test frame around the mirror direction.
+				const double a[3] = { -sin(double(angle)), 0.0, cos(double(angle)) };
+				const double t[3] = { a[2], 0.0, -a[0] };
+				const double b[3] = { 0.0, 1.0, 0.0 };
+
+				auto binOf = [&](const double* w)
+				{
+					const double length = sqrt(w[0] * w[0] + w[1] * w[1] + w[2] * w[2]);
+					const double x   = 1.0 - (w[0] * a[0] + w[1] * a[1] + w[2] * a[2]) / length;
+					const double q   = x / (x + c);
+					const double phi = atan2(w[0] * b[0] + w[1] * b[1] + w[2] * b[2], w[0] * t[0] + w[1] * t[1] + w[2] * t[2]) + M_PI;
+
+					const int ringBin = std::min(ringBins - 1, int(std::max(0.0, q) / qMax * ringBins));
+					const int phiBin  = std::min(phiBins - 1, int(phi / (2.0 * M_PI) * phiBins));
+					return ringBin * phiBins + phiBin;
+				};
+
+				std::vector<double> observed(ringBins * phiBins, 0.0);
+				std::vector<double> expected(ringBins * phiBins, 0.0);
+
+				int below = 0;
+				for (int i = 0; i < numSamples; ++i)
+				{
+					PerRayData prd;
+					prd.sampler   = SAMPLER_LCG;
+					prd.seed      = generator();
+					prd.dimension = 0;
+					microfacetReflectionSample(mat, state, wo, prd);
+
+					const double w[3] = { prd.wi.x, prd.wi.y, prd.wi.z };
+					observed[binOf(w)] += 1.0;
+
+					below += (prd.wi.z <= 0.0f) ? 1 : 0;
+				}
+
+				// Expected counts, the pdf integrated over the bins. The integral is taken over the half vectors on a fine grid, where
+				// the Jacobian 4 |wo.h| of the reflection cancels the singularity of the density at wi = -wo. The grid is spaced like the
+				// bins, d(solid angle) = dx dphi with dx = ch / (1 - q)^2 dq.
+				const double ch    = std::max(alpha * alpha, 1.0e-4);
+				const double qMaxH = 1.0 / (1.0 + ch); // The half vectors are on the upper hemisphere.
+				const double cell  = (qMaxH / gridSize) * (2.0 * M_PI / gridSize);
+
+				// Trowbridge-Reitz distribution of the half vectors.
+				auto D = [alpha](double cosTheta)
+				{
+					const double tan2Theta = (1.0 - cosTheta * cosTheta) / (cosTheta * cosTheta);
+					const double e = 1.0 + tan2Theta / (alpha * alpha);
+					return 1.0 / (M_PI * alpha * alpha * pow(cosTheta, 4.0) * e * e);
+				};
+
+				double mass = 0.0;
+				for (int i = 0; i < gridSize; ++i)
+				{
+					const double q   = (i + 0.5) / gridSize * qMaxH;
+					const double x   = ch * q / (1.0 - q);
+					const double sinTheta = sqrt(std::max(0.0, x * (2.0 - x)));
+					const double jacobian = ch / ((1.0 - q) * (1.0 - q));
+
+					for (int j = 0; j < gridSize; ++j)
+					{
+						const double phi = (j + 0.5) / gridSize * 2.0 * M_PI;
+						const double h[3] = { sinTheta * cos(phi), sinTheta * sin(phi), 1.0 - x };
+						const double woh  = h[0] * wo.x + h[1] * wo.y + h[2] * wo.z;
+						const double w[3] = { 2.0 * woh * h[0] - wo.x, 2.0 * woh * h[1] - wo.y, 2.0 * woh * h[2] - wo.z };
+
+						// Next to wi = -wo the direction in float no longer determines the half vector, there the density of the half
+						// vectors is taken directly. The band is far narrower than a bin.
+						double density = D(1.0 - x) * (1.0 - x);
+						if (1.0e-3 < fabs(woh))
+						{
+							PerRayData prd;
+							prd.wi = optix::make_float3(float(w[0]), float(w[1]), float(w[2]));
+							microfacetReflectionPdf(mat, state, wo, prd);
+							density = double(prd.pdf) * 4.0 * fabs(woh);
+						}
+
+						const double weight = density * jacobian * cell;
+						expected[binOf(w)] += weight * numSamples;
+						mass += weight;
+					}
+				}
+
+				double statistic;
+				int    dof;
+				const double pValue = chiSquareTest(observed, expected, statistic, dof);
+
+				char line[256];
+				snprintf(line, sizeof(line), "  %9.2f  %6.2f   %10.2f  %3d  %7.4f  %.4f  %6.2f%%", roughness, angle, statistic, dof, pValue, mass, 100.0 * below / numSamples);
+				std::cout << line << std::endl;
+
+				// The distribution is the claimed pdf, which integrates to 1 over the sphere.
+				if (pValue < significance / numTests || !(fabs(mass - 1.0) <= 2.0e-3))
+				{
+					++failures;
+				}
+			}
+		}
+		std::cout << "}" << std::endl;
+
+		return (failures == 0) ? 0 : 1;
+	}
+
+	// D-tree sampling against its pdf, then path tracing vs. path guiding in the GuidingScene, two rooms lit through a door by
+	// a lamp facing away from it. Both at equal render time against a converged guided image of another sampler, the time of
+	// the SD-tree updates included. Guiding has to win at the last budget.
+	int benchmarkGuiding()
+	{
+		int failures = 0;
+
+		std::cout << "guiding:" << std::endl;
+		std::cout << "{" << std::endl;
+
+		// A D-tree learned from a lobe around +x over a constant, every leaf has records. E[1 / pdf] is the area of the sphere,
+		// E[[z > 0] / pdf] the one of the upper hemisphere.
+		{
+			std::mt19937 generator(1234u);
+			std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+			DTree building;
+			DTree sampling;
+			for (int iteration = 0; iteration < 4; ++iteration)
+			{
+				for (int record = 0; record < 100000; ++record)
+				{
+					float pdf;
+					const optix::float3 direction = sampling.sample(optix::make_float2(uniform(generator), uniform(generator)), pdf);
+					const float value = 1.0f + 100.0f * powf(std::max(0.0f, direction.x), 8.0f);
+					building.record(direction, value / pdf);
+				}
+				building.build();
+				sampling = building;
+				building.reset(sampling, 20, 0.01f);
+			}
+
+			const int numSamples = 1 << 20;
+
+			double sphere     = 0.0;
+			double hemisphere = 0.0;
+			double squares    = 0.0;
+			int    zeroPdfs   = 0;
+			int    mismatches = 0; // Of the pdf of the descent in sample() and pdf() of the direction, which can round into the
+			                       // neighbour of a node for directions on its border.
+			for (int i = 0; i < numSamples; ++i)
+			{
+				float pdf;
+				const optix::float3 direction = sampling.sample(optix::make_float2(uniform(generator), uniform(generator)), pdf);
+				if (1e-3f * pdf < fabsf(pdf - sampling.pdf(direction)))
+				{
+					++mismatches;
+				}
+				if (pdf <= 0.0f)
+				{
+					++zeroPdfs;
+					continue;
+				}
+				sphere     += 1.0 / pdf;
+				hemisphere += (0.0f < direction.z) ? 1.0 / pdf : 0.0;
+				squares    += 1.0 / (double(pdf) * pdf);
+			}
+			sphere     /= numSamples;
+			hemisphere /= numSamples;
+
+			const double standardError = sqrt(std::max(0.0, squares / numSamples - sphere * sphere) / numSamples);
+			if (zeroPdfs != 0 || numSamples < 10000 * mismatches || 4.0 * standardError < fabs(sphere - 4.0 * M_PI) || 4.0 * standardError < fabs(hemisphere - 2.0 * M_PI))
+			{
+				++failures;
+			}
+
+			char line[256];
+			snprintf(line, sizeof(line), "  D-tree: %d nodes, depth %d, E[1/pdf] %.4f (4 pi %.4f), upper hemisphere %.4f (2 pi %.4f), standard error %.4f, %d zero pdfs, %d pdf mismatches",
+			         sampling.getNumNodes(), sampling.getDepth(), sphere, 4.0 * M_PI, hemisphere, 2.0 * M_PI, standardError, zeroPdfs, mismatches);
+			std::cout << line << std::endl;
+		}
+
+		std::unique_ptr<Scene> scene = loadGuidingScene();
+		if (!scene)
+		{
+			std::cout << "}" << std::endl;
+			return (failures == 0) ? 0 : 1;
+		}
+
+		const int    width            = 64;
+		const int    height           = 36;
+		const int    referenceSamples = 4096;
+		const int    maxPathLength    = 6;
+		const double budgets[]        = { 1.0, 2.0, 4.0, 8.0 }; // Seconds.
+		const int    numBudgets       = int(sizeof(budgets) / sizeof(budgets[0]));
+
+		HostScene hostScene;
+		hostScene.build(*scene);
+
+		HostRenderer renderer(hostScene);
+		setCamera(renderer, getGuidingSceneCamera(width, height));
+		renderer.setPathLengths(3, maxPathLength);
+
+		// The default threshold is meant for images of a megapixel, this one has 2304 pixels.
+		renderer.getGuidingTree().setSpatialThreshold(300);
+
+		renderer.setSampler(SAMPLER_HALTON);
+		renderer.setGuiding(true);
+		const double referenceTime = renderSamples(renderer, referenceSamples);
+		const std::vector<optix::float4> reference = renderer.getOutputBuffer();
+
+		const double referenceMean = meanLuminance(reference);
+
+		std::cout << "  " << width << "x" << height << ", " << hostScene.getNumTriangles() << " triangles, path length " << maxPathLength << ", guided Halton reference "
+		          << referenceSamples << " samples per pixel in " << referenceTime << " s, mean " << referenceMean << std::endl;
+
+		renderer.setSampler(SAMPLER_SOBOL);
+
+		std::vector<double> rmse[2];
+		std::vector<int>    samples[2];
+		double means[2];
+		for (int method = 0; method < 2; ++method)
+		{
+			renderer.setGuiding(method == 1);
+
+			means[method] = renderEqualTime(renderer, reference, budgets, numBudgets, rmse[method], samples[method]);
+
+			// Both converge to the reference.
+			if (0.03 * referenceMean < fabs(means[method] - referenceMean))
+			{
+				++failures;
+			}
+		}
+
+		SDTree& guiding = renderer.getGuidingTree();
+		std::cout << "  SD-tree after " << renderer.getGuidingIteration() << " training iterations: " << guiding.getNumCells() << " cells, "
+		          << guiding.getNumDTreeNodes() << " D-tree nodes, last update " << renderer.getGuidingUpdateTime() * 1000.0 << " ms" << std::endl;
+		std::cout << "  mean path tracing " << means[0] << ", path guiding " << means[1] << std::endl;
+		std::cout << "    time s  PT spp     PT RMSE  guided spp  guided RMSE  speedup" << std::endl;
+		for (int i = 0; i < numBudgets; ++i)
+		{
+			char line[256];
+			snprintf(line, sizeof(line), "  %8.1f  %6d  %10.5f  %10d  %11.5f  %6.2fx", budgets[i], samples[0][i], rmse[0][i], samples[1][i], rmse[1][i],
+			         (rmse[0][i] * rmse[0][i]) / (rmse[1][i] * rmse[1][i]));
+			std::cout << line << std::endl;
+		}
+		std::cout << "}" << std::endl;
+
+		// Guiding has to pay for its training and its slower passes by the last budget.
+		if (rmse[0][numBudgets - 1] <= rmse[1][numBudgets - 1])
+		{
+			++failures;
+		}
+		return (failures == 0) ? 0 : 1;
+	}
+
+	// Path tracing vs. bidirectional path tracing at equal render time on one scene. Both integrators render a converged image
+	// with another sampler, which must agree, and both are measured against their average. Returns the number of failed checks.
+	static int compareIntegrators(HostRenderer& renderer, const char* name, const int referenceSamples, double const* budgets, const int numBudgets)
+	{
+		int failures = 0;
+
+		static const char* const names[2] = { "path tracing", "bidirectional" };
+
+		renderer.setSampler(SAMPLER_HALTON);
+
+		std::vector<optix::float4> reference;
+		double referenceMeans[2];
+		for (int method = 0; method < 2; ++method)
+		{
+			renderer.setIntegrator((method == 0) ? INTEGRATOR_PATH : INTEGRATOR_BIDIRECTIONAL);
+
+			const double referenceTime = renderSamples(renderer, referenceSamples);
+			std::vector<optix::float4> const& image = renderer.getOutputBuffer();
+			referenceMeans[method] = meanLuminance(image);
+
+			std::cout << "  " << name << ", " << names[method] << " Halton reference " << referenceSamples << " samples per pixel in " << referenceTime << " s, mean "
+			          << referenceMeans[method] << std::endl;
+
+			if (method == 0)
+			{
+				reference = image;
+			}
+			else
+			{
+				for (size_t i = 0; i < reference.size(); ++i)
+				{
+					reference[i] = 0.5f * (reference[i] + image[i]);
+				}
+			}
+		}
+		const double referenceMean = meanLuminance(reference);
+
+		// Both integrators converge to the same image.
+		const double difference = (referenceMeans[1] - referenceMeans[0]) / referenceMean;
+		if (0.02 < fabs(difference))
+		{
+			++failures;
+		}
+
+		renderer.setSampler(SAMPLER_SOBOL);
+
+		std::vector<double> rmse[2];
+		std::vector<int>    samples[2];
+		for (int method = 0; method < 2; ++method)
+		{
+			renderer.setIntegrator((method == 0) ? INTEGRATOR_PATH : INTEGRATOR_BIDIRECTIONAL);
+
+			const double mean = renderEqualTime(renderer, reference, budgets, numBudgets, rmse[method], samples[method]);
+
+			// Converges to the shared reference.
+			if (0.03 * referenceMean < fabs(mean - referenceMean))
+			{
+				++failures;
+			}
+		}
+
+		std::cout << "  reference means differ by " << 100.0 * difference << " %, both measured against their average" << std::endl;
+		std::cout << "    time s  PT spp     PT RMSE  BDPT spp    BDPT RMSE  speedup" << std::endl;
+		for (int i = 0; i < numBudgets; ++i)
+		{
+			char line[256];
+			snprintf(line, sizeof(line), "  %8.1f  %6d  %10.5f  %8d  %11.5f  %6.2fx", budgets[i], samples[0][i], rmse[0][i], samples[1][i], rmse[1][i],
+			         (rmse[0][i] * rmse[0][i]) / (rmse[1][i] * rmse[1][i]));
+			std::cout << line << std::endl;
+		}
+		return failures;
+	}
+
+	// Bidirectional path tracing vs. path tracing on two scenes in which the camera subpaths hardly find the light: the scene
+	// of Scene::build() lit by a small quad lamp, whose reflections in the mirror sphere reach the floor as caustics, and the
+	// GuidingScene, whose lamp lights the room of the camera through a door.
+	int benchmarkBidirectional()
+	{
+		int failures = 0;
+
+		std::cout << "bdpt:" << std::endl;
+		std::cout << "{" << std::endl;
+
+		const int    width            = 64;
+		const int    height           = 36;
+		const int    referenceSamples = 4096;
+		const int    maxPathLength    = 6;
+		const double budgets[]        = { 1.0, 2.0, 4.0, 8.0 }; // Seconds.
+		const int    numBudgets       = int(sizeof(budgets) / sizeof(budgets[0]));
+
+		// The quad lamp of createBenchmarkScene() shrunk to 0.2 x 0.2 at the same power. The red metal gets rougher, the
+		// peak of its microfacetReflectionEval() at the normal makes fireflies for both integrators otherwise.
+		{
+			Scene scene;
+			createBenchmarkScene(scene);
+
+			Light* lamp = scene.mLightList.back();
+			lamp->u        *= 0.2f;
+			lamp->v        *= 0.2f;
+			lamp->area      = optix::length(optix::cross(lamp->u, lamp->v));
+			lamp->emission /= lamp->area;
+
+			scene.mMaterialList[0]->roughness = 0.5f;
+
+			HostScene hostScene;
+			hostScene.build(scene);
+
+			HostRenderer renderer(hostScene);
+			setCamera(renderer, getBenchmarkCamera(width, height, 20.0f));
+			renderer.setPathLengths(3, maxPathLength);
+
+			std::cout << "  " << width << "x" << height << ", path length " << maxPathLength << std::endl;
+			failures += compareIntegrators(renderer, "small lamp", referenceSamples, budgets, numBudgets);
+		}
+
+		std::unique_ptr<Scene> scene = loadGuidingScene();
+		if (scene)
+		{
+			HostScene hostScene;
+			hostScene.build(*scene);
+
+			HostRenderer renderer(hostScene);
+			setCamera(renderer, getGuidingSceneCamera(width, height));
+			renderer.setPathLengths(3, maxPathLength);
+
+			failures += compareIntegrators(renderer, "door", referenceSamples, budgets, numBudgets);
+		}
+		std::cout << "}" << std::endl;
+
+		return (failures == 0) ? 0 : 1;
+	}
+}
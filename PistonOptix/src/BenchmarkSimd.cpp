@@ -0,0 +1,394 @@
+#include "inc/BenchmarkCommon.h"
+#include "inc/SimdMath.h"
+#include "inc/SimdShading.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace POptix
+{
+	// Kernel of one shading helper for the simd benchmark. Runs over count elements of the input and output arrays.
+	typedef void (*SimdKernel)(const float* const* in, float* const* out, const int count);
+
+	struct SimdCase
+	{
+		const char* name;
+		int         numInputs;
+		int         numOutputs;
+		float       lo[6];           // Uniform inputs in [lo, hi], with logInputs 10^[lo, hi].
+		float       hi[6];
+		bool        logInputs;
+		bool        unitVector;      // The first three inputs are normalized.
+		bool        relativeError;   // Error relative to the scalar result, else relative to max(1, |scalar result|).
+		float       tolerance;       // Maximum error in FLT_EPSILON.
+		SimdKernel  scalar;
+		SimdKernel  simd[3];         // 4, 8 and 16 lanes.
+	};
+
+	template<int W>
+	static inline simd::Float3<W> loadSimdFloat3(const float* const* in, const int i)
+	{
+		return simd::Float3<W>(simd::Float<W>::load(in[0] + i), simd::Float<W>::load(in[1] + i), simd::Float<W>::load(in[2] + i));
+	}
+
+	template<int W>
+	static inline void storeSimdFloat3(simd::Float3<W> const& v, float* const* out, const int i)
+	{
+		v.x.store(out[0] + i);
+		v.y.store(out[1] + i);
+		v.z.store(out[2] + i);
+	}
+
+	static inline void storeFloat3(const optix::float3& v, float* const* out, const int i)
+	{
+		out[0][i] = v.x;
+		out[1][i] = v.y;
+		out[2][i] = v.z;
+	}
+
+	static void scalarExp(const float* const* in, float* const* out, const int count)
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			out[0][i] = expf(in[0][i]);
+		}
+	}
+
+	template<int W>
+	static void simdExp(const float* const* in, float* const* out, const int count)
+	{
+		for (int i = 0; i < count; i += W)
+		{
+			simd::exp(simd::Float<W>::load(in[0] + i)).store(out[0] + i);
+		}
+	}
+
+	static void scalarLog(const float* const* in, float* const* out, const int count)
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			out[0][i] = ::logf(in[0][i]);
+		}
+	}
+
+	template<int W>
+	static void simdLog(const float* const* in, float* const* out, const int count)
+	{
+		for (int i = 0; i < count; i += W)
+		{
+			simd::log(simd::Float<W>::load(in[0] + i)).store(out[0] + i);
+		}
+	}
+
+	static void scalarSin(const float* const* in, float* const* out, const int count)
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			out[0][i] = sinf(in[0][i]);
+		}
+	}
+
+	template<int W>
+	static void simdSin(const float* const* in, float* const* out, const int count)
+	{
+		for (int i = 0; i < count; i += W)
+		{
+			simd::sin(simd::Float<W>::load(in[0] + i)).store(out[0] + i);
+		}
+	}
+
+	static void scalarCos(const float* const* in, float* const* out, const int count)
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			out[0][i] = cosf(in[0][i]);
+		}
+	}
+
+	template<int W>
+	static void simdCos(const float* const* in, float* const* out, const int count)
+	{
+		for (int i = 0; i < count; i += W)
+		{
+			simd::cos(simd::Float<W>::load(in[0] + i)).store(out[0] + i);
+		}
+	}
+
+	static void scalarPow(const float* const* in, float* const* out, const int count)
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			out[0][i] = ::powf(in[0][i], in[1][i]);
+		}
+	}
+
+	template<int W>
+	static void simdPow(const float* const* in, float* const* out, const int count)
+	{
+		for (int i = 0; i < count; i += W)
+		{
+			simd::pow(simd::Float<W>::load(in[0] + i), simd::Float<W>::load(in[1] + i)).store(out[0] + i);
+		}
+	}
+
+	static void scalarTbn(const float* const* in, float* const* out, const int count)
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			const TBN tbn(optix::make_float3(in[0][i], in[1][i], in[2][i]));
+			storeFloat3(tbn.transform(optix::make_float3(in[3][i], in[4][i], in[5][i])), out, i);
+		}
+	}
+
+	template<int W>
+	static void simdTbn(const float* const* in, float* const* out, const int count)
+	{
+		for (int i = 0; i < count; i += W)
+		{
+			const simd::TBN<W> tbn(loadSimdFloat3<W>(in, i));
+			storeSimdFloat3<W>(tbn.transform(loadSimdFloat3<W>(in + 3, i)), out, i);
+		}
+	}
+
+	static void scalarLuminance(const float* const* in, float* const* out, const int count)
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			out[0][i] = luminance(optix::make_float3(in[0][i], in[1][i], in[2][i]));
+		}
+	}
+
+	template<int W>
+	static void simdLuminance(const float* const* in, float* const* out, const int count)
+	{
+		for (int i = 0; i < count; i += W)
+		{
+			simd::luminance(loadSimdFloat3<W>(in, i)).store(out[0] + i);
+		}
+	}
+
+	static void scalarPowerHeuristic(const float* const* in, float* const* out, const int count)
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			out[0][i] = PowerHeuristic(1, in[0][i], 1, in[1][i]);
+		}
+	}
+
+	template<int W>
+	static void simdPowerHeuristic(const float* const* in, float* const* out, const int count)
+	{
+		for (int i = 0; i < count; i += W)
+		{
+			simd::PowerHeuristic(1, simd::Float<W>::load(in[0] + i), 1, simd::Float<W>::load(in[1] + i)).store(out[0] + i);
+		}
+	}
+
+	static void scalarAlignVector(const float* const* in, float* const* out, const int count)
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			optix::float3 w = optix::make_float3(in[3][i], in[4][i], in[5][i]);
+			AlignVector(optix::make_float3(in[0][i], in[1][i], in[2][i]), w);
+			storeFloat3(w, out, i);
+		}
+	}
+
+	template<int W>
+	static void simdAlignVector(const float* const* in, float* const* out, const int count)
+	{
+		for (int i = 0; i < count; i += W)
+		{
+			simd::Float3<W> w = loadSimdFloat3<W>(in + 3, i);
+			simd::AlignVector(loadSimdFloat3<W>(in, i), w);
+			storeSimdFloat3<W>(w, out, i);
+		}
+	}
+
+	static void scalarUniformHemisphere(const float* const* in, float* const* out, const int count)
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			storeFloat3(UniformHemisphereSampling(optix::make_float2(in[0][i], in[1][i])), out, i);
+		}
+	}
+
+	template<int W>
+	static void simdUniformHemisphere(const float* const* in, float* const* out, const int count)
+	{
+		for (int i = 0; i < count; i += W)
+		{
+			storeSimdFloat3<W>(simd::UniformHemisphereSampling(simd::Float<W>::load(in[0] + i), simd::Float<W>::load(in[1] + i)), out, i);
+		}
+	}
+
+	static void scalarCosineHemisphere(const float* const* in, float* const* out, const int count)
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			storeFloat3(UnitSquareToCosineHemisphere(optix::make_float2(in[0][i], in[1][i])), out, i);
+		}
+	}
+
+	template<int W>
+	static void simdCosineHemisphere(const float* const* in, float* const* out, const int count)
+	{
+		for (int i = 0; i < count; i += W)
+		{
+			storeSimdFloat3<W>(simd::UnitSquareToCosineHemisphere(simd::Float<W>::load(in[0] + i), simd::Float<W>::load(in[1] + i)), out, i);
+		}
+	}
+
+	static void scalarCosineWeighted(const float* const* in, float* const* out, const int count)
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			storeFloat3(CosineWeightedHemisphereSampling(optix::make_float2(in[0][i], in[1][i]), in[2][i]), out, i);
+		}
+	}
+
+	template<int W>
+	static void simdCosineWeighted(const float* const* in, float* const* out, const int count)
+	{
+		for (int i = 0; i < count; i += W)
+		{
+			storeSimdFloat3<W>(simd::CosineWeightedHemisphereSampling(simd::Float<W>::load(in[0] + i), simd::Float<W>::load(in[1] + i), simd::Float<W>::load(in[2] + i)), out, i);
+		}
+	}
+
+#define SIMD_KERNELS(kernel) { kernel<4>, kernel<8>, kernel<16> }
+
+	static const SimdCase g_simdCases[] =
+	{
+		{ "exp",              1, 1, { -80.0f },                                   { 80.0f },                               false, false, true,   4.0f, scalarExp,              SIMD_KERNELS(simdExp) },
+		{ "log",              1, 1, { -30.0f },                                   { 30.0f },                               true,  false, false,  4.0f, scalarLog,              SIMD_KERNELS(simdLog) },
+		{ "sin",              1, 1, { -8.0f * M_PIf },                            { 8.0f * M_PIf },                        false, false, false,  4.0f, scalarSin,              SIMD_KERNELS(simdSin) },
+		{ "cos",              1, 1, { -8.0f * M_PIf },                            { 8.0f * M_PIf },                        false, false, false,  4.0f, scalarCos,              SIMD_KERNELS(simdCos) },
+		{ "pow",              2, 1, { 0.0f, 0.0f },                               { 1.0f, 8.0f },                          false, false, true,  64.0f, scalarPow,              SIMD_KERNELS(simdPow) },
+		{ "TBN::transform",   6, 3, { -1.0f, -1.0f, -1.0f, -1.0f, -1.0f, -1.0f }, { 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f }, false, true,  false,  4.0f, scalarTbn,              SIMD_KERNELS(simdTbn) },
+		{ "luminance",        3, 1, { 0.0f, 0.0f, 0.0f },                         { 10.0f, 10.0f, 10.0f },                 false, false, true,   4.0f, scalarLuminance,        SIMD_KERNELS(simdLuminance) },
+		{ "PowerHeuristic",   2, 1, { 0.0f, 0.0f },                               { 10.0f, 10.0f },                        false, false, false,  4.0f, scalarPowerHeuristic,   SIMD_KERNELS(simdPowerHeuristic) },
+		{ "AlignVector",      6, 3, { -1.0f, -1.0f, -1.0f, -1.0f, -1.0f, -1.0f }, { 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f }, false, true,  false,  4.0f, scalarAlignVector,      SIMD_KERNELS(simdAlignVector) },
+		{ "UniformHemisphere",2, 3, { 0.0f, 0.0f },                               { 1.0f, 1.0f },                          false, false, false,  8.0f, scalarUniformHemisphere, SIMD_KERNELS(simdUniformHemisphere) },
+		{ "CosineHemisphere", 2, 3, { 0.0f, 0.0f },                               { 1.0f, 1.0f },                          false, false, false, 16.0f, scalarCosineHemisphere, SIMD_KERNELS(simdCosineHemisphere) },
+		{ "CosineWeighted",   3, 3, { 0.0f, 0.0f, 0.0f },                         { 1.0f, 1.0f, 100.0f },                  false, false, false, 32.0f, scalarCosineWeighted,   SIMD_KERNELS(simdCosineWeighted) },
+	};
+
+#undef SIMD_KERNELS
+
+	// Every shader_common.h helper of SimdShading.h and the SimdMath.h transcendentals at 4, 8 and 16 lanes against the scalar version.
+	// The error is the largest deviation from the scalar result in FLT_EPSILON, the benchmark fails when it exceeds the tolerance.
+	// pow() loses |y * log(x)| ulp in the exp() argument, and the cosine hemisphere z = sqrt(1 - x^2 - y^2) amplifies the
+	// sin/cos rounding near the rim, so both get looser tolerances.
+	int benchmarkSimd()
+	{
+		const int count     = 4096; // Multiple of 16, all arrays stay in the L2 cache.
+		const int numPasses = 256;
+
+		std::mt19937 generator(36);
+		std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+		int failures = 0;
+
+		std::cout << "simd: native width " << SIMD_WIDTH << ", " << count << " elements x " << numPasses << " passes" << std::endl;
+		std::cout << "{" << std::endl;
+		std::cout << "  helper              scalar M/s   4 lanes M/s (error)   8 lanes M/s (error)  16 lanes M/s (error)" << std::endl;
+
+		for (const SimdCase& test : g_simdCases)
+		{
+			std::vector<float> inputs[6];
+			std::vector<float> reference[3];
+			std::vector<float> outputs[3];
+			const float* in[6];
+			float*       ref[3];
+			float*       out[3];
+
+			for (int k = 0; k < test.numInputs; ++k)
+			{
+				inputs[k].resize(count);
+				for (int i = 0; i < count; ++i)
+				{
+					const float x = test.lo[k] + (test.hi[k] - test.lo[k]) * uniform(generator);
+					inputs[k][i] = test.logInputs ? powf(10.0f, x) : x;
+				}
+			}
+			if (test.unitVector)
+			{
+				for (int i = 0; i < count; ++i)
+				{
+					const optix::float3 v = optix::normalize(optix::make_float3(inputs[0][i], inputs[1][i], inputs[2][i]));
+					inputs[0][i] = v.x;
+					inputs[1][i] = v.y;
+					inputs[2][i] = v.z;
+				}
+			}
+			for (int k = 0; k < test.numInputs; ++k)
+			{
+				in[k] = inputs[k].data();
+			}
+			for (int k = 0; k < test.numOutputs; ++k)
+			{
+				reference[k].resize(count);
+				outputs[k].resize(count);
+				ref[k] = reference[k].data();
+				out[k] = outputs[k].data();
+			}
+
+			Timer timer;
+			timer.start();
+			for (int pass = 0; pass < numPasses; ++pass)
+			{
+				test.scalar(in, ref, count);
+			}
+			const double scalarTime = timer.getTime();
+
+			const double items = double(count) * double(numPasses);
+
+			char line[256];
+			int  length = snprintf(line, sizeof(line), "  %-18s  %10.1f", test.name, items / scalarTime * 1.0e-6);
+
+			for (int w = 0; w < 3; ++w)
+			{
+				timer.restart();
+				for (int pass = 0; pass < numPasses; ++pass)
+				{
+					test.simd[w](in, out, count);
+				}
+				const double simdTime = timer.getTime();
+
+				float maxError = 0.0f;
+				for (int k = 0; k < test.numOutputs; ++k)
+				{
+					for (int i = 0; i < count; ++i)
+					{
+						const float a = outputs[k][i];
+						const float b = reference[k][i];
+						if (a == b || (a != a && b != b))
+						{
+							continue;
+						}
+						const float scale = test.relativeError ? fabsf(b) : std::max(1.0f, fabsf(b));
+						const float error = (a != a || b != b) ? FLT_MAX : fabsf(a - b) / std::max(scale, FLT_MIN) / FLT_EPSILON;
+						maxError = std::max(maxError, error);
+					}
+				}
+				if (test.tolerance < maxError)
+				{
+					++failures;
+				}
+
+				length += snprintf(line + length, sizeof(line) - length, "   %7.1f %5.1fx (%4.1f)", items / simdTime * 1.0e-6, scalarTime / simdTime, maxError);
+			}
+			std::cout << line << std::endl;
+		}
+
+		std::cout << "  accuracy " << ((failures == 0) ? "within" : "OUTSIDE") << " the tolerances" << std::endl;
+		std::cout << "}" << std::endl;
+
+		return (failures == 0) ? 0 : 1;
+	}
+}
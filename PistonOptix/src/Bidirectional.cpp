@@ -0,0 +1,724 @@
+#include "inc/Bidirectional.h"
+
+#include <algorithm>
+
+#include "inc/MyAssert.h"
+
+namespace POptix
+{
+	static float emitterArea(Light const& light)
+	{
+		return (light.lightType == SPHERE) ? 4.0f * M_PIf * light.radius * light.radius : light.area;
+	}
+
+	static float remapDelta(const float pdf)
+	{
+		return (pdf != 0.0f) ? pdf : 1.0f;
+	}
+
+	EmitterDistribution::EmitterDistribution()
+	{
+	}
+
+	void EmitterDistribution::build(std::vector<Light> const& lights)
+	{
+		m_lights.clear();
+		m_cdf.clear();
+		m_pmf.assign(lights.size(), 0.0f);
+
+		std::vector<double> powers;
+		double total = 0.0;
+		for (size_t i = 0; i < lights.size(); ++i)
+		{
+			Light const& light = lights[i];
+			if (light.lightType != QUAD && light.lightType != SPHERE)
+			{
+				continue;
+			}
+			const double power = double(luminance(light.emission)) * emitterArea(light);
+			if (0.0 < power)
+			{
+				m_lights.push_back(int(i));
+				powers.push_back(power);
+				total += power;
+			}
+		}
+
+		double sum = 0.0;
+		for (size_t i = 0; i < m_lights.size(); ++i)
+		{
+			sum += powers[i];
+			m_cdf.push_back(float(sum / total));
+			m_pmf[m_lights[i]] = float(powers[i] / total);
+		}
+		if (!m_cdf.empty())
+		{
+			m_cdf.back() = 1.0f;
+		}
+	}
+
+	int EmitterDistribution::sample(const float u, float& pmf) const
+	{
+		MY_ASSERT(!empty());
+
+		const int i = std::min(int(std::upper_bound(m_cdf.begin(), m_cdf.end(), u) - m_cdf.begin()), int(m_lights.size()) - 1);
+		pmf = m_pmf[m_lights[i]];
+		return m_lights[i];
+	}
+
+	float BidirectionalCamera::directionPdf(const optix::float3& direction) const
+	{
+		const float lengthW  = optix::length(W);
+		const float cosTheta = optix::dot(direction, W) / lengthW;
+		if (cosTheta <= 0.0f)
+		{
+			return 0.0f;
+		}
+		// The rays are uniform on the image plane at distance |W|, whose area is 4 |U x V|.
+		const float area = 4.0f * optix::length(optix::cross(U, V));
+		return (lengthW * lengthW) / (area * cosTheta * cosTheta * cosTheta);
+	}
+
+	bool BidirectionalCamera::project(const optix::float3& point, int& pixel) const
+	{
+		const optix::float3 direction = point - position;
+		const float depth = optix::dot(direction, W);
+		if (depth <= 0.0f)
+		{
+			return false;
+		}
+
+		// ndc.x * U + ndc.y * V of the point on the image plane.
+		const optix::float3 plane = direction * (optix::dot(W, W) / depth) - W;
+		const float ndcX = optix::dot(plane, U) / optix::dot(U, U);
+		const float ndcY = optix::dot(plane, V) / optix::dot(V, V);
+
+		const int x = int(floorf((ndcX + 1.0f) * 0.5f * float(width)));
+		const int y = int(floorf((ndcY + 1.0f) * 0.5f * float(height)));
+		if (x < 0 || width <= x || y < 0 || height <= y)
+		{
+			return false;
+		}
+		pixel = y * width + x;
+		return true;
+	}
+
+	BidirectionalIntegrator::BidirectionalIntegrator(HostScene const& scene, EmitterDistribution const& emitters, BidirectionalCamera const& camera, const ELightSelection lightSelection,
+	                                                 const int minPathLength, const int maxPathLength, const float sceneEpsilon)
+		: m_scene(scene)
+		, m_emitters(emitters)
+		, m_camera(camera)
+		, m_selector(lightSelection, scene.getLightTree(), scene.getLightAliasTable(), scene.getEnvironment())
+		, m_minPathLength(minPathLength)
+		, m_maxPathLength(maxPathLength)
+		, m_sceneEpsilon(sceneEpsilon)
+	{
+		m_cameraPath.reserve(m_maxPathLength + 1);
+		m_lightPath.reserve(m_maxPathLength + 1);
+	}
+
+	optix::float3 BidirectionalIntegrator::sample(PerRayData& prd, ShadowCache& shadowCache, std::vector<Splat>& splats)
+	{
+		// The light subpath reads the sample dimensions after those of the longest camera subpath. The LCG has no dimensions,
+		// it gets a stream of its own.
+		PerRayData lightPrd = prd;
+		lightPrd.dimension = SAMPLE_DIMENSION_CAMERA + (m_maxPathLength + 1) * SAMPLE_DIMENSIONS_PER_SEGMENT;
+		if (prd.sampler == SAMPLER_LCG)
+		{
+			lightPrd.seed = tea<4>(prd.seed, 1u);
+		}
+
+		PathVertex camera;
+		camera.position       = prd.hit_pos;
+		camera.geometryNormal = optix::normalize(m_camera.W);
+		camera.shadingNormal  = camera.geometryNormal;
+		camera.toPrevious     = -camera.geometryNormal;
+		camera.beta           = optix::make_float3(1.0f);
+		camera.pdfFwd         = 1.0f;
+		camera.pdfRev         = 0.0f;
+		camera.type           = PATH_VERTEX_CAMERA;
+		camera.index          = -1;
+		camera.brdf           = LAMBERT;
+		camera.delta          = false;
+		camera.neeLight       = -1;
+
+		m_cameraPath.clear();
+		m_cameraPath.push_back(camera);
+
+		optix::float3 radiance = randomWalk(prd, prd.hit_pos, prd.wi, optix::make_float3(1.0f), m_camera.directionPdf(prd.wi), false, m_cameraPath);
+
+		traceLightPath(lightPrd);
+
+		// s == 1 are the connections to the light vertices of the camera subpath, there are some without a light subpath.
+		const int numCamera = int(m_cameraPath.size());
+		const int numLight  = std::max(int(m_lightPath.size()), 1);
+		for (int t = 1; t <= numCamera; ++t)
+		{
+			for (int s = 0; s <= numLight && s + t <= m_maxPathLength + 2; ++s)
+			{
+				// A pinhole can't be hit, and the lights seen by the camera are those hit by the camera subpath.
+				if ((t == 1 && s <= 1))
+				{
+					continue;
+				}
+
+				int pixel = -1;
+				const optix::float3 contribution = connect(s, t, shadowCache, pixel);
+				if (t == 1)
+				{
+					// NaN values will never go away. Filter them out before they can arrive in the output buffer.
+					if (0 <= pixel && isNotNull(contribution) && !(isnan(contribution.x) || isnan(contribution.y) || isnan(contribution.z)))
+					{
+						const Splat splat = { pixel, contribution };
+						splats.push_back(splat);
+					}
+				}
+				else
+				{
+					radiance += contribution;
+				}
+			}
+		}
+		return radiance;
+	}
+
+	optix::float3 BidirectionalIntegrator::randomWalk(PerRayData& prd, optix::float3 origin, optix::float3 direction, optix::float3 beta, float pdf, const bool importance,
+	                                                  std::vector<PathVertex>& path)
+	{
+		std::vector<Light> const& lights = m_scene.getLights();
+
+		while (int(path.size()) < m_maxPathLength + 1)
+		{
+			const int previous = int(path.size()) - 1;
+
+			TriangleHit hit;
+			if (!m_scene.intersect(origin, direction, m_sceneEpsilon, RT_DEFAULT_MAX, hit))
+			{
+				const int environmentLight = m_scene.getEnvironmentLight();
+				if (importance || environmentLight < 0)
+				{
+					return optix::make_float3(0.0f);
+				}
+
+				// miss.cu. The environment has no light subpaths, it's weighted against the next event estimation only.
+				const EnvironmentMap& environment = m_scene.getEnvironment();
+				const optix::float3 emission = lights[environmentLight].emission * environment.eval(environmentUV(direction));
+
+				float weight = 1.0f;
+				if (path[previous].type == PATH_VERTEX_SURFACE && 0.0f < pdf)
+				{
+					weight = powerHeuristic(pdf, lightSelectionPmf(lights, m_selector, environmentLight, origin) * environment.pdf(direction));
+				}
+				return beta * emission * weight;
+			}
+
+			State state;
+			m_scene.getState(origin, direction, hit, state);
+
+			PathVertex vertex;
+			vertex.position       = state.hit_position;
+			vertex.geometryNormal = state.geometry_normal;
+			vertex.shadingNormal  = state.shading_normal;
+			vertex.toPrevious     = -direction;
+			vertex.beta           = beta;
+			vertex.pdfFwd         = toArea(pdf, path[previous], vertex);
+			vertex.pdfRev         = 0.0f;
+			vertex.brdf           = LAMBERT;
+			vertex.delta          = false;
+			vertex.neeLight       = -1;
+
+			const int lightIndex = m_scene.getLightIndex(hit.primitive);
+			if (0 <= lightIndex)
+			{
+				// Lights absorb. The camera subpath keeps the vertex for the strategy without light vertices.
+				if (!importance)
+				{
+					vertex.type  = PATH_VERTEX_LIGHT;
+					vertex.index = lightIndex;
+					path.push_back(vertex);
+				}
+				return optix::make_float3(0.0f);
+			}
+
+			vertex.type  = PATH_VERTEX_SURFACE;
+			vertex.index = m_scene.getMaterialIndex(hit.primitive);
+
+			Material const& mat = m_scene.getMaterials()[vertex.index];
+
+			prd.hit_pos = state.hit_position;
+			prd.wo      = vertex.toPrevious;
+			prd.flags   = 0;
+
+			vertex.brdf           = beginSurface(mat, state, prd);
+			vertex.geometryNormal = state.geometry_normal;
+			vertex.shadingNormal  = state.shading_normal;
+			vertex.delta          = (prd.brdf_flags & BSDF_SPECULAR) != 0;
+
+			// The light vertex of the connection of this camera vertex, drawn here with the random numbers of the segment.
+			if (!importance && !vertex.delta && !lights.empty())
+			{
+				vertex.neeLight = selectLight(lights, m_selector, vertex.position, sample1D(prd, SAMPLE_DIMENSION_LIGHT_SELECTION), vertex.neeSelectionPmf);
+				sampleLight(lights[vertex.neeLight], m_selector, prd, state, vertex.neeSample);
+			}
+
+			path.push_back(vertex);
+			if (m_maxPathLength + 1 <= int(path.size()))
+			{
+				break;
+			}
+
+			PathVertex const& current = path.back();
+
+			g_brdfSample[current.brdf](mat, state, current.toPrevious, prd);
+			const optix::float3 wi = prd.wi;
+
+			// Do not sample opaque surfaces below the geometry!
+			if (optix::dot(wi, current.geometryNormal) <= 0.0f)
+			{
+				break;
+			}
+
+			const float pdfWi = brdfPdf(current, current.toPrevious, wi);
+			const optix::float3 f = importance ? evalBrdf(current, wi, current.toPrevious, true) : evalBrdf(current, current.toPrevious, wi, false);
+			if (pdfWi <= 0.0f || isNull(f))
+			{
+				break;
+			}
+			beta *= f * fabsf(optix::dot(wi, current.shadingNormal)) / pdfWi;
+
+			// The previous vertex sampled from this one in the other direction.
+			path[previous].pdfRev = current.delta ? 0.0f : toArea(brdfPdf(current, wi, current.toPrevious), current, path[previous]);
+
+			// Russian Roulette path termination after m_minPathLength path segments.
+			if (m_minPathLength <= int(path.size()) - 2)
+			{
+				const float probability = russianRouletteProbability(beta);
+				if (probability <= sample1D(prd, SAMPLE_DIMENSION_ROULETTE))
+				{
+					break;
+				}
+				beta /= probability;
+			}
+
+			origin    = current.position;
+			direction = wi;
+			pdf       = current.delta ? 0.0f : pdfWi;
+			nextSegment(prd);
+		}
+		return optix::make_float3(0.0f);
+	}
+
+	void BidirectionalIntegrator::traceLightPath(PerRayData& prd)
+	{
+		m_lightPath.clear();
+		if (m_emitters.empty())
+		{
+			return;
+		}
+
+		float pmf;
+		const int lightIndex = m_emitters.sample(sample1D(prd, SAMPLE_DIMENSION_LIGHT_SELECTION), pmf);
+		Light const& light = m_scene.getLights()[lightIndex];
+
+		// Uniform on the area.
+		const optix::float2 u = sample2D(prd, SAMPLE_DIMENSION_LIGHT);
+
+		PathVertex vertex;
+		if (light.lightType == SPHERE)
+		{
+			vertex.geometryNormal = UniformSampleSphere(u.x, u.y);
+			vertex.position       = light.position + light.radius * vertex.geometryNormal;
+		}
+		else
+		{
+			vertex.geometryNormal = light.normal;
+			vertex.position       = light.position + light.u * u.x + light.v * u.y;
+		}
+		vertex.shadingNormal = vertex.geometryNormal;
+		vertex.toPrevious    = vertex.geometryNormal;
+		vertex.pdfRev        = 0.0f;
+		vertex.type          = PATH_VERTEX_LIGHT;
+		vertex.index         = lightIndex;
+		vertex.brdf          = LAMBERT;
+		vertex.delta         = false;
+		vertex.neeLight      = -1;
+		vertex.pdfFwd        = originPdf(vertex);
+		vertex.beta          = light.emission / vertex.pdfFwd;
+
+		m_lightPath.push_back(vertex);
+
+		// Cosine weighted around the normal.
+		const TBN tbn(vertex.geometryNormal);
+		const optix::float3 direction = tbn.inverse_transform(UnitSquareToCosineHemisphere(sample2D(prd, SAMPLE_DIMENSION_BRDF)));
+
+		const float pdf = emissionPdf(vertex, direction);
+		if (pdf <= 0.0f)
+		{
+			return;
+		}
+		const optix::float3 beta = vertex.beta * optix::dot(vertex.geometryNormal, direction) / pdf;
+
+		nextSegment(prd);
+		randomWalk(prd, vertex.position, direction, beta, pdf, true, m_lightPath);
+	}
+
+	optix::float3 BidirectionalIntegrator::connect(const int s, const int t, ShadowCache& shadowCache, int& pixel)
+	{
+		const optix::float3 black = optix::make_float3(0.0f);
+
+		std::vector<Light> const& lights = m_scene.getLights();
+
+		PathVertex const& pt = m_cameraPath[t - 1];
+
+		PathVertex sampled; // The light vertex of s == 1.
+		optix::float3 contribution;
+
+		if (s == 0)
+		{
+			// closesthit_light.cu, the backside is black.
+			if (pt.type != PATH_VERTEX_LIGHT || optix::dot(pt.toPrevious, pt.geometryNormal) < 0.0f)
+			{
+				return black;
+			}
+			contribution = pt.beta * lights[pt.index].emission;
+		}
+		else if (t == 1)
+		{
+			// The vertex of the light subpath seen by the camera.
+			PathVertex const& qs = m_lightPath[s - 1];
+			if (qs.type != PATH_VERTEX_SURFACE || qs.delta || !m_camera.project(qs.position, pixel))
+			{
+				return black;
+			}
+
+			const optix::float3 toCamera = pt.position - qs.position;
+			const float distance = optix::length(toCamera);
+			const optix::float3 direction = toCamera / distance;
+
+			const optix::float3 f = evalBrdf(qs, direction, qs.toPrevious, true);
+			if (isNull(f))
+			{
+				return black;
+			}
+
+			// The importance of the pinhole is the pdf of its rays, the We / pdf of PBRT.
+			contribution = qs.beta * f * fabsf(optix::dot(direction, qs.shadingNormal)) * m_camera.directionPdf(-direction) / (distance * distance);
+			if (isNull(contribution) || !visible(qs.position, pt.position, shadowCache))
+			{
+				return black;
+			}
+		}
+		else if (s == 1)
+		{
+			// The next event estimation of the path tracer, see sampleDirectLighting().
+			if (pt.type != PATH_VERTEX_SURFACE || pt.neeLight < 0)
+			{
+				return black;
+			}
+
+			Light const& light = lights[pt.neeLight];
+			LightSample const& lightSample = pt.neeSample;
+			if (lightSample.pdf <= 0.0f || lightSample.distance == 0.0f)
+			{
+				return black;
+			}
+			if (light.lightType == QUAD && optix::dot(light.normal, -lightSample.direction) <= 0.0f)
+			{
+				return black;
+			}
+
+			const optix::float3 direction = lightSample.direction;
+			const optix::float3 f = evalBrdf(pt, pt.toPrevious, direction, false);
+			if (isNull(f))
+			{
+				return black;
+			}
+			contribution = pt.beta * f * fabsf(optix::dot(direction, pt.shadingNormal)) * lightSample.emission / (pt.neeSelectionPmf * lightSample.pdf);
+			if (isNull(contribution))
+			{
+				return black;
+			}
+
+			if (light.lightType == DIRECTIONAL || light.lightType == ENVIRONMENT)
+			{
+				if (m_scene.occluded(pt.position, direction, m_sceneEpsilon, lightSample.distance - m_sceneEpsilon, &shadowCache))
+				{
+					return black;
+				}
+				// Only the camera subpath reaches them. The environment is weighted against its BRDF samples like by the path tracer.
+				if (light.isDelta)
+				{
+					return contribution;
+				}
+				return contribution * powerHeuristic(pt.neeSelectionPmf * lightSample.pdf, brdfPdf(pt, pt.toPrevious, direction));
+			}
+
+			sampled.position       = lightSample.surfacePos;
+			sampled.geometryNormal = (light.lightType == SPHERE) ? optix::normalize(lightSample.surfacePos - light.position) : light.normal;
+			sampled.shadingNormal  = sampled.geometryNormal;
+			sampled.toPrevious     = sampled.geometryNormal;
+			sampled.type           = PATH_VERTEX_LIGHT;
+			sampled.index          = pt.neeLight;
+			sampled.delta          = false;
+			sampled.pdfFwd         = originPdf(sampled);
+			sampled.pdfRev         = 0.0f;
+
+			if (!visible(pt.position, sampled.position, shadowCache))
+			{
+				return black;
+			}
+		}
+		else
+		{
+			PathVertex const& qs = m_lightPath[s - 1];
+			if (pt.type != PATH_VERTEX_SURFACE || pt.delta || qs.delta)
+			{
+				return black;
+			}
+
+			const optix::float3 edge = qs.position - pt.position;
+			const float distance2 = optix::dot(edge, edge);
+			const optix::float3 direction = edge / sqrtf(distance2);
+
+			const optix::float3 fCamera = evalBrdf(pt, pt.toPrevious, direction, false);
+			const optix::float3 fLight  = evalBrdf(qs, -direction, qs.toPrevious, true);
+			contribution = pt.beta * fCamera * fLight * qs.beta * (fabsf(optix::dot(direction, pt.shadingNormal)) * fabsf(optix::dot(direction, qs.shadingNormal)) / distance2);
+			if (isNull(contribution) || !visible(pt.position, qs.position, shadowCache))
+			{
+				return black;
+			}
+		}
+
+		return contribution * misWeight(s, t, sampled);
+	}
+
+	float BidirectionalIntegrator::misWeight(const int s, const int t, PathVertex const& sampled)
+	{
+		// The full path x_0 ... x_(n - 1) from the light to the camera.
+		const int n = s + t;
+		auto vertex = [&](const int k) -> PathVertex const&
+		{
+			if (k < s)
+			{
+				return (s == 1) ? sampled : m_lightPath[k];
+			}
+			return m_cameraPath[n - 1 - k];
+		};
+
+		// m_pdfLight[k] is the density of x_k sampled from x_(k - 1), m_pdfCamera[k] the one sampled from x_(k + 1).
+		m_pdfLight.assign(n, 0.0f);
+		m_pdfCamera.assign(n, 0.0f);
+		m_delta.assign(n, 0);
+		for (int k = 0; k < n; ++k)
+		{
+			PathVertex const& v = vertex(k);
+			m_pdfLight[k]  = (k < s) ? v.pdfFwd : v.pdfRev;
+			m_pdfCamera[k] = (k < s) ? v.pdfRev : v.pdfFwd;
+			m_delta[k]     = v.delta ? 1 : 0;
+		}
+
+		// The densities around the connection, which the subpaths couldn't know.
+		PathVertex const& pt = vertex(s);
+		if (s == 0)
+		{
+			if (1 < n - 1)
+			{
+				PathVertex const& next = vertex(1);
+				m_pdfLight[1] = toArea(emissionPdf(pt, optix::normalize(next.position - pt.position)), pt, next);
+			}
+		}
+		else
+		{
+			PathVertex const& qs = vertex(s - 1);
+			const optix::float3 direction = optix::normalize(pt.position - qs.position);
+
+			if (s < n - 1)
+			{
+				m_pdfLight[s] = toArea((s == 1) ? emissionPdf(qs, direction) : brdfPdf(qs, qs.toPrevious, direction), qs, pt);
+			}
+			m_pdfCamera[s - 1] = toArea((t == 1) ? m_camera.directionPdf(-direction) : brdfPdf(pt, pt.toPrevious, -direction), pt, qs);
+
+			if (s + 1 < n - 1)
+			{
+				m_pdfLight[s + 1] = toArea(brdfPdf(pt, -direction, pt.toPrevious), pt, vertex(s + 1));
+			}
+			if (2 <= s)
+			{
+				m_pdfCamera[s - 2] = toArea(brdfPdf(qs, direction, qs.toPrevious), qs, vertex(s - 2));
+			}
+		}
+
+		// The light vertex x_0 is sampled on its own by the connections to a new light vertex and with the light subpaths
+		// by all other strategies which start on the light.
+		PathVertex const& light = vertex(0);
+		const float pdfOrigin = originPdf(light);
+		const float pdfConnection = (vertex(1).type == PATH_VERTEX_SURFACE) ? connectionPdf(light, vertex(1)) : 0.0f;
+
+		const int maxVertices = m_maxPathLength + 1;
+		auto valid = [&](const int strategy)
+		{
+			const int cameraVertices = n - strategy;
+			if (maxVertices < strategy || maxVertices < cameraVertices || cameraVertices < 1 || (cameraVertices == 1 && strategy <= 1))
+			{
+				return false;
+			}
+			if (strategy == 0)
+			{
+				return true;
+			}
+			if ((strategy == 1 && pdfConnection <= 0.0f) || (2 <= strategy && pdfOrigin <= 0.0f))
+			{
+				return false;
+			}
+			return !m_delta[strategy - 1] && !m_delta[strategy];
+		};
+
+		// Power heuristic, with the pdfs of the other strategies relative to the one of this.
+		float sum   = 1.0f;
+		float ratio = 1.0f;
+		for (int strategy = s + 1; strategy < n; ++strategy)
+		{
+			// x_(strategy - 1) moves to the light subpath.
+			const int k = strategy - 1;
+			if (k == 0)
+			{
+				ratio *= remapDelta(pdfConnection) / remapDelta(m_pdfCamera[0]);
+			}
+			else
+			{
+				ratio *= remapDelta(m_pdfLight[k]) / remapDelta(m_pdfCamera[k]);
+				if (k == 1)
+				{
+					ratio *= remapDelta(pdfOrigin) / remapDelta(pdfConnection);
+				}
+			}
+			if (valid(strategy))
+			{
+				sum += ratio * ratio;
+			}
+		}
+
+		ratio = 1.0f;
+		for (int strategy = s - 1; 0 <= strategy; --strategy)
+		{
+			// x_strategy moves to the camera subpath.
+			const int k = strategy;
+			if (k == 0)
+			{
+				ratio *= remapDelta(m_pdfCamera[0]) / remapDelta(pdfConnection);
+			}
+			else
+			{
+				ratio *= remapDelta(m_pdfCamera[k]) / remapDelta(m_pdfLight[k]);
+				if (k == 1)
+				{
+					ratio *= remapDelta(pdfConnection) / remapDelta(pdfOrigin);
+				}
+			}
+			if (valid(strategy))
+			{
+				sum += ratio * ratio;
+			}
+		}
+		return 1.0f / sum;
+	}
+
+	optix::float3 BidirectionalIntegrator::evalBrdf(PathVertex const& vertex, const optix::float3& toCamera, const optix::float3& toLight, const bool importance) const
+	{
+		// Like the BRDF samples, nothing arrives from below the surface.
+		const float cosCameraGeometry = optix::dot(toCamera, vertex.geometryNormal);
+		const float cosLightGeometry  = optix::dot(toLight, vertex.geometryNormal);
+		if (cosCameraGeometry <= 0.0f || cosLightGeometry <= 0.0f)
+		{
+			return optix::make_float3(0.0f);
+		}
+
+		State state;
+		state.hit_position    = vertex.position;
+		state.geometry_normal = vertex.geometryNormal;
+		state.shading_normal  = vertex.shadingNormal;
+
+		PerRayData prd;
+		prd.wi    = toLight;
+		prd.flags = 0;
+
+		optix::float3 f = evalSurface(vertex.brdf, m_scene.getMaterials()[vertex.index], state, toCamera, prd);
+
+		if (importance)
+		{
+			// The adjoint BRDF of the shading normals, see "Non-symmetric Scattering in Light Transport Algorithms" by Veach.
+			const float denominator = cosLightGeometry * fabsf(optix::dot(toCamera, vertex.shadingNormal));
+			f *= (0.0f < denominator) ? fabsf(optix::dot(toLight, vertex.shadingNormal)) * cosCameraGeometry / denominator : 0.0f;
+		}
+		return f;
+	}
+
+	float BidirectionalIntegrator::brdfPdf(PathVertex const& vertex, const optix::float3& from, const optix::float3& direction) const
+	{
+		if (vertex.type != PATH_VERTEX_SURFACE || vertex.delta)
+		{
+			return 0.0f;
+		}
+
+		State state;
+		state.hit_position    = vertex.position;
+		state.geometry_normal = vertex.geometryNormal;
+		state.shading_normal  = vertex.shadingNormal;
+
+		PerRayData prd;
+		prd.wi    = direction;
+		prd.flags = 0;
+
+		g_brdfPdf[vertex.brdf](m_scene.getMaterials()[vertex.index], state, from, prd);
+		return prd.pdf;
+	}
+
+	float BidirectionalIntegrator::toArea(const float pdf, PathVertex const& from, PathVertex const& to) const
+	{
+		const optix::float3 edge = to.position - from.position;
+		const float distance2 = optix::dot(edge, edge);
+		if (distance2 <= 0.0f)
+		{
+			return 0.0f;
+		}
+		if (to.type == PATH_VERTEX_CAMERA)
+		{
+			return pdf / distance2;
+		}
+		return pdf * fabsf(optix::dot(to.geometryNormal, edge)) / (distance2 * sqrtf(distance2));
+	}
+
+	float BidirectionalIntegrator::emissionPdf(PathVertex const& light, const optix::float3& direction) const
+	{
+		const float cosTheta = optix::dot(light.geometryNormal, direction);
+		return (0.0f < cosTheta) ? cosTheta * M_1_PIf : 0.0f;
+	}
+
+	float BidirectionalIntegrator::originPdf(PathVertex const& light) const
+	{
+		return m_emitters.pmf(light.index) / emitterArea(m_scene.getLights()[light.index]);
+	}
+
+	float BidirectionalIntegrator::connectionPdf(PathVertex const& light, PathVertex const& vertex) const
+	{
+		const optix::float3 edge = light.position - vertex.position;
+		const float distance = optix::length(edge);
+		const float cosTheta = -optix::dot(light.geometryNormal, edge) / distance;
+		if (cosTheta <= 0.0f)
+		{
+			return 0.0f;
+		}
+
+		std::vector<Light> const& lights = m_scene.getLights();
+		const float pdf = lightSelectionPmf(lights, m_selector, light.index, vertex.position) * lightSamplePdf(lights[light.index], vertex.position, distance, cosTheta);
+		return pdf * cosTheta / (distance * distance);
+	}
+
+	bool BidirectionalIntegrator::visible(const optix::float3& from, const optix::float3& to, ShadowCache& shadowCache) const
+	{
+		// Any hit in the open interval blocks, the light geometry included. The sysSceneEpsilon is applied on both sides.
+		const optix::float3 edge = to - from;
+		const float distance = optix::length(edge);
+		return !m_scene.occluded(from, edge / distance, m_sceneEpsilon, distance - m_sceneEpsilon, &shadowCache);
+	}
+}
@@ -0,0 +1,104 @@
+#include "inc/BlueNoiseTile.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
+namespace POptix
+{
+	std::vector<unsigned short> BlueNoiseTile::s_ranks = BlueNoiseTile::whiteNoise();
+	bool                        BlueNoiseTile::s_loaded = false;
+
+	std::vector<unsigned short> BlueNoiseTile::whiteNoise()
+	{
+		const int numTexels = BLUE_NOISE_TILE_SIZE * BLUE_NOISE_TILE_SIZE;
+
+		std::vector<unsigned short> ranks(numTexels);
+		for (int i = 0; i < numTexels; ++i)
+		{
+			ranks[i] = static_cast<unsigned short>(i);
+		}
+
+		// Fisher-Yates shuffle, deterministic.
+		unsigned int seed = 0u;
+		for (int i = numTexels - 1; 0 < i; --i)
+		{
+			seed = hashCombine(seed, unsigned(i));
+			std::swap(ranks[i], ranks[seed % unsigned(i + 1)]);
+		}
+		return ranks;
+	}
+
+	// Skips white space and # comments between the fields of the PGM header.
+	static bool readPgmField(FILE* file, int& value)
+	{
+		int c = fgetc(file);
+		while (c == '#' || c == ' ' || c == '\t' || c == '\r' || c == '\n')
+		{
+			if (c == '#')
+			{
+				while (c != '\n' && c != EOF)
+				{
+					c = fgetc(file);
+				}
+			}
+			c = fgetc(file);
+		}
+		ungetc(c, file);
+		return fscanf(file, "%d", &value) == 1;
+	}
+
+	bool BlueNoiseTile::load(std::string const& filename)
+	{
+		const int numTexels = BLUE_NOISE_TILE_SIZE * BLUE_NOISE_TILE_SIZE;
+
+		s_ranks  = whiteNoise();
+		s_loaded = false;
+
+		FILE* file = fopen(filename.c_str(), "rb");
+		if (!file)
+		{
+			std::cerr << "BlueNoiseTile::load() couldn't open " << filename << ", the blue noise sampler falls back to white noise." << std::endl;
+			return false;
+		}
+
+		char magic[2] = { 0, 0 };
+		int width     = 0;
+		int height    = 0;
+		int maximum   = 0;
+
+		bool valid = fread(magic, 1, 2, file) == 2 && magic[0] == 'P' && magic[1] == '5' &&
+		             readPgmField(file, width) && readPgmField(file, height) && readPgmField(file, maximum) &&
+		             width == BLUE_NOISE_TILE_SIZE && height == BLUE_NOISE_TILE_SIZE && maximum == numTexels - 1;
+
+		std::vector<unsigned short> ranks(numTexels);
+		std::vector<int> count(numTexels, 0);
+		if (valid)
+		{
+			fgetc(file); // The single white space after the maximum value.
+
+			// PGM rows start at the top of the image, the sampler doesn't care, the tile repeats.
+			for (int i = 0; i < numTexels && valid; ++i)
+			{
+				unsigned char bytes[2];
+				valid = fread(bytes, 1, 2, file) == 2;
+
+				const int rank = (int(bytes[0]) << 8) | bytes[1]; // Big endian.
+				valid = valid && rank < numTexels && ++count[rank] == 1;
+				ranks[i] = static_cast<unsigned short>(rank);
+			}
+		}
+		fclose(file);
+
+		// A permutation of all ranks, otherwise the rotations of the pixels are not uniform.
+		if (!valid)
+		{
+			std::cerr << "BlueNoiseTile::load() " << filename << " is not a " << BLUE_NOISE_TILE_SIZE << "x" << BLUE_NOISE_TILE_SIZE << " rank mask, the blue noise sampler falls back to white noise." << std::endl;
+			return false;
+		}
+
+		s_ranks  = ranks;
+		s_loaded = true;
+		return true;
+	}
+}
@@ -0,0 +1,1146 @@
+#include "inc/Bvh.h"
+
+#include "inc/RadixSort.h"
+#include "inc/TileScheduler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include "inc/MyAssert.h"
+
+namespace POptix
+{
+	// Beyond this depth the SAH splits are replaced by median splits to keep the traversal stack bounded.
+	static const int kMaxSahDepth = 30;
+
+	// Primitives per task of the parallel LBVH steps.
+	static const int kLinearChunk = 4096;
+
+	static inline int countLeadingZeros(unsigned int v)
+	{
+#if defined(_MSC_VER)
+		unsigned long index;
+		return _BitScanReverse(&index, v) ? 31 - int(index) : 32;
+#else
+		return (v != 0) ? __builtin_clz(v) : 32;
+#endif
+	}
+
+	struct BvhBin
+	{
+		optix::Aabb bounds;
+		int         count;
+	};
+
+	// SBVH bin, counts the references starting and ending in it.
+	struct BvhSpatialBin
+	{
+		optix::Aabb bounds;
+		int         entry;
+		int         exit;
+	};
+
+	// Part of a triangle inside the bounds.
+	struct BvhReference
+	{
+		optix::Aabb  bounds;
+		unsigned int primitive;
+	};
+
+	// Bounds of the part of a triangle between lo and hi along axis.
+	static optix::Aabb clipTriangle(const optix::float3* v, const int axis, const float lo, const float hi)
+	{
+		optix::Aabb bounds;
+		for (int i = 0; i < 3; ++i)
+		{
+			const optix::float3& a = v[i];
+			const optix::float3& b = v[(i + 1) % 3];
+			const float ca = optix::getByIndex(a, axis);
+			const float cb = optix::getByIndex(b, axis);
+
+			if (lo <= ca && ca <= hi)
+			{
+				bounds.include(a);
+			}
+
+			const float planes[2] = { lo, hi };
+			for (const float plane : planes)
+			{
+				if ((ca < plane && plane < cb) || (cb < plane && plane < ca))
+				{
+					optix::float3 p = a + (b - a) * ((plane - ca) / (cb - ca));
+					// The interpolated coordinates carry rounding errors, pad them so the pieces on both sides still cover the triangle.
+					optix::float3 pad = optix::fabs(p) * 1.0e-6f + 1.0e-30f;
+					optix::setByIndex(p, axis, plane);
+					optix::setByIndex(pad, axis, 0.0f);
+					bounds.include(p - pad);
+					bounds.include(p + pad);
+				}
+			}
+		}
+		return bounds;
+	}
+
+	static optix::Aabb intersectBounds(optix::Aabb const& a, optix::Aabb const& b)
+	{
+		optix::Aabb result(optix::fmaxf(a.m_min, b.m_min), optix::fminf(a.m_max, b.m_max));
+		if (!result.valid())
+		{
+			result.invalidate();
+		}
+		return result;
+	}
+
+	static float areaOrZero(optix::Aabb const& bounds)
+	{
+		return bounds.valid() ? bounds.area() : 0.0f;
+	}
+
+	Bvh::Bvh()
+	{
+	}
+
+	Bvh::~Bvh()
+	{
+	}
+
+	int Bvh::createNode()
+	{
+		BvhNode node;
+		node.offset = 0;
+		node.count  = 0;
+		m_nodes.push_back(node);
+		return int(m_nodes.size()) - 1;
+	}
+
+	void Bvh::build(std::vector<optix::Aabb> const& primitiveBounds, BvhBuildOptions const& options)
+	{
+		m_options = options;
+		m_nodes.clear();
+		m_primitiveIndices.clear();
+
+		if (primitiveBounds.empty())
+		{
+			return;
+		}
+
+		if (options.builder == BVH_BUILDER_LBVH)
+		{
+			buildLinear(primitiveBounds);
+			return;
+		}
+
+		std::vector<optix::float3> centroids(primitiveBounds.size());
+		m_primitiveIndices.resize(primitiveBounds.size());
+		for (size_t i = 0; i < primitiveBounds.size(); ++i)
+		{
+			centroids[i] = primitiveBounds[i].center();
+			m_primitiveIndices[i] = static_cast<unsigned int>(i);
+		}
+
+		m_nodes.reserve(2 * primitiveBounds.size());
+		createNode();
+		subdivide(0, 0, int(primitiveBounds.size()), primitiveBounds, centroids);
+	}
+
+	void Bvh::subdivide(int nodeIndex, int begin, int end, std::vector<optix::Aabb> const& primitiveBounds, std::vector<optix::float3> const& centroids)
+	{
+		// Explicit stack of pending (node, begin, end, depth) ranges.
+		struct Range
+		{
+			int node;
+			int begin;
+			int end;
+			int depth;
+		};
+
+		std::vector<Range> pending;
+		pending.push_back({ nodeIndex, begin, end, 0 });
+
+		std::vector<BvhBin> bins(3 * m_options.binCount); // All three axes are binned in one pass.
+		std::vector<float>  rightArea(m_options.binCount);
+		std::vector<int>    rightCount(m_options.binCount);
+
+		while (!pending.empty())
+		{
+			const Range range = pending.back();
+			pending.pop_back();
+
+			const int count = range.end - range.begin;
+
+			optix::Aabb bounds;
+			optix::Aabb centroidBounds;
+			for (int i = range.begin; i < range.end; ++i)
+			{
+				const unsigned int prim = m_primitiveIndices[i];
+				bounds.include(primitiveBounds[prim]);
+				centroidBounds.include(centroids[prim]);
+			}
+			m_nodes[range.node].bounds = bounds;
+
+			const float leafCost = m_options.intersectionCost * float(count);
+
+			int   bestAxis  = -1;
+			int   bestSplit = -1;
+			float bestCost  = leafCost;
+
+			if (1 < count && range.depth < kMaxSahDepth)
+			{
+				const float parentArea = fmaxf(bounds.area(), 1.0e-20f);
+
+				const optix::float3 centroidExtent = centroidBounds.extent();
+				const optix::float3 scale = make_float3(
+					(0.0f < centroidExtent.x) ? float(m_options.binCount) / centroidExtent.x : 0.0f,
+					(0.0f < centroidExtent.y) ? float(m_options.binCount) / centroidExtent.y : 0.0f,
+					(0.0f < centroidExtent.z) ? float(m_options.binCount) / centroidExtent.z : 0.0f);
+
+				for (BvhBin& bin : bins)
+				{
+					bin.bounds.invalidate();
+					bin.count = 0;
+				}
+
+				for (int i = range.begin; i < range.end; ++i)
+				{
+					const unsigned int prim = m_primitiveIndices[i];
+					const optix::float3 b = (centroids[prim] - centroidBounds.m_min) * scale;
+
+					BvhBin& binX = bins[                         std::min(m_options.binCount - 1, int(b.x))];
+					BvhBin& binY = bins[    m_options.binCount + std::min(m_options.binCount - 1, int(b.y))];
+					BvhBin& binZ = bins[2 * m_options.binCount + std::min(m_options.binCount - 1, int(b.z))];
+					binX.bounds.include(primitiveBounds[prim]);
+					binY.bounds.include(primitiveBounds[prim]);
+					binZ.bounds.include(primitiveBounds[prim]);
+					binX.count++;
+					binY.count++;
+					binZ.count++;
+				}
+
+				for (int axis = 0; axis < 3; ++axis)
+				{
+					if (optix::getByIndex(scale, axis) <= 0.0f)
+					{
+						continue;
+					}
+					const BvhBin* axisBins = &bins[axis * m_options.binCount];
+
+					// Sweep from the right to get the area and count of everything right of each plane.
+					optix::Aabb accumulated;
+					int accumulatedCount = 0;
+					for (int b = m_options.binCount - 1; 0 < b; --b)
+					{
+						accumulated.include(axisBins[b].bounds);
+						accumulatedCount += axisBins[b].count;
+						rightArea[b]  = (0 < accumulatedCount) ? accumulated.area() : 0.0f;
+						rightCount[b] = accumulatedCount;
+					}
+
+					accumulated.invalidate();
+					accumulatedCount = 0;
+					for (int b = 0; b < m_options.binCount - 1; ++b)
+					{
+						accumulated.include(axisBins[b].bounds);
+						accumulatedCount += axisBins[b].count;
+
+						if (accumulatedCount == 0 || rightCount[b + 1] == 0)
+						{
+							continue;
+						}
+
+						const float cost = m_options.traversalCost +
+							m_options.intersectionCost * (accumulated.area() * float(accumulatedCount) + rightArea[b + 1] * float(rightCount[b + 1])) / parentArea;
+						if (cost < bestCost)
+						{
+							bestCost  = cost;
+							bestAxis  = axis;
+							bestSplit = b;
+						}
+					}
+				}
+			}
+
+			int middle = -1;
+			if (0 <= bestAxis)
+			{
+				const float axisMin = optix::getByIndex(centroidBounds.m_min, bestAxis);
+				const float scale   = float(m_options.binCount) / (optix::getByIndex(centroidBounds.m_max, bestAxis) - axisMin);
+
+				unsigned int* split = std::partition(&m_primitiveIndices[range.begin], &m_primitiveIndices[0] + range.end,
+					[&](unsigned int prim)
+					{
+						const int b = std::min(m_options.binCount - 1, int((optix::getByIndex(centroids[prim], bestAxis) - axisMin) * scale));
+						return b <= bestSplit;
+					});
+				middle = int(split - &m_primitiveIndices[0]);
+			}
+			else if (m_options.maxLeafSize < count)
+			{
+				// SAH prefers a leaf (or all centroids coincide) but the leaf would be too big. Split at the median of the widest axis.
+				const int axis = centroidBounds.longestAxis();
+				middle = range.begin + count / 2;
+				std::nth_element(&m_primitiveIndices[range.begin], &m_primitiveIndices[middle], &m_primitiveIndices[0] + range.end,
+					[&](unsigned int a, unsigned int b)
+					{
+						return optix::getByIndex(centroids[a], axis) < optix::getByIndex(centroids[b], axis);
+					});
+			}
+
+			if (middle <= range.begin || range.end <= middle)
+			{
+				m_nodes[range.node].offset = range.begin;
+				m_nodes[range.node].count  = count;
+				continue;
+			}
+
+			const int left = createNode();
+			createNode();
+			m_nodes[range.node].offset = left;
+			m_nodes[range.node].count  = 0;
+
+			// Push the right child first so the left subtree is emitted first (depth-first order).
+			pending.push_back({ left + 1, middle, range.end, range.depth + 1 });
+			pending.push_back({ left, range.begin, middle, range.depth + 1 });
+		}
+	}
+
+	void Bvh::build(std::vector<optix::float3> const& triangleVertices, BvhBuildOptions const& options, std::vector<unsigned char> const* splittable)
+	{
+		MY_ASSERT(triangleVertices.size() % 3 == 0);
+
+		if (options.builder == BVH_BUILDER_SBVH)
+		{
+			m_options = options;
+			buildSpatialSplits(triangleVertices, splittable);
+			return;
+		}
+
+		std::vector<optix::Aabb> primitiveBounds(triangleVertices.size() / 3);
+		for (size_t i = 0; i < primitiveBounds.size(); ++i)
+		{
+			primitiveBounds[i].set(triangleVertices[i * 3], triangleVertices[i * 3 + 1], triangleVertices[i * 3 + 2]);
+		}
+		build(primitiveBounds, options);
+	}
+
+	// Split BVH after Stich, Friedrich and Dietrich, "Spatial Splits in Bounding Volume Hierarchies", HPG 2009.
+	// Every node evaluates the binned object split. When its children overlap noticeably, a binned spatial split is evaluated as well,
+	// which clips the triangles at the bin planes. References straddling the chosen plane are either duplicated or, when cheaper, unsplit.
+	void Bvh::buildSpatialSplits(std::vector<optix::float3> const& triangleVertices, std::vector<unsigned char> const* splittable)
+	{
+		m_nodes.clear();
+		m_primitiveIndices.clear();
+
+		const int numPrimitives = int(triangleVertices.size() / 3);
+		if (numPrimitives == 0)
+		{
+			return;
+		}
+
+		struct Range
+		{
+			int                       node;
+			std::vector<BvhReference> references;
+			int                       depth;
+		};
+
+		std::vector<Range> pending(1);
+		pending[0].node  = 0;
+		pending[0].depth = 0;
+		pending[0].references.resize(numPrimitives);
+
+		optix::Aabb rootBounds;
+		for (int i = 0; i < numPrimitives; ++i)
+		{
+			pending[0].references[i].bounds.set(triangleVertices[i * 3], triangleVertices[i * 3 + 1], triangleVertices[i * 3 + 2]);
+			pending[0].references[i].primitive = unsigned(i);
+			rootBounds.include(pending[0].references[i].bounds);
+		}
+
+		const float minOverlap   = m_options.spatialSplitAlpha * rootBounds.area();
+		const int maxReferences  = int(float(numPrimitives) * (1.0f + m_options.maxDuplication));
+		int numReferences        = numPrimitives;
+		const int binCount       = m_options.binCount;
+
+		std::vector<BvhBin>        bins(binCount);
+		std::vector<BvhSpatialBin> spatialBins(binCount);
+		std::vector<optix::Aabb>   rightBounds(binCount);
+		std::vector<int>           rightCount(binCount);
+
+		m_nodes.reserve(2 * numPrimitives);
+		createNode();
+
+		while (!pending.empty())
+		{
+			Range range;
+			range.node  = pending.back().node;
+			range.depth = pending.back().depth;
+			range.references.swap(pending.back().references);
+			pending.pop_back();
+
+			std::vector<BvhReference>& references = range.references;
+			const int count = int(references.size());
+
+			optix::Aabb bounds;
+			optix::Aabb centroidBounds;
+			for (const BvhReference& reference : references)
+			{
+				bounds.include(reference.bounds);
+				centroidBounds.include(reference.bounds.center());
+			}
+			m_nodes[range.node].bounds = bounds;
+
+			const float parentArea = fmaxf(bounds.area(), 1.0e-20f);
+			const float leafCost   = m_options.intersectionCost * float(count);
+
+			// Object split.
+			int         objectAxis  = -1;
+			int         objectSplit = -1;
+			float       objectCost  = FLT_MAX;
+			optix::Aabb objectLeft;
+			optix::Aabb objectRight;
+
+			// Spatial split.
+			int         spatialAxis  = -1;
+			int         spatialSplit = -1;
+			float       spatialCost  = FLT_MAX;
+			optix::Aabb spatialLeft;
+			optix::Aabb spatialRight;
+			int         spatialLeftCount  = 0;
+			int         spatialRightCount = 0;
+
+			if (1 < count && range.depth < kMaxSahDepth)
+			{
+				for (int axis = 0; axis < 3; ++axis)
+				{
+					const float axisMin = optix::getByIndex(centroidBounds.m_min, axis);
+					const float extent  = optix::getByIndex(centroidBounds.m_max, axis) - axisMin;
+					if (extent <= 0.0f)
+					{
+						continue;
+					}
+					const float scale = float(binCount) / extent;
+
+					for (BvhBin& bin : bins)
+					{
+						bin.bounds.invalidate();
+						bin.count = 0;
+					}
+					for (const BvhReference& reference : references)
+					{
+						BvhBin& bin = bins[std::min(binCount - 1, int((reference.bounds.center(axis) - axisMin) * scale))];
+						bin.bounds.include(reference.bounds);
+						bin.count++;
+					}
+
+					optix::Aabb accumulated;
+					int accumulatedCount = 0;
+					for (int b = binCount - 1; 0 < b; --b)
+					{
+						accumulated.include(bins[b].bounds);
+						accumulatedCount += bins[b].count;
+						rightBounds[b] = accumulated;
+						rightCount[b]  = accumulatedCount;
+					}
+
+					accumulated.invalidate();
+					accumulatedCount = 0;
+					for (int b = 0; b < binCount - 1; ++b)
+					{
+						accumulated.include(bins[b].bounds);
+						accumulatedCount += bins[b].count;
+						if (accumulatedCount == 0 || rightCount[b + 1] == 0)
+						{
+							continue;
+						}
+
+						const float cost = m_options.traversalCost +
+							m_options.intersectionCost * (accumulated.area() * float(accumulatedCount) + rightBounds[b + 1].area() * float(rightCount[b + 1])) / parentArea;
+						if (cost < objectCost)
+						{
+							objectCost  = cost;
+							objectAxis  = axis;
+							objectSplit = b;
+							objectLeft  = accumulated;
+							objectRight = rightBounds[b + 1];
+						}
+					}
+				}
+
+				const bool overlapping = (0 <= objectAxis) && minOverlap < areaOrZero(intersectBounds(objectLeft, objectRight));
+				if ((objectAxis < 0 || overlapping) && numReferences < maxReferences)
+				{
+					for (int axis = 0; axis < 3; ++axis)
+					{
+						const float axisMin = optix::getByIndex(bounds.m_min, axis);
+						const float extent  = optix::getByIndex(bounds.m_max, axis) - axisMin;
+						if (extent <= 0.0f)
+						{
+							continue;
+						}
+						const float binWidth = extent / float(binCount);
+						const float scale    = float(binCount) / extent;
+
+						for (BvhSpatialBin& bin : spatialBins)
+						{
+							bin.bounds.invalidate();
+							bin.entry = 0;
+							bin.exit  = 0;
+						}
+
+						for (const BvhReference& reference : references)
+						{
+							const bool canSplit = (splittable == nullptr) || (*splittable)[reference.primitive];
+							if (!canSplit)
+							{
+								// Kept whole on the side of its centroid.
+								BvhSpatialBin& bin = spatialBins[std::min(binCount - 1, std::max(0, int((reference.bounds.center(axis) - axisMin) * scale)))];
+								bin.bounds.include(reference.bounds);
+								bin.entry++;
+								bin.exit++;
+								continue;
+							}
+
+							const int first = std::min(binCount - 1, std::max(0, int((optix::getByIndex(reference.bounds.m_min, axis) - axisMin) * scale)));
+							const int last  = std::min(binCount - 1, std::max(first, int((optix::getByIndex(reference.bounds.m_max, axis) - axisMin) * scale)));
+
+							if (first == last)
+							{
+								spatialBins[first].bounds.include(reference.bounds);
+							}
+							else
+							{
+								const optix::float3* v = &triangleVertices[reference.primitive * 3];
+								for (int b = first; b <= last; ++b)
+								{
+									const float lo = (b == first) ? -FLT_MAX : axisMin + binWidth * float(b);
+									const float hi = (b == last)  ?  FLT_MAX : axisMin + binWidth * float(b + 1);
+									const optix::Aabb piece = intersectBounds(clipTriangle(v, axis, lo, hi), reference.bounds);
+									if (piece.valid())
+									{
+										spatialBins[b].bounds.include(piece);
+									}
+								}
+							}
+							spatialBins[first].entry++;
+							spatialBins[last].exit++;
+						}
+
+						optix::Aabb accumulated;
+						int accumulatedCount = 0;
+						for (int b = binCount - 1; 0 < b; --b)
+						{
+							accumulated.include(spatialBins[b].bounds);
+							accumulatedCount += spatialBins[b].exit;
+							rightBounds[b] = accumulated;
+							rightCount[b]  = accumulatedCount;
+						}
+
+						accumulated.invalidate();
+						accumulatedCount = 0;
+						for (int b = 0; b < binCount - 1; ++b)
+						{
+							accumulated.include(spatialBins[b].bounds);
+							accumulatedCount += spatialBins[b].entry;
+							if (accumulatedCount == 0 || rightCount[b + 1] == 0)
+							{
+								continue;
+							}
+
+							const float cost = m_options.traversalCost +
+								m_options.intersectionCost * (accumulated.area() * float(accumulatedCount) + rightBounds[b + 1].area() * float(rightCount[b + 1])) / parentArea;
+							if (cost < spatialCost)
+							{
+								spatialCost       = cost;
+								spatialAxis       = axis;
+								spatialSplit      = b;
+								spatialLeft       = accumulated;
+								spatialRight      = rightBounds[b + 1];
+								spatialLeftCount  = accumulatedCount;
+								spatialRightCount = rightCount[b + 1];
+							}
+						}
+					}
+				}
+			}
+
+			std::vector<BvhReference> left;
+			std::vector<BvhReference> right;
+
+			const bool forceSplit = m_options.maxLeafSize < count;
+
+			if (0 <= spatialAxis && spatialCost < objectCost && (spatialCost < leafCost || forceSplit))
+			{
+				const float axisMin = optix::getByIndex(bounds.m_min, spatialAxis);
+				const float plane   = axisMin + (optix::getByIndex(bounds.m_max, spatialAxis) - axisMin) * float(spatialSplit + 1) / float(binCount);
+
+				optix::Aabb splitLeft  = spatialLeft;
+				optix::Aabb splitRight = spatialRight;
+				int splitLeftCount  = spatialLeftCount;
+				int splitRightCount = spatialRightCount;
+
+				for (const BvhReference& reference : references)
+				{
+					const float lo = optix::getByIndex(reference.bounds.m_min, spatialAxis);
+					const float hi = optix::getByIndex(reference.bounds.m_max, spatialAxis);
+					const bool canSplit = (splittable == nullptr) || (*splittable)[reference.primitive];
+
+					if (hi <= plane)
+					{
+						left.push_back(reference);
+					}
+					else if (plane <= lo)
+					{
+						right.push_back(reference);
+					}
+					else if (!canSplit)
+					{
+						((reference.bounds.center(spatialAxis) < plane) ? left : right).push_back(reference);
+					}
+					else
+					{
+						// Reference unsplitting: keep the reference whole on one side when that is cheaper than duplicating it.
+						optix::Aabb unsplitLeft = splitLeft;
+						unsplitLeft.include(reference.bounds);
+						optix::Aabb unsplitRight = splitRight;
+						unsplitRight.include(reference.bounds);
+
+						const float costSplit = splitLeft.area() * float(splitLeftCount) + splitRight.area() * float(splitRightCount);
+						const float costLeft  = unsplitLeft.area() * float(splitLeftCount) + splitRight.area() * float(splitRightCount - 1);
+						const float costRight = splitLeft.area() * float(splitLeftCount - 1) + unsplitRight.area() * float(splitRightCount);
+
+						const bool duplicate = (costSplit < costLeft && costSplit < costRight) && numReferences < maxReferences;
+						if (duplicate)
+						{
+							const optix::float3* v = &triangleVertices[reference.primitive * 3];
+							BvhReference leftPiece  = { intersectBounds(clipTriangle(v, spatialAxis, -FLT_MAX, plane), reference.bounds), reference.primitive };
+							BvhReference rightPiece = { intersectBounds(clipTriangle(v, spatialAxis, plane,  FLT_MAX), reference.bounds), reference.primitive };
+
+							if (leftPiece.bounds.valid() && rightPiece.bounds.valid())
+							{
+								left.push_back(leftPiece);
+								right.push_back(rightPiece);
+								++numReferences;
+							}
+							else
+							{
+								(leftPiece.bounds.valid() ? left : right).push_back(reference);
+							}
+						}
+						else if (costLeft <= costRight)
+						{
+							left.push_back(reference);
+							splitLeft = unsplitLeft;
+							--splitRightCount;
+						}
+						else
+						{
+							right.push_back(reference);
+							splitRight = unsplitRight;
+							--splitLeftCount;
+						}
+					}
+				}
+			}
+			else if (0 <= objectAxis && (objectCost < leafCost || forceSplit))
+			{
+				const float axisMin = optix::getByIndex(centroidBounds.m_min, objectAxis);
+				const float scale   = float(binCount) / (optix::getByIndex(centroidBounds.m_max, objectAxis) - axisMin);
+				for (const BvhReference& reference : references)
+				{
+					const int b = std::min(binCount - 1, int((reference.bounds.center(objectAxis) - axisMin) * scale));
+					((b <= objectSplit) ? left : right).push_back(reference);
+				}
+			}
+
+			if ((left.empty() || right.empty()) && forceSplit)
+			{
+				// All centroids coincide or the spatial split degenerated. Split at the median of the widest axis.
+				left.clear();
+				right.clear();
+				const int axis = centroidBounds.longestAxis();
+				std::nth_element(references.begin(), references.begin() + count / 2, references.end(),
+					[axis](BvhReference const& a, BvhReference const& b)
+					{
+						return a.bounds.center(axis) < b.bounds.center(axis);
+					});
+				left.assign(references.begin(), references.begin() + count / 2);
+				right.assign(references.begin() + count / 2, references.end());
+			}
+
+			if (left.empty() || right.empty())
+			{
+				m_nodes[range.node].offset = int(m_primitiveIndices.size());
+				m_nodes[range.node].count  = count;
+				for (const BvhReference& reference : references)
+				{
+					m_primitiveIndices.push_back(reference.primitive);
+				}
+				continue;
+			}
+
+			const int leftNode = createNode();
+			createNode();
+			m_nodes[range.node].offset = leftNode;
+			m_nodes[range.node].count  = 0;
+
+			// Push the right child first so the left subtree is emitted first (depth-first order).
+			pending.push_back(Range());
+			pending.back().node  = leftNode + 1;
+			pending.back().depth = range.depth + 1;
+			pending.back().references.swap(right);
+
+			pending.push_back(Range());
+			pending.back().node  = leftNode;
+			pending.back().depth = range.depth + 1;
+			pending.back().references.swap(left);
+		}
+	}
+
+	// Morton code and index of the first differing bit between the sorted keys i and j, -1 outside the range.
+	// Equal keys fall back to the index so the hierarchy stays a proper binary tree.
+	static int commonPrefix(std::vector<unsigned int> const& keys, const int i, const int j)
+	{
+		if (j < 0 || int(keys.size()) <= j)
+		{
+			return -1;
+		}
+		if (keys[i] == keys[j])
+		{
+			return 32 + countLeadingZeros(unsigned(i ^ j));
+		}
+		return countLeadingZeros(keys[i] ^ keys[j]);
+	}
+
+	// Runs function(begin, end) over [0, count) on the scheduler, or serially without one.
+	template<typename RangeFunction>
+	static void parallelRange(TileScheduler* scheduler, const int count, const int grainSize, RangeFunction const& function)
+	{
+		if (scheduler == nullptr)
+		{
+			function(0, count);
+			return;
+		}
+		scheduler->parallelFor(count, grainSize, [&function](int begin, int end, int /*threadIndex*/)
+		{
+			function(begin, end);
+		});
+	}
+
+	// Linear BVH after Karras, "Maximizing Parallelism in the Construction of BVHs, Octrees, and k-d Trees", HPG 2012,
+	// with the treelet restructuring of Karras and Aila, "Fast Parallel Construction of High-Quality Bounding Volume Hierarchies", HPG 2013.
+	// The Karras hierarchy has n - 1 internal nodes (0 to n - 2) followed by the n leaves. It is converted into the
+	// depth-first layout of the other builders at the end, collapsing subtrees into leaves where the SAH prefers it.
+	void Bvh::buildLinear(std::vector<optix::Aabb> const& primitiveBounds)
+	{
+		const int n = int(primitiveBounds.size());
+		TileScheduler* scheduler = m_options.scheduler;
+
+		optix::Aabb centroidBounds;
+		for (const optix::Aabb& bounds : primitiveBounds)
+		{
+			centroidBounds.include(bounds.center());
+		}
+
+		// Morton codes of the centroids, 10 bits per axis.
+		std::vector<unsigned int> keys(n);
+		std::vector<int>          values(n);
+		const optix::float3 extent = centroidBounds.extent();
+		const optix::float3 scale  = optix::make_float3(
+			(0.0f < extent.x) ? 1023.0f / extent.x : 0.0f,
+			(0.0f < extent.y) ? 1023.0f / extent.y : 0.0f,
+			(0.0f < extent.z) ? 1023.0f / extent.z : 0.0f);
+
+		parallelRange(scheduler, n, kLinearChunk, [&](int begin, int end)
+		{
+			for (int i = begin; i < end; ++i)
+			{
+				const optix::float3 p = (primitiveBounds[i].center() - centroidBounds.m_min) * scale;
+				keys[i]   = morton3D(unsigned(p.x), unsigned(p.y), unsigned(p.z));
+				values[i] = i;
+			}
+		});
+
+		if (scheduler != nullptr)
+		{
+			std::vector<unsigned int> scratchKeys;
+			std::vector<int>          scratchValues;
+			radixSort(*scheduler, keys, values, 30, scratchKeys, scratchValues);
+		}
+		else
+		{
+			std::vector<unsigned long long> pairs(n);
+			for (int i = 0; i < n; ++i)
+			{
+				pairs[i] = ((unsigned long long)(keys[i]) << 32) | unsigned(i);
+			}
+			std::sort(pairs.begin(), pairs.end());
+			for (int i = 0; i < n; ++i)
+			{
+				keys[i]   = unsigned(pairs[i] >> 32);
+				values[i] = int(pairs[i] & 0xFFFFFFFFull);
+			}
+		}
+
+		const int numInternal = n - 1;
+		const int numNodes    = 2 * n - 1;
+
+		std::vector<int>         children(2 * size_t(numInternal));
+		std::vector<int>         parents(numNodes, -1);
+		std::vector<optix::Aabb> nodeBounds(numNodes);
+		std::vector<int>         nodeCounts(numNodes, 1);
+		std::vector<float>       nodeCosts(numNodes);
+
+		// Every internal node finds its key range and split independently.
+		parallelRange(scheduler, numInternal, kLinearChunk, [&](int begin, int end)
+		{
+			for (int i = begin; i < end; ++i)
+			{
+				const int d = (commonPrefix(keys, i, i + 1) - commonPrefix(keys, i, i - 1) < 0) ? -1 : 1;
+
+				// Upper bound of the range length, then binary search for the other end.
+				const int prefixMin = commonPrefix(keys, i, i - d);
+				int lengthMax = 2;
+				while (prefixMin < commonPrefix(keys, i, i + lengthMax * d))
+				{
+					lengthMax *= 2;
+				}
+				int length = 0;
+				for (int t = lengthMax / 2; 1 <= t; t /= 2)
+				{
+					if (prefixMin < commonPrefix(keys, i, i + (length + t) * d))
+					{
+						length += t;
+					}
+				}
+				const int j = i + length * d;
+
+				// Binary search for the position of the highest differing bit.
+				const int prefixNode = commonPrefix(keys, i, j);
+				int split = 0;
+				int t     = length;
+				do
+				{
+					t = (t + 1) / 2;
+					if (prefixNode < commonPrefix(keys, i, i + (split + t) * d))
+					{
+						split += t;
+					}
+				} while (1 < t);
+				const int gamma = i + split * d + std::min(d, 0);
+
+				const int left  = (std::min(i, j) == gamma)     ? numInternal + gamma     : gamma;
+				const int right = (std::max(i, j) == gamma + 1) ? numInternal + gamma + 1 : gamma + 1;
+				children[2 * i]     = left;
+				children[2 * i + 1] = right;
+				parents[left]  = i;
+				parents[right] = i;
+			}
+		});
+
+		const float leafCostFactor = m_options.intersectionCost;
+		const int   maxLeafSize    = m_options.maxLeafSize;
+
+		// SAH cost of a subtree (not normalized), with the option to collapse it into a single leaf.
+		auto subtreeCost = [&](const float area, const int count, const float childCosts)
+		{
+			const float cost = m_options.traversalCost * area + childCosts;
+			return (count <= maxLeafSize) ? std::min(cost, leafCostFactor * area * float(count)) : cost;
+		};
+
+		parallelRange(scheduler, n, kLinearChunk, [&](int begin, int end)
+		{
+			for (int i = begin; i < end; ++i)
+			{
+				const int leaf = numInternal + i;
+				nodeBounds[leaf] = primitiveBounds[values[i]];
+				nodeCosts[leaf]  = leafCostFactor * nodeBounds[leaf].area();
+			}
+		});
+
+		// Bottom-up passes. The second thread arriving at a node finds both subtrees finished, owns the node and continues upwards.
+		std::vector<std::atomic<int>> visits(std::max(numInternal, 1));
+		const int numPasses = std::max(1, m_options.treeletPasses);
+
+		for (int pass = 0; pass < numPasses; ++pass)
+		{
+			for (std::atomic<int>& visit : visits)
+			{
+				visit.store(0, std::memory_order_relaxed);
+			}
+
+			parallelRange(scheduler, n, kLinearChunk, [&](int begin, int end)
+			{
+				for (int i = begin; i < end; ++i)
+				{
+					int node = parents[numInternal + i];
+					while (0 <= node && visits[node].fetch_add(1, std::memory_order_acq_rel) == 1)
+					{
+						const int left  = children[2 * node];
+						const int right = children[2 * node + 1];
+
+						nodeBounds[node] = nodeBounds[left];
+						nodeBounds[node].include(nodeBounds[right]);
+						nodeCounts[node] = nodeCounts[left] + nodeCounts[right];
+						nodeCosts[node]  = subtreeCost(nodeBounds[node].area(), nodeCounts[node], nodeCosts[left] + nodeCosts[right]);
+
+						if (0 < m_options.treeletPasses && kTreeletSize <= nodeCounts[node])
+						{
+							restructureTreelet(node, numInternal, children, parents, nodeBounds, nodeCounts, nodeCosts);
+						}
+
+						node = parents[node];
+					}
+				}
+			});
+		}
+
+		// Depth-first relayout. Subtrees which are cheaper as a leaf are collapsed, their primitives gathered in tree order.
+		m_nodes.reserve(numNodes);
+		m_primitiveIndices.reserve(n);
+		createNode();
+
+		std::vector<std::pair<int, int>> pending(1, std::make_pair(0, 0)); // (Karras node, node), node 0 is the only leaf when n == 1.
+		std::vector<int> gather;
+
+		while (!pending.empty())
+		{
+			const int source = pending.back().first;
+			const int target = pending.back().second;
+			pending.pop_back();
+
+			m_nodes[target].bounds = nodeBounds[source];
+
+			const bool isLeaf = (numInternal <= source);
+			const bool collapse = !isLeaf && nodeCounts[source] <= maxLeafSize &&
+				leafCostFactor * nodeBounds[source].area() * float(nodeCounts[source]) <= nodeCosts[source];
+
+			if (isLeaf || collapse)
+			{
+				m_nodes[target].offset = int(m_primitiveIndices.size());
+				m_nodes[target].count  = nodeCounts[source];
+
+				gather.assign(1, source);
+				while (!gather.empty())
+				{
+					const int node = gather.back();
+					gather.pop_back();
+					if (numInternal <= node)
+					{
+						m_primitiveIndices.push_back(unsigned(values[node - numInternal]));
+					}
+					else
+					{
+						gather.push_back(children[2 * node + 1]);
+						gather.push_back(children[2 * node]);
+					}
+				}
+				continue;
+			}
+
+			const int left = createNode();
+			createNode();
+			m_nodes[target].offset = left;
+			m_nodes[target].count  = 0;
+
+			pending.push_back(std::make_pair(children[2 * source + 1], left + 1));
+			pending.push_back(std::make_pair(children[2 * source],     left));
+		}
+	}
+
+	// Replaces the topology of the up to kTreeletSize nodes below root with the SAH optimal one.
+	// The treelet grows by expanding its largest leaf, the optimal topology over the leaf subsets is found by dynamic programming.
+	void Bvh::restructureTreelet(const int root, const int numInternal, std::vector<int>& children, std::vector<int>& parents,
+	                             std::vector<optix::Aabb>& nodeBounds, std::vector<int>& nodeCounts, std::vector<float>& nodeCosts) const
+	{
+		int leaves[kTreeletSize];
+		int internals[kTreeletSize - 1];
+		int numLeaves    = 2;
+		int numInternals = 0;
+
+		leaves[0] = children[2 * root];
+		leaves[1] = children[2 * root + 1];
+
+		while (numLeaves < kTreeletSize)
+		{
+			int   largest     = -1;
+			float largestArea = -1.0f;
+			for (int i = 0; i < numLeaves; ++i)
+			{
+				if (leaves[i] < numInternal && largestArea < nodeBounds[leaves[i]].area())
+				{
+					largest     = i;
+					largestArea = nodeBounds[leaves[i]].area();
+				}
+			}
+			if (largest < 0)
+			{
+				break;
+			}
+
+			const int expanded = leaves[largest];
+			internals[numInternals++] = expanded;
+			leaves[largest]     = children[2 * expanded];
+			leaves[numLeaves++] = children[2 * expanded + 1];
+		}
+
+		if (numLeaves < 3)
+		{
+			return;
+		}
+
+		const int numSubsets = 1 << numLeaves;
+
+		optix::Aabb   subsetBounds[1 << kTreeletSize];
+		float         subsetCosts[1 << kTreeletSize];
+		int           subsetCounts[1 << kTreeletSize];
+		unsigned char subsetPartitions[1 << kTreeletSize];
+
+		for (int s = 1; s < numSubsets; ++s)
+		{
+			const int lowest = s & -s;
+			if (s == lowest)
+			{
+				int bit = 0;
+				while ((1 << bit) != s)
+				{
+					++bit;
+				}
+				subsetBounds[s] = nodeBounds[leaves[bit]];
+				subsetCounts[s] = nodeCounts[leaves[bit]];
+				subsetCosts[s]  = nodeCosts[leaves[bit]];
+				continue;
+			}
+
+			subsetBounds[s] = subsetBounds[lowest];
+			subsetBounds[s].include(subsetBounds[s ^ lowest]);
+			subsetCounts[s] = subsetCounts[lowest] + subsetCounts[s ^ lowest];
+
+			// Only the partitions with the lowest leaf on the left side, so each split is visited once.
+			const int rest = s ^ lowest;
+			float bestCost = FLT_MAX;
+			for (int sub = (rest - 1) & rest; ; sub = (sub - 1) & rest)
+			{
+				const int p = sub | lowest;
+				const float cost = subsetCosts[p] + subsetCosts[s ^ p];
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					subsetPartitions[s] = (unsigned char)(p);
+				}
+				if (sub == 0)
+				{
+					break;
+				}
+			}
+
+			const float area = subsetBounds[s].area();
+			const float cost = m_options.traversalCost * area + bestCost;
+			subsetCosts[s] = (subsetCounts[s] <= m_options.maxLeafSize) ? std::min(cost, m_options.intersectionCost * area * float(subsetCounts[s])) : cost;
+		}
+
+		const int full = numSubsets - 1;
+		if (nodeCosts[root] <= subsetCosts[full])
+		{
+			return;
+		}
+
+		// Rebuild top-down, reusing the internal nodes of the old treelet.
+		std::pair<int, int> pending[kTreeletSize]; // (subset, node)
+		int numPending = 0;
+		int nextInternal = 0;
+		pending[numPending++] = std::make_pair(full, root);
+
+		while (0 < numPending)
+		{
+			const int subset = pending[numPending - 1].first;
+			const int node   = pending[numPending - 1].second;
+			--numPending;
+
+			nodeBounds[node] = subsetBounds[subset];
+			nodeCounts[node] = subsetCounts[subset];
+			nodeCosts[node]  = subsetCosts[subset];
+
+			const int parts[2] = { subsetPartitions[subset], subset ^ subsetPartitions[subset] };
+			for (int c = 0; c < 2; ++c)
+			{
+				int child;
+				if ((parts[c] & (parts[c] - 1)) == 0)
+				{
+					int bit = 0;
+					while ((1 << bit) != parts[c])
+					{
+						++bit;
+					}
+					child = leaves[bit];
+				}
+				else
+				{
+					child = internals[nextInternal++];
+					pending[numPending++] = std::make_pair(parts[c], child);
+				}
+				children[2 * node + c] = child;
+				parents[child] = node;
+			}
+		}
+	}
+
+	void Bvh::reference(BvhBuildOptions const& options, std::shared_ptr<const void> const& storage,
+	                    const BvhNode* nodes, const size_t numNodes, const unsigned int* primitiveIndices, const size_t numPrimitiveIndices)
+	{
+		m_options = options;
+		m_nodes.reference(storage, nodes, numNodes);
+		m_primitiveIndices.reference(storage, primitiveIndices, numPrimitiveIndices);
+	}
+
+	void Bvh::refit(std::vector<optix::Aabb> const& primitiveBounds)
+	{
+		MY_ASSERT(primitiveBounds.size() == m_primitiveIndices.size());
+
+		// A referenced hierarchy gets its own nodes here, the primitive indices stay shared.
+		std::vector<BvhNode>& nodes            = m_nodes.edit();
+		const unsigned int*   primitiveIndices = m_primitiveIndices.data();
+
+		// Children always have higher indices than their parent.
+		for (int i = int(nodes.size()) - 1; 0 <= i; --i)
+		{
+			BvhNode& node = nodes[i];
+			node.bounds.invalidate();
+
+			if (node.isLeaf())
+			{
+				for (int p = node.offset; p < node.offset + node.count; ++p)
+				{
+					node.bounds.include(primitiveBounds[primitiveIndices[p]]);
+				}
+			}
+			else
+			{
+				node.bounds.include(nodes[node.offset].bounds);
+				node.bounds.include(nodes[node.offset + 1].bounds);
+			}
+		}
+	}
+
+	float Bvh::sahCost() const
+	{
+		if (m_nodes.empty())
+		{
+			return 0.0f;
+		}
+
+		const float rootArea = fmaxf(m_nodes[0].bounds.area(), 1.0e-20f);
+
+		float cost = 0.0f;
+		for (const BvhNode& node : m_nodes)
+		{
+			const float area = node.bounds.area();
+			cost += (node.isLeaf()) ? m_options.intersectionCost * area * float(node.count) : m_options.traversalCost * area;
+		}
+		return cost / rootArea;
+	}
+}
@@ -0,0 +1,392 @@
+#include "inc/BvhCache.h"
+#include "inc/Scene.h"
+
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+#if defined(_WIN32)
+#include <Windows.h>
+#include <direct.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace POptix
+{
+	static const char kMagic[8] = { 'P', 'O', 'B', 'V', 'H', 'C', 'H', 'E' };
+
+	// Element sizes of the EBvhCacheArray entries.
+	static const unsigned long long kElementSizes[BVH_CACHE_ARRAYS] =
+	{
+		sizeof(BvhNode),
+		sizeof(unsigned int),
+		sizeof(optix::float3),
+		sizeof(optix::float3),
+		sizeof(int),
+		sizeof(int)
+	};
+
+	// The arrays start on cache line boundaries inside the file.
+	static const unsigned long long kAlignment = 64;
+
+	static inline unsigned long long alignUp(const unsigned long long offset)
+	{
+		return (offset + kAlignment - 1) & ~(kAlignment - 1);
+	}
+
+	// 64 bit multiply-rotate hash over 8 byte words, finished with the MurmurHash3 mixer.
+	class Hasher
+	{
+	public:
+		Hasher()
+			: m_state(0xcbf29ce484222325ull)
+		{
+		}
+
+		void add(const void* data, const size_t size)
+		{
+			const unsigned char* bytes = static_cast<const unsigned char*>(data);
+			size_t i = 0;
+			for (; i + 8 <= size; i += 8)
+			{
+				unsigned long long word;
+				memcpy(&word, bytes + i, 8);
+				mix(word);
+			}
+			if (i < size)
+			{
+				unsigned long long word = 0;
+				memcpy(&word, bytes + i, size - i);
+				mix(word);
+			}
+			mix(size);
+		}
+
+		template<typename T>
+		void add(T const& value)
+		{
+			add(&value, sizeof(T));
+		}
+
+		unsigned long long get() const
+		{
+			unsigned long long h = m_state;
+			h ^= h >> 33;
+			h *= 0xff51afd7ed558ccdull;
+			h ^= h >> 33;
+			h *= 0xc4ceb9fe1a85ec53ull;
+			h ^= h >> 33;
+			return h;
+		}
+
+	private:
+		void mix(const unsigned long long word)
+		{
+			m_state ^= word * 0x87c37b91114253d5ull;
+			m_state  = (m_state << 31) | (m_state >> 33);
+			m_state *= 0x4cf5ad432745937full;
+		}
+
+	private:
+		unsigned long long m_state;
+	};
+
+	// Read only mapping of a whole file.
+	class MappedFile
+	{
+	public:
+		explicit MappedFile(std::string const& filename)
+			: m_data(nullptr)
+			, m_size(0)
+#if defined(_WIN32)
+			, m_file(INVALID_HANDLE_VALUE)
+			, m_mapping(nullptr)
+#endif
+		{
+#if defined(_WIN32)
+			m_file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (m_file == INVALID_HANDLE_VALUE)
+			{
+				return;
+			}
+			LARGE_INTEGER size;
+			if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0)
+			{
+				return;
+			}
+			m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (m_mapping == nullptr)
+			{
+				return;
+			}
+			m_data = MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+			if (m_data != nullptr)
+			{
+				m_size = static_cast<size_t>(size.QuadPart);
+			}
+#else
+			const int fd = open(filename.c_str(), O_RDONLY);
+			if (fd < 0)
+			{
+				return;
+			}
+			struct stat info;
+			if (fstat(fd, &info) == 0 && 0 < info.st_size)
+			{
+				void* data = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+				if (data != MAP_FAILED)
+				{
+					m_data = data;
+					m_size = static_cast<size_t>(info.st_size);
+				}
+			}
+			close(fd); // The mapping stays valid.
+#endif
+		}
+
+		~MappedFile()
+		{
+#if defined(_WIN32)
+			if (m_data != nullptr)
+			{
+				UnmapViewOfFile(m_data);
+			}
+			if (m_mapping != nullptr)
+			{
+				CloseHandle(m_mapping);
+			}
+			if (m_file != INVALID_HANDLE_VALUE)
+			{
+				CloseHandle(m_file);
+			}
+#else
+			if (m_data != nullptr)
+			{
+				munmap(m_data, m_size);
+			}
+#endif
+		}
+
+		const unsigned char* getData() const { return static_cast<const unsigned char*>(m_data); }
+		size_t               getSize() const { return m_size; }
+
+	private:
+		MappedFile(MappedFile const&);
+		MappedFile& operator=(MappedFile const&);
+
+	private:
+		void*  m_data;
+		size_t m_size;
+#if defined(_WIN32)
+		HANDLE m_file;
+		HANDLE m_mapping;
+#endif
+	};
+
+	BvhCache::BvhCache(std::string const& directory)
+		: m_directory(directory)
+		, m_hits(0)
+		, m_misses(0)
+	{
+		// Fails harmlessly when the directory exists already.
+#if defined(_WIN32)
+		_mkdir(m_directory.c_str());
+#else
+		mkdir(m_directory.c_str(), 0755);
+#endif
+	}
+
+	BvhCache::~BvhCache()
+	{
+	}
+
+	unsigned long long BvhCache::computeKey(Scene const& scene, BvhBuildOptions const& options)
+	{
+		Hasher hasher;
+
+		hasher.add(kVersion);
+		hasher.add(static_cast<int>(options.builder));
+		hasher.add(options.binCount);
+		hasher.add(options.maxLeafSize);
+		hasher.add(options.traversalCost);
+		hasher.add(options.intersectionCost);
+		hasher.add(options.spatialSplitAlpha);
+		hasher.add(options.maxDuplication);
+		hasher.add(options.treeletPasses);
+
+		// The node meshes in the order HostScene::build() flattens them. The builder entry of a mesh decides its spatial splits.
+		for (const Node* node : scene.mNodeList)
+		{
+			hasher.add(node->transform, 16 * sizeof(float));
+			hasher.add(node->materialID);
+			for (unsigned int meshID : node->mMeshIDList)
+			{
+				std::map<unsigned int, Mesh*>::const_iterator it = scene.mMeshList.find(meshID);
+				if (it != scene.mMeshList.end())
+				{
+					hasher.add(it->second->attributes.data(), it->second->attributes.size() * sizeof(VertexAttributes));
+					hasher.add(it->second->indices.data(), it->second->indices.size() * sizeof(unsigned int));
+					hasher.add(it->second->builder.data(), it->second->builder.size());
+				}
+			}
+		}
+
+		// Quad and sphere lights add their emitting geometry. Field by field, Light has padding.
+		for (const Light* light : scene.mLightList)
+		{
+			hasher.add(static_cast<int>(light->lightType));
+			hasher.add(light->position);
+			hasher.add(light->normal);
+			hasher.add(light->u);
+			hasher.add(light->v);
+			hasher.add(light->radius);
+		}
+
+		return hasher.get();
+	}
+
+	std::string BvhCache::getFilename(const unsigned long long key) const
+	{
+		char name[32];
+		snprintf(name, sizeof(name), "%016llx.bvh", key);
+		return m_directory + std::string("/") + std::string(name);
+	}
+
+	bool BvhCache::load(const unsigned long long key, BvhBuildOptions const& options, Bvh& bvh, BvhCacheTriangles const& triangles)
+	{
+		std::shared_ptr<MappedFile> file(new MappedFile(getFilename(key)));
+
+		const unsigned char* data = file->getData();
+		const size_t         size = file->getSize();
+
+		bool valid = (data != nullptr && sizeof(BvhCacheHeader) <= size);
+
+		BvhCacheHeader header;
+		if (valid)
+		{
+			memcpy(&header, data, sizeof(BvhCacheHeader));
+			valid = memcmp(header.magic, kMagic, sizeof(kMagic)) == 0 &&
+			        header.version  == kVersion &&
+			        header.nodeSize == sizeof(BvhNode) &&
+			        header.key      == key &&
+			        header.fileSize == size;
+			for (int i = 0; i < BVH_CACHE_ARRAYS && valid; ++i)
+			{
+				valid = header.offsets[i] % kAlignment == 0 &&
+				        header.offsets[i] <= size &&
+				        header.counts[i] <= (size - header.offsets[i]) / kElementSizes[i];
+			}
+			valid = valid &&
+			        header.counts[BVH_CACHE_VERTICES] == 3 * header.counts[BVH_CACHE_MATERIAL_INDICES] &&
+			        header.counts[BVH_CACHE_NORMALS]  == header.counts[BVH_CACHE_VERTICES] &&
+			        header.counts[BVH_CACHE_LIGHT_INDICES] == header.counts[BVH_CACHE_MATERIAL_INDICES];
+		}
+
+		if (!valid)
+		{
+			++m_misses;
+			return false;
+		}
+
+		// Nothing is copied, the pages are read when the renderer first touches them.
+		bvh.reference(options, file,
+		              reinterpret_cast<const BvhNode*>(data + header.offsets[BVH_CACHE_NODES]), size_t(header.counts[BVH_CACHE_NODES]),
+		              reinterpret_cast<const unsigned int*>(data + header.offsets[BVH_CACHE_PRIMITIVE_INDICES]), size_t(header.counts[BVH_CACHE_PRIMITIVE_INDICES]));
+		triangles.vertices->reference(file, reinterpret_cast<const optix::float3*>(data + header.offsets[BVH_CACHE_VERTICES]), size_t(header.counts[BVH_CACHE_VERTICES]));
+		triangles.normals->reference(file, reinterpret_cast<const optix::float3*>(data + header.offsets[BVH_CACHE_NORMALS]), size_t(header.counts[BVH_CACHE_NORMALS]));
+		triangles.materialIndices->reference(file, reinterpret_cast<const int*>(data + header.offsets[BVH_CACHE_MATERIAL_INDICES]), size_t(header.counts[BVH_CACHE_MATERIAL_INDICES]));
+		triangles.lightIndices->reference(file, reinterpret_cast<const int*>(data + header.offsets[BVH_CACHE_LIGHT_INDICES]), size_t(header.counts[BVH_CACHE_LIGHT_INDICES]));
+
+		triangles.bounds->m_min = optix::make_float3(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]);
+		triangles.bounds->m_max = optix::make_float3(header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]);
+
+		++m_hits;
+		return true;
+	}
+
+	bool BvhCache::store(const unsigned long long key, Bvh const& bvh, BvhCacheTriangles const& triangles)
+	{
+		const void* arrays[BVH_CACHE_ARRAYS] =
+		{
+			bvh.getNodes().data(),
+			bvh.getPrimitiveIndices().data(),
+			triangles.vertices->data(),
+			triangles.normals->data(),
+			triangles.materialIndices->data(),
+			triangles.lightIndices->data()
+		};
+
+		BvhCacheHeader header;
+		memset(&header, 0, sizeof(BvhCacheHeader));
+		memcpy(header.magic, kMagic, sizeof(kMagic));
+		header.version  = kVersion;
+		header.nodeSize = sizeof(BvhNode);
+		header.key      = key;
+
+		header.boundsMin[0] = triangles.bounds->m_min.x;
+		header.boundsMin[1] = triangles.bounds->m_min.y;
+		header.boundsMin[2] = triangles.bounds->m_min.z;
+		header.boundsMax[0] = triangles.bounds->m_max.x;
+		header.boundsMax[1] = triangles.bounds->m_max.y;
+		header.boundsMax[2] = triangles.bounds->m_max.z;
+
+		header.counts[BVH_CACHE_NODES]             = bvh.getNodes().size();
+		header.counts[BVH_CACHE_PRIMITIVE_INDICES] = bvh.getPrimitiveIndices().size();
+		header.counts[BVH_CACHE_VERTICES]          = triangles.vertices->size();
+		header.counts[BVH_CACHE_NORMALS]           = triangles.normals->size();
+		header.counts[BVH_CACHE_MATERIAL_INDICES]  = triangles.materialIndices->size();
+		header.counts[BVH_CACHE_LIGHT_INDICES]     = triangles.lightIndices->size();
+
+		unsigned long long offset = sizeof(BvhCacheHeader);
+		for (int i = 0; i < BVH_CACHE_ARRAYS; ++i)
+		{
+			header.offsets[i] = alignUp(offset);
+			offset = header.offsets[i] + header.counts[i] * kElementSizes[i];
+		}
+		header.fileSize = offset;
+
+		const std::string filename  = getFilename(key);
+		const std::string temporary = filename + std::string(".tmp");
+
+		FILE* file = fopen(temporary.c_str(), "wb");
+		if (file == nullptr)
+		{
+			return false;
+		}
+
+		const char padding[kAlignment] = {};
+
+		bool written = fwrite(&header, sizeof(BvhCacheHeader), 1, file) == 1;
+		offset = sizeof(BvhCacheHeader);
+		for (int i = 0; i < BVH_CACHE_ARRAYS && written; ++i)
+		{
+			const size_t gap   = size_t(header.offsets[i] - offset);
+			const size_t bytes = size_t(header.counts[i] * kElementSizes[i]);
+			written = fwrite(padding, 1, gap, file) == gap &&
+			          (bytes == 0 || fwrite(arrays[i], 1, bytes, file) == bytes);
+			offset = header.offsets[i] + bytes;
+		}
+		written = (fclose(file) == 0) && written;
+
+		if (written)
+		{
+			// rename() doesn't replace existing files on Windows.
+			std::remove(filename.c_str());
+			written = std::rename(temporary.c_str(), filename.c_str()) == 0;
+		}
+		if (!written)
+		{
+			std::remove(temporary.c_str());
+		}
+		return written;
+	}
+
+	void BvhCache::remove(const unsigned long long key)
+	{
+		std::remove(getFilename(key).c_str());
+	}
+}
@@ -0,0 +1,327 @@
+#include "inc/CompressedBvh.h"
+
+#include <cmath>
+#include <cstring>
+
+#include "inc/MyAssert.h"
+
+namespace POptix
+{
+	static_assert(sizeof(CompressedBvhNode) == 64, "CompressedBvhNode must fill exactly one cache line.");
+
+	// 2^(exponent - 127), built directly from the float bits.
+	static inline float exponentToScale(const unsigned char exponent)
+	{
+		const unsigned int bits = unsigned(exponent) << 23;
+		float scale;
+		memcpy(&scale, &bits, sizeof(float));
+		return scale;
+	}
+
+	CompressedBvh::CompressedBvh()
+	{
+	}
+
+	CompressedBvh::~CompressedBvh()
+	{
+	}
+
+	void CompressedBvh::quantizeChildren(CompressedBvhNode& node, optix::Aabb const& bounds, const optix::Aabb* childBounds, const int count) const
+	{
+		node.origin = bounds.m_min;
+
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			const float origin = optix::getByIndex(bounds.m_min, axis);
+			const float extent = optix::getByIndex(bounds.m_max, axis) - origin;
+
+			// Smallest power of two cell size which covers the extent with 255 cells.
+			int exponent = 1;
+			if (0.0f < extent)
+			{
+				int e;
+				frexpf(extent / 255.0f, &e);
+				exponent = std::min(254, std::max(1, e + 127));
+			}
+
+			for (;;)
+			{
+				const float scale = exponentToScale((unsigned char)(exponent));
+				bool fits = true;
+
+				for (int c = 0; c < count && fits; ++c)
+				{
+					const float lo = optix::getByIndex(childBounds[c].m_min, axis);
+					const float hi = optix::getByIndex(childBounds[c].m_max, axis);
+
+					// Round outwards, checked with the same expression the traversal decodes with.
+					int qlo = std::max(0, std::min(255, int(floorf((lo - origin) / scale))));
+					while (0 < qlo && lo < origin + float(qlo) * scale)
+					{
+						--qlo;
+					}
+					int qhi = std::max(0, int(ceilf((hi - origin) / scale)));
+					while (qhi <= 255 && origin + float(qhi) * scale < hi)
+					{
+						++qhi;
+					}
+
+					if (255 < qhi)
+					{
+						fits = false;
+						break;
+					}
+					node.lo[axis][c] = (unsigned char)(qlo);
+					node.hi[axis][c] = (unsigned char)(qhi);
+				}
+
+				if (fits || 254 <= exponent)
+				{
+					MY_ASSERT(fits);
+					break;
+				}
+				++exponent;
+			}
+			node.exponent[axis] = (unsigned char)(exponent);
+		}
+
+		// Unused slots get an empty box.
+		for (int c = count; c < 4; ++c)
+		{
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				node.lo[axis][c] = 255;
+				node.hi[axis][c] = 0;
+			}
+		}
+	}
+
+	void CompressedBvh::build(Bvh const& bvh, SharedArray<optix::float3> const& triangleVertices)
+	{
+		m_nodes.clear();
+		m_triangles.clear();
+		m_bounds.invalidate();
+
+		SharedArray<BvhNode> const&      binaryNodes = bvh.getNodes();
+		SharedArray<unsigned int> const& indices     = bvh.getPrimitiveIndices();
+		if (binaryNodes.empty())
+		{
+			return;
+		}
+
+		m_bounds = binaryNodes[0].bounds;
+		m_nodes.reserve(binaryNodes.size() / 3 + 1);
+		m_triangles.reserve(indices.size());
+
+		// (compressed node, binary node) pairs still to fill.
+		std::vector<std::pair<int, int>> pending(1, std::make_pair(0, 0));
+		m_nodes.push_back(CompressedBvhNode());
+
+		while (!pending.empty())
+		{
+			const int target = pending.back().first;
+			const int source = pending.back().second;
+			pending.pop_back();
+
+			// Open the children with the largest surface area until there are four. A binary leaf root becomes a single leaf child.
+			int children[4];
+			int count = 0;
+			if (binaryNodes[source].isLeaf())
+			{
+				children[count++] = source;
+			}
+			else
+			{
+				children[count++] = binaryNodes[source].offset;
+				children[count++] = binaryNodes[source].offset + 1;
+
+				while (count < 4)
+				{
+					int   largest     = -1;
+					float largestArea = -1.0f;
+					for (int c = 0; c < count; ++c)
+					{
+						const BvhNode& child = binaryNodes[children[c]];
+						if (!child.isLeaf() && largestArea < child.bounds.area())
+						{
+							largest     = c;
+							largestArea = child.bounds.area();
+						}
+					}
+					if (largest < 0)
+					{
+						break;
+					}
+					const int opened = children[largest];
+					children[largest] = binaryNodes[opened].offset;
+					children[count++] = binaryNodes[opened].offset + 1;
+				}
+			}
+
+			optix::Aabb childBounds[4];
+			for (int c = 0; c < count; ++c)
+			{
+				childBounds[c] = binaryNodes[children[c]].bounds;
+			}
+
+			CompressedBvhNode node;
+			memset(&node, 0, sizeof(node));
+			node.count = (unsigned char)(count);
+			quantizeChildren(node, binaryNodes[source].bounds, childBounds, count);
+
+			for (int c = 0; c < count; ++c)
+			{
+				const BvhNode& child = binaryNodes[children[c]];
+				if (child.isLeaf())
+				{
+					MY_ASSERT(unsigned(child.count) <= kMaxLeafSize);
+					MY_ASSERT(m_triangles.size() < (1u << kLeafCountShift));
+
+					node.child[c] = kLeafFlag | (unsigned(child.count) << kLeafCountShift) | unsigned(m_triangles.size());
+					for (int i = child.offset; i < child.offset + child.count; ++i)
+					{
+						const unsigned int primitive = indices[i];
+						CompressedBvhTriangle triangle;
+						triangle.v0 = triangleVertices[primitive * 3];
+						triangle.v1 = triangleVertices[primitive * 3 + 1];
+						triangle.v2 = triangleVertices[primitive * 3 + 2];
+						triangle.primitive = primitive;
+						m_triangles.push_back(triangle);
+					}
+				}
+				else
+				{
+					node.child[c] = unsigned(m_nodes.size());
+					m_nodes.push_back(CompressedBvhNode());
+					pending.push_back(std::make_pair(int(node.child[c]), children[c]));
+				}
+			}
+
+			m_nodes[target] = node;
+		}
+	}
+
+	bool CompressedBvh::intersect(const optix::float3& origin, const optix::float3& direction, const float tmin, const float tmax, TriangleHit& hit, BvhTraversalStats* stats) const
+	{
+		if (m_nodes.empty())
+		{
+			return false;
+		}
+
+		const WatertightRay wray = makeWatertightRay(origin, direction);
+		BvhRay ray(origin, direction, tmin, tmax);
+
+		float tnear;
+		if (!intersectAabb(m_bounds, ray, tnear))
+		{
+			return false;
+		}
+
+		struct Entry
+		{
+			unsigned int child;
+			float        tnear;
+		};
+		Entry stack[256];
+		int stackSize = 0;
+		stack[stackSize++] = { 0u, tnear };
+
+		bool found = false;
+
+		while (0 < stackSize)
+		{
+			const Entry entry = stack[--stackSize];
+			if (ray.tmax < entry.tnear)
+			{
+				continue;
+			}
+
+			if (entry.child & kLeafFlag)
+			{
+				const unsigned int first = entry.child & ((1u << kLeafCountShift) - 1u);
+				const unsigned int count = (entry.child & ~kLeafFlag) >> kLeafCountShift;
+				for (unsigned int i = first; i < first + count; ++i)
+				{
+					const CompressedBvhTriangle& triangle = m_triangles[i];
+					float t;
+					float beta;
+					float gamma;
+					if (intersectTriangleWatertight(wray, ray.tmin, ray.tmax, triangle.v0, triangle.v1, triangle.v2, t, beta, gamma))
+					{
+						ray.tmax      = t;
+						hit.t         = t;
+						hit.beta      = beta;
+						hit.gamma     = gamma;
+						hit.primitive = triangle.primitive;
+						found = true;
+					}
+				}
+				if (stats)
+				{
+					stats->primitivesTested += count;
+				}
+				continue;
+			}
+
+			const CompressedBvhNode& node = m_nodes[entry.child];
+			if (stats)
+			{
+				++stats->nodesVisited;
+			}
+
+			// Decode and slab test all four slots, only the first node.count are used.
+			float tentry[4];
+			float texit[4];
+			for (int c = 0; c < 4; ++c)
+			{
+				tentry[c] = ray.tmin;
+				texit[c]  = ray.tmax;
+			}
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				const float scale  = exponentToScale(node.exponent[axis]);
+				const float base   = optix::getByIndex(node.origin, axis);
+				const float o      = optix::getByIndex(ray.origin, axis);
+				const float invDir = optix::getByIndex(ray.invDirection, axis);
+				// Plain comparisons instead of fminf()/fmaxf() let the compiler keep the four lanes in one SIMD register.
+				for (int c = 0; c < 4; ++c)
+				{
+					const float t0 = (base + float(node.lo[axis][c]) * scale - o) * invDir;
+					const float t1 = (base + float(node.hi[axis][c]) * scale - o) * invDir;
+					const float tsmaller = (t0 < t1) ? t0 : t1;
+					const float tbigger  = (t0 < t1) ? t1 : t0;
+					tentry[c] = (tentry[c] < tsmaller) ? tsmaller : tentry[c];
+					texit[c]  = (tbigger < texit[c])   ? tbigger  : texit[c];
+				}
+			}
+
+			// Push the hit children far to near, so the nearest one is popped next.
+			Entry hits[4];
+			int numHits = 0;
+			for (int c = 0; c < node.count; ++c)
+			{
+				if (tentry[c] <= texit[c])
+				{
+					int i = numHits++;
+					while (0 < i && hits[i - 1].tnear < tentry[c])
+					{
+						hits[i] = hits[i - 1];
+						--i;
+					}
+					hits[i] = { node.child[c], tentry[c] };
+				}
+			}
+			for (int i = 0; i < numHits; ++i)
+			{
+				MY_ASSERT(stackSize < 256);
+				stack[stackSize++] = hits[i];
+			}
+		}
+		return found;
+	}
+
+	size_t CompressedBvh::getMemorySize() const
+	{
+		return m_nodes.size() * sizeof(CompressedBvhNode) + m_triangles.size() * sizeof(CompressedBvhTriangle);
+	}
+}
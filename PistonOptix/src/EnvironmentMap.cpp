@@ -0,0 +1,134 @@
+#include "inc/EnvironmentMap.h"
+
+#include <HDRLoader.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include "shaders/shader_common.h"
+#include "shaders/environment_sample.h"
+
+namespace POptix
+{
+	EnvironmentMap::EnvironmentMap()
+		: m_width(0)
+		, m_height(0)
+		, m_averageLuminance(0.0f)
+	{
+	}
+
+	EnvironmentMap::~EnvironmentMap()
+	{
+	}
+
+	void EnvironmentMap::build(const int width, const int height, const float* texels)
+	{
+		m_width  = width;
+		m_height = height;
+		m_texels.assign(texels, texels + size_t(width) * height * 4);
+
+		m_marginal.resize(height + 1);
+		m_conditional.resize(size_t(height) * (width + 1));
+
+		// Cumulative sums in double, a 4k map has millions of texels.
+		std::vector<double> rowSums(height);
+		double total = 0.0;
+		for (int row = 0; row < height; ++row)
+		{
+			float* cdf = &m_conditional[size_t(row) * (width + 1)];
+			const float* texel = &m_texels[size_t(row) * width * 4];
+
+			std::vector<double> weights(width);
+			double sum = 0.0;
+			for (int column = 0; column < width; ++column, texel += 4)
+			{
+				weights[column] = std::max(0.0f, luminance(optix::make_float3(texel[0], texel[1], texel[2])));
+				sum += weights[column];
+			}
+
+			// Black rows are sampled uniformly, the marginal never picks them anyway.
+			double partial = 0.0;
+			cdf[0] = 0.0f;
+			for (int column = 0; column < width; ++column)
+			{
+				partial += weights[column];
+				cdf[column + 1] = (0.0 < sum) ? float(partial / sum) : float(column + 1) / float(width);
+			}
+			cdf[width] = 1.0f;
+
+			rowSums[row] = sum;
+			total += sum;
+		}
+
+		double sum = 0.0;
+		m_marginal[0] = 0.0f;
+		for (int row = 0; row < height; ++row)
+		{
+			sum += rowSums[row];
+			m_marginal[row + 1] = (0.0 < total) ? float(sum / total) : float(row + 1) / float(height);
+		}
+		m_marginal[height] = 1.0f;
+
+		m_averageLuminance = float(total / (double(width) * height));
+	}
+
+	bool EnvironmentMap::load(std::string const& filename)
+	{
+		HDRLoader hdr(filename);
+		if (hdr.failed())
+		{
+			const float black[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+			build(1, 1, black);
+			return false;
+		}
+
+		const int width  = int(hdr.width());
+		const int height = int(hdr.height());
+
+		// The file starts with the top row.
+		std::vector<float> texels(size_t(width) * height * 4);
+		for (int row = 0; row < height; ++row)
+		{
+			const float* src = hdr.raster() + size_t(height - row - 1) * width * 4;
+			std::copy(src, src + size_t(width) * 4, texels.begin() + size_t(row) * width * 4);
+		}
+		build(width, height, texels.data());
+		return true;
+	}
+
+	optix::float3 EnvironmentMap::eval(const optix::float2& uv) const
+	{
+		const float x = uv.x * float(m_width) - 0.5f;
+		const float y = uv.y * float(m_height) - 0.5f;
+		const float fx = floorf(x);
+		const float fy = floorf(y);
+		const float ax = x - fx;
+		const float ay = y - fy;
+
+		// Repeat wrapping.
+		const int x0 = ((int(fx) % m_width) + m_width) % m_width;
+		const int y0 = ((int(fy) % m_height) + m_height) % m_height;
+		const int x1 = (x0 + 1) % m_width;
+		const int y1 = (y0 + 1) % m_height;
+
+		const float* t00 = &m_texels[(size_t(y0) * m_width + x0) * 4];
+		const float* t10 = &m_texels[(size_t(y0) * m_width + x1) * 4];
+		const float* t01 = &m_texels[(size_t(y1) * m_width + x0) * 4];
+		const float* t11 = &m_texels[(size_t(y1) * m_width + x1) * 4];
+
+		const optix::float3 bottom = optix::lerp(optix::make_float3(t00[0], t00[1], t00[2]), optix::make_float3(t10[0], t10[1], t10[2]), ax);
+		const optix::float3 top    = optix::lerp(optix::make_float3(t01[0], t01[1], t01[2]), optix::make_float3(t11[0], t11[1], t11[2]), ax);
+		return optix::lerp(bottom, top, ay);
+	}
+
+	optix::float3 EnvironmentMap::sample(const float u1, const float u2, float& pdf) const
+	{
+		const optix::float2 uv = sampleEnvironment(m_marginal.data(), m_conditional.data(), m_width, m_height, u1, u2, pdf);
+		return environmentDirection(uv);
+	}
+
+	float EnvironmentMap::pdf(const optix::float3& direction) const
+	{
+		return environmentPdf(m_marginal.data(), m_conditional.data(), m_width, m_height, direction);
+	}
+}
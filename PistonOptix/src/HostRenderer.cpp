@@ -0,0 +1,698 @@
+#include "inc/HostRenderer.h"
+
+#include "inc/HostShading.h"
+#include "inc/MyAssert.h"
+#include "inc/Timer.h"
+
+#include <cfloat>
+
+namespace POptix
+{
+	// Share of the continuation rays which follow the BRDF once the SD-tree learned something. Half and half like in
+	// "Practical Path Guiding for Efficient Light-Transport Simulation", the BRDF keeps glossy lobes and caustics sampled well.
+	static const float c_guidingBsdfFraction = 0.5f;
+
+	// The Scene of reservoir.h. Shadow rays like those of the next event estimation, the light geometry excluded on both sides.
+	struct RestirScene
+	{
+		RestirScene(HostScene const& hostScene, const float epsilon, ShadowCache& cache)
+			: scene(hostScene)
+			, sceneEpsilon(epsilon)
+			, shadowCache(&cache)
+		{
+		}
+
+		Light         light(const int index) const                   { return scene.getLights()[index]; }
+		Material      material(const int index) const                { return scene.getMaterials()[index]; }
+		optix::float3 environment(const optix::float2& uv) const     { return scene.getEnvironment().eval(uv); }
+
+		bool visible(const optix::float3& origin, const optix::float3& direction, const float distance) const
+		{
+			return !scene.occluded(origin, direction, sceneEpsilon, distance - sceneEpsilon, shadowCache);
+		}
+
+		HostScene const& scene;
+		float            sceneEpsilon;
+		ShadowCache*     shadowCache;
+	};
+
+	// The light samples of sampleDirectLighting() as candidates of restirCandidates(), drawn with the LCG of its seed.
+	struct RestirLightSampler
+	{
+		RestirLightSampler(HostScene const& hostScene, const ELightSelection mode)
+			: scene(hostScene)
+			, selector(mode, hostScene.getLightTree(), hostScene.getLightAliasTable(), hostScene.getEnvironment())
+		{
+		}
+
+		int sample(const optix::float3& position, unsigned int& seed, optix::float3& point, float& pdf) const
+		{
+			float selectionPmf;
+			const int lightIndex = selectLight(scene.getLights(), selector, position, rng(seed), selectionPmf);
+			Light const& light = scene.getLights()[lightIndex];
+
+			PerRayData prd;
+			prd.sampler   = SAMPLER_LCG;
+			prd.seed      = seed;
+			prd.dimension = 0;
+
+			State state;
+			state.hit_position = position;
+
+			LightSample lightSample;
+			sampleLight(light, selector, prd, state, lightSample);
+			seed = prd.seed;
+
+			if (lightSample.pdf <= 0.0f || lightSample.distance == 0.0f)
+			{
+				return -1;
+			}
+			point = (light.lightType == ENVIRONMENT || light.lightType == DIRECTIONAL) ? lightSample.direction : lightSample.surfacePos;
+			pdf   = selectionPmf * lightSample.pdf;
+			return lightIndex;
+		}
+
+		HostScene const& scene;
+		LightSelector    selector;
+	};
+
+	// The ReservoirPixel of the first pass, the candidates of restirSpatial().
+	struct RestirCandidates
+	{
+		ReservoirPixel const& operator()(const int x, const int y) const
+		{
+			return reservoirs[(size_t(y) * width + x) * RESTIR_SLOTS + RESTIR_SLOT_CANDIDATES];
+		}
+
+		ReservoirPixel const* reservoirs;
+		int                   width;
+	};
+
+	HostRenderer::HostRenderer(HostScene const& scene, int numThreads, NumaTopology const* topology)
+		: m_scene(scene)
+		, m_scheduler(numThreads, topology)
+		, m_width(0)
+		, m_height(0)
+		, m_iterationIndex(0)
+		, m_samplesPerPass(1)
+		, m_resolveTime(0.0)
+		, m_cameraPosition(optix::make_float3(0.0f))
+		, m_cameraU(optix::make_float3(1.0f, 0.0f, 0.0f))
+		, m_cameraV(optix::make_float3(0.0f, 1.0f, 0.0f))
+		, m_cameraW(optix::make_float3(0.0f, 0.0f, -1.0f))
+		, m_minPathLength(2)
+		, m_maxPathLength(5)
+		, m_sceneEpsilon(500.0f * 1.0e-7f)
+		, m_lightSelection(LIGHT_SELECTION_UNIFORM)
+		, m_sampler(SAMPLER_SOBOL)
+		, m_adaptiveEnabled(false)
+		, m_guidingEnabled(false)
+		, m_guidingRecording(true)
+		, m_guidingIteration(0)
+		, m_guidingPasses(0)
+		, m_guidingUpdateTime(0.0)
+		, m_guidingThreadTime(0.0)
+		, m_guidingImageVariance(0.0)
+		, m_restir(RESTIR_OFF)
+		, m_integrator(INTEGRATOR_PATH)
+	{
+		m_emitters.build(m_scene.getLights());
+
+		if (topology != nullptr && 1 < topology->getNumNodes())
+		{
+			// Replicated on the nodes, so the BVH, vertex and material fetches of the workers stay node local.
+			m_nodeScenes.resize(topology->getNumNodes());
+			for (int node = 0; node < topology->getNumNodes(); ++node)
+			{
+				topology->runOnNode(node, [this, &scene, node]()
+				{
+					m_nodeScenes[node].reset(new HostScene(scene));
+				});
+			}
+		}
+	}
+
+	HostRenderer::~HostRenderer()
+	{
+		joinGuiding();
+	}
+
+	void HostRenderer::setResolution(int width, int height)
+	{
+		if (width != m_width || height != m_height)
+		{
+			m_width  = width;
+			m_height = height;
+			m_outputBuffer.assign(size_t(m_width) * m_height, optix::make_float4(0.0f));
+			m_meanSquares.assign(size_t(m_width) * m_height, 0.0f);
+			m_scheduler.setImageSize(m_width, m_height);
+			m_adaptive.setImageSize(m_width, m_height);
+			restartAccumulation();
+		}
+	}
+
+	void HostRenderer::setCamera(const optix::float3& position, const optix::float3& U, const optix::float3& V, const optix::float3& W)
+	{
+		m_cameraPosition = position;
+		m_cameraU = U;
+		m_cameraV = V;
+		m_cameraW = W;
+		restartAccumulation();
+	}
+
+	void HostRenderer::setPathLengths(int minPathLength, int maxPathLength)
+	{
+		m_minPathLength = minPathLength;
+		m_maxPathLength = maxPathLength;
+		restartAccumulation();
+	}
+
+	void HostRenderer::setSceneEpsilon(float epsilon)
+	{
+		m_sceneEpsilon = epsilon;
+		restartAccumulation();
+	}
+
+	void HostRenderer::setLightSelection(ELightSelection selection)
+	{
+		m_lightSelection = selection;
+		restartAccumulation();
+	}
+
+	void HostRenderer::setSampler(ESampler sampler)
+	{
+		m_sampler = sampler;
+		restartAccumulation();
+	}
+
+	void HostRenderer::setSamplesPerPass(int samples)
+	{
+		MY_ASSERT(0 < samples);
+		m_samplesPerPass = samples;
+		m_scheduler.setSampleSlices(samples);
+	}
+
+	void HostRenderer::setAdaptive(bool enabled)
+	{
+		m_adaptiveEnabled = enabled;
+		restartAccumulation();
+	}
+
+	void HostRenderer::setGuiding(bool enabled)
+	{
+		joinGuiding();
+
+		m_guidingEnabled = enabled;
+		m_guiding.init(m_scene.getBounds());
+		m_guidingRecording  = true;
+		m_guidingIteration  = 0;
+		m_guidingPasses     = 0;
+		m_guidingUpdateTime = 0.0;
+		restartAccumulation();
+	}
+
+	void HostRenderer::setRestir(ERestir mode)
+	{
+		m_restir = mode;
+		restartAccumulation();
+	}
+
+	void HostRenderer::setIntegrator(EIntegrator integrator)
+	{
+		m_integrator = integrator;
+		restartAccumulation();
+	}
+
+	void HostRenderer::restartAccumulation()
+	{
+		m_iterationIndex = 0;
+		m_accumulator.clear();
+		m_adaptive.restart();
+		m_guidingImage.clear();
+	}
+
+	void HostRenderer::render()
+	{
+		MY_ASSERT(0 < m_width && 0 < m_height);
+
+		if (isConverged())
+		{
+			return;
+		}
+
+		m_accumulator.setLayout(m_width, m_height, m_scheduler.getTiles(), m_scheduler);
+
+		// The splats are divided by the samples of the pixel they land in, and the light subpaths have no guided or resampled vertices.
+		MY_ASSERT(m_integrator == INTEGRATOR_PATH || (!m_adaptiveEnabled && !m_guidingEnabled && m_restir == RESTIR_OFF));
+
+		if (m_restir != RESTIR_OFF)
+		{
+			// The temporal reuse takes the reservoir of the previous sample of the pixel.
+			MY_ASSERT(m_samplesPerPass == 1);
+			m_reservoirs.resize(size_t(m_width) * m_height * RESTIR_SLOTS);
+		}
+
+		m_scheduler.run([this](Tile const& tile, int threadIndex)
+		{
+			renderTile(tile, threadIndex);
+		});
+		m_passStats = m_scheduler.getLastPassStats();
+
+		if (m_restir != RESTIR_OFF)
+		{
+			// The neighbours of the pixels at the edges of a tile are in other tiles.
+			m_scheduler.run([this](Tile const& tile, int threadIndex)
+			{
+				restirTile(tile, threadIndex);
+			});
+		}
+
+		Timer timer;
+		timer.start();
+		m_accumulator.resolve(m_scheduler, m_outputBuffer, (m_adaptiveEnabled || m_guidingEnabled) ? &m_meanSquares : nullptr);
+		m_resolveTime = timer.getTime();
+
+		m_iterationIndex += m_samplesPerPass;
+
+		if (m_adaptiveEnabled)
+		{
+			// All active pixels have m_iterationIndex samples, the skipped ones keep theirs.
+			m_adaptive.update(m_outputBuffer.data(), m_meanSquares.data(), m_iterationIndex);
+		}
+
+		if (m_guidingEnabled)
+		{
+			if (!m_adaptiveEnabled)
+			{
+				combineGuidingIterations(m_guidingThread.joinable());
+			}
+
+			if (m_guidingThread.joinable())
+			{
+				// The next passes sample what the iteration learned and record into the next one.
+				joinGuiding();
+				m_guiding.swap(m_guidingUpdate);
+				m_guidingUpdateTime = m_guidingThreadTime;
+				m_guidingRecording  = true;
+
+				m_guidingIteration = std::min(m_guidingIteration + 1, 30);
+				m_guidingPasses    = 0;
+			}
+			else if (++m_guidingPasses == (1 << m_guidingIteration))
+			{
+				// The iteration collected all its records. The next pass leaves m_guiding as it is for the update to copy.
+				m_guidingRecording = false;
+				m_guidingThread    = std::thread(&HostRenderer::updateGuiding, this, m_guidingIteration);
+			}
+		}
+	}
+
+	void HostRenderer::updateGuiding(int iteration)
+	{
+		Timer timer;
+		timer.start();
+
+		m_guidingUpdate = m_guiding;
+		m_guidingUpdate.update(iteration);
+
+		m_guidingThreadTime = timer.getTime();
+	}
+
+	void HostRenderer::combineGuidingIterations(bool iterationEnd)
+	{
+		const size_t numPixels = m_outputBuffer.size();
+		const int    samples   = m_accumulator.getNumPasses() * m_samplesPerPass;
+
+		// Of the pixel means of the iteration, from the sample variance of their luminance. Unknown after a single sample.
+		double variance = DBL_MAX;
+		if (1 < samples)
+		{
+			double sum = 0.0;
+			for (size_t i = 0; i < numPixels; ++i)
+			{
+				const double L = luminance(optix::make_float3(m_outputBuffer[i]));
+				sum += std::max(0.0, double(m_meanSquares[i]) - L * L);
+			}
+			variance = sum / (double(numPixels) * (samples - 1));
+		}
+
+		if (!m_guidingImage.empty())
+		{
+			// One weight for the whole image, per pixel weights would follow the noise of the pixels and bias them.
+			const double total  = m_guidingImageVariance + variance;
+			const float  weight = (0.0 < total) ? float(m_guidingImageVariance / total) : 0.5f;
+			for (size_t i = 0; i < numPixels; ++i)
+			{
+				m_outputBuffer[i] = weight * m_outputBuffer[i] + (1.0f - weight) * m_guidingImage[i];
+			}
+			variance = (0.0 < total) ? m_guidingImageVariance * (variance / total) : 0.0;
+		}
+
+		if (iterationEnd)
+		{
+			// The next iteration samples a better distribution, its passes start an image of their own.
+			m_guidingImage         = m_outputBuffer;
+			m_guidingImageVariance = variance;
+			m_accumulator.clear();
+		}
+	}
+
+	void HostRenderer::joinGuiding()
+	{
+		if (m_guidingThread.joinable())
+		{
+			m_guidingThread.join();
+		}
+	}
+
+	void HostRenderer::renderTile(Tile const& tile, int threadIndex)
+	{
+		const optix::float2 screen = optix::make_float2(float(m_width), float(m_height));
+
+		// One per tile, the tile runs on a single thread and its shadow rays are coherent.
+		ShadowCache shadowCache;
+
+		// The guided vertices of the current path, reused by the paths of the tile.
+		std::vector<GuidingVertex> guidingPath;
+		guidingPath.reserve(m_maxPathLength);
+
+		HostScene const& scene = isNumaEnabled() ? *m_nodeScenes[m_scheduler.getThreadNode(threadIndex)] : m_scene;
+
+		optix::float4* samples = m_accumulator.getTileBuffer(tile.index);
+
+		const RestirScene        restirScene(scene, m_sceneEpsilon, shadowCache);
+		const RestirLightSampler restirSampler(scene, m_lightSelection);
+
+		std::unique_ptr<BidirectionalIntegrator> bidirectional;
+		if (m_integrator == INTEGRATOR_BIDIRECTIONAL)
+		{
+			const BidirectionalCamera camera = { m_cameraPosition, m_cameraU, m_cameraV, m_cameraW, m_width, m_height };
+			bidirectional.reset(new BidirectionalIntegrator(scene, m_emitters, camera, m_lightSelection, m_minPathLength, m_maxPathLength, m_sceneEpsilon));
+		}
+		std::vector<Splat>& splats = m_accumulator.getTileSplats(tile.index);
+
+		for (int y = tile.y; y < tile.y + tile.height; ++y)
+		{
+			for (int x = tile.x; x < tile.x + tile.width; ++x)
+			{
+				const size_t pixel = size_t(y) * m_width + x;
+
+				ReservoirPixel* candidates = (m_restir != RESTIR_OFF) ? &m_reservoirs[pixel * RESTIR_SLOTS + RESTIR_SLOT_CANDIDATES] : nullptr;
+				if (candidates != nullptr)
+				{
+					candidates->surface.materialIndex = -1;
+				}
+
+				if (m_adaptiveEnabled && !m_adaptive.isActive(x, y))
+				{
+					// Converged, no sample this pass.
+					samples[size_t(y - tile.y) * tile.width + (x - tile.x)] = optix::make_float4(0.0f);
+					continue;
+				}
+
+				PerRayData prd;
+
+				// Same samples and camera ray as raygeneration.cu.
+				const optix::float2 jitter = beginSample(prd, m_sampler, x, y, m_width, m_iterationIndex + tile.slice);
+
+				const optix::float2 fragment = optix::make_float2(float(x), float(y)) + jitter;
+				const optix::float2 ndc = (fragment / screen) * 2.0f - 1.0f;
+
+				prd.hit_pos = m_cameraPosition;
+				prd.wi = optix::normalize(ndc.x * m_cameraU + ndc.y * m_cameraV + m_cameraW);
+
+				optix::float3 radiance;
+				if (bidirectional)
+				{
+					radiance = bidirectional->sample(prd, shadowCache, splats);
+				}
+				else
+				{
+					integrator(scene, prd, radiance, shadowCache, m_guidingEnabled ? &guidingPath : nullptr, candidates);
+				}
+
+				if (candidates != nullptr)
+				{
+					// The sample is written by restirTile().
+					candidates->radiance = radiance;
+					if (0 <= candidates->surface.materialIndex)
+					{
+						ReservoirPixel const& previous = m_reservoirs[pixel * RESTIR_SLOTS + RESTIR_SLOT_FINAL];
+
+						unsigned int seed = restirSeed(unsigned(pixel), m_iterationIndex, 0);
+						candidates->reservoir = restirInitial(restirScene, restirSampler, m_restir, candidates->surface, (0 < m_iterationIndex) ? &previous : nullptr, seed);
+					}
+					continue;
+				}
+
+				// NaN values will never go away. Filter them out before they can arrive in the output buffer.
+				const bool valid = !(isnan(radiance.x) || isnan(radiance.y) || isnan(radiance.z));
+
+				samples[size_t(y - tile.y) * tile.width + (x - tile.x)] = valid ? optix::make_float4(radiance, 1.0f) : optix::make_float4(0.0f);
+			}
+		}
+	}
+
+	void HostRenderer::restirTile(Tile const& tile, int threadIndex)
+	{
+		ShadowCache shadowCache;
+
+		HostScene const& scene = isNumaEnabled() ? *m_nodeScenes[m_scheduler.getThreadNode(threadIndex)] : m_scene;
+
+		const RestirScene      restirScene(scene, m_sceneEpsilon, shadowCache);
+		const RestirCandidates candidates = { m_reservoirs.data(), m_width };
+
+		optix::float4* samples = m_accumulator.getTileBuffer(tile.index);
+
+		for (int y = tile.y; y < tile.y + tile.height; ++y)
+		{
+			for (int x = tile.x; x < tile.x + tile.width; ++x)
+			{
+				// renderTile() wrote their samples.
+				if (m_adaptiveEnabled && !m_adaptive.isActive(x, y))
+				{
+					continue;
+				}
+
+				const size_t pixel = size_t(y) * m_width + x;
+
+				ReservoirPixel const& own   = m_reservoirs[pixel * RESTIR_SLOTS + RESTIR_SLOT_CANDIDATES];
+				ReservoirPixel&       final = m_reservoirs[pixel * RESTIR_SLOTS + RESTIR_SLOT_FINAL];
+
+				final.surface   = own.surface;
+				final.reservoir = restirEmptyReservoir();
+
+				optix::float3 radiance = own.radiance;
+				if (0 <= own.surface.materialIndex)
+				{
+					unsigned int seed = restirSeed(unsigned(pixel), m_iterationIndex, 1);
+					const optix::float3 direct = restirSpatial(restirScene, candidates, m_restir, x, y, m_width, m_height, final.reservoir, seed);
+					if (own.shaded)
+					{
+						radiance += direct;
+					}
+				}
+
+				// NaN values will never go away. Filter them out before they can arrive in the output buffer.
+				const bool valid = !(isnan(radiance.x) || isnan(radiance.y) || isnan(radiance.z));
+
+				samples[size_t(y - tile.y) * tile.width + (x - tile.x)] = valid ? optix::make_float4(radiance, 1.0f) : optix::make_float4(0.0f);
+			}
+		}
+	}
+
+	void HostRenderer::integrator(HostScene const& scene, PerRayData& prd, optix::float3& radiance, ShadowCache& shadowCache, std::vector<GuidingVertex>* guidingPath,
+	                              ReservoirPixel* restirPixel) const
+	{
+		radiance = optix::make_float3(0.0f);
+		optix::float3 throughput = optix::make_float3(1.0f);
+		int depth = 0;
+
+		prd.brdf_flags = 0;
+
+		if (guidingPath != nullptr)
+		{
+			guidingPath->clear();
+		}
+
+		bool previousGuided = false; // The last vertex of guidingPath is the one before the current segment.
+
+		while (depth < m_maxPathLength)
+		{
+			prd.wo = -prd.wi;
+			prd.flags &= (depth == 1) ? FLAG_DIRECT_RESAMPLED : 0;
+			prd.flags |= (depth == m_maxPathLength - 1) ? FLAG_LAST_SEGMENT : 0;
+
+			const optix::float3 origin    = prd.hit_pos;
+			const optix::float3 direction = prd.wi;
+
+			GuidingVertex vertex;
+			vertex.dTrees = nullptr;
+
+			bool emission = true; // prd.radiance arrives at origin directly from a light.
+
+			TriangleHit hit;
+			if (!scene.intersect(origin, direction, m_sceneEpsilon, RT_DEFAULT_MAX, hit))
+			{
+				// miss.cu
+				const LightSelector selector(m_lightSelection, scene.getLightTree(), scene.getLightAliasTable(), scene.getEnvironment());
+				shadeMiss(scene.getLights(), selector, scene.getEnvironmentLight(), origin, direction, prd);
+			}
+			else if (0 <= scene.getLightIndex(hit.primitive))
+			{
+				closestHitLight(scene, prd, direction, hit);
+			}
+			else
+			{
+				closestHit(scene, prd, direction, hit, shadowCache, (guidingPath != nullptr) ? &vertex : nullptr, (depth == 0) ? restirPixel : nullptr);
+				emission = false;
+			}
+
+			radiance += throughput * prd.radiance;
+
+			if (guidingPath != nullptr && isNotNull(prd.radiance))
+			{
+				const optix::float3 contribution = throughput * prd.radiance;
+
+				// Everything found further down the path arrives at the earlier vertices along their sampled directions. The D-trees
+				// learn the indirect light only: the next event estimation samples the lights, continuation rays guided to them would
+				// be missing from the light bouncing off the other surfaces. So a light hit isn't recorded at the vertex before it.
+				const size_t count = guidingPath->size() - ((USE_NEXT_EVENT_ESTIMATION && emission && previousGuided) ? 1 : 0);
+				for (size_t i = 0; i < count; ++i)
+				{
+					GuidingVertex& guided = (*guidingPath)[i];
+					guided.radiance.x += (0.0f < guided.throughput.x) ? contribution.x / guided.throughput.x : 0.0f;
+					guided.radiance.y += (0.0f < guided.throughput.y) ? contribution.y / guided.throughput.y : 0.0f;
+					guided.radiance.z += (0.0f < guided.throughput.z) ? contribution.z / guided.throughput.z : 0.0f;
+				}
+			}
+
+			if ((prd.flags & FLAG_TERMINATE) || prd.pdf <= 0.0f || isNull(prd.f_over_pdf))
+			{
+				break;
+			}
+
+			throughput *= prd.f_over_pdf;
+
+			if (vertex.dTrees != nullptr)
+			{
+				vertex.throughput = throughput;
+				vertex.radiance   = optix::make_float3(0.0f);
+				guidingPath->push_back(vertex);
+			}
+			previousGuided = (vertex.dTrees != nullptr);
+
+			// Russian Roulette path termination after m_minPathLength path segments.
+			if (m_minPathLength <= depth)
+			{
+				const float probability = russianRouletteProbability(throughput);
+				if (probability <= sample1D(prd, SAMPLE_DIMENSION_ROULETTE))
+				{
+					break;
+				}
+				throughput /= probability;
+			}
+
+			++depth;
+			nextSegment(prd);
+		}
+
+		if (guidingPath != nullptr && m_guidingRecording)
+		{
+			for (GuidingVertex const& guided : *guidingPath)
+			{
+				guided.dTrees->building.record(guided.direction, luminance(guided.radiance) / guided.pdf);
+			}
+		}
+	}
+
+	void HostRenderer::closestHit(HostScene const& scene, PerRayData& prd, const optix::float3& direction, TriangleHit const& hit, ShadowCache& shadowCache, GuidingVertex* guidingVertex,
+	                              ReservoirPixel* restirPixel) const
+	{
+		State state;
+		scene.getState(prd.hit_pos, direction, hit, state);
+
+		prd.hit_pos = state.hit_position;
+
+		const Material& mat = scene.getMaterials()[scene.getMaterialIndex(hit.primitive)];
+
+		const EBrdfTypes brdf = beginSurface(mat, state, prd);
+
+		// Inactive without guiding and in the first training iteration, then only the BRDF is sampled. Specular vertices neither
+		// learn nor are guided, nothing but their mirror direction contributes.
+		DTreeWrapper const* dTrees = (guidingVertex != nullptr && (prd.brdf_flags & (BSDF_DIFFUSE | BSDF_GLOSSY))) ? &m_guiding.getDTrees(prd.hit_pos) : nullptr;
+		const GuidingMixture guiding((dTrees != nullptr) ? &dTrees->sampling : nullptr, c_guidingBsdfFraction);
+
+		// The guiding distribution puts directions below the surface, unlike the BRDF samples that is no rare grazing case.
+		// The path ends there, but the next event estimation of the vertex is still done, or its direct light would be missing.
+		const bool continued = sampleGuidedSurface(brdf, mat, state, guiding, prd);
+
+#if USE_NEXT_EVENT_ESTIMATION
+		// renderTile() resamples the direct light of the primary hit from the reservoirs. They are resampled when the path ends
+		// here too, or the temporal reuse would lose them, but the light is added only where the next event estimation runs.
+		// The path guiding learns the direct light of these hits from the paths only.
+		if (restirPixel != nullptr && (prd.brdf_flags & (BSDF_DIFFUSE | BSDF_GLOSSY)) && !scene.getLights().empty())
+		{
+			RestirSurface& surface = restirPixel->surface;
+			surface.position       = state.hit_position;
+			surface.materialIndex  = scene.getMaterialIndex(hit.primitive);
+			surface.geometryNormal = state.geometry_normal;
+			surface.brdf           = brdf;
+			surface.shadingNormal  = state.shading_normal;
+			surface.distance       = hit.t;
+			surface.wo             = prd.wo;
+
+			restirPixel->shaded = (continued || guiding.isActive()) ? 1 : 0;
+
+			prd.flags |= FLAG_DIRECT_RESAMPLED;
+		}
+#endif // USE_NEXT_EVENT_ESTIMATION
+
+		if (!continued && !guiding.isActive())
+		{
+			return;
+		}
+
+		if (continued && dTrees != nullptr)
+		{
+			guidingVertex->dTrees    = dTrees;
+			guidingVertex->direction = prd.wi;
+			guidingVertex->pdf       = prd.pdf;
+		}
+
+#if USE_NEXT_EVENT_ESTIMATION
+		if (prd.flags & FLAG_DIRECT_RESAMPLED)
+		{
+			return;
+		}
+
+		const LightSelector selector(m_lightSelection, scene.getLightTree(), scene.getLightAliasTable(), scene.getEnvironment());
+
+		ShadowRay shadowRay;
+		if (sampleDirectLighting(scene.getLights(), selector, mat, state, prd, m_sceneEpsilon, shadowRay, (dTrees != nullptr) ? &guiding : nullptr))
+		{
+			// Any hit in the open interval blocks the light, the light geometry included.
+			if (!scene.occluded(shadowRay.origin, shadowRay.direction, shadowRay.tmin, shadowRay.tmax, &shadowCache))
+			{
+				prd.radiance += shadowRay.radiance;
+			}
+		}
+#endif // USE_NEXT_EVENT_ESTIMATION
+	}
+
+	void HostRenderer::closestHitLight(HostScene const& scene, PerRayData& prd, const optix::float3& direction, TriangleHit const& hit) const
+	{
+		State state;
+		scene.getState(prd.hit_pos, direction, hit, state);
+
+		// The light was one of the candidates of the next event estimation at the ray origin.
+		const LightSelector selector(m_lightSelection, scene.getLightTree(), scene.getLightAliasTable(), scene.getEnvironment());
+		const int   lightIndex   = scene.getLightIndex(hit.primitive);
+		const optix::float3 origin = prd.hit_pos;
+		const float selectionPmf = lightSelectionPmf(scene.getLights(), selector, lightIndex, origin);
+
+		prd.hit_pos = state.hit_position;
+
+		shadeLight(scene.getLights()[lightIndex], selectionPmf, origin, hit.t, state.geometry_normal, prd);
+	}
+}
@@ -0,0 +1,277 @@
+#include "inc/HostScene.h"
+#include "inc/Scene.h"
+
+#include <optixu/optixu_matrix_namespace.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
+#include "inc/MyAssert.h"
+
+namespace POptix
+{
+	HostScene::HostScene()
+		: m_environmentLight(-1)
+	{
+	}
+
+	HostScene::~HostScene()
+	{
+	}
+
+	void HostScene::build(Scene const& scene, BvhBuildOptions const& options, BvhCache* cache)
+	{
+		m_vertices.clear();
+		m_normals.clear();
+		m_materialIndices.clear();
+		m_lightIndices.clear();
+		m_materials.clear();
+		m_lights.clear();
+		m_splittable.clear();
+
+		// Meshes without a builder entry in the scene file use the builder of the options.
+		const bool defaultSplittable = (options.builder == BVH_BUILDER_SBVH);
+
+		// Any mesh selecting "Sbvh" switches the build to spatial splits, restricted to the triangles of those meshes.
+		BvhBuildOptions buildOptions = options;
+		for (const Node* node : scene.mNodeList)
+		{
+			for (unsigned int meshID : node->mMeshIDList)
+			{
+				std::map<unsigned int, Mesh*>::const_iterator it = scene.mMeshList.find(meshID);
+				if (it != scene.mMeshList.end() && it->second->builder == std::string("Sbvh"))
+				{
+					buildOptions.builder = BVH_BUILDER_SBVH;
+				}
+			}
+		}
+
+		for (const Material* material : scene.mMaterialList)
+		{
+			m_materials.push_back(*material);
+		}
+		for (const Light* light : scene.mLightList)
+		{
+			m_lights.push_back(*light);
+		}
+		m_lightTree.build(m_lights);
+
+		// The first environment light, miss.cu supports one.
+		m_environmentLight = -1;
+		m_environment = EnvironmentMap();
+		for (int i = 0; i < int(m_lights.size()) && m_environmentLight < 0; ++i)
+		{
+			if (m_lights[i].lightType == ENVIRONMENT)
+			{
+				m_environmentLight = i;
+				m_environment.load(scene.mEnvironmentFile);
+			}
+		}
+
+		const BvhCacheTriangles triangles = { &m_vertices, &m_normals, &m_materialIndices, &m_lightIndices, &m_bounds };
+
+		// A hit skips the flattening and the build, the arrays stay in the mapped file.
+		unsigned long long key = 0;
+		char keyString[32] = "";
+		if (cache != nullptr)
+		{
+			key = BvhCache::computeKey(scene, options);
+			snprintf(keyString, sizeof(keyString), "%016llx", key);
+
+			if (cache->load(key, buildOptions, m_bvh, triangles))
+			{
+				std::cout << "BVH cache hit " << keyString << " in " << cache->getDirectory() << std::endl;
+				buildLightAliasTable();
+				return;
+			}
+			std::cout << "BVH cache miss " << keyString << " in " << cache->getDirectory() << ", building" << std::endl;
+		}
+
+		for (const Node* node : scene.mNodeList)
+		{
+			for (unsigned int meshID : node->mMeshIDList)
+			{
+				std::map<unsigned int, Mesh*>::const_iterator it = scene.mMeshList.find(meshID);
+				if (it != scene.mMeshList.end())
+				{
+					const std::string& builder = it->second->builder;
+					const bool splittable = builder.empty() ? defaultSplittable : (builder == std::string("Sbvh"));
+					addMesh(it->second->attributes, it->second->indices, node->transform, node->materialID, -1, splittable);
+				}
+			}
+		}
+
+		// Same light geometry as Application::createScene().
+		for (int i = 0; i < int(m_lights.size()); ++i)
+		{
+			const Light& light = m_lights[i];
+			Mesh* lightMesh = nullptr;
+
+			if (light.lightType == QUAD)
+			{
+				lightMesh = Scene::createParallelogram(0.5f * (light.u + light.v), light.u, light.v, light.normal);
+			}
+			else if (light.lightType == SPHERE)
+			{
+				lightMesh = Scene::createSphere(32, 32, light.radius, M_PIf);
+			}
+
+			if (lightMesh != nullptr)
+			{
+				const float lightTransform[16] = { 1.0f, 0.0f, 0.0f, light.position.x,
+				                                   0.0f, 1.0f, 0.0f, light.position.y,
+				                                   0.0f, 0.0f, 1.0f, light.position.z,
+				                                   0.0f, 0.0f, 0.0f, 1.0f };
+				addMesh(lightMesh->attributes, lightMesh->indices, lightTransform, -1, i, defaultSplittable);
+				delete lightMesh;
+			}
+		}
+
+		m_bounds.invalidate();
+		for (const optix::float3& vertex : m_vertices)
+		{
+			m_bounds.include(vertex);
+		}
+
+		buildLightAliasTable();
+
+		m_bvh.build(m_vertices.edit(), buildOptions, &m_splittable);
+
+		if (cache != nullptr && !cache->store(key, m_bvh, triangles))
+		{
+			std::cerr << "BVH cache: could not write " << keyString << " to " << cache->getDirectory() << std::endl;
+		}
+	}
+
+	void HostScene::buildLightAliasTable()
+	{
+		// Directional and environment lights are weighted by the power falling onto the scene.
+		m_lightAliasTable.build(m_lights, m_bounds.valid() ? 0.5f * optix::length(m_bounds.extent()) : 0.0f, m_environment.getAverageLuminance());
+	}
+
+	void HostScene::addMesh(std::vector<VertexAttributes> const& attributes, std::vector<unsigned int> const& indices, const float* transform, const int materialIndex, const int lightIndex, const bool splittable)
+	{
+		const optix::Matrix4x4 matrix(transform);
+		const optix::Matrix4x4 inverse = matrix.inverse(); // Normals use the inverse transpose.
+		const float* m   = matrix.getData();
+		const float* inv = inverse.getData();
+
+		std::vector<optix::float3> positions(attributes.size());
+		std::vector<optix::float3> normals(attributes.size());
+		for (size_t i = 0; i < attributes.size(); ++i)
+		{
+			const optix::float3 p = attributes[i].vertex;
+			const optix::float3 n = attributes[i].normal;
+			positions[i] = optix::make_float3(m[0] * p.x + m[1] * p.y + m[ 2] * p.z + m[ 3],
+			                                  m[4] * p.x + m[5] * p.y + m[ 6] * p.z + m[ 7],
+			                                  m[8] * p.x + m[9] * p.y + m[10] * p.z + m[11]);
+			normals[i] = optix::make_float3(inv[0] * n.x + inv[4] * n.y + inv[ 8] * n.z,
+			                                inv[1] * n.x + inv[5] * n.y + inv[ 9] * n.z,
+			                                inv[2] * n.x + inv[6] * n.y + inv[10] * n.z);
+		}
+
+		MY_ASSERT(indices.size() % 3 == 0);
+		for (size_t i = 0; i < indices.size(); ++i)
+		{
+			m_vertices.push_back(positions[indices[i]]);
+			m_normals.push_back(normals[indices[i]]);
+		}
+		m_materialIndices.resize(m_vertices.size() / 3, materialIndex);
+		m_lightIndices.resize(m_vertices.size() / 3, lightIndex);
+		m_splittable.resize(m_vertices.size() / 3, splittable ? 1 : 0);
+	}
+
+	bool HostScene::intersect(const optix::float3& origin, const optix::float3& direction, const float tmin, const float tmax, TriangleHit& hit, BvhTraversalStats* stats) const
+	{
+		const WatertightRay wray = makeWatertightRay(origin, direction);
+		BvhRay ray(origin, direction, tmin, tmax);
+
+		bool found = false;
+		auto intersectTriangle = [&](unsigned int primitive, BvhRay& r)
+		{
+			const optix::float3* v = &m_vertices[primitive * 3];
+			float t;
+			float beta;
+			float gamma;
+			if (intersectTriangleWatertight(wray, r.tmin, r.tmax, v[0], v[1], v[2], t, beta, gamma))
+			{
+				r.tmax        = t;
+				hit.t         = t;
+				hit.beta      = beta;
+				hit.gamma     = gamma;
+				hit.primitive = primitive;
+				found = true;
+			}
+		};
+		m_bvh.intersect(ray, intersectTriangle, stats);
+		return found;
+	}
+
+	bool HostScene::occluded(const optix::float3& origin, const optix::float3& direction, const float tmin, const float tmax, ShadowCache* cache, BvhTraversalStats* stats) const
+	{
+		const WatertightRay wray = makeWatertightRay(origin, direction);
+
+		// Only the hit decision is needed, no distance and barycentrics.
+		auto occludedTriangle = [&](unsigned int primitive, BvhRay const& r)
+		{
+			const optix::float3* v = &m_vertices[primitive * 3];
+			float t;
+			float beta;
+			float gamma;
+			return intersectTriangleWatertight(wray, r.tmin, r.tmax, v[0], v[1], v[2], t, beta, gamma);
+		};
+
+		BvhRay ray(origin, direction, tmin, tmax);
+
+		if (cache != nullptr && cache->primitive < getNumTriangles())
+		{
+			++cache->lookups;
+			if (occludedTriangle(cache->primitive, ray))
+			{
+				++cache->hits;
+				return true;
+			}
+		}
+
+		unsigned int occluder = ~0u;
+		auto occludedPrimitive = [&](unsigned int primitive, BvhRay const& r)
+		{
+			if (occludedTriangle(primitive, r))
+			{
+				occluder = primitive;
+				return true;
+			}
+			return false;
+		};
+
+		if (!m_bvh.occluded(ray, occludedPrimitive, stats))
+		{
+			return false;
+		}
+
+		if (cache != nullptr)
+		{
+			cache->primitive = occluder;
+		}
+		return true;
+	}
+
+	void HostScene::getState(const optix::float3& origin, const optix::float3& direction, TriangleHit const& hit, State& state) const
+	{
+		const optix::float3* v = &m_vertices[hit.primitive * 3];
+		const optix::float3* n = &m_normals[hit.primitive * 3];
+
+		// Same geometric normal as intersection_triangle_indexed.cu.
+		const optix::float3 ed0 = v[1] - v[0];
+		const optix::float3 ed1 = v[0] - v[2];
+		const optix::float3 geoNormal = optix::normalize(optix::cross(ed1, ed0));
+
+		const float alpha = 1.0f - hit.beta - hit.gamma;
+		const optix::float3 normal = n[0] * alpha + n[1] * hit.beta + n[2] * hit.gamma;
+
+		state.hit_position    = origin + direction * hit.t;
+		state.geometry_normal = geoNormal;
+		state.shading_normal  = (0.0f < optix::dot(normal, normal)) ? optix::normalize(normal) : geoNormal;
+	}
+}
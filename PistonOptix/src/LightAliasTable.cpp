@@ -0,0 +1,99 @@
+#include "inc/LightAliasTable.h"
+
+#include <algorithm>
+
+#include "inc/MyAssert.h"
+#include "shaders/light_alias.h"
+
+namespace POptix
+{
+	LightAliasTable::LightAliasTable()
+	{
+	}
+
+	LightAliasTable::~LightAliasTable()
+	{
+	}
+
+	float LightAliasTable::getLightPower(Light const& light, const float sceneRadius, const float environmentLuminance)
+	{
+		if (light.lightType == DIRECTIONAL)
+		{
+			// emission is the irradiance on surfaces facing the light.
+			return luminance(light.emission) * M_PIf * sceneRadius * sceneRadius;
+		}
+		if (light.lightType == ENVIRONMENT)
+		{
+			// A constant environment of radiance L gives the irradiance pi * L.
+			return luminance(light.emission) * environmentLuminance * M_PIf * M_PIf * sceneRadius * sceneRadius;
+		}
+		return luminance(light.emission) * light.area * M_PIf;
+	}
+
+	// Vose's variant of the alias method, see "A Linear Algorithm for Generating Random Numbers with a Given Distribution".
+	// Each of the n entries holds the probability mass 1 / n, split between the light itself and one alias.
+	void LightAliasTable::build(std::vector<Light> const& lights, const float sceneRadius, const float environmentLuminance)
+	{
+		const int numLights = int(lights.size());
+
+		m_entries.resize(numLights);
+		if (numLights == 0)
+		{
+			return;
+		}
+
+		std::vector<double> power(numLights);
+		double totalPower = 0.0;
+		for (int i = 0; i < numLights; ++i)
+		{
+			power[i] = std::max(0.0, double(getLightPower(lights[i], sceneRadius, environmentLuminance)));
+			totalPower += power[i];
+		}
+
+		std::vector<double> scaled(numLights);
+		std::vector<int>    small;
+		std::vector<int>    large;
+		for (int i = 0; i < numLights; ++i)
+		{
+			const double pmf = (0.0 < totalPower) ? power[i] / totalPower : 1.0 / numLights;
+
+			m_entries[i].pmf       = float(pmf);
+			m_entries[i].threshold = 1.0f;
+			m_entries[i].alias     = i;
+
+			scaled[i] = pmf * numLights;
+			((scaled[i] < 1.0) ? small : large).push_back(i);
+		}
+
+		while (!small.empty() && !large.empty())
+		{
+			const int less = small.back();
+			small.pop_back();
+			const int more = large.back();
+
+			m_entries[less].threshold = float(scaled[less]);
+			m_entries[less].alias     = more;
+
+			// The rest of the entry of less is taken from more.
+			scaled[more] -= 1.0 - scaled[less];
+			if (scaled[more] < 1.0)
+			{
+				large.pop_back();
+				small.push_back(more);
+			}
+		}
+
+		// What is left is 1 up to rounding and keeps its own entry, the initial threshold of 1.
+	}
+
+	int LightAliasTable::sample(const float u, float& pmf) const
+	{
+		MY_ASSERT(!m_entries.empty());
+		return sampleLightAlias(m_entries.data(), int(m_entries.size()), u, pmf);
+	}
+
+	float LightAliasTable::pmf(const int lightIndex) const
+	{
+		return lightAliasPmf(m_entries.data(), lightIndex);
+	}
+}
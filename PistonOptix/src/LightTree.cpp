@@ -0,0 +1,298 @@
+#include "inc/LightTree.h"
+
+#include <algorithm>
+#include <cfloat>
+
+#include "inc/MyAssert.h"
+#include "shaders/light_tree.h"
+
+namespace POptix
+{
+	static const int kNumBins = 12;
+
+	// Bounds and emission cone of a group of lights.
+	struct LightCluster
+	{
+		LightCluster()
+			: axis(optix::make_float3(0.0f, 0.0f, 1.0f))
+			, thetaO(0.0f)
+			, thetaE(0.0f)
+			, power(0.0f)
+			, empty(true)
+		{
+		}
+
+		optix::Aabb   bounds;
+		optix::float3 axis;
+		float         thetaO;
+		float         thetaE;
+		float         power;
+		bool          empty;
+	};
+
+	// Smallest cone containing both cones, see Conty Estevez and Kulla, section 4.3.
+	static void mergeCone(LightCluster& a, const optix::float3& axis, const float thetaO, const float thetaE)
+	{
+		a.thetaE = std::max(a.thetaE, thetaE);
+
+		optix::float3 axisA   = a.axis;
+		float         thetaOA = a.thetaO;
+		optix::float3 axisB   = axis;
+		float         thetaOB = thetaO;
+		if (thetaOA < thetaOB)
+		{
+			std::swap(axisA, axisB);
+			std::swap(thetaOA, thetaOB);
+		}
+
+		const float thetaD = acosf(optix::clamp(optix::dot(axisA, axisB), -1.0f, 1.0f));
+		if (std::min(thetaD + thetaOB, M_PIf) <= thetaOA)
+		{
+			a.axis   = axisA;
+			a.thetaO = thetaOA;
+			return;
+		}
+
+		const float thetaOMerged = 0.5f * (thetaOA + thetaD + thetaOB);
+		if (M_PIf <= thetaOMerged)
+		{
+			a.axis   = axisA;
+			a.thetaO = M_PIf;
+			return;
+		}
+
+		// Rotate axisA towards axisB by thetaR.
+		const float thetaR = thetaOMerged - thetaOA;
+		const optix::float3 ortho = axisB - axisA * optix::dot(axisA, axisB);
+		const float orthoLength = optix::length(ortho);
+		a.axis   = (orthoLength < 1.0e-6f) ? axisA : optix::normalize(axisA * cosf(thetaR) + ortho / orthoLength * sinf(thetaR));
+		a.thetaO = thetaOMerged;
+	}
+
+	static void addToCluster(LightCluster& cluster, const optix::Aabb& bounds, const optix::float3& axis, const float thetaO, const float thetaE, const float power)
+	{
+		cluster.bounds.include(bounds);
+		cluster.power += power;
+		if (cluster.empty)
+		{
+			cluster.axis   = axis;
+			cluster.thetaO = thetaO;
+			cluster.thetaE = thetaE;
+			cluster.empty  = false;
+		}
+		else
+		{
+			mergeCone(cluster, axis, thetaO, thetaE);
+		}
+	}
+
+	// Solid angle measure of a cone of normals plus the emission spread, Conty Estevez and Kulla, equation 1.
+	static float orientationMeasure(const float thetaO, const float thetaE)
+	{
+		const float thetaW = std::min(thetaO + thetaE, M_PIf);
+		return 2.0f * M_PIf * (1.0f - cosf(thetaO)) +
+		       0.5f * M_PIf * (2.0f * thetaW * sinf(thetaO) - cosf(thetaO - 2.0f * thetaW) - 2.0f * thetaO * sinf(thetaO) + cosf(thetaO));
+	}
+
+	static float clusterCost(LightCluster const& cluster)
+	{
+		if (cluster.empty)
+		{
+			return 0.0f;
+		}
+		// Flat clusters, e.g. coplanar quads, still need a measure that grows with their extent.
+		const float area = std::max(cluster.bounds.area(), 1.0e-12f);
+		return cluster.power * area * orientationMeasure(cluster.thetaO, cluster.thetaE);
+	}
+
+	LightTree::LightTree()
+		: m_numLights(0)
+		, m_numDirectionalLights(0)
+		, m_depth(0)
+	{
+	}
+
+	LightTree::~LightTree()
+	{
+	}
+
+	void LightTree::build(std::vector<Light> const& lights)
+	{
+		m_nodes.clear();
+		m_lightMap.assign(lights.size(), -1);
+		m_numLights = int(lights.size());
+		m_numDirectionalLights = 0;
+		m_depth = 0;
+
+		std::vector<BuildLight> buildLights;
+		std::vector<int>        directionalLights;
+
+		for (int i = 0; i < m_numLights; ++i)
+		{
+			Light const& light = lights[i];
+
+			BuildLight build;
+			build.index  = i;
+			build.power  = luminance(light.emission) * light.area;
+			build.thetaE = 0.5f * M_PIf;
+
+			if (light.lightType == QUAD)
+			{
+				build.bounds.invalidate();
+				build.bounds.include(light.position);
+				build.bounds.include(light.position + light.u);
+				build.bounds.include(light.position + light.v);
+				build.bounds.include(light.position + light.u + light.v);
+				build.axis   = light.normal;
+				build.thetaO = 0.0f;  // One sided.
+			}
+			else if (light.lightType == SPHERE)
+			{
+				build.bounds = optix::Aabb(light.position - optix::make_float3(light.radius), light.position + optix::make_float3(light.radius));
+				build.axis   = optix::make_float3(0.0f, 0.0f, 1.0f);
+				build.thetaO = M_PIf; // Normals in all directions.
+			}
+			else
+			{
+				// Directional and environment lights.
+				m_lightMap[i] = -1 - int(directionalLights.size());
+				directionalLights.push_back(i);
+				continue;
+			}
+
+			build.centroid = build.bounds.center();
+			buildLights.push_back(build);
+		}
+
+		m_numDirectionalLights = int(directionalLights.size());
+		m_lightMap.insert(m_lightMap.end(), directionalLights.begin(), directionalLights.end());
+
+		if (!buildLights.empty())
+		{
+			m_nodes.reserve(2 * buildLights.size() - 1);
+			buildNode(buildLights, 0, int(buildLights.size()), -1, 1);
+		}
+	}
+
+	int LightTree::buildNode(std::vector<BuildLight>& lights, const int begin, const int end, const int parent, const int depth)
+	{
+		m_depth = std::max(m_depth, depth);
+
+		LightCluster cluster;
+		optix::Aabb  centroidBounds;
+		for (int i = begin; i < end; ++i)
+		{
+			addToCluster(cluster, lights[i].bounds, lights[i].axis, lights[i].thetaO, lights[i].thetaE, lights[i].power);
+			centroidBounds.include(lights[i].centroid);
+		}
+
+		const int index = int(m_nodes.size());
+		LightTreeNode node;
+		node.boundsMin = cluster.bounds.m_min;
+		node.boundsMax = cluster.bounds.m_max;
+		node.power     = cluster.power;
+		node.axis      = cluster.axis;
+		node.cosThetaO = cosf(cluster.thetaO);
+		node.cosThetaE = cosf(cluster.thetaE);
+		node.child     = 0;
+		node.parent    = parent;
+		m_nodes.push_back(node);
+
+		if (end - begin == 1)
+		{
+			m_nodes[index].child = -1 - lights[begin].index;
+			m_lightMap[lights[begin].index] = index;
+			return index;
+		}
+
+		// Binned SAOH over the centroids, with the regularization favouring cuts across the longest extent.
+		const optix::float3 extent = centroidBounds.extent();
+		const float maxExtent = std::max(extent.x, std::max(extent.y, extent.z));
+
+		float bestCost = FLT_MAX;
+		int   bestAxis = -1;
+		int   bestBin  = 0;
+
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			const float axisExtent = optix::getByIndex(extent, axis);
+			if (axisExtent <= 0.0f)
+			{
+				continue;
+			}
+			const float axisMin = optix::getByIndex(centroidBounds.m_min, axis);
+
+			LightCluster bins[kNumBins];
+			for (int i = begin; i < end; ++i)
+			{
+				const int bin = std::min(int((optix::getByIndex(lights[i].centroid, axis) - axisMin) / axisExtent * kNumBins), kNumBins - 1);
+				addToCluster(bins[bin], lights[i].bounds, lights[i].axis, lights[i].thetaO, lights[i].thetaE, lights[i].power);
+			}
+
+			float rightCost[kNumBins];
+			bool  rightEmpty[kNumBins];
+			LightCluster right;
+			for (int b = kNumBins - 1; 0 < b; --b)
+			{
+				if (!bins[b].empty)
+				{
+					addToCluster(right, bins[b].bounds, bins[b].axis, bins[b].thetaO, bins[b].thetaE, bins[b].power);
+				}
+				rightCost[b]  = clusterCost(right);
+				rightEmpty[b] = right.empty;
+			}
+
+			LightCluster left;
+			for (int b = 0; b < kNumBins - 1; ++b)
+			{
+				if (!bins[b].empty)
+				{
+					addToCluster(left, bins[b].bounds, bins[b].axis, bins[b].thetaO, bins[b].thetaE, bins[b].power);
+				}
+				if (left.empty || rightEmpty[b + 1])
+				{
+					continue;
+				}
+				const float cost = (maxExtent / axisExtent) * (clusterCost(left) + rightCost[b + 1]);
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestBin  = b;
+				}
+			}
+		}
+
+		int middle = (begin + end) / 2;
+		if (0 <= bestAxis)
+		{
+			const float axisMin    = optix::getByIndex(centroidBounds.m_min, bestAxis);
+			const float axisExtent = optix::getByIndex(extent, bestAxis);
+			std::vector<BuildLight>::iterator split = std::partition(lights.begin() + begin, lights.begin() + end, [&](BuildLight const& light)
+			{
+				return std::min(int((optix::getByIndex(light.centroid, bestAxis) - axisMin) / axisExtent * kNumBins), kNumBins - 1) <= bestBin;
+			});
+			middle = int(split - lights.begin());
+		}
+		if (middle == begin || middle == end)
+		{
+			// Identical centroids, split by count.
+			middle = (begin + end) / 2;
+		}
+
+		buildNode(lights, begin, middle, index, depth + 1);
+		m_nodes[index].child = buildNode(lights, middle, end, index, depth + 1);
+		return index;
+	}
+
+	int LightTree::sample(const optix::float3& position, const float u, float& pmf) const
+	{
+		MY_ASSERT(0 < m_numLights);
+		return sampleLightTree(m_nodes.data(), m_lightMap.data(), m_numLights, m_numDirectionalLights, position, u, pmf);
+	}
+
+	float LightTree::pmf(const int lightIndex, const optix::float3& position) const
+	{
+		return lightTreePmf(m_nodes.data(), m_lightMap.data(), m_numLights, m_numDirectionalLights, lightIndex, position);
+	}
+}
@@ -0,0 +1,237 @@
+#include "inc/NumaTopology.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+
+#if defined(_WIN32)
+#include <Windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "inc/MyAssert.h"
+
+namespace POptix
+{
+#if !defined(_WIN32)
+	// Parses the sysfs list format, e.g. "0-3,8-11".
+	static std::vector<int> parseCpuList(std::string const& list)
+	{
+		std::vector<int> cpus;
+		size_t pos = 0;
+		while (pos < list.size())
+		{
+			size_t end = list.find(',', pos);
+			if (end == std::string::npos)
+			{
+				end = list.size();
+			}
+			const std::string range = list.substr(pos, end - pos);
+			const size_t dash = range.find('-');
+			if (!range.empty() && range[0] != '\n')
+			{
+				const int first = std::stoi(range.substr(0, dash));
+				const int last  = (dash == std::string::npos) ? first : std::stoi(range.substr(dash + 1));
+				for (int cpu = first; cpu <= last; ++cpu)
+				{
+					cpus.push_back(cpu);
+				}
+			}
+			pos = end + 1;
+		}
+		return cpus;
+	}
+
+	static bool readLine(std::string const& filename, std::string& line)
+	{
+		std::ifstream file(filename.c_str());
+		return file && std::getline(file, line);
+	}
+#endif
+
+	NumaTopology::NumaTopology()
+		: m_simulated(false)
+	{
+		m_nodes.push_back(getProcessCpus());
+	}
+
+	NumaTopology::~NumaTopology()
+	{
+	}
+
+	std::vector<int> NumaTopology::getProcessCpus()
+	{
+		std::vector<int> cpus;
+#if defined(_WIN32)
+		const WORD numGroups = GetActiveProcessorGroupCount();
+		for (WORD group = 0; group < numGroups; ++group)
+		{
+			const DWORD count = GetActiveProcessorCount(group);
+			for (DWORD i = 0; i < count; ++i)
+			{
+				cpus.push_back(int(group) * 64 + int(i));
+			}
+		}
+#else
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		if (sched_getaffinity(0, sizeof(set), &set) == 0)
+		{
+			for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+			{
+				if (CPU_ISSET(cpu, &set))
+				{
+					cpus.push_back(cpu);
+				}
+			}
+		}
+#endif
+		if (cpus.empty())
+		{
+			const int count = std::max(1, int(std::thread::hardware_concurrency()));
+			for (int cpu = 0; cpu < count; ++cpu)
+			{
+				cpus.push_back(cpu);
+			}
+		}
+		return cpus;
+	}
+
+	NumaTopology NumaTopology::detect()
+	{
+		NumaTopology topology;
+		std::vector<std::vector<int>> nodes;
+
+#if defined(_WIN32)
+		ULONG highestNode = 0;
+		if (GetNumaHighestNodeNumber(&highestNode))
+		{
+			for (ULONG node = 0; node <= highestNode; ++node)
+			{
+				GROUP_AFFINITY affinity;
+				if (!GetNumaNodeProcessorMaskEx(USHORT(node), &affinity))
+				{
+					continue;
+				}
+				std::vector<int> cpus;
+				for (int bit = 0; bit < 64; ++bit)
+				{
+					if (affinity.Mask & (KAFFINITY(1) << bit))
+					{
+						cpus.push_back(int(affinity.Group) * 64 + bit);
+					}
+				}
+				if (!cpus.empty())
+				{
+					nodes.push_back(cpus);
+				}
+			}
+		}
+#else
+		std::string online;
+		if (readLine("/sys/devices/system/node/online", online))
+		{
+			const std::vector<int> processCpus = topology.m_nodes[0];
+			for (int node : parseCpuList(online))
+			{
+				std::string list;
+				if (!readLine("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist", list))
+				{
+					continue;
+				}
+				std::vector<int> cpus;
+				for (int cpu : parseCpuList(list))
+				{
+					if (std::find(processCpus.begin(), processCpus.end(), cpu) != processCpus.end())
+					{
+						cpus.push_back(cpu);
+					}
+				}
+				// Nodes without CPUs of this process, e.g. memory only nodes, get no threads.
+				if (!cpus.empty())
+				{
+					nodes.push_back(cpus);
+				}
+			}
+		}
+#endif
+
+		if (!nodes.empty())
+		{
+			topology.m_nodes.swap(nodes);
+		}
+		return topology;
+	}
+
+	NumaTopology NumaTopology::simulate(int numNodes)
+	{
+		MY_ASSERT(0 < numNodes);
+
+		NumaTopology topology;
+		const std::vector<int> cpus = topology.m_nodes[0];
+
+		topology.m_nodes.assign(numNodes, std::vector<int>());
+		for (int i = 0; i < std::max(numNodes, int(cpus.size())); ++i)
+		{
+			// With fewer CPUs than nodes, the nodes share CPUs.
+			topology.m_nodes[i % numNodes].push_back(cpus[i % cpus.size()]);
+		}
+		topology.m_simulated = true;
+		return topology;
+	}
+
+	int NumaTopology::getNumCpus() const
+	{
+		int count = 0;
+		for (std::vector<int> const& cpus : m_nodes)
+		{
+			count += int(cpus.size());
+		}
+		return count;
+	}
+
+	bool NumaTopology::pinCurrentThread(int node) const
+	{
+		MY_ASSERT(0 <= node && node < getNumNodes());
+
+		std::vector<int> const& cpus = m_nodes[node];
+		if (cpus.empty())
+		{
+			return false;
+		}
+
+#if defined(_WIN32)
+		// A node never spans processor groups.
+		GROUP_AFFINITY affinity;
+		memset(&affinity, 0, sizeof(affinity));
+		affinity.Group = WORD(cpus[0] / 64);
+		for (int cpu : cpus)
+		{
+			affinity.Mask |= KAFFINITY(1) << (cpu % 64);
+		}
+		return SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr) != 0;
+#else
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		for (int cpu : cpus)
+		{
+			CPU_SET(cpu, &set);
+		}
+		return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#endif
+	}
+
+	void NumaTopology::runOnNode(int node, std::function<void()> const& function) const
+	{
+		std::thread thread([this, node, &function]()
+		{
+			pinCurrentThread(node);
+			function();
+		});
+		thread.join();
+	}
+}
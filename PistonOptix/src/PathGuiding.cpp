@@ -0,0 +1,425 @@
+#include "inc/PathGuiding.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "inc/MyAssert.h"
+#include "shaders/shader_common.h"
+
+namespace POptix
+{
+	// D-trees deeper than this don't resolve more than the noise of the records.
+	static const int c_maxDTreeDepth = 20;
+
+	static optix::float2 directionToCanonical(const optix::float3& direction)
+	{
+		const float cosTheta = std::min(std::max(direction.z, -1.0f), 1.0f);
+
+		float phi = atan2f(direction.y, direction.x);
+		if (phi < 0.0f)
+		{
+			phi += 2.0f * M_PIf;
+		}
+		return optix::make_float2(std::min(0.5f * (cosTheta + 1.0f), 0.99999994f), std::min(phi * (0.5f * M_1_PIf), 0.99999994f));
+	}
+
+	static optix::float3 canonicalToDirection(const optix::float2& p)
+	{
+		const float cosTheta = 2.0f * p.x - 1.0f;
+		const float sinTheta = sqrtf(std::max(0.0f, 1.0f - cosTheta * cosTheta));
+		const float phi      = 2.0f * M_PIf * p.y;
+
+		return optix::make_float3(sinTheta * cosf(phi), sinTheta * sinf(phi), cosTheta);
+	}
+
+	// Chooses the half of u, scaled back to [0, 1).
+	static int sampleHalf(float& u, const float first, const float second)
+	{
+		const float total = first + second;
+		const float p     = (0.0f < total) ? first / total : 0.5f;
+
+		if (u < p)
+		{
+			u = std::min(u / p, 0.99999994f);
+			return 0;
+		}
+		u = std::min((u - p) / (1.0f - p), 0.99999994f);
+		return 1;
+	}
+
+	static void atomicAdd(std::atomic<float>& target, const float value)
+	{
+		float current = target.load(std::memory_order_relaxed);
+		while (!target.compare_exchange_weak(current, current + value, std::memory_order_relaxed))
+		{
+		}
+	}
+
+
+	DTree::Node::Node()
+	{
+		for (int i = 0; i < 4; ++i)
+		{
+			sum[i].store(0.0f, std::memory_order_relaxed);
+			child[i] = 0;
+		}
+	}
+
+	DTree::Node::Node(Node const& other)
+	{
+		*this = other;
+	}
+
+	DTree::Node& DTree::Node::operator=(Node const& other)
+	{
+		for (int i = 0; i < 4; ++i)
+		{
+			sum[i].store(other.getSum(i), std::memory_order_relaxed);
+			child[i] = other.child[i];
+		}
+		return *this;
+	}
+
+
+	DTree::DTree()
+		: m_nodes(1)
+		, m_total(0.0f)
+		, m_depth(1)
+		, m_numRecords(0)
+	{
+	}
+
+	DTree::DTree(DTree const& other)
+		: m_nodes(other.m_nodes)
+		, m_total(other.m_total)
+		, m_depth(other.m_depth)
+		, m_numRecords(other.getNumRecords())
+	{
+	}
+
+	DTree& DTree::operator=(DTree const& other)
+	{
+		m_nodes      = other.m_nodes;
+		m_total      = other.m_total;
+		m_depth      = other.m_depth;
+		m_numRecords = other.getNumRecords();
+		return *this;
+	}
+
+	void DTree::record(const optix::float3& direction, const float value) const
+	{
+		// Fireflies of NaN or infinity would poison the whole distribution.
+		if (!(0.0f <= value) || !std::isfinite(value))
+		{
+			return;
+		}
+
+		// Paths which find nothing count for the density of the vertices, which decides the spatial splits.
+		m_numRecords.fetch_add(1, std::memory_order_relaxed);
+		if (value == 0.0f)
+		{
+			return;
+		}
+
+		optix::float2 p = directionToCanonical(direction);
+
+		int index = 0;
+		for (;;)
+		{
+			const int x = (0.5f <= p.x) ? 1 : 0;
+			const int y = (0.5f <= p.y) ? 1 : 0;
+			const int i = x + 2 * y;
+
+			Node const& node = m_nodes[index];
+			if (node.isLeaf(i))
+			{
+				atomicAdd(node.sum[i], value);
+				break;
+			}
+			p.x   = 2.0f * p.x - float(x);
+			p.y   = 2.0f * p.y - float(y);
+			index = node.child[i];
+		}
+	}
+
+	float DTree::buildNode(const int index)
+	{
+		Node& node = m_nodes[index];
+		for (int i = 0; i < 4; ++i)
+		{
+			if (!node.isLeaf(i))
+			{
+				node.sum[i].store(buildNode(node.child[i]), std::memory_order_relaxed);
+			}
+		}
+		return node.getTotal();
+	}
+
+	void DTree::build()
+	{
+		m_total = buildNode(0);
+	}
+
+	void DTree::reset(DTree const& previous, const int maxDepth, const float subdivisionThreshold)
+	{
+		m_total      = 0.0f;
+		m_numRecords = 0;
+
+		// Nothing learned, keep the structure.
+		if (previous.m_total <= 0.0f)
+		{
+			m_nodes = previous.m_nodes;
+			m_depth = previous.m_depth;
+			for (Node& node : m_nodes)
+			{
+				node = Node();
+			}
+			return;
+		}
+
+		// A leaf of previous which gets split hands a quarter of its value to each of its new children, so the splits go on
+		// until the share of a node is below the threshold.
+		struct Entry
+		{
+			int   node;
+			int   previousNode; // -1 below the leaves of previous.
+			float sum;
+			int   depth;
+		};
+
+		m_nodes.assign(1, Node());
+		m_depth = 1;
+
+		const float threshold = previous.m_total * subdivisionThreshold;
+
+		std::vector<Entry> stack;
+		stack.push_back({ 0, 0, previous.m_total, 1 });
+		while (!stack.empty())
+		{
+			const Entry entry = stack.back();
+			stack.pop_back();
+
+			m_depth = std::max(m_depth, entry.depth);
+
+			for (int i = 0; i < 4; ++i)
+			{
+				const float sum = (0 <= entry.previousNode) ? previous.m_nodes[entry.previousNode].getSum(i) : 0.25f * entry.sum;
+				if (entry.depth < maxDepth && threshold < sum)
+				{
+					const int child = int(m_nodes.size());
+					m_nodes.push_back(Node());
+					m_nodes[entry.node].child[i] = child;
+
+					const int previousChild = (0 <= entry.previousNode) ? previous.m_nodes[entry.previousNode].child[i] : 0;
+					stack.push_back({ child, (previousChild != 0) ? previousChild : -1, sum, entry.depth + 1 });
+				}
+			}
+		}
+	}
+
+	optix::float3 DTree::sample(optix::float2 u, float& pdf) const
+	{
+		if (m_total <= 0.0f)
+		{
+			pdf = 0.25f * M_1_PIf;
+			return canonicalToDirection(u);
+		}
+
+		optix::float2 origin = optix::make_float2(0.0f);
+		float         size   = 1.0f;
+
+		float result = 1.0f;
+
+		int index = 0;
+		for (;;)
+		{
+			Node const& node = m_nodes[index];
+
+			// First the column, then the quadrant within it, which picks quadrant i with the probability sum[i] / total.
+			const int x = sampleHalf(u.x, node.getSum(0) + node.getSum(2), node.getSum(1) + node.getSum(3));
+			const int y = sampleHalf(u.y, node.getSum(x), node.getSum(x + 2));
+			const int i = x + 2 * y;
+
+			size *= 0.5f;
+			origin.x += size * float(x);
+			origin.y += size * float(y);
+
+			result *= 4.0f * node.getSum(i) / node.getTotal();
+
+			if (node.isLeaf(i))
+			{
+				break;
+			}
+			index = node.child[i];
+		}
+		pdf = result * (0.25f * M_1_PIf);
+		return canonicalToDirection(origin + size * u);
+	}
+
+	float DTree::pdf(const optix::float3& direction) const
+	{
+		if (m_total <= 0.0f)
+		{
+			return 0.25f * M_1_PIf;
+		}
+
+		optix::float2 p = directionToCanonical(direction);
+
+		float result = 1.0f;
+
+		int index = 0;
+		for (;;)
+		{
+			const int x = (0.5f <= p.x) ? 1 : 0;
+			const int y = (0.5f <= p.y) ? 1 : 0;
+			const int i = x + 2 * y;
+
+			Node const& node  = m_nodes[index];
+			const float total = node.getTotal();
+			if (total <= 0.0f)
+			{
+				return 0.0f;
+			}
+			result *= 4.0f * node.getSum(i) / total;
+
+			if (node.isLeaf(i))
+			{
+				break;
+			}
+			p.x   = 2.0f * p.x - float(x);
+			p.y   = 2.0f * p.y - float(y);
+			index = node.child[i];
+		}
+		// The square has the area 1, the sphere 4 pi.
+		return result * (0.25f * M_1_PIf);
+	}
+
+
+	SDTree::SDTree()
+		: m_origin(optix::make_float3(0.0f))
+		, m_size(1.0f)
+		, m_spatialThreshold(4000)
+		, m_directionalThreshold(0.01f)
+	{
+		init(optix::Aabb(optix::make_float3(-1.0f), optix::make_float3(1.0f)));
+	}
+
+	SDTree::~SDTree()
+	{
+	}
+
+	void SDTree::init(optix::Aabb const& bounds)
+	{
+		MY_ASSERT(bounds.valid());
+
+		const optix::float3 extent = bounds.extent();
+
+		// A cube, so the cells don't get long and thin. The margin keeps points on the bounds inside.
+		m_size   = 1.01f * std::max(std::max(extent.x, extent.y), std::max(extent.z, 1.0e-6f));
+		m_origin = bounds.center() - optix::make_float3(0.5f * m_size);
+
+		m_nodes.clear();
+		m_nodes.push_back({ 0, -1, 0 });
+
+		m_dTrees.assign(1, DTreeWrapper());
+	}
+
+	void SDTree::setSpatialThreshold(const int records)
+	{
+		MY_ASSERT(0 < records);
+		m_spatialThreshold = records;
+	}
+
+	void SDTree::setDirectionalThreshold(const float share)
+	{
+		MY_ASSERT(0.0f < share && share < 1.0f);
+		m_directionalThreshold = share;
+	}
+
+	DTreeWrapper const& SDTree::getDTrees(const optix::float3& position) const
+	{
+		optix::float3 p = (position - m_origin) / m_size;
+
+		int index = 0;
+		while (0 <= m_nodes[index].children)
+		{
+			Node const& node = m_nodes[index];
+
+			float& v = (node.axis == 0) ? p.x : (node.axis == 1) ? p.y : p.z;
+			if (v < 0.5f)
+			{
+				v     = 2.0f * v;
+				index = node.children;
+			}
+			else
+			{
+				v     = 2.0f * v - 1.0f;
+				index = node.children + 1;
+			}
+		}
+		return m_dTrees[m_nodes[index].dTrees];
+	}
+
+	void SDTree::update(const int iteration)
+	{
+		for (DTreeWrapper& dTrees : m_dTrees)
+		{
+			dTrees.building.build();
+		}
+
+		const int threshold = int(float(m_spatialThreshold) * sqrtf(float(1 << std::min(iteration, 30))));
+
+		// The children of a split cell start with copies of its D-trees and half its records each. They are checked again
+		// further down the loop, so a cell with many records is split several times.
+		for (size_t index = 0; index < m_nodes.size(); ++index)
+		{
+			if (0 <= m_nodes[index].children)
+			{
+				continue;
+			}
+
+			const int dTrees  = m_nodes[index].dTrees;
+			const int records = m_dTrees[dTrees].building.getNumRecords();
+			if (records <= threshold)
+			{
+				continue;
+			}
+
+			const int axis     = (m_nodes[index].axis + 1) % 3;
+			const int children = int(m_nodes.size());
+
+			m_dTrees[dTrees].building.setNumRecords(records / 2);
+			m_dTrees.push_back(m_dTrees[dTrees]);
+
+			m_nodes[index].children = children;
+			m_nodes.push_back({ axis, -1, dTrees });
+			m_nodes.push_back({ axis, -1, int(m_dTrees.size()) - 1 });
+		}
+
+		for (DTreeWrapper& dTrees : m_dTrees)
+		{
+			dTrees.sampling = dTrees.building;
+			dTrees.building.reset(dTrees.sampling, c_maxDTreeDepth, m_directionalThreshold);
+		}
+	}
+
+	void SDTree::swap(SDTree& other)
+	{
+		std::swap(m_origin, other.m_origin);
+		std::swap(m_size, other.m_size);
+		std::swap(m_spatialThreshold, other.m_spatialThreshold);
+		std::swap(m_directionalThreshold, other.m_directionalThreshold);
+		m_nodes.swap(other.m_nodes);
+		m_dTrees.swap(other.m_dTrees);
+	}
+
+	int SDTree::getNumDTreeNodes() const
+	{
+		int count = 0;
+		for (DTreeWrapper const& dTrees : m_dTrees)
+		{
+			count += dTrees.sampling.getNumNodes() + dTrees.building.getNumNodes();
+		}
+		return count;
+	}
+}
@@ -0,0 +1,79 @@
+#include "inc/RadixSort.h"
+#include "inc/TileScheduler.h"
+
+#include <algorithm>
+
+#include "inc/MyAssert.h"
+
+namespace POptix
+{
+	static const int kRadixBits  = 8;
+	static const int kRadixSize  = 1 << kRadixBits;
+	static const int kSortChunk  = 16384; // Elements per histogram, fixed so the result doesn't depend on the thread count.
+
+	void radixSort(TileScheduler& scheduler, std::vector<unsigned int>& keys, std::vector<int>& values, const int numBits,
+	               std::vector<unsigned int>& scratchKeys, std::vector<int>& scratchValues)
+	{
+		MY_ASSERT(keys.size() == values.size());
+		MY_ASSERT(0 < numBits && numBits <= 32);
+
+		const int count     = int(keys.size());
+		const int numChunks = (count + kSortChunk - 1) / kSortChunk;
+
+		scratchKeys.resize(count);
+		scratchValues.resize(count);
+
+		std::vector<int> offsets(size_t(numChunks) * kRadixSize);
+
+		for (int shift = 0; shift < numBits; shift += kRadixBits)
+		{
+			std::vector<unsigned int> const& srcKeys   = keys;
+			std::vector<int> const&          srcValues = values;
+
+			std::fill(offsets.begin(), offsets.end(), 0);
+			scheduler.parallelFor(numChunks, 1, [&](int begin, int end, int /*threadIndex*/)
+			{
+				for (int chunk = begin; chunk < end; ++chunk)
+				{
+					int* histogram = &offsets[size_t(chunk) * kRadixSize];
+					const int last = std::min(count, (chunk + 1) * kSortChunk);
+					for (int i = chunk * kSortChunk; i < last; ++i)
+					{
+						++histogram[(srcKeys[i] >> shift) & (kRadixSize - 1)];
+					}
+				}
+			});
+
+			// Digit major exclusive prefix sum, chunk order inside a digit keeps the sort stable.
+			int offset = 0;
+			for (int digit = 0; digit < kRadixSize; ++digit)
+			{
+				for (int chunk = 0; chunk < numChunks; ++chunk)
+				{
+					int& counter = offsets[size_t(chunk) * kRadixSize + digit];
+					const int digitCount = counter;
+					counter = offset;
+					offset += digitCount;
+				}
+			}
+
+			scheduler.parallelFor(numChunks, 1, [&](int begin, int end, int /*threadIndex*/)
+			{
+				for (int chunk = begin; chunk < end; ++chunk)
+				{
+					int* chunkOffsets = &offsets[size_t(chunk) * kRadixSize];
+					const int last = std::min(count, (chunk + 1) * kSortChunk);
+					for (int i = chunk * kSortChunk; i < last; ++i)
+					{
+						const int target = chunkOffsets[(srcKeys[i] >> shift) & (kRadixSize - 1)]++;
+						scratchKeys[target]   = srcKeys[i];
+						scratchValues[target] = srcValues[i];
+					}
+				}
+			});
+
+			keys.swap(scratchKeys);
+			values.swap(scratchValues);
+		}
+	}
+}
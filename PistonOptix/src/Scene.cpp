@@ -12,6 +12,7 @@ namespace POptix
 	
 
 	Scene::Scene()
+		: mCamera(nullptr)
 	{
 		//build();
 	}
@@ -147,6 +148,7 @@ namespace POptix
 		directionalLight->emission = optix::make_float3(10.0f, 10.0f, 10.0f);
 		directionalLight->lightType = POptix::ELightType::DIRECTIONAL;
 		directionalLight->normal = optix::normalize(optix::make_float3(-1.0f, 1.0f, 1.0f));
+		directionalLight->isDelta = true;
 		mLightList.emplace_back(directionalLight);
 
 		mCamera = new PinholeCamera();
@@ -243,6 +245,7 @@ namespace POptix
 
 				optix::float3 v1, v2;
 				char light_type[20] = "None";
+				char light_file[256] = "";
 
 				while (fgets(line, kMaxLineLength, file))
 				{
@@ -258,6 +261,7 @@ namespace POptix
 					sscanf(line, " v1 %f %f %f", &v1.x, &v1.y, &v1.z);
 					sscanf(line, " v2 %f %f %f", &v2.x, &v2.y, &v2.z);
 					sscanf(line, " type %s", light_type);
+					sscanf(line, " file %255s", light_file);
 				}
 
 				if (strcmp(light_type, "Quad") == 0)
@@ -282,7 +286,10 @@ namespace POptix
 				}
 				else if (strcmp(light_type, "Environment") == 0)
 				{
-					//light.lightType = ENVIRONMENT;
+					// emission scales the HDR image, relative to the scene file like the meshes.
+					light->lightType = ENVIRONMENT;
+					light->area = 0.0f;
+					scene->mEnvironmentFile = scene->properties.sceneDirectoryPath + "\\" + light_file;
 				}
 
 				scene->mLightList.emplace_back(light);
@@ -293,6 +300,9 @@ namespace POptix
 			//------------------------------------------//
 			if (sscanf(line, " mesh %s", name) == 1)
 			{
+				Mesh* loadedMesh = nullptr;
+				char builder[64] = "";
+
 				while (fgets(line, kMaxLineLength, file))
 				{
 					// end group
@@ -300,6 +310,7 @@ namespace POptix
 						break;
 
 					sscanf(line, " name %s", name);
+					sscanf(line, " builder %63s", builder);
 					int count = 0;
 					char path[2048];
 
@@ -313,8 +324,14 @@ namespace POptix
 						mesh->filePath = path;
 						mesh->ID = meshCount;
 						scene->mMeshList.insert(make_pair(meshCount, mesh));
+						loadedMesh = mesh;
 					}
 				}
+
+				if (loadedMesh != nullptr)
+				{
+					loadedMesh->builder = builder;
+				}
 			}
 
 			//------------------------------------------//
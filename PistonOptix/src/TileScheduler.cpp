@@ -0,0 +1,431 @@
+#include "inc/TileScheduler.h"
+
+#include <algorithm>
+
+#include "inc/MyAssert.h"
+
+namespace POptix
+{
+	// Hilbert curve index of cell (x, y) in a grid of side n (power of two).
+	static unsigned int hilbertIndex(unsigned int n, unsigned int x, unsigned int y)
+	{
+		unsigned int d = 0;
+		for (unsigned int s = n / 2; s > 0; s /= 2)
+		{
+			const unsigned int rx = (x & s) ? 1 : 0;
+			const unsigned int ry = (y & s) ? 1 : 0;
+			d += s * s * ((3 * rx) ^ ry);
+			// Rotate the quadrant.
+			if (ry == 0)
+			{
+				if (rx == 1)
+				{
+					x = s - 1 - x;
+					y = s - 1 - y;
+				}
+				std::swap(x, y);
+			}
+		}
+		return d;
+	}
+
+	TileScheduler::TileScheduler(int numThreads, NumaTopology const* topology)
+		: m_width(0)
+		, m_height(0)
+		, m_tileSize(32)
+		, m_numSlices(1)
+		, m_order(TILE_ORDER_HILBERT)
+		, m_workStealing(true)
+		, m_tilesDirty(true)
+		, m_pinThreads(topology != nullptr)
+		, m_function(nullptr)
+		, m_dispatchTiles(nullptr)
+		, m_generation(0)
+		, m_running(0)
+		, m_quit(false)
+		, m_passIndex(0)
+	{
+		if (topology != nullptr)
+		{
+			m_topology = *topology;
+		}
+
+		if (numThreads <= 0)
+		{
+			numThreads = (topology != nullptr) ? topology->getNumCpus() : std::max(1, int(std::thread::hardware_concurrency()));
+		}
+
+		// Contiguous blocks of threads per node, sized by the number of CPUs of the node.
+		const int numCpus = m_topology.getNumCpus();
+		int node = 0;
+		int nodeEnd = int(m_topology.getCpus(0).size());
+		for (int i = 0; i < numThreads; ++i)
+		{
+			const int cpu = int((long long)(i) * numCpus / numThreads);
+			while (nodeEnd <= cpu && node + 1 < m_topology.getNumNodes())
+			{
+				++node;
+				nodeEnd += int(m_topology.getCpus(node).size());
+			}
+			m_threadNodes.push_back(node);
+		}
+
+		for (int i = 0; i < numThreads; ++i)
+		{
+			m_queues.push_back(std::unique_ptr<WorkerQueue>(new WorkerQueue));
+		}
+		for (int i = 0; i < numThreads; ++i)
+		{
+			m_workers.push_back(std::thread(&TileScheduler::workerLoop, this, i));
+		}
+	}
+
+	TileScheduler::~TileScheduler()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_quit = true;
+		}
+		m_startCondition.notify_all();
+		for (std::thread& worker : m_workers)
+		{
+			worker.join();
+		}
+	}
+
+	void TileScheduler::setImageSize(int width, int height)
+	{
+		if (width != m_width || height != m_height)
+		{
+			m_width  = width;
+			m_height = height;
+			m_tilesDirty = true;
+		}
+	}
+
+	void TileScheduler::setTileSize(int tileSize)
+	{
+		MY_ASSERT(0 < tileSize);
+		if (tileSize != m_tileSize)
+		{
+			m_tileSize = tileSize;
+			m_tilesDirty = true;
+		}
+	}
+
+	void TileScheduler::setTileOrder(ETileOrder order)
+	{
+		if (order != m_order)
+		{
+			m_order = order;
+			m_tilesDirty = true;
+		}
+	}
+
+	void TileScheduler::setWorkStealing(bool enable)
+	{
+		m_workStealing = enable;
+	}
+
+	void TileScheduler::setSampleSlices(int numSlices)
+	{
+		MY_ASSERT(0 < numSlices);
+		if (numSlices != m_numSlices)
+		{
+			m_numSlices = numSlices;
+			m_tilesDirty = true;
+		}
+	}
+
+	std::vector<Tile> const& TileScheduler::getTiles()
+	{
+		if (m_tilesDirty)
+		{
+			createTiles();
+		}
+		return m_tiles;
+	}
+
+	void TileScheduler::createTiles()
+	{
+		const int tilesX = (m_width  + m_tileSize - 1) / m_tileSize;
+		const int tilesY = (m_height + m_tileSize - 1) / m_tileSize;
+
+		m_tiles.clear();
+		m_tiles.reserve(tilesX * tilesY);
+		for (int ty = 0; ty < tilesY; ++ty)
+		{
+			for (int tx = 0; tx < tilesX; ++tx)
+			{
+				Tile tile;
+				tile.x      = tx * m_tileSize;
+				tile.y      = ty * m_tileSize;
+				tile.width  = std::min(m_tileSize, m_width  - tile.x);
+				tile.height = std::min(m_tileSize, m_height - tile.y);
+				tile.index  = 0;
+				tile.slice  = 0;
+				m_tiles.push_back(tile);
+			}
+		}
+
+		if (m_order == TILE_ORDER_HILBERT)
+		{
+			unsigned int n = 1;
+			while (n < unsigned(std::max(tilesX, tilesY)))
+			{
+				n *= 2;
+			}
+
+			std::vector<unsigned int> keys(m_tiles.size());
+			for (size_t i = 0; i < m_tiles.size(); ++i)
+			{
+				keys[i] = hilbertIndex(n, m_tiles[i].x / m_tileSize, m_tiles[i].y / m_tileSize);
+			}
+
+			std::vector<int> order(m_tiles.size());
+			for (size_t i = 0; i < order.size(); ++i)
+			{
+				order[i] = int(i);
+			}
+			std::sort(order.begin(), order.end(), [&keys](int a, int b) { return keys[a] < keys[b]; });
+
+			std::vector<Tile> sorted(m_tiles.size());
+			for (size_t i = 0; i < order.size(); ++i)
+			{
+				sorted[i] = m_tiles[order[i]];
+			}
+			m_tiles.swap(sorted);
+		}
+
+		if (1 < m_numSlices)
+		{
+			std::vector<Tile> sliced;
+			sliced.reserve(m_tiles.size() * m_numSlices);
+			for (Tile const& tile : m_tiles)
+			{
+				for (int slice = 0; slice < m_numSlices; ++slice)
+				{
+					sliced.push_back(tile);
+					sliced.back().slice = slice;
+				}
+			}
+			m_tiles.swap(sliced);
+		}
+
+		for (size_t i = 0; i < m_tiles.size(); ++i)
+		{
+			m_tiles[i].index = int(i);
+		}
+		m_tilesDirty = false;
+	}
+
+	void TileScheduler::run(TileFunction const& function)
+	{
+		if (m_tilesDirty)
+		{
+			createTiles();
+		}
+
+		dispatch(m_tiles, function);
+		++m_passIndex;
+	}
+
+	void TileScheduler::parallelFor(int count, int grainSize, RangeFunction const& function)
+	{
+		MY_ASSERT(0 < grainSize);
+
+		m_ranges.clear();
+		for (int begin = 0; begin < count; begin += grainSize)
+		{
+			Tile range;
+			range.x      = begin;
+			range.y      = 0;
+			range.width  = std::min(grainSize, count - begin);
+			range.height = 1;
+			range.index  = int(m_ranges.size());
+			range.slice  = 0;
+			m_ranges.push_back(range);
+		}
+
+		if (m_ranges.size() <= 1)
+		{
+			// Not worth waking up the workers.
+			if (0 < count)
+			{
+				function(0, count, 0);
+			}
+			return;
+		}
+
+		dispatch(m_ranges, [&function](Tile const& range, int threadIndex)
+		{
+			function(range.x, range.x + range.width, threadIndex);
+		});
+	}
+
+	int TileScheduler::getHomeNode(int index, int count) const
+	{
+		MY_ASSERT(0 <= index && index < count);
+
+		// Inverse of the contiguous runs in dispatch().
+		const int numThreads = getNumThreads();
+		int thread = int((long long)(index) * numThreads / count);
+		while (0 < thread && index < int((long long)(count) * thread / numThreads))
+		{
+			--thread;
+		}
+		while (thread + 1 < numThreads && int((long long)(count) * (thread + 1) / numThreads) <= index)
+		{
+			++thread;
+		}
+		return m_threadNodes[thread];
+	}
+
+	void TileScheduler::dispatch(std::vector<Tile> const& tiles, TileFunction const& function)
+	{
+		const int numThreads = getNumThreads();
+		const int numTiles   = int(tiles.size());
+
+		// Contiguous runs of the tile order, so each thread starts on a compact region of the image.
+		for (int i = 0; i < numThreads; ++i)
+		{
+			const int begin = int((long long)(numTiles) * i / numThreads);
+			const int end   = int((long long)(numTiles) * (i + 1) / numThreads);
+
+			std::lock_guard<std::mutex> lock(m_queues[i]->mutex);
+			m_queues[i]->tiles.clear();
+			for (int t = begin; t < end; ++t)
+			{
+				m_queues[i]->tiles.push_back(t);
+			}
+		}
+
+		m_stats.threads.assign(numThreads, TileThreadStats());
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_function = &function;
+		m_dispatchTiles = &tiles;
+		m_running  = numThreads;
+		m_passTimer.restart();
+		++m_generation;
+		m_startCondition.notify_all();
+
+		m_doneCondition.wait(lock, [this] { return m_running == 0; });
+		m_function = nullptr;
+		m_dispatchTiles = nullptr;
+
+		m_stats.passTime = m_passTimer.getTime();
+
+		double firstFinish = m_stats.passTime;
+		double busy = 0.0;
+		for (TileThreadStats const& thread : m_stats.threads)
+		{
+			firstFinish = std::min(firstFinish, thread.finishTime);
+			busy += thread.busyTime;
+		}
+		m_stats.tailLatency = m_stats.passTime - firstFinish;
+		m_stats.utilization = (0.0 < m_stats.passTime) ? busy / (m_stats.passTime * numThreads) : 1.0;
+	}
+
+	bool TileScheduler::popTile(int threadIndex, int& tile)
+	{
+		WorkerQueue& queue = *m_queues[threadIndex];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.tiles.empty())
+		{
+			return false;
+		}
+		tile = queue.tiles.front();
+		queue.tiles.pop_front();
+		return true;
+	}
+
+	bool TileScheduler::stealTile(int threadIndex, int& tile)
+	{
+		// Start with the neighbour in curve order, its remaining tiles are the closest ones in the image.
+		// Workers on the own node come first, their tiles touch node local data.
+		const int numThreads = getNumThreads();
+		for (int pass = 0; pass < 2; ++pass)
+		{
+			for (int i = 1; i < numThreads; ++i)
+			{
+				const int victimIndex = (threadIndex + i) % numThreads;
+				if ((m_threadNodes[victimIndex] == m_threadNodes[threadIndex]) != (pass == 0))
+				{
+					continue;
+				}
+
+				WorkerQueue& victim = *m_queues[victimIndex];
+				std::lock_guard<std::mutex> lock(victim.mutex);
+				if (!victim.tiles.empty())
+				{
+					tile = victim.tiles.back();
+					victim.tiles.pop_back();
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+
+	void TileScheduler::workerLoop(int threadIndex)
+	{
+		unsigned int generation = 0;
+
+		if (m_pinThreads)
+		{
+			m_topology.pinCurrentThread(m_threadNodes[threadIndex]);
+		}
+
+		for (;;)
+		{
+			const TileFunction*      function = nullptr;
+			const std::vector<Tile>* tiles    = nullptr;
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_startCondition.wait(lock, [&] { return m_quit || generation != m_generation; });
+				if (m_quit)
+				{
+					return;
+				}
+				generation = m_generation;
+				function   = m_function;
+				tiles      = m_dispatchTiles;
+			}
+
+			TileThreadStats stats = {};
+			Timer tileTimer;
+
+			int tile;
+			for (;;)
+			{
+				bool stolen = false;
+				if (!popTile(threadIndex, tile))
+				{
+					if (!m_workStealing || !stealTile(threadIndex, tile))
+					{
+						break;
+					}
+					stolen = true;
+				}
+
+				tileTimer.restart();
+				(*function)((*tiles)[tile], threadIndex);
+				stats.busyTime += tileTimer.getTime();
+				++stats.tiles;
+				if (stolen)
+				{
+					++stats.steals;
+				}
+			}
+
+			std::lock_guard<std::mutex> lock(m_mutex);
+			stats.finishTime = m_passTimer.getTime();
+			m_stats.threads[threadIndex] = stats;
+			if (--m_running == 0)
+			{
+				m_doneCondition.notify_one();
+			}
+		}
+	}
+}
@@ -0,0 +1,119 @@
+#include "inc/TopLevelAccel.h"
+#include "inc/Scene.h"
+
+#include "inc/MyAssert.h"
+
+namespace POptix
+{
+	optix::Aabb computeMeshBounds(Mesh const& mesh)
+	{
+		optix::Aabb bounds;
+		for (const VertexAttributes& attribute : mesh.attributes)
+		{
+			bounds.include(attribute.vertex);
+		}
+		return bounds;
+	}
+
+	// Transforms the box by taking the extremes per matrix element (Arvo, Graphics Gems 1990) instead of all eight corners.
+	optix::Aabb transformBounds(optix::Aabb const& bounds, optix::Matrix4x4 const& matrix)
+	{
+		if (!bounds.valid())
+		{
+			return bounds;
+		}
+
+		const float* m = matrix.getData();
+
+		float resultMin[3] = { m[3], m[7], m[11] };
+		float resultMax[3] = { m[3], m[7], m[11] };
+
+		for (int row = 0; row < 3; ++row)
+		{
+			for (int col = 0; col < 3; ++col)
+			{
+				const float a = m[row * 4 + col] * optix::getByIndex(bounds.m_min, col);
+				const float b = m[row * 4 + col] * optix::getByIndex(bounds.m_max, col);
+				resultMin[row] += fminf(a, b);
+				resultMax[row] += fmaxf(a, b);
+			}
+		}
+
+		return optix::Aabb(optix::make_float3(resultMin[0], resultMin[1], resultMin[2]),
+		                   optix::make_float3(resultMax[0], resultMax[1], resultMax[2]));
+	}
+
+	TopLevelAccel::TopLevelAccel()
+		: m_builtSahCost(0.0f)
+		, m_rebuildThreshold(1.3f)
+		, m_dirty(false)
+		, m_topologyChanged(true)
+	{
+	}
+
+	TopLevelAccel::~TopLevelAccel()
+	{
+	}
+
+	unsigned int TopLevelAccel::addInstance(unsigned int meshID, optix::Aabb const& objectBounds, const float* transform)
+	{
+		Instance instance;
+		instance.meshID       = meshID;
+		instance.transform    = optix::Matrix4x4(transform);
+		instance.objectBounds = objectBounds;
+
+		m_instances.push_back(instance);
+		m_worldBounds.push_back(transformBounds(objectBounds, instance.transform));
+
+		m_topologyChanged = true;
+		return static_cast<unsigned int>(m_instances.size() - 1);
+	}
+
+	void TopLevelAccel::setTransform(unsigned int instanceIndex, const float* transform)
+	{
+		MY_ASSERT(instanceIndex < m_instances.size());
+
+		Instance& instance = m_instances[instanceIndex];
+		instance.transform = optix::Matrix4x4(transform);
+		m_worldBounds[instanceIndex] = transformBounds(instance.objectBounds, instance.transform);
+
+		m_dirty = true;
+	}
+
+	void TopLevelAccel::build()
+	{
+		m_bvh.build(m_worldBounds, m_buildOptions);
+		m_builtSahCost = m_bvh.sahCost();
+
+		m_dirty = false;
+		m_topologyChanged = false;
+	}
+
+	ETopLevelUpdate TopLevelAccel::update()
+	{
+		if (m_topologyChanged)
+		{
+			build();
+			return TOP_LEVEL_REBUILD;
+		}
+		if (!m_dirty)
+		{
+			return TOP_LEVEL_UNCHANGED;
+		}
+
+		m_bvh.refit(m_worldBounds);
+		m_dirty = false;
+
+		if (m_rebuildThreshold < getDegradation())
+		{
+			build();
+			return TOP_LEVEL_REBUILD;
+		}
+		return TOP_LEVEL_REFIT;
+	}
+
+	float TopLevelAccel::getDegradation() const
+	{
+		return (0.0f < m_builtSahCost) ? m_bvh.sahCost() / m_builtSahCost : 1.0f;
+	}
+}
@@ -0,0 +1,601 @@
+#include "inc/WavefrontRenderer.h"
+
+#include <algorithm>
+
+#include "inc/HostShading.h"
+#include "inc/MyAssert.h"
+#include "inc/RadixSort.h"
+#include "inc/Timer.h"
+
+namespace POptix
+{
+	static const int kGrainSize      = 1024; // Paths per parallelFor() chunk.
+	static const int kPartitionChunk = 4096; // Paths per partition() chunk. Fixed, so the queue order doesn't depend on the thread count.
+	static const int kStripRows      = 16;   // Rows per Accumulator tile.
+
+	WavefrontRenderer::WavefrontRenderer(HostScene const& scene, int numThreads)
+		: m_scene(scene)
+		, m_scheduler(numThreads)
+		, m_width(0)
+		, m_height(0)
+		, m_iterationIndex(0)
+		, m_cameraPosition(optix::make_float3(0.0f))
+		, m_cameraU(optix::make_float3(1.0f, 0.0f, 0.0f))
+		, m_cameraV(optix::make_float3(0.0f, 1.0f, 0.0f))
+		, m_cameraW(optix::make_float3(0.0f, 0.0f, -1.0f))
+		, m_minPathLength(2)
+		, m_maxPathLength(5)
+		, m_sceneEpsilon(500.0f * 1.0e-7f)
+		, m_raySorting(false)
+		, m_lightSelection(LIGHT_SELECTION_UNIFORM)
+		, m_sampler(SAMPLER_SOBOL)
+	{
+		m_stats = WavefrontStats();
+	}
+
+	WavefrontRenderer::~WavefrontRenderer()
+	{
+	}
+
+	void WavefrontRenderer::setResolution(int width, int height)
+	{
+		if (width == m_width && height == m_height)
+		{
+			return;
+		}
+
+		m_width  = width;
+		m_height = height;
+
+		const size_t numPaths = size_t(m_width) * m_height;
+
+		m_origin.resize(numPaths);
+		m_direction.resize(numPaths);
+		m_throughput.resize(numPaths);
+		m_radiance.resize(numPaths);
+		m_segmentRadiance.resize(numPaths);
+		m_fOverPdf.resize(numPaths);
+		m_pdf.resize(numPaths);
+		m_flags.resize(numPaths);
+		m_brdfFlags.resize(numPaths);
+		m_seed.resize(numPaths);
+		m_dimension.resize(numPaths);
+
+		m_hit.resize(numPaths);
+		m_geometryNormal.resize(numPaths);
+		m_shadingNormal.resize(numPaths);
+
+		m_shadowDirection.resize(numPaths);
+		m_shadowTmax.resize(numPaths);
+		m_shadowRadiance.resize(numPaths);
+
+		m_keys.resize(numPaths);
+
+		m_outputBuffer.assign(numPaths, optix::make_float4(0.0f));
+
+		m_strips.clear();
+		for (int y = 0; y < m_height; y += kStripRows)
+		{
+			Tile strip;
+			strip.x      = 0;
+			strip.y      = y;
+			strip.width  = m_width;
+			strip.height = std::min(kStripRows, m_height - y);
+			strip.index  = int(m_strips.size());
+			strip.slice  = 0;
+			m_strips.push_back(strip);
+		}
+		m_accumulator.setLayout(m_width, m_height, m_strips, m_scheduler);
+
+		restartAccumulation();
+	}
+
+	void WavefrontRenderer::setCamera(const optix::float3& position, const optix::float3& U, const optix::float3& V, const optix::float3& W)
+	{
+		m_cameraPosition = position;
+		m_cameraU = U;
+		m_cameraV = V;
+		m_cameraW = W;
+		restartAccumulation();
+	}
+
+	void WavefrontRenderer::setPathLengths(int minPathLength, int maxPathLength)
+	{
+		m_minPathLength = minPathLength;
+		m_maxPathLength = maxPathLength;
+		restartAccumulation();
+	}
+
+	void WavefrontRenderer::setSceneEpsilon(float epsilon)
+	{
+		m_sceneEpsilon = epsilon;
+		restartAccumulation();
+	}
+
+	void WavefrontRenderer::setLightSelection(ELightSelection selection)
+	{
+		m_lightSelection = selection;
+		restartAccumulation();
+	}
+
+	void WavefrontRenderer::setSampler(ESampler sampler)
+	{
+		m_sampler = sampler;
+		restartAccumulation();
+	}
+
+	void WavefrontRenderer::restartAccumulation()
+	{
+		m_iterationIndex = 0;
+		m_accumulator.clear();
+	}
+
+	void WavefrontRenderer::render()
+	{
+		MY_ASSERT(0 < m_width && 0 < m_height);
+
+		m_stats = WavefrontStats();
+
+		Timer timer;
+
+		timer.restart();
+		generate();
+		m_stats.generate += timer.getTime();
+
+		int depth = 0;
+		while (depth < m_maxPathLength && !m_active.empty())
+		{
+			double sortTime = 0.0;
+			if (m_raySorting && 0 < depth)
+			{
+				timer.restart();
+				sortRays();
+				sortTime = timer.getTime();
+				m_stats.sort += sortTime;
+			}
+
+			m_stats.activePaths.push_back(int(m_active.size()));
+			m_stats.sortTimes.push_back(sortTime);
+
+			timer.restart();
+			extend(depth);
+			const double extendTime = timer.getTime();
+			m_stats.extend += extendTime;
+
+			timer.restart();
+			partition(m_active, 2, m_hitQueues);
+			m_stats.compact += timer.getTime();
+
+			timer.restart();
+			m_surfaces.swap(m_hitQueues[KEY_SURFACE]);
+			shadeLights();
+			beginSurfaces();
+			m_stats.shade += timer.getTime();
+
+			timer.restart();
+			partition(m_surfaces, NUM_OF_BRDF, m_brdfQueues);
+			m_stats.compact += timer.getTime();
+
+			timer.restart();
+			for (int brdf = 0; brdf < NUM_OF_BRDF; ++brdf)
+			{
+				if (!m_brdfQueues[brdf].empty())
+				{
+					shadeSurfaces(EBrdfTypes(brdf));
+				}
+			}
+			m_stats.shade += timer.getTime();
+
+			timer.restart();
+			partition(m_surfaces, 1, &m_shadowQueue);
+			m_stats.compact += timer.getTime();
+
+			timer.restart();
+			connect();
+			const double connectTime = timer.getTime();
+			m_stats.connect += connectTime;
+
+			m_stats.traceTimes.push_back(extendTime + connectTime);
+
+			timer.restart();
+			advance(depth);
+			partition(m_surfaces, 1, &m_active);
+			m_stats.compact += timer.getTime();
+
+			++depth;
+		}
+
+		timer.restart();
+		accumulate();
+		m_stats.accumulate += timer.getTime();
+
+		++m_iterationIndex;
+	}
+
+	void WavefrontRenderer::generate()
+	{
+		const int numPaths = m_width * m_height;
+		const optix::float2 screen = optix::make_float2(float(m_width), float(m_height));
+
+		m_active.resize(numPaths);
+
+		m_scheduler.parallelFor(numPaths, kGrainSize, [&](int begin, int end, int /*threadIndex*/)
+		{
+			for (int path = begin; path < end; ++path)
+			{
+				const int x = path % m_width;
+				const int y = path / m_width;
+
+				// Same samples and camera ray as raygeneration.cu.
+				PerRayData prd;
+				const optix::float2 jitter = beginSample(prd, m_sampler, x, y, m_width, m_iterationIndex);
+
+				const optix::float2 fragment = optix::make_float2(float(x), float(y)) + jitter;
+				const optix::float2 ndc = (fragment / screen) * 2.0f - 1.0f;
+
+				m_origin[path]     = m_cameraPosition;
+				m_direction[path]  = optix::normalize(ndc.x * m_cameraU + ndc.y * m_cameraV + m_cameraW);
+				m_throughput[path] = optix::make_float3(1.0f);
+				m_radiance[path]   = optix::make_float3(0.0f);
+				m_pdf[path]        = 0.0f;
+				m_brdfFlags[path]  = 0;
+				m_seed[path]       = prd.seed;
+				m_dimension[path]  = prd.dimension;
+				m_active[path]     = path;
+			}
+		});
+	}
+
+	void WavefrontRenderer::extend()
+	{
+		m_stats.extensionRays += m_active.size();
+
+		std::vector<Light> const& lights = m_scene.getLights();
+		const LightSelector selector(m_lightSelection, m_scene.getLightTree(), m_scene.getLightAliasTable(), m_scene.getEnvironment());
+
+		m_scheduler.parallelFor(int(m_active.size()), kGrainSize, [&](int begin, int end, int /*threadIndex*/)
+		{
+			for (int i = begin; i < end; ++i)
+			{
+				const int path = m_active[i];
+
+				// m_brdfFlags stay those of the BSDF sample which generated the ray, the light and miss shading weight by them.
+				m_flags[path] = (depth == m_maxPathLength - 1) ? FLAG_LAST_SEGMENT : 0;
+
+				const optix::float3 origin    = m_origin[path];
+				const optix::float3 direction = m_direction[path];
+
+				TriangleHit& hit = m_hit[path];
+				if (!m_scene.intersect(origin, direction, m_sceneEpsilon, RT_DEFAULT_MAX, hit))
+				{
+					// miss.cu, the environment light if there is one. Cheap enough to not get its own queue.
+					PerRayData prd;
+					prd.flags      = m_flags[path];
+					prd.brdf_flags = m_brdfFlags[path];
+					prd.pdf        = m_pdf[path];
+
+					shadeMiss(lights, selector, m_scene.getEnvironmentLight(), origin, direction, prd);
+
+					m_radiance[path] += m_throughput[path] * prd.radiance;
+					m_keys[path] = KEY_TERMINATED;
+					continue;
+				}
+
+				State state;
+				m_scene.getState(origin, direction, hit, state);
+
+				m_geometryNormal[path] = state.geometry_normal;
+				m_shadingNormal[path]  = state.shading_normal;
+
+				if (0 <= m_scene.getLightIndex(hit.primitive))
+				{
+					// The path ends here. shadeLights() needs the ray origin for the light selection probability.
+					m_keys[path] = KEY_LIGHT;
+					continue;
+				}
+
+				m_origin[path] = state.hit_position;
+				m_keys[path]   = KEY_SURFACE;
+			}
+		});
+	}
+
+	void WavefrontRenderer::shadeLights()
+	{
+		std::vector<int> const& queue = m_hitQueues[KEY_LIGHT];
+		std::vector<Light> const& lights = m_scene.getLights();
+		const LightSelector selector(m_lightSelection, m_scene.getLightTree(), m_scene.getLightAliasTable(), m_scene.getEnvironment());
+
+		m_scheduler.parallelFor(int(queue.size()), kGrainSize, [&](int begin, int end, int /*threadIndex*/)
+		{
+			for (int i = begin; i < end; ++i)
+			{
+				const int path = queue[i];
+
+				PerRayData prd;
+				prd.wo         = -m_direction[path];
+				prd.flags      = m_flags[path];
+				prd.brdf_flags = m_brdfFlags[path];
+				prd.pdf        = m_pdf[path];
+
+				const int lightIndex = m_scene.getLightIndex(m_hit[path].primitive);
+				shadeLight(lights[lightIndex], lightSelectionPmf(lights, selector, lightIndex, m_origin[path]), m_origin[path], m_hit[path].t, m_geometryNormal[path], prd);
+
+				m_radiance[path] += m_throughput[path] * prd.radiance;
+			}
+		});
+	}
+
+	void WavefrontRenderer::beginSurfaces()
+	{
+		std::vector<Material> const& materials = m_scene.getMaterials();
+
+		m_scheduler.parallelFor(int(m_surfaces.size()), kGrainSize, [&](int begin, int end, int /*threadIndex*/)
+		{
+			for (int i = begin; i < end; ++i)
+			{
+				const int path = m_surfaces[i];
+
+				PerRayData prd;
+				prd.wo         = -m_direction[path];
+				prd.flags      = m_flags[path];
+				prd.brdf_flags = m_brdfFlags[path];
+				loadSampler(path, prd);
+
+				State state;
+				state.hit_position    = m_origin[path];
+				state.geometry_normal = m_geometryNormal[path];
+				state.shading_normal  = m_shadingNormal[path];
+
+				const EBrdfTypes brdf = beginSurface(materials[m_scene.getMaterialIndex(m_hit[path].primitive)], state, prd);
+
+				m_geometryNormal[path]  = state.geometry_normal;
+				m_shadingNormal[path]   = state.shading_normal;
+				m_flags[path]           = prd.flags;
+				m_brdfFlags[path]       = prd.brdf_flags;
+				m_seed[path]            = prd.seed;
+				m_segmentRadiance[path] = prd.radiance;
+				m_fOverPdf[path]        = prd.f_over_pdf;
+				m_pdf[path]             = prd.pdf;
+				m_keys[path]            = (unsigned char)(brdf);
+			}
+		});
+	}
+
+	void WavefrontRenderer::shadeSurfaces(EBrdfTypes brdf)
+	{
+		std::vector<int> const& queue = m_brdfQueues[brdf];
+		std::vector<Material> const& materials = m_scene.getMaterials();
+		std::vector<Light> const& lights = m_scene.getLights();
+		const LightSelector selector(m_lightSelection, m_scene.getLightTree(), m_scene.getLightAliasTable(), m_scene.getEnvironment());
+
+		m_scheduler.parallelFor(int(queue.size()), kGrainSize, [&](int begin, int end, int /*threadIndex*/)
+		{
+			for (int i = begin; i < end; ++i)
+			{
+				const int path = queue[i];
+
+				PerRayData prd;
+				prd.hit_pos    = m_origin[path];
+				prd.wo         = -m_direction[path];
+				prd.wi         = m_direction[path];
+				prd.radiance   = m_segmentRadiance[path];
+				prd.flags      = m_flags[path];
+				prd.brdf_flags = m_brdfFlags[path];
+				prd.f_over_pdf = m_fOverPdf[path];
+				prd.pdf        = m_pdf[path];
+				loadSampler(path, prd);
+
+				State state;
+				state.hit_position    = m_origin[path];
+				state.geometry_normal = m_geometryNormal[path];
+				state.shading_normal  = m_shadingNormal[path];
+
+				Material const& mat = materials[m_scene.getMaterialIndex(m_hit[path].primitive)];
+
+				m_keys[path] = 1; // No shadow ray.
+
+				if (sampleSurface(brdf, mat, state, prd))
+				{
+#if USE_NEXT_EVENT_ESTIMATION
+					ShadowRay shadowRay;
+					if (sampleDirectLighting(lights, selector, mat, state, prd, m_sceneEpsilon, shadowRay))
+					{
+						m_shadowDirection[path] = shadowRay.direction;
+						m_shadowTmax[path]      = shadowRay.tmax;
+						m_shadowRadiance[path]  = shadowRay.radiance;
+						m_keys[path] = 0;
+					}
+#endif // USE_NEXT_EVENT_ESTIMATION
+				}
+
+				m_direction[path] = prd.wi;
+				m_flags[path]     = prd.flags;
+				m_fOverPdf[path]  = prd.f_over_pdf;
+				m_pdf[path]       = prd.pdf;
+				m_seed[path]      = prd.seed;
+			}
+		});
+	}
+
+	void WavefrontRenderer::connect()
+	{
+		m_stats.shadowRays += m_shadowQueue.size();
+
+		m_scheduler.parallelFor(int(m_shadowQueue.size()), kGrainSize, [&](int begin, int end, int /*threadIndex*/)
+		{
+			ShadowCache shadowCache;
+
+			for (int i = begin; i < end; ++i)
+			{
+				const int path = m_shadowQueue[i];
+
+				// Any hit in the open interval blocks the light, the light geometry included.
+				if (!m_scene.occluded(m_origin[path], m_shadowDirection[path], m_sceneEpsilon, m_shadowTmax[path], &shadowCache))
+				{
+					m_segmentRadiance[path] += m_shadowRadiance[path];
+				}
+			}
+		});
+	}
+
+	void WavefrontRenderer::advance(const int depth)
+	{
+		m_scheduler.parallelFor(int(m_surfaces.size()), kGrainSize, [&](int begin, int end, int /*threadIndex*/)
+		{
+			for (int i = begin; i < end; ++i)
+			{
+				const int path = m_surfaces[i];
+
+				m_radiance[path] += m_throughput[path] * m_segmentRadiance[path];
+
+				if ((m_flags[path] & FLAG_TERMINATE) || m_pdf[path] <= 0.0f || isNull(m_fOverPdf[path]))
+				{
+					m_keys[path] = KEY_TERMINATED;
+					continue;
+				}
+
+				m_throughput[path] *= m_fOverPdf[path];
+				m_keys[path] = 0;
+
+				// Russian Roulette path termination after m_minPathLength path segments.
+				if (m_minPathLength <= depth)
+				{
+					PerRayData prd;
+					loadSampler(path, prd);
+
+					const float probability = russianRouletteProbability(m_throughput[path]);
+					const bool  terminate   = probability <= sample1D(prd, SAMPLE_DIMENSION_ROULETTE);
+
+					m_seed[path] = prd.seed;
+					if (terminate)
+					{
+						m_keys[path] = KEY_TERMINATED;
+						continue;
+					}
+					m_throughput[path] /= probability;
+				}
+
+				m_dimension[path] += SAMPLE_DIMENSIONS_PER_SEGMENT; // nextSegment()
+			}
+		});
+	}
+
+	void WavefrontRenderer::loadSampler(const int path, PerRayData& prd) const
+	{
+		prd.seed         = m_seed[path];
+		prd.sample_index = unsigned(m_iterationIndex);
+		prd.dimension    = m_dimension[path];
+		prd.sampler      = m_sampler;
+	}
+
+	void WavefrontRenderer::accumulate()
+	{
+		m_scheduler.parallelFor(m_width * m_height, kGrainSize, [&](int begin, int end, int /*threadIndex*/)
+		{
+			for (int path = begin; path < end; ++path)
+			{
+				const optix::float3 radiance = m_radiance[path];
+
+				// NaN values will never go away. Filter them out before they can arrive in the output buffer.
+				const bool valid = !(isnan(radiance.x) || isnan(radiance.y) || isnan(radiance.z));
+
+				// Same sums and merge order as HostRenderer, so the images stay identical.
+				Tile const& strip = m_strips[path / m_width / kStripRows];
+				m_accumulator.getTileBuffer(strip.index)[path - strip.y * m_width] = valid ? optix::make_float4(radiance, 1.0f) : optix::make_float4(0.0f);
+			}
+		});
+
+		m_accumulator.resolve(m_scheduler, m_outputBuffer);
+	}
+
+	void WavefrontRenderer::sortRays()
+	{
+		const int count = int(m_active.size());
+		if (count < 2)
+		{
+			return;
+		}
+
+		// 9 bits per axis of the origin inside the scene bounds and the direction octant on top.
+		const optix::Aabb& bounds = m_scene.getBounds();
+		const optix::float3 extent = bounds.extent();
+		const optix::float3 scale = optix::make_float3(511.0f / std::max(extent.x, 1.0e-20f),
+		                                               511.0f / std::max(extent.y, 1.0e-20f),
+		                                               511.0f / std::max(extent.z, 1.0e-20f));
+
+		m_sortKeys.resize(count);
+		m_scheduler.parallelFor(count, kGrainSize, [&](int begin, int end, int /*threadIndex*/)
+		{
+			for (int i = begin; i < end; ++i)
+			{
+				const int path = m_active[i];
+
+				const optix::float3 p = optix::fminf(optix::fmaxf((m_origin[path] - bounds.m_min) * scale, optix::make_float3(0.0f)), optix::make_float3(511.0f));
+				const optix::float3 d = m_direction[path];
+
+				const unsigned int octant = ((d.x < 0.0f) ? 1 : 0) | ((d.y < 0.0f) ? 2 : 0) | ((d.z < 0.0f) ? 4 : 0);
+				m_sortKeys[i] = (octant << 27) | morton3D((unsigned int)(p.x), (unsigned int)(p.y), (unsigned int)(p.z));
+			}
+		});
+
+		radixSort(m_scheduler, m_sortKeys, m_active, 30, m_sortScratchKeys, m_sortScratchValues);
+	}
+
+	void WavefrontRenderer::partition(std::vector<int> const& input, const int numQueues, std::vector<int>* queues)
+	{
+		const int count     = int(input.size());
+		const int numChunks = (count + kPartitionChunk - 1) / kPartitionChunk;
+
+		// Count per chunk and queue.
+		m_chunkCounts.assign(size_t(numChunks) * numQueues, 0);
+		m_scheduler.parallelFor(numChunks, 1, [&](int begin, int end, int /*threadIndex*/)
+		{
+			for (int chunk = begin; chunk < end; ++chunk)
+			{
+				int* counts = &m_chunkCounts[size_t(chunk) * numQueues];
+				const int last = std::min(count, (chunk + 1) * kPartitionChunk);
+				for (int i = chunk * kPartitionChunk; i < last; ++i)
+				{
+					const int key = m_keys[input[i]];
+					if (key < numQueues)
+					{
+						++counts[key];
+					}
+				}
+			}
+		});
+
+		// Exclusive prefix sum turns the counts into the write offsets of each chunk.
+		for (int q = 0; q < numQueues; ++q)
+		{
+			int offset = 0;
+			for (int chunk = 0; chunk < numChunks; ++chunk)
+			{
+				int& counter = m_chunkCounts[size_t(chunk) * numQueues + q];
+				const int chunkCount = counter;
+				counter = offset;
+				offset += chunkCount;
+			}
+			queues[q].resize(offset);
+		}
+
+		m_scheduler.parallelFor(numChunks, 1, [&](int begin, int end, int /*threadIndex*/)
+		{
+			for (int chunk = begin; chunk < end; ++chunk)
+			{
+				int* offsets = &m_chunkCounts[size_t(chunk) * numQueues];
+				const int last = std::min(count, (chunk + 1) * kPartitionChunk);
+				for (int i = chunk * kPartitionChunk; i < last; ++i)
+				{
+					const int path = input[i];
+					const int key  = m_keys[path];
+					if (key < numQueues)
+					{
+						queues[key][offsets[key]++] = path;
+					}
+				}
+			}
+		});
+	}
+}
@@ -1,5 +1,7 @@
 #include "shaders/app_config.h"
 #include "inc/Application.h"
+#include "inc/Benchmark.h"
+#include "inc/BlueNoiseTile.h"
 #include <sutil.h>
 
 #include <cstdlib>
@@ -27,10 +29,13 @@ void printUsage(const std::string& argv0)
 		"  -n | --nopbo           Disable OpenGL interop for the image display.\n"
 		"  -s | --stack <int>     Set the OptiX stack size (1024) (debug feature).\n"
 		"  -f | --file <filename> Save image to file and exit.\n"
+		"  -a | --accel <name>    Acceleration builder Trbvh, Sbvh, Bvh or Lbvh (Trbvh).\n"
+		"  -b | --benchmark <name> Run a headless host side benchmark and exit.\n"
 		"App Keystrokes:\n"
 		"  SPACE  Toggles ImGui display.\n"
-		"\n"
-		<< std::endl;
+		"Benchmarks:\n";
+	POptix::printBenchmarks();
+	std::cerr << std::endl;
 }
 
 
@@ -43,9 +48,14 @@ int main(int argc, char *argv[])
 	int  stackSize = 1024;  // Command line parameter just to be able to find the smallest working size.
 	std::string environment = std::string(sutil::samplesDir()) + "/data/NV_Default_HDR_3000x1500.hdr";
 
+	std::string builder = "Trbvh";
+
 	std::string filenameScreenshot = "PistonOptix.png";
 	bool showViewer = true;
 
+	// The blue noise sampler reads the tile on the host and the device, the benchmarks included.
+	POptix::BlueNoiseTile::load(std::string(sutil::samplesDir()) + "/data/BlueNoise64.pgm");
+
 	// Parse the command line parameters.
 	for (int i = 1; i < argc; ++i)
 	{
@@ -111,6 +121,26 @@ int main(int argc, char *argv[])
 			filenameScreenshot = argv[++i];
 			showViewer = false; // Do not render the GUI when just taking a screenshot. (Automated QA feature.)
 		}
+		else if (arg == "-a" || arg == "--accel")
+		{
+			if (i == argc - 1)
+			{
+				std::cerr << "Option '" << arg << "' requires additional argument.\n";
+				printUsage(argv[0]);
+				return 0;
+			}
+			builder = argv[++i];
+		}
+		else if (arg == "-b" || arg == "--benchmark")
+		{
+			if (i == argc - 1)
+			{
+				std::cerr << "Option '" << arg << "' requires additional argument.\n";
+				printUsage(argv[0]);
+				return 0;
+			}
+			return POptix::runBenchmark(argv[++i]); // No window or OptiX context needed.
+		}
 		else
 		{
 			std::cerr << "Unknown option '" << arg << "'\n";
@@ -146,7 +176,7 @@ int main(int argc, char *argv[])
 	}
 
 	g_app = new Application(window, windowWidth, windowHeight,
-		devices, stackSize, interop);
+		devices, stackSize, interop, builder);
 
 	if (!g_app->isValid())
 	{
@@ -106,7 +106,8 @@ namespace {
       return ReadScanlineNoRLE(inf, RGBEline, wid); // Found an old-format scanline
     }
 
-    if(size_t(size_t(c2)<<8 | size_t(c3)) != wid) throw HDRError("Scanline width inconsistent");
+    // The width bytes are unsigned, a plain char sign extends e.g. the 0xb8 of 3000.
+    if(size_t(size_t((unsigned char)c2)<<8 | size_t((unsigned char)c3)) != wid) throw HDRError("Scanline width inconsistent");
 
     // This scanline is RLE.
     for(unsigned int ch=0; ch<4; ch++) {